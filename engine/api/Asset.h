@@ -0,0 +1,229 @@
+#pragma once
+
+
+
+// ***************
+//  STD Libraries
+// ***************
+
+#include <memory>
+#include <string>
+
+
+
+// ***************
+//  Common Header
+// ***************
+
+#include "common_header.h"
+
+#include "Render.h"
+
+
+
+// ***********
+//  API Begin
+// ***********
+
+namespace Swarm {
+    namespace Asset {
+
+        //! Starts asset loading
+        /*!
+         * Called by \ref Core::init(), after the job workers have been started. Loads run as jobs; see
+         * \ref Util::runJob().
+         *
+         * \param worker_count most loads to decode at once; '0' allows one per job worker
+         */
+        void init(unsigned int worker_count = 0);
+
+        //! Stops asset loading
+        /*!
+         * Called by \ref Core::cleanup(). Loads that have not started are abandoned and marked \ref FAILED, and any
+         * uploads still queued are dropped.
+         */
+        void cleanup();
+
+        //! Loading progress of an asset
+        enum State {
+            LOADING,    //!< Reading and decoding on a worker thread
+            UPLOADING,  //!< Decoded, waiting for the GL thread to upload it, and for the GPU to finish the upload
+            READY,      //!< Uploaded and usable for rendering
+            FAILED      //!< Loading failed; see \ref Handle::error()
+        };
+
+        class AssetEntry;
+
+        //! Shared handle to an asset that may still be loading
+        /*!
+         * Handles are cheap to copy; every copy refers to the same asset. A default constructed Handle refers to
+         * nothing, and reports \ref FAILED. The asset cache never evicts an asset while a Handle refers to it, or
+         * while any copy of a Texture or Model taken from it lives.
+         */
+        class Handle {
+        public:
+            Handle() {}
+            Handle(const Handle &other);
+            Handle &operator=(const Handle &other);
+            ~Handle();
+
+            //! Get the current \ref State of the asset
+            State state() const;
+
+            bool ready()  const { return state() == READY; }
+            bool failed() const { return state() == FAILED; }
+
+            //! Does this Handle refer to an asset
+            bool valid() const { return (bool)_entry; }
+
+            //! Block until the asset has left the \ref LOADING state
+            /*!
+             * Only waits for the worker thread; uploads happen when the GL thread calls \ref processUploads(), so
+             * waiting here for \ref READY from the GL thread would never return.
+             */
+            void wait() const;
+
+            //! Get the path the asset was loaded from
+            std::string path() const;
+
+            //! Get the error message of a \ref FAILED asset, or an empty string
+            std::string error() const;
+
+            //! Get the number of Handles referring to this asset, including this one
+            size_t references() const;
+
+            bool operator==(const Handle &rhs) const { return _entry == rhs._entry; }
+            bool operator!=(const Handle &rhs) const { return _entry != rhs._entry; }
+
+        protected:
+            Handle(const std::shared_ptr<AssetEntry> &entry);
+            std::shared_ptr<AssetEntry> _entry;
+        };
+
+        //! \ref Handle to a texture
+        class TextureHandle : public Handle {
+        public:
+            TextureHandle() {}
+
+            //! Get the decoded pixels; only available until uploaded, null otherwise
+            /*!
+             * The handle releases its pixels once the texture is uploaded, but the returned snapshot stays valid for as
+             * long as the caller keeps it, on any thread.
+             */
+            std::shared_ptr<const Texture::RawTextureData> data() const;
+
+            //! Get the uploaded texture; only available in the \ref READY state, an empty TexMap otherwise
+            /*!
+             * The TexMap and every copy of it count as a reference to the asset, so the texture is not deleted while
+             * one is still in use, such as by a RenderObject.
+             */
+            Texture::TexMap texture() const;
+
+        protected:
+            friend TextureHandle loadTexture(const std::string &path, Texture::FileType type);
+            TextureHandle(const std::shared_ptr<AssetEntry> &entry) : Handle(entry) {}
+        };
+
+        //! \ref Handle to a model
+        class ModelHandle : public Handle {
+        public:
+            ModelHandle() {}
+
+            //! Get the parsed model data; only available until uploaded, null otherwise
+            /*!
+             * The handle releases its data once the model is uploaded, but the returned snapshot stays valid for as
+             * long as the caller keeps it, on any thread.
+             */
+            std::shared_ptr<const Model::RawModelDataIndexed> data() const;
+
+            //! Get the uploaded model; only available in the \ref READY state, an unloaded Model otherwise
+            /*!
+             * The Model and every copy of it count as a reference to the asset, as in \ref TextureHandle::texture().
+             */
+            Model::Model model() const;
+
+        protected:
+            friend ModelHandle loadModel(const std::string &path, unsigned int optimize_flags);
+            ModelHandle(const std::shared_ptr<AssetEntry> &entry) : Handle(entry) {}
+        };
+
+        //! Load a texture in the background
+        /*!
+         * Queues the file to be decoded as a job; the decoded pixels are then queued for upload. Loading
+         * a path that is already cached returns a Handle to the cached texture, and a file with the same content as
+         * a cached texture shares that texture instead of being decoded again.
+         *
+         * \param path location of the image file; may be relative or absolute
+         * \param type format of the image file
+         * \return \ref TextureHandle to the loading texture
+         */
+        TextureHandle loadTexture(const std::string &path, Texture::FileType type = Texture::PNG);
+
+        //! Load a model in the background
+        /*!
+         * Queues the file to be parsed with \ref Model::loadFromOBJ(), indexed and passed through
+         * \ref Model::optimize() as a job; the result is then queued for upload. Cached models are shared
+         * the same way as in \ref loadTexture(), as long as they were loaded with the same \a optimize_flags.
+         *
+         * \param path location of the OBJ file; may be relative or absolute
+         * \param optimize_flags \ref Model::OptimizeFlags to optimize with, or '0' to skip optimization
+         * \return \ref ModelHandle to the loading model
+         */
+        ModelHandle loadModel(const std::string &path, unsigned int optimize_flags = Model::OPTIMIZE_ALL);
+
+        //! Block until no loads are left to run
+        void waitAll();
+
+        //! Upload decoded assets to OpenGL
+        /*!
+         * Must be called from a thread with a current OpenGL context; \ref Core::start() calls this once per cycle
+         * with \ref uploadBudget(). Assets are uploaded in the order they finished decoding, until \a byte_budget is
+         * spent. At least one asset is uploaded per call, so an asset larger than the budget cannot stall the queue.
+         *
+         * Each call's uploads are flushed behind a fence, and only become \ref READY once the GPU has passed it, so
+         * other contexts never draw them half uploaded; that is usually by the next call.
+         *
+         * \param byte_budget number of bytes that may be uploaded by this call
+         * \return number of assets uploaded
+         */
+        size_t processUploads(size_t byte_budget);
+
+        //! Set the per-cycle upload budget used by \ref Core::start(); defaults to 16 MiB
+        void setUploadBudget(size_t bytes);
+        size_t uploadBudget();
+
+        //! Get the number of assets waiting to be uploaded
+        size_t pendingUploads();
+
+        //! Counters describing the asset cache
+        struct CacheStats {
+            size_t hits = 0;          //!< Loads answered by an asset already cached under the same path
+            size_t content_hits = 0;  //!< Loads that found a cached asset with the same file content
+            size_t misses = 0;        //!< Loads that had to read a new file
+            size_t evictions = 0;     //!< Assets evicted to stay within the budget, or by \ref trimCache()
+            size_t entries = 0;       //!< Assets currently cached
+            size_t bytes = 0;         //!< Bytes of decoded or uploaded data currently cached
+        };
+
+        //! Get the current \ref CacheStats
+        CacheStats cacheStats();
+
+        //! Reset the hit, miss and eviction counters of \ref CacheStats
+        void resetCacheStats();
+
+        //! Set the memory budget of the asset cache; defaults to 256 MiB
+        /*!
+         * Once the cache grows past the budget, decoded assets no \ref Handle refers to are evicted, least recently
+         * loaded first; evicted textures and models are deleted on the next \ref processUploads(), and evicted assets
+         * that were still waiting for upload are dropped without being uploaded. Assets that are still
+         * referenced, by a Handle or by a Texture or Model taken from one, are never evicted, so the cache can stay
+         * over budget.
+         */
+        void setCacheBudget(size_t bytes);
+        size_t cacheBudget();
+
+        //! Evict every asset no \ref Handle refers to, regardless of the budget
+        void trimCache();
+
+    }
+}
@@ -6,10 +6,14 @@
 //  STD Libraries
 // ***************
 
+#include <algorithm>
+#include <cstdint>
 #include <math.h>
+#include <memory>
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 
 
@@ -25,6 +29,9 @@
 //  API Begin
 // ***********
 
+// The handle type behind cl_event, so Events can hold one without the CL headers
+struct _cl_event;
+
 namespace Swarm {
     namespace CL {
 
@@ -93,13 +100,70 @@ namespace Swarm {
             friend class ContextInternal;
         };
 
+        //! Handle to a command enqueued on a \ref CommandQueue
+        /*!
+         * Returned by every enqueue, and passed in wait lists to make later commands wait for it. Copies share the
+         * same command. A default-constructed Event refers to no command, counts as complete, and is skipped in wait
+         * lists.
+         */
+        class Event {
+        public:
+            Event() {}
+            Event(const Event &other);
+            Event(Event &&other) : _event(other._event) { other._event = nullptr; }
+            Event &operator=(Event other) { std::swap(_event, other._event); return *this; }
+            ~Event();
+
+            //! Whether this refers to a command
+            bool valid() const { return _event != nullptr; }
+
+            //! Whether the command has finished
+            bool complete() const;
+
+            //! Block until the command has finished
+            /*!
+             * \throws Exception::CLCommandException if the command failed
+             */
+            void wait() const;
+
+            //! Block until every command in 'events' has finished
+            static void waitAll(const std::vector<Event> &events);
+
+            //! Nanoseconds the command ran for on the device; '0' unless its queue has \ref QUEUE_PROFILING
+            uint64_t duration() const;
+
+            #if defined(SWARM_INCLUDE_CL)
+            //! Take ownership of 'event'
+            explicit Event(cl_event event) : _event(event) {}
+            cl_event event() const { return _event; }
+            operator cl_event() const { return _event; }
+            #endif
+
+        protected:
+            ::_cl_event* _event = nullptr;
+        };
+
+        //! Events a command waits for before it starts
+        typedef std::vector<Event> EventList;
+
+        //! Work size of a kernel, in one to three dimensions
+        struct NDRange {
+            unsigned int dimensions = 0; //!< '0' for none; as a local size, leaves it to the implementation
+            size_t sizes[3] = { 1, 1, 1 };
+
+            NDRange() {}
+            NDRange(size_t x) : dimensions(1) { sizes[0] = x; }
+            NDRange(size_t x, size_t y) : dimensions(2) { sizes[0] = x; sizes[1] = y; }
+            NDRange(size_t x, size_t y, size_t z) : dimensions(3) { sizes[0] = x; sizes[1] = y; sizes[2] = z; }
+        };
+
         //template<typename T> class BufferTemplateBase;
         struct BufferInternal;
         class BufferBase {
             //template<typename T> friend class BufferTemplateBase;
         protected:
             BufferInternal* _buffer;
-            BufferBase(const Context* ctx, bool read, bool write);
+            BufferBase(const Context* ctx, bool read, bool write, bool host_allocated = false);
             virtual ~BufferBase();
             void recreate(size_t size, void* data);
         public:
@@ -114,6 +178,7 @@ namespace Swarm {
             size_t _size = 0;
             size_t _capacity = 0;
             T* _data = nullptr;
+            bool _owns_data = true; // False while the data is the caller's, from the constructor
 
             virtual void checkBounds(size_t index) {
                 if(index >= _size) throw std::out_of_range("Buffer::checkBounds");
@@ -130,7 +195,7 @@ namespace Swarm {
             }
 
             Buffer(const Context* ctx, bool read, bool write, size_t size, size_t capacity, T data[])
-                    : _size(size), _capacity(capacity), _data(data), BufferBase(ctx, read, write) {
+                    : _size(size), _capacity(capacity), _data(data), _owns_data(false), BufferBase(ctx, read, write) {
                 recreate(sizeof(T) * _capacity, _data);
             }
 
@@ -139,11 +204,12 @@ namespace Swarm {
             Buffer(const Context* ctx, bool read, bool write, size_t size)
                     : Buffer(ctx, read, write, size, size) {}
 
+            //! Create a Buffer over the caller's 'data', which must outlive it
             Buffer(const Context* ctx, bool read, bool write, size_t size, T data[])
                     : Buffer(ctx, read, write, size, size, data) {}
 
             virtual ~Buffer() {
-                if(_data != nullptr) delete [] _data;
+                if(_owns_data && _data != nullptr) delete [] _data;
             }
 
             size_t size() const { return _size; }
@@ -178,8 +244,9 @@ namespace Swarm {
                 _size = size;
                 _capacity = size;
                 recreate(sizeof(T) * _capacity, newData);
-                delete [] _data;
+                if(_owns_data) delete [] _data;
                 _data = newData;
+                _owns_data = true;
             }
 
             T* data() { return _data; }
@@ -237,6 +304,26 @@ namespace Swarm {
             }
         };
 
+        //! Buffer whose memory the CL implementation allocates, where both the host and the device can reach it
+        /*!
+         * Created with CL_MEM_ALLOC_HOST_PTR and never copied to or from by the host; host code reads and writes it
+         * through the pointer \ref CommandQueue::enqueueMap() returns, and unmaps it with
+         * \ref CommandQueue::enqueueUnmap() before a kernel uses it. On devices that share memory with the host,
+         * neither copies anything.
+         */
+        template<typename T> class MappedBuffer : public BufferBase {
+        protected:
+            size_t _size;
+
+        public:
+            MappedBuffer(const Context* ctx, bool read, bool write, size_t size)
+                    : BufferBase(ctx, read, write, true), _size(size) {
+                recreate(sizeof(T) * _size, nullptr);
+            }
+
+            size_t size() const { return _size; }
+        };
+
         struct KernelInternal;
         class Program;
 
@@ -248,8 +335,13 @@ namespace Swarm {
                 argumentInternalBuffer(index, buffer);
             }
 
+            template<typename T> void argument(unsigned int index, const MappedBuffer<T> &buffer) {
+                argumentInternalBuffer(index, buffer);
+            }
+
+            //! Set a plain argument from 'size' consecutive values of type T; '1' for a scalar
             template<typename T> void argument(unsigned int index, size_t size, const T* data) {
-                argumentInternal(index, sizeof(T), data);
+                argumentInternal(index, size * sizeof(T), data);
             }
 
             #if defined(SWARM_INCLUDE_CL)
@@ -298,17 +390,101 @@ namespace Swarm {
 
         struct CommandQueueInternal;
 
+        //! Properties of a \ref CommandQueue; combine with '|'
+        enum QueueProperties {
+            QUEUE_IN_ORDER = 0,             //!< Commands run one at a time, in the order they were enqueued
+            QUEUE_OUT_OF_ORDER = 1 << 0,    //!< Commands run as soon as the events they wait for are complete
+            QUEUE_PROFILING = 1 << 1        //!< Events record their times; see \ref Event::duration()
+        };
+
+        //! Queue of commands for one Device
+        /*!
+         * Every enqueue returns an \ref Event, and takes an \ref EventList of commands it must wait for. On a queue
+         * created with \ref QUEUE_OUT_OF_ORDER, those are the only commands it waits for, so transfers and kernels
+         * that do not depend on each other can run at the same time; on an in-order queue, each command also waits
+         * for the one before it.
+         *
+         * Any enqueue that fails throws an \ref Exception::CLCommandException. Commands are not started until the
+         * queue is flushed; a blocking command, \ref Event::wait(), \ref flush() and \ref finish() all flush it.
+         */
         class CommandQueue {
         public:
-            CommandQueue(const Context* context, const Device* device);
 
-            // TODO: Error Checking and Event Handling on CL Enqueues
-            void enqueueCommand(const Kernel &kernel, size_t size);
+            //! Create a queue for 'device'
+            /*!
+             * \param properties \ref QueueProperties; \ref QUEUE_OUT_OF_ORDER is dropped if the device does not
+             *                   support it, which is always safe, as an in-order queue still honours wait lists
+             * \throws Exception::CLObjectCreationException if the queue could not be created
+             */
+            CommandQueue(const Context* context, const Device* device, unsigned int properties = QUEUE_IN_ORDER);
+
+            //! Get the \ref QueueProperties the queue was created with
+            unsigned int properties() const;
+
+            //! Run 'kernel' over 'global' work items, in work groups of 'local'
+            Event enqueueKernel(const Kernel &kernel, const NDRange &global, const NDRange &local = NDRange(),
+                                const EventList &wait = EventList());
+
+            //! Run 'kernel' over 'size' work items
+            Event enqueueCommand(const Kernel &kernel, size_t size) {
+                return enqueueKernel(kernel, NDRange(size));
+            }
+
+            //! Read all of 'buffer' into its host memory
+            template<typename T> Event enqueueRead(Buffer<T> &buffer, bool blocking, const EventList &wait = EventList()) {
+                return enqueueReadInternal(buffer, blocking, 0, sizeof(T) * buffer.size(), buffer.data(), wait);
+            }
 
-            template<typename T> void enqueueRead(const Buffer<T> &buffer, bool blocking) {
-                enqueueReadInternal(buffer, blocking, sizeof(T) * buffer.size(), buffer.data());
+            //! Read elements ['offset', 'offset' + 'count') of 'buffer' into 'data'
+            /*!
+             * Unless 'blocking', 'data' must stay valid, and untouched, until the returned \ref Event is complete.
+             */
+            template<typename T> Event enqueueRead(const Buffer<T> &buffer, size_t offset, size_t count, T* data, bool blocking,
+                                                   const EventList &wait = EventList()) {
+                return enqueueReadInternal(buffer, blocking, sizeof(T) * offset, sizeof(T) * count, data, wait);
             }
 
+            //! Write all of 'buffer' from its host memory
+            template<typename T> Event enqueueWrite(const Buffer<T> &buffer, bool blocking, const EventList &wait = EventList()) {
+                return enqueueWriteInternal(buffer, blocking, 0, sizeof(T) * buffer.size(), buffer.data(), wait);
+            }
+
+            //! Write elements ['offset', 'offset' + 'count') of 'buffer' from 'data'
+            /*!
+             * Unless 'blocking', 'data' must stay valid, and unchanged, until the returned \ref Event is complete.
+             */
+            template<typename T> Event enqueueWrite(const Buffer<T> &buffer, size_t offset, size_t count, const T* data, bool blocking,
+                                                    const EventList &wait = EventList()) {
+                return enqueueWriteInternal(buffer, blocking, sizeof(T) * offset, sizeof(T) * count, data, wait);
+            }
+
+            //! Map 'buffer' into host memory, and get the pointer to it
+            /*!
+             * The pointer may differ from one mapping to the next. Unless 'blocking', it may only be used once 'event'
+             * is complete.
+             *
+             * \param event receives the \ref Event of the map, if not 'nullptr'
+             */
+            template<typename T> T* enqueueMap(MappedBuffer<T> &buffer, bool read, bool write, bool blocking = true,
+                                               const EventList &wait = EventList(), Event* event = nullptr) {
+                return (T*)enqueueMapInternal(buffer, read, write, blocking, sizeof(T) * buffer.size(), wait, event);
+            }
+
+            //! Hand memory mapped by \ref enqueueMap() back to the device; 'data' must not be used afterwards
+            Event enqueueUnmap(const BufferBase &buffer, void* data, const EventList &wait = EventList());
+
+            //! Get an Event that completes with every command in 'wait', or with every command before it if empty
+            Event enqueueMarker(const EventList &wait = EventList());
+
+            //! As \ref enqueueMarker(), and also make every later command wait for it
+            Event enqueueBarrier(const EventList &wait = EventList());
+
+            //! Start every enqueued command, without waiting for them
+            void flush();
+
+            //! Block until every enqueued command has finished
+            void finish();
+
             #if defined(SWARM_INCLUDE_CL)
             cl_command_queue queue() const;
             operator cl_command_queue() const { return queue(); }
@@ -318,7 +494,73 @@ namespace Swarm {
             friend struct CommandQueueInternal;
             CommandQueueInternal* _command_queue;
 
-            void enqueueReadInternal(const BufferBase &buffer, bool blocking, size_t size, void* data);
+            Event enqueueReadInternal(const BufferBase &buffer, bool blocking, size_t offset, size_t size, void* data, const EventList &wait);
+            Event enqueueWriteInternal(const BufferBase &buffer, bool blocking, size_t offset, size_t size, const void* data, const EventList &wait);
+            void* enqueueMapInternal(const BufferBase &buffer, bool read, bool write, bool blocking, size_t size, const EventList &wait, Event* event);
+        };
+
+        //! Streams data through a kernel in chunks, moving each chunk while its neighbours compute
+        /*!
+         * Two sets of input and output buffers take turns. Each chunk is written to its input buffer, run through
+         * the kernel into its output buffer, and read back, and each command only waits for the ones it depends on;
+         * on a \ref QUEUE_OUT_OF_ORDER queue, a chunk's upload overlaps the compute of the chunk before it, and its
+         * compute the download of that chunk.
+         *
+         * The kernel is run once per chunk, over one work item per element, with arguments 0 and 1 set to the chunk's
+         * input and output buffers and argument 2 to its element count as a 'uint'. Any other arguments are left as
+         * set. Setting arguments is not thread-safe, so the kernel must not be used elsewhere during \ref run().
+         */
+        template<typename In, typename Out> class StreamPipeline {
+        public:
+
+            //! Create the buffers for chunks of 'chunk' elements
+            StreamPipeline(const Context* ctx, CommandQueue &queue, Kernel &kernel, size_t chunk)
+                    : _queue(queue), _kernel(kernel), _chunk(std::max(chunk, (size_t)1)) {
+                for(int set = 0; set < 2; set++) {
+                    _input[set].reset(new Buffer<In>(ctx, true, false, _chunk));
+                    _output[set].reset(new Buffer<Out>(ctx, false, true, _chunk));
+                }
+            }
+
+            size_t chunk() const { return _chunk; }
+
+            //! Run all 'count' elements of 'input' through the kernel, into 'output'
+            /*!
+             * Neither 'input' nor 'output' may be touched until the returned \ref Event is complete.
+             *
+             * \param wait events to complete before anything is written
+             * \return Event that completes once every chunk has been read back
+             */
+            Event run(const In* input, Out* output, size_t count, const EventList &wait = EventList()) {
+                Event uploaded[2], computed[2], downloaded[2];
+                for(size_t offset = 0, chunk = 0; offset < count; offset += _chunk, chunk++) {
+                    size_t set = chunk % 2;
+                    size_t elements = std::min(_chunk, count - offset);
+
+                    // An input buffer is free once the kernel reading it is done, an output buffer once it is read back
+                    EventList upload_after(wait);
+                    upload_after.push_back(computed[set]);
+                    uploaded[set] = _queue.enqueueWrite(*_input[set], 0, elements, input + offset, false, upload_after);
+
+                    unsigned int size = (unsigned int)elements;
+                    _kernel.argument(0, *_input[set]);
+                    _kernel.argument(1, *_output[set]);
+                    _kernel.argument(2, 1, &size);
+                    computed[set] = _queue.enqueueKernel(_kernel, NDRange(elements), NDRange(), { uploaded[set], downloaded[set] });
+
+                    downloaded[set] = _queue.enqueueRead(*_output[set], 0, elements, output + offset, false, { computed[set] });
+                }
+                Event done = _queue.enqueueMarker(count > 0 ? EventList{ downloaded[0], downloaded[1] } : wait);
+                _queue.flush();
+                return done;
+            }
+
+        protected:
+            CommandQueue &_queue;
+            Kernel &_kernel;
+            size_t _chunk;
+            std::unique_ptr<Buffer<In>> _input[2];
+            std::unique_ptr<Buffer<Out>> _output[2];
         };
 
 
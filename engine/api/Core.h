@@ -67,9 +67,47 @@ namespace Swarm {
 
         typedef void (*GameCycleFunc)(double);
 
+        //! Run the Engine on the calling thread until \ref stop() is called
+        /*!
+         * Calls the game cycle function with a fixed timestep of 1 / \ref simulationRate() seconds, as many times as
+         * needed to keep up with real time, and in between handles window events at the \ref MAIN_LOOP target rate.
+         * If a frame falls far enough behind, the steps it cannot catch up on are dropped instead of run in a burst.
+         */
         void start(GameCycleFunc function);
         void stop();
 
+        //! Loops the Engine runs, each on its own thread
+        enum Loop {
+            MAIN_LOOP,      //!< Game cycle and window events; the thread that called \ref start()
+            RENDER_LOOP,    //!< Rendering every visible Window
+            PHYSICS_LOOP
+        };
+
+        //! Set how many times a second the given loop runs; '0' runs it as fast as it can. Defaults to 60
+        void setTargetRate(Loop loop, double rate);
+        double targetRate(Loop loop);
+
+        //! Set how many fixed steps a second the game cycle function is called with. Defaults to 60
+        void setSimulationRate(double rate);
+        double simulationRate();
+
+        //! How far, from 0 to 1, real time is past the last simulation step, towards the next one
+        /*!
+         * Rendering runs at its own rate, so it blends the last two simulation steps by this much; movement then looks
+         * smooth however the rates line up.
+         */
+        double interpolation();
+
+        //! Timings of a loop, averaged over its recent frames
+        struct LoopStats {
+            double frame_ms = 0.0;      //!< Time from the start of one frame to the start of the next
+            double jitter_ms = 0.0;     //!< Mean difference of frame times from their average
+            double utilization = 0.0;   //!< Share of each frame spent working rather than waiting, from 0 to 1
+            size_t frames = 0;
+        };
+
+        LoopStats loopStats(Loop loop);
+
     }
 
     namespace Config {
@@ -166,5 +166,22 @@ namespace Swarm {
             Type _type;
         };
 
+        class CLCommandException : public std::runtime_error {
+        public:
+            enum Type {
+                ENQUEUE,
+                WAIT
+            };
+
+            Type type() { return _type; }
+
+            static CLCommandException Enqueue(int err_code, const std::string &command);
+            static CLCommandException Wait(int err_code);
+
+        protected:
+            CLCommandException(Type type, const std::string &message);
+            Type _type;
+        };
+
     }
 }
\ No newline at end of file
@@ -226,6 +226,8 @@ namespace Swarm {
             static Log log_physics;
             //! Virtual Hardware Environment Log, used to document VHE scripting.
             static Log log_vhe;
+            //! Asset Log, used to document background asset loading.
+            static Log log_asset;
 
         protected:
 
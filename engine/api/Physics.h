@@ -6,6 +6,10 @@
 //  STD Libraries
 // ***************
 
+#include <cstddef>
+#include <utility>
+#include <vector>
+
 
 
 // ***************
@@ -28,13 +32,157 @@ namespace Swarm {
 
     namespace Physics {
 
-        void init();
+        class PhysicsObject;
+
+        //! Where rigid bodies are integrated
+        enum Backend {
+            BACKEND_AUTO,   //!< \ref BACKEND_CL when a CL device is available, otherwise \ref BACKEND_CPU
+            BACKEND_CPU,    //!< SIMD code run on the job workers; needs no CL device
+            BACKEND_CL      //!< The movement kernel, run on the CL device with the most compute units
+        };
+
+        //! Starts physics, and the physics thread that steps it
+        /*!
+         * Called by \ref Core::init() when initialized with SWM_INIT_PHYSICS. The physics thread only steps while the
+         * engine is running; see \ref Core::start(). Like the game cycle, it steps by a fixed
+         * 1 / \ref Core::simulationRate() seconds, as many times as needed to keep up with real time. If the CL
+         * backend is asked for but cannot be created, the CPU backend is used instead.
+         *
+         * \param backend \ref Backend to integrate bodies with
+         */
+        void init(Backend backend = BACKEND_AUTO);
+
+        //! Stops the physics thread, and the backend
         void cleanup();
 
-        class PhysicsObjectInternal;
-        //class PhysicsObject : public PhysicsObjectInternal {
-        //public:
-
-        //};
+        //! Get the \ref Backend chosen by \ref init(); never \ref BACKEND_AUTO once initialized
+        Backend backend();
+
+        //! Advance every body by 'delta_time' seconds, then clear the forces and torques applied to them
+        /*!
+         * Bodies use semi-implicit Euler; velocities are updated from the applied forces first, then positions and
+         * orientations from the new velocities. Bodies whose bounds then overlap are found with the \ref BroadPhase
+         * set. Called by the physics thread each cycle; only call this directly when the engine is not running.
+         */
+        void step(float delta_time);
+
+        //! Get the number of bodies that exist
+        size_t bodyCount();
+
+        //! How \ref step() finds bodies whose bounds overlap
+        enum BroadPhase {
+            BROAD_PHASE_NONE,   //!< Skip it; \ref overlaps() stays empty
+            BROAD_PHASE_SWEEP,  //!< Sweep and prune, along the axis bodies are spread out the most; for sparse scenes
+            BROAD_PHASE_GRID    //!< Uniform grid of cells; for dense crowds of similarly sized bodies
+        };
+
+        //! Set how \ref step() finds overlapping bodies; defaults to \ref BROAD_PHASE_SWEEP
+        /*!
+         * Either way, only bodies with a radius count (see \ref PhysicsObject::setRadius()), pairs are found in
+         * parallel on the job workers, and both report the same pairs in the same order.
+         */
+        void setBroadPhase(BroadPhase broad_phase);
+        BroadPhase broadPhase();
+
+        //! Set the cell size of \ref BROAD_PHASE_GRID; '0', the default, uses twice the median body diameter
+        /*!
+         * Bodies larger than a cell are kept out of the grid and tested against every other body instead, so a few
+         * huge bodies cost a pass over the rest each rather than crowding every cell.
+         */
+        void setGridCellSize(float size);
+        float gridCellSize();
+
+        //! Get every pair of bodies whose bounds overlapped after the last \ref step()
+        /*!
+         * Pairs are ordered by the first body, then the second, so the same bodies in the same state always give the
+         * same list, however many threads found it. Destroying any \ref PhysicsObject empties the list until the next
+         * step.
+         */
+        std::vector<std::pair<PhysicsObject*, PhysicsObject*>> overlaps();
+
+        //! Times, in milliseconds, and counts from the last \ref step()
+        struct StepStats {
+            double integrate_ms = 0.0;      //!< Time spent moving bodies
+            double broad_phase_ms = 0.0;    //!< Time spent finding overlapping bounds
+            size_t bodies = 0;
+            size_t pairs = 0;               //!< Pairs of bodies whose bounds overlap
+        };
+        StepStats stepStats();
+
+        struct Vec3 {
+            float x;
+            float y;
+            float z;
+            #if defined(SWARM_INCLUDE_GLM)
+            Vec3(const glm::vec3 &vec) : x(vec.x), y(vec.y), z(vec.z) {}
+            operator glm::vec3() const { return glm::vec3(x, y, z); }
+            #endif
+            Vec3(float x = 0.0f, float y = 0.0f, float z = 0.0f) : x(x), y(y), z(z) {}
+        };
+
+        //! Rotation quaternion; w is the real part
+        struct Quat {
+            float x;
+            float y;
+            float z;
+            float w;
+            Quat(float x = 0.0f, float y = 0.0f, float z = 0.0f, float w = 1.0f) : x(x), y(y), z(z), w(w) {}
+        };
+
+        //! A rigid body, stepped by \ref step()
+        /*!
+         * Bodies are stored packed together, one array per component, so a step integrates many at once. The body
+         * exists as long as the PhysicsObject does. Every call is thread-safe; each waits while a step moves the
+         * bodies, but not while it finds overlapping pairs.
+         */
+        class PhysicsObject {
+        public:
+
+            //! Create a body at rest, at the origin
+            /*!
+             * \param mass mass of the body; '0' makes it immovable by force
+             * \param inertia principal moments of inertia, about the body's own axes; a '0' moment makes the body
+             *                immovable by torque about that axis
+             */
+            PhysicsObject(float mass = 1.0f, const Vec3 &inertia = Vec3(1.0f, 1.0f, 1.0f));
+            PhysicsObject(const PhysicsObject &other) = delete;
+            PhysicsObject &operator=(const PhysicsObject &other) = delete;
+            virtual ~PhysicsObject();
+
+            Vec3 position() const;
+            void setPosition(const Vec3 &position);
+
+            Quat orientation() const;
+            void setOrientation(const Quat &orientation);
+
+            Vec3 velocity() const;
+            void setVelocity(const Vec3 &velocity);
+
+            //! Angular velocity about the world axes, in radians per second
+            Vec3 angularVelocity() const;
+            void setAngularVelocity(const Vec3 &velocity);
+
+            //! Add a force, through the center of mass, to be applied over the next step
+            void applyForce(const Vec3 &force);
+
+            //! Add a torque, about the world axes, to be applied over the next step
+            void applyTorque(const Vec3 &torque);
+
+            //! Write the body's model matrix, from its position and orientation, straight into 'matrix'
+            /*!
+             * Meant for \ref Render::RenderObject::instance(), so a RenderObject following a body writes into the draw's
+             * instance buffer, with no copy of the body in between.
+             *
+             * \param matrix receives the model matrix; 16 floats, column-major
+             */
+            void modelMatrix(float* matrix) const;
+
+            //! Radius of the sphere bounding the body, around its position; '0', the default, never overlaps anything
+            float radius() const;
+            void setRadius(float radius);
+
+        protected:
+            size_t _slot;
+        };
     }
-}
\ No newline at end of file
+}
@@ -6,7 +6,10 @@
 //  STD Libraries
 // ***************
 
+#include <atomic>
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <set>
 #include <unordered_map>
 #include <vector>
@@ -180,6 +183,9 @@ namespace Swarm {
             const Type::TargetType target() const { return _target; }
             SWMuint id() const { return _id; }
             void bind(SWMuint active) const;
+
+            //! Keep 'owner' alive for as long as this TexMap or any copy of it lives; used to pin cached assets
+            void setOwner(const std::shared_ptr<const void> &owner) { _owner = owner; }
             bool operator==(const TexMap &rhs) const;
             bool operator!=(const TexMap &rhs) const { return !operator==(rhs); }
             bool operator< (const TexMap &rhs) const;
@@ -189,14 +195,35 @@ namespace Swarm {
         protected:
             Type::TargetType _target;
             SWMuint _id;
+            std::shared_ptr<const void> _owner;
         };
 
         enum FileType {
             PNG
         };
 
+        //! Decoded texture pixels, kept on the CPU
+        struct RawTextureData {
+            unsigned int width = 0;
+            unsigned int height = 0;
+            std::vector<unsigned char> pixels; //!< 8-bit RGBA, row by row
+        };
+
+        //! Decodes an image file without touching OpenGL; safe to call from any thread
+        /*!
+         * \throw TextureException Throws a \ref TextureException when the file cannot be read or decoded.
+         */
+        RawTextureData decodeTexFromFile(const std::string &path, FileType type);
+
+        //! Uploads decoded pixels as a new texture; requires a current OpenGL context
+        TexMap loadTexFromData(const RawTextureData &data);
+
+        //! Decodes and uploads an image file; equivalent to \ref loadTexFromData(decodeTexFromFile(path, type))
         TexMap loadTexFromFile(const std::string &path, FileType type);
 
+        //! Deletes a texture created by \ref loadTexFromData() or \ref loadTexFromFile(); requires a current OpenGL context
+        void unloadTex(const TexMap &tex);
+
         class Texture {
         public:
             void bind() const;
@@ -429,6 +456,11 @@ namespace std {
 }
 
 namespace Swarm {
+    namespace Render {
+        class Device;
+        class VAOTable;
+    }
+
     namespace Model {
 
         void cleanup();
@@ -571,6 +603,12 @@ namespace Swarm {
          * parameters), this function does nothing and returns false. For a function that performs the
          * same functionality, but with default \ref DataType values, see \ref computeTangents(RawModelData&).
          *
+         * Every three consecutive data points are treated as a triangle. Data points with identical vertex, uv, and
+         * normal values are treated as one shared vertex, so each gets the average tangent of all the faces that use
+         * it (and later indexing still merges them). Resulting tangents are orthonormal to the normals, and
+         * bitangents are rebuilt from the normal and tangent with the handedness of the UV mapping. Large meshes are
+         * processed with SIMD over multiple threads.
+         *
          * \param raw_model_data \ref RawModelData collection to compute Tangents for
          * \param vertex_type \ref DataType that represents vertex positions; must have at least 3 dimensions
          * \param uv_type \ref DataType that represents texture coordinates; must have at least 2 dimensions
@@ -677,9 +715,138 @@ namespace Swarm {
 
         protected:
             unsigned int *_indices = nullptr;
-            size_t _index_size;
+            size_t _index_size = 0;
+        };
+
+        //! Computes Tangent data for a \ref RawModelDataIndexed collection
+        /*!
+         * Performs the same functionality as \ref computeTangents(RawModelData&, Type::DataType&, Type::DataType&,
+         * Type::DataType&, Type::DataType&, Type::DataType&), but uses the stored indices to find triangles. Tangents
+         * are accumulated over every face that references a data point. Also returns false if any stored index is
+         * out of range.
+         *
+         * \param raw_model_data \ref RawModelDataIndexed collection to compute Tangents for
+         * \param vertex_type \ref DataType that represents vertex positions; must have at least 3 dimensions
+         * \param uv_type \ref DataType that represents texture coordinates; must have at least 2 dimensions
+         * \param normal_type \ref DataType that represents normal directions; must have at least 3 dimensions
+         * \param tangent_type \ref DataType that represents the produced tangents; must have exactly 3 dimensions
+         * \param bitangent_type \ref DataType that represents the produced bitangents; must have exactly 3 dimensions
+         * \return True upon a successful computation, false otherwise
+         * \sa RawModelDataIndexed, DataType, computeTangents(RawModelDataIndexed&)
+         */
+        bool computeTangents(RawModelDataIndexed &raw_model_data,
+                             const Type::DataType &vertex_type, const Type::DataType &uv_type,
+                             const Type::DataType &normal_type,
+                             const Type::DataType &tangent_type, const Type::DataType &bitangent_type);
+
+        //! Computes Tangent data for a \ref RawModelDataIndexed collection
+        /*!
+         * Performs the same functionality as \ref computeTangents(RawModelDataIndexed&, Type::DataType&,
+         * Type::DataType&, Type::DataType&, Type::DataType&, Type::DataType&), with the standard \ref DataType
+         * defaults.
+         *
+         * \param raw_model_data \ref RawModelDataIndexed collection to compute Tangents for
+         * \return True upon a successful computation, false otherwise
+         */
+        static inline bool computeTangents(RawModelDataIndexed &raw_model_data) {
+            return computeTangents(raw_model_data, Type::VERTEX, Type::UV, Type::NORMAL, Type::TANGENT,
+                                   Type::BITANGENT);
+        }
+
+        //! Post-transform vertex cache efficiency of an index order
+        struct VertexCacheStats {
+            float acmr; //!< Average Cache Miss Ratio; vertex transforms per triangle, from 3.0 (worst) down toward 0.5
+            float atvr; //!< Average Transformed Vertex Ratio; vertex transforms per unique vertex, 1.0 is ideal
+        };
+
+        //! Measures how well a \ref RawModelDataIndexed collection's index order uses the vertex cache
+        /*!
+         * Simulates a FIFO post-transform vertex cache of the given size over the stored indices.
+         *
+         * \param data \ref RawModelDataIndexed collection to analyze
+         * \param cache_size number of vertices the simulated cache holds
+         * \return \ref VertexCacheStats for the current index order
+         */
+        VertexCacheStats analyzeVertexCache(const RawModelDataIndexed &data, unsigned int cache_size = 16);
+
+        //! Stages that \ref optimize() can run; may be combined
+        enum OptimizeFlags {
+            OPTIMIZE_VERTEX_CACHE = 0x01, //!< Reorder triangles for vertex cache reuse (Forsyth)
+            OPTIMIZE_OVERDRAW     = 0x02, //!< Reorder clusters of triangles so outward-facing ones are drawn first
+            OPTIMIZE_VERTEX_FETCH = 0x04, //!< Reorder data points into first-use order, dropping unreferenced ones
+            OPTIMIZE_ALL          = 0x07
+        };
+
+        //! Vertex cache statistics from before and after a call to \ref optimize()
+        struct OptimizeResult {
+            VertexCacheStats before;
+            VertexCacheStats after;
+        };
+
+        //! Reorders a \ref RawModelDataIndexed collection for faster rendering
+        /*!
+         * Runs the stages selected by \a flags, in order: triangles are reordered for vertex cache reuse, then
+         * clusters of triangles are reordered to reduce overdraw (kept only if the cache miss ratio gets no more than
+         * 5% worse), then data points are renumbered in the order they are first used so vertex fetches are
+         * sequential. The set of triangles drawn is unchanged. Intended to run once, after \ref RawModelData::index()
+         * and before a \ref Model is created; Models use 16-bit indices automatically when the data point count
+         * allows. Collections with out of range indices are left untouched.
+         *
+         * \param data \ref RawModelDataIndexed collection to reorder in place
+         * \param flags bitwise combination of \ref OptimizeFlags
+         * \param cache_size vertex cache size to assume when measuring and when trading cache reuse for overdraw
+         * \param vertex_type \ref DataType that represents vertex positions; used by the overdraw stage
+         * \return \ref VertexCacheStats from before and after optimization
+         * \sa analyzeVertexCache()
+         */
+        OptimizeResult optimize(RawModelDataIndexed &data, unsigned int flags = OPTIMIZE_ALL, unsigned int cache_size = 16,
+                                const Type::DataType &vertex_type = Type::VERTEX);
+
+        //! Simplifies a \ref RawModelDataIndexed collection, returning the indices of a coarser mesh
+        /*!
+         * Collapses edges in order of least quadric error until at most \a target_index_count indices remain, or
+         * until no collapse stays within \a max_error. Data points are never moved or added; collapses only merge a
+         * data point onto a neighbouring one, so the returned indices refer to the same data points as \a data.
+         * Open borders only collapse along themselves, and data points on attribute seams (those sharing a position
+         * with another data point) are kept. Errors are distances relative to the radius of the mesh's bounding
+         * sphere. Returns a copy of the original indices if \a data has invalid indices or no suitable vertices.
+         *
+         * \param data \ref RawModelDataIndexed collection to simplify
+         * \param target_index_count desired number of indices (3 per triangle)
+         * \param max_error largest error any single collapse may introduce, relative to the mesh radius
+         * \param result_error optional output for the largest error introduced
+         * \param vertex_type \ref DataType that represents vertex positions; must have at least 3 dimensions
+         * \return indices of the simplified mesh
+         * \sa generateLODs()
+         */
+        std::vector<unsigned int> simplify(const RawModelDataIndexed &data, size_t target_index_count,
+                                           float max_error = 0.01f, float* result_error = nullptr,
+                                           const Type::DataType &vertex_type = Type::VERTEX);
+
+        //! A simplified level of detail for a \ref RawModelDataIndexed collection
+        struct LODLevel {
+            std::vector<unsigned int> indices; //!< Indices into the original collection's data points
+            float error;                       //!< Largest error, relative to the mesh's bounding sphere radius
         };
 
+        //! Generates a chain of progressively simplified levels of detail
+        /*!
+         * Produces one \ref LODLevel per entry of \a ratios, each targeting that fraction of the original triangle
+         * count (e.g. {0.5, 0.25, 0.125}). Levels are simplified from one another in order, so \a ratios should be
+         * decreasing, and errors never decrease down the chain. Generation stops early once \a max_error prevents
+         * any further reduction. The result can be passed to \ref Model::Model(const RawModelDataIndexed&,
+         * const std::vector<LODLevel>&).
+         *
+         * \param data \ref RawModelDataIndexed collection to simplify
+         * \param ratios target triangle ratios for each level, relative to the original mesh
+         * \param max_error largest error any level may have, relative to the mesh radius
+         * \param vertex_type \ref DataType that represents vertex positions; must have at least 3 dimensions
+         * \return generated levels, finest first, not including the original mesh
+         * \sa simplify()
+         */
+        std::vector<LODLevel> generateLODs(const RawModelDataIndexed &data, const std::vector<float> &ratios,
+                                           float max_error = 0.05f, const Type::DataType &vertex_type = Type::VERTEX);
+
         //! Loads an OBJ file as a \ref RawModelData collection
         /*!
          * Attempts to open a given OBJ file and parse its contents. Contents are parsed into a \ref RawModelData
@@ -726,13 +893,27 @@ namespace Swarm {
             return loadFromOBJ(path, Type::VERTEX, Type::UV, Type::NORMAL);
         }
 
+        //! How a \ref Model lays out its vertex data on the GPU
+        /*!
+         * Every attribute of a Model shares one vertex buffer. By default each vertex's attributes are stored
+         * together, so drawing a vertex fetches one contiguous span; planar layout stores each attribute's values
+         * one after another instead. Compression stores texture coordinates as 16 bit normalized integers (as half
+         * floats, when any falls outside [0, 1]), and normals, tangents and bitangents as signed normalized
+         * 10:10:10:2 integers, in exchange for a little precision.
+         */
+        struct VertexFormat {
+            bool interleaved = true;
+            bool compressed = false;
+        };
+
         //! Storage object for OpenGL Buffer and VAO IDs
         /*!
-         * A Model object stores a collection of Buffer IDs representing OpenGL Data Buffers. The IDs are created with
-         * data from a \ref RawModelDataIndexed collection; only one Model needs to be created for each unique
-         * \ref RawModelDataIndexed collection. Models can be rendered by binding their Vertex Array Object (VAO) IDs,
-         * which can be retrieved with \ref ::vao(), and are generated on an as needed basis for each OpenGL context,
-         * depending on which one is active in the current thread.
+         * A Model object stores the IDs of an OpenGL vertex buffer, laid out as its \ref VertexFormat says, and an
+         * element buffer. The IDs are created with data from a \ref RawModelDataIndexed collection; only one Model
+         * needs to be created for each unique \ref RawModelDataIndexed collection. Models can be rendered by binding
+         * their Vertex Array Object (VAO) IDs, which can be retrieved with \ref ::vao(), and are generated on an as
+         * needed basis for each OpenGL context, depending on which one is active in the current thread. Each context
+         * keeps its own table of VAOs, so windows rendering on different threads never share one.
          */
         class Model {
         public:
@@ -751,6 +932,17 @@ namespace Swarm {
              */
             Model(const RawModelDataIndexed &data);
 
+            //! Model Creation Constructor with Levels of Detail
+            /*!
+             * Creates a loaded Model object like \ref Model(const RawModelDataIndexed&), additionally storing the
+             * indices of each given \ref LODLevel in the same element buffer. Level 0 is always \a data itself.
+             *
+             * \param data \ref RawModelDataIndexed collection to use
+             * \param lods simplified levels, finest first, as produced by \ref generateLODs()
+             * \param format layout of the vertex buffer
+             */
+            Model(const RawModelDataIndexed &data, const std::vector<LODLevel> &lods, const VertexFormat &format = VertexFormat());
+
             //! Model Copy Constructor
             /*!
              * Copies another Model object, making both Model objects have the same Buffer and VAO IDs.
@@ -772,7 +964,8 @@ namespace Swarm {
             /*!
              * Retrieves a VAO ID for the current model, based on which OpenGL context is active in the current thread.
              * If a VAO has not yet been generated for this Model and OpenGL context combination, generate a new VAO
-             * before retrieving.
+             * before retrieving. Each call looks the context up; a \ref Render::RenderObjectCollection resolves the
+             * VAOs of everything it draws once per batch instead.
              *
              * \return VAO ID for this Model
              */
@@ -781,9 +974,55 @@ namespace Swarm {
             //! Get this Model's number of Elements (Indices)
             size_t elementCount() const { return _element_count; }
 
+            //! Get the number of levels of detail stored, including the full detail level 0
+            size_t lodCount() const { return _lods.size(); }
+
+            //! Get the number of Elements (Indices) in the given level of detail
+            size_t elementCount(size_t lod) const { return lod < _lods.size() ? _lods[lod].count : 0; }
+
+            //! Get the position of the given level of detail's first Element within the element buffer
+            size_t elementOffset(size_t lod) const { return lod < _lods.size() ? _lods[lod].offset : 0; }
+
+            //! Get the simplification error of the given level of detail, relative to \ref boundsRadius()
+            float lodError(size_t lod) const { return lod < _lods.size() ? _lods[lod].error : 0.0f; }
+
+            //! Choose a level of detail for a given on-screen size
+            /*!
+             * Returns the coarsest level of detail whose error, when the Model's bounding sphere covers
+             * \a radius_pixels on screen, is no more than \a threshold_pixels.
+             *
+             * \param radius_pixels projected radius of the Model's bounding sphere, in pixels
+             * \param threshold_pixels largest acceptable on-screen error, in pixels
+             * \return level of detail to draw
+             */
+            size_t selectLOD(float radius_pixels, float threshold_pixels = 1.0f) const;
+
+            //! Get the radius of this Model's bounding sphere
+            float boundsRadius() const { return _bounds_radius; }
+
+            #if defined(SWARM_INCLUDE_GLM)
+            //! Get the center of this Model's bounding sphere
+            glm::vec3 boundsCenter() const { return glm::vec3(_bounds_center[0], _bounds_center[1], _bounds_center[2]); }
+
+            //! Get the minimum corner of this Model's axis aligned bounding box
+            glm::vec3 boundsMin() const { return glm::vec3(_bounds_min[0], _bounds_min[1], _bounds_min[2]); }
+
+            //! Get the maximum corner of this Model's axis aligned bounding box
+            glm::vec3 boundsMax() const { return glm::vec3(_bounds_max[0], _bounds_max[1], _bounds_max[2]); }
+            #endif
+
+            //! Get the GL type of this Model's Elements; GL_UNSIGNED_SHORT when every index fits in 16 bits
+            SWMenum elementType() const { return _element_type; }
+
+            //! Get the size of this Model's vertex buffer, in bytes
+            size_t vertexBytes() const { return _vertex_bytes; }
+
             //! Has this Model been properly loaded yet? (Either from Creation or Copy/Assignment)
             bool loaded() const { return _loaded; }
 
+            //! Keep 'owner' alive for as long as this Model or any copy of it lives; used to pin cached assets
+            void setOwner(const std::shared_ptr<const void> &owner) { _owner = owner; }
+
             bool operator==(const Model &rhs) const;
             bool operator!=(const Model &rhs) const { return !operator==(rhs); }
             bool operator< (const Model &rhs) const;
@@ -791,6 +1030,13 @@ namespace Swarm {
             bool operator> (const Model &rhs) const { return !operator<=(rhs); }
             bool operator>=(const Model &rhs) const { return !operator<(rhs); }
 
+            //! Release this Model's Buffers and VAOs
+            /*!
+             * Deletes the Buffers shared by this Model and every copy of it, and the VAO of the current OpenGL context.
+             * This Model becomes unloaded; copies are left referring to deleted Buffers, and must not be rendered.
+             */
+            void release();
+
             //! Cleanup all Model Objects
             /*!
              * Releases all Buffers and VAOs created by the construction of new Models. Generally called by
@@ -799,20 +1045,42 @@ namespace Swarm {
             static void cleanup();
 
         protected:
-            void genBuffers(const RawModelDataIndexed &data);
-            void genVAO();
+            void genBuffers(const RawModelDataIndexed &data, const std::vector<LODLevel> &lods, const VertexFormat &format);
+            SWMuint genVAO();
+            void bindAttributes(Render::Device &dev) const;
+
+            friend class Render::VAOTable;
 
-            struct BufferEntry {
-                SWMuint buffer;
+            struct AttributeEntry {
                 SWMuint attrib;
-                VecType type;
-                friend bool operator<(const BufferEntry &lhs, const BufferEntry &rhs) { return lhs.buffer < rhs.buffer; }
+                SWMint components;
+                SWMenum type;
+                bool normalized;
+                SWMsizei stride;
+                size_t offset;
             };
 
             bool _loaded = false;
-            std::set<BufferEntry> _data_buffers;
+            SWMuint _vertex_buffer = 0;
+            std::vector<AttributeEntry> _attributes;
+            size_t _vertex_bytes = 0;
             SWMuint _element_buffer = 0;
             size_t _element_count = 0;
+            SWMenum _element_type = 0x1405; // GL_UNSIGNED_INT
+
+            struct LODRange {
+                size_t offset;
+                size_t count;
+                float error;
+            };
+            std::vector<LODRange> _lods;
+
+            float _bounds_center[3] = { 0.0f, 0.0f, 0.0f };
+            float _bounds_radius = 0.0f;
+            float _bounds_min[3] = { 0.0f, 0.0f, 0.0f };
+            float _bounds_max[3] = { 0.0f, 0.0f, 0.0f };
+
+            std::shared_ptr<const void> _owner;
 
         };
     }
@@ -822,18 +1090,266 @@ namespace Swarm {
         void init();
         void cleanup();
 
+        //! Layout of a uniform block in a linked \ref Program, as reflected from OpenGL
+        struct UniformBlock {
+            std::string name;
+            SWMuint index = 0;   //!< Index of the block in its program
+            SWMuint binding = 0; //!< Binding point the block reads its buffer range from
+            size_t size = 0;     //!< Bytes the block's buffer range must hold
+            std::unordered_map<std::string, size_t> offsets; //!< Byte offset of each member; arrays without "[0]"
+        };
+
+        //! Backend that every OpenGL call made by the engine goes through
+        /*!
+         * All rendering, from buffer and texture uploads to draw calls, is issued through the Device returned by
+         * \ref device(). By default that is the OpenGL backend from \ref Device::gl(); a \ref RecordingDevice can be
+         * set instead to run the render path headless, capturing what would have been sent to the GPU.
+         *
+         * Objects (buffers, textures, programs, ...) belong to the Device that created them, and must be deleted by the
+         * same Device. Devices are not thread-safe, aside from the \ref RecordingDevice; calls are expected from the
+         * thread owning the current context.
+         */
+        class Device {
+        public:
+            virtual ~Device() {}
+
+            // Shaders and Programs
+
+            //! Create and compile a shader; 'id' is set even if compilation fails, and 'log' receives the info log
+            virtual bool compileShader(SWMuint &id, SWMenum type, const std::string &src, std::string &log) = 0;
+            virtual void deleteShader(SWMuint shader) = 0;
+
+            //! Create a program and link the given shaders into it; 'id' is set even if linking fails
+            virtual bool linkProgram(SWMuint &id, const std::vector<SWMuint> &shaders, std::string &log) = 0;
+            virtual void deleteProgram(SWMuint program) = 0;
+            virtual void useProgram(SWMuint program) = 0;
+            virtual SWMint uniformLocation(SWMuint program, const std::string &name) = 0;
+
+            //! List the active uniforms of a linked program and their locations; arrays are listed without "[0]"
+            virtual void activeUniforms(SWMuint program, std::vector<std::pair<std::string, SWMint>> &uniforms) = 0;
+
+            //! List the active uniform blocks of a linked program, with the offset of every member
+            virtual void activeUniformBlocks(SWMuint program, std::vector<UniformBlock> &blocks) = 0;
+
+            //! Source a program's uniform block from the buffer range bound to the given binding point
+            virtual void uniformBlockBinding(SWMuint program, SWMuint block, SWMuint binding) = 0;
+
+            // Uniforms; set on the program currently in use. 'components' is the vector size of each element.
+
+            virtual void uniformf (SWMint location, SWMsizei components, SWMsizei count, const SWMfloat* data) = 0;
+            virtual void uniformi (SWMint location, SWMsizei components, SWMsizei count, const SWMint*   data) = 0;
+            virtual void uniformui(SWMint location, SWMsizei components, SWMsizei count, const SWMuint*  data) = 0;
+            virtual void uniformMatrix(SWMint location, SWMsizei columns, SWMsizei rows, SWMsizei count, const SWMfloat* data) = 0;
+
+            // Buffers and Vertex Arrays
+
+            virtual SWMuint createBuffer() = 0;
+            virtual void deleteBuffer(SWMuint buffer) = 0;
+            virtual void bindBuffer(SWMenum target, SWMuint buffer) = 0;
+
+            //! Bind part of a buffer to an indexed binding point of 'target', such as a GL_UNIFORM_BUFFER binding
+            virtual void bindBufferRange(SWMenum target, SWMuint index, SWMuint buffer, size_t offset, size_t bytes) = 0;
+
+            //! Upload 'bytes' of static data to the buffer bound to 'target'
+            virtual void bufferData(SWMenum target, size_t bytes, const void* data) = 0;
+
+            //! Replace the contents of the buffer bound to 'target' with data that is rewritten every frame
+            /*!
+             * The previous contents are orphaned rather than overwritten, so the upload never waits for draws still
+             * reading them.
+             */
+            virtual void bufferStream(SWMenum target, size_t bytes, const void* data) = 0;
+
+            virtual SWMuint createVertexArray() = 0;
+            virtual void deleteVertexArray(SWMuint vao) = 0;
+            virtual void bindVertexArray(SWMuint vao) = 0;
+
+            //! Enable an attribute of the bound vertex array, sourcing it from the buffer bound to GL_ARRAY_BUFFER
+            /*!
+             * \param divisor '0' to advance the attribute per vertex, or 'n' to advance it once every n instances
+             */
+            virtual void vertexAttribute(SWMuint attrib, SWMint components, SWMenum type, bool normalized,
+                                         SWMsizei stride, size_t offset, SWMuint divisor) = 0;
+
+            // Textures
+
+            virtual SWMuint createTexture() = 0;
+            virtual void deleteTexture(SWMuint texture) = 0;
+            virtual void bindTexture(SWMuint active, SWMenum target, SWMuint texture) = 0;
+
+            //! Upload 8-bit RGBA pixels to a 2D texture, with mipmaps and trilinear filtering
+            virtual void textureImage2D(SWMuint texture, unsigned int width, unsigned int height, const void* pixels) = 0;
+
+            // Drawing
+
+            virtual void viewport(SWMint x, SWMint y, SWMsizei width, SWMsizei height) = 0;
+
+            //! Clear the color and depth buffers
+            virtual void clear(float r, float g, float b, float a) = 0;
+
+            //! Enable or disable a capability, such as GL_DEPTH_TEST
+            virtual void enable(SWMenum capability, bool enabled) = 0;
+
+            //! Draw from the bound vertex array; 'offset' is in bytes into its element buffer
+            virtual void drawElements(SWMenum mode, SWMsizei count, SWMenum type, size_t offset) = 0;
+
+            //! Draw 'instances' copies of the bound vertex array's elements
+            virtual void drawElementsInstanced(SWMenum mode, SWMsizei count, SWMenum type, size_t offset, SWMsizei instances) = 0;
+
+            // Synchronization
+
+            //! Insert a fence after every command issued so far, and flush them all to the GPU
+            /*!
+             * Objects those commands created or filled are safe to use from other contexts once \ref fenceSignaled()
+             * returns true for the fence.
+             */
+            virtual SWMuint fenceSync() = 0;
+
+            //! Has the GPU finished every command issued before the fence; never blocks
+            virtual bool fenceSignaled(SWMuint fence) = 0;
+            virtual void deleteFence(SWMuint fence) = 0;
+
+            //! Get the OpenGL backend
+            static Device* gl();
+        };
+
+        //! Get the Device all rendering currently goes through
+        /*!
+         * Unless state caching has been turned off with \ref setStateCaching(), this is a state cache in front of the
+         * Device set with \ref setDevice().
+         */
+        Device &device();
+
+        //! Set the Device all rendering goes through; 'nullptr' restores \ref Device::gl()
+        void setDevice(Device* device);
+
+        //! Counters kept by the state cache in front of the current \ref Device
+        struct StateStats {
+            size_t changes = 0; //!< Binds and enables passed on to the Device
+            size_t dropped = 0; //!< Binds and enables dropped, as they set what was already set
+        };
+
+        //! Choose whether \ref device() puts a state cache in front of the current Device; on by default
+        /*!
+         * The cache tracks the bound program, vertex array, buffers and buffer ranges, the texture bound to each unit,
+         * and enabled capabilities, and drops changes that set what is already set. State belongs to a context, and
+         * each thread has its own current context, so each thread tracks its own; \ref invalidateStateCache() must be
+         * called after switching contexts, or after changing state without going through \ref device().
+         */
+        void setStateCaching(bool caching);
+        bool stateCaching();
+
+        //! Forget the state the calling thread's cache has tracked, so the next change of everything goes through
+        void invalidateStateCache();
+
+        //! Get the calling thread's state cache counters since the last \ref resetStateStats()
+        StateStats stateStats();
+        void resetStateStats();
+
+        //! Get the state cache counters of the last frame the render thread finished
+        StateStats frameStateStats();
+
+        //! Kinds of command captured by a \ref RecordingDevice
+        enum DeviceCommandType {
+            CMD_USE_PROGRAM,        //!< object: program
+            CMD_UNIFORM,            //!< target: location, count: elements, bytes: data size
+            CMD_BIND_BUFFER,        //!< target: buffer target, object: buffer
+            CMD_BIND_BUFFER_RANGE,  //!< target: binding index, object: buffer, count: offset, bytes: range size
+            CMD_BUFFER_DATA,        //!< target: buffer target, object: bound buffer, bytes: data size
+            CMD_BUFFER_STREAM,      //!< target: buffer target, object: bound buffer, bytes: data size
+            CMD_BIND_VERTEX_ARRAY,  //!< object: vertex array
+            CMD_VERTEX_ATTRIBUTE,   //!< target: attribute, object: bound buffer, count: components, bytes: offset
+            CMD_BIND_TEXTURE,       //!< target: texture unit, object: texture
+            CMD_TEXTURE_IMAGE,      //!< object: texture, bytes: pixel data size
+            CMD_VIEWPORT,           //!< count: width * height
+            CMD_CLEAR,
+            CMD_ENABLE,             //!< target: capability, count: '1' if enabled, '0' if disabled
+            CMD_DRAW_ELEMENTS,      //!< target: element type, object: bound vertex array, count: indices, bytes: offset
+            CMD_DRAW_INSTANCED,     //!< as CMD_DRAW_ELEMENTS, with count being the indices of each instance
+            CMD_FENCE_SYNC          //!< object: fence
+        };
+
+        //! Single command captured by a \ref RecordingDevice
+        struct DeviceCommand {
+            DeviceCommandType type;
+            SWMuint target;
+            SWMuint object;
+            size_t count;
+            size_t bytes;
+            unsigned long long hash; //!< Hash of the uploaded data, for comparing command streams; '0' if none
+            size_t instances;        //!< Instances drawn by a draw command; '0' for other commands
+        };
+
+        //! Counters kept by a \ref RecordingDevice
+        struct DeviceStats {
+            size_t commands = 0;
+
+            size_t draw_calls = 0;
+            size_t instances = 0;           //!< Objects drawn; one per plain draw, plus each instance of instanced draws
+            size_t indices = 0;             //!< Indices drawn, over all instances
+
+            size_t program_binds = 0;
+            size_t vertex_array_binds = 0;
+            size_t buffer_binds = 0;
+            size_t texture_binds = 0;
+            size_t redundant_binds = 0;     //!< Binds of what was already bound; included in the counts above
+            size_t capability_changes = 0;
+
+            size_t uniform_uploads = 0;
+            size_t uniform_bytes = 0;
+            size_t buffer_uploads = 0;
+            size_t buffer_bytes = 0;
+            size_t texture_uploads = 0;
+            size_t texture_bytes = 0;
+        };
+
+        //! Headless \ref Device that records commands instead of executing them
+        /*!
+         * Hands out object names the way OpenGL would, and tracks bound state, but never touches a GPU; usable without
+         * a window or context. Every command is counted in \ref stats(), and is also captured in \ref commands()
+         * unless recording was turned off with \ref setRecordCommands(). Thread-safe.
+         */
+        class RecordingDevice : public Device {
+        public:
+            virtual DeviceStats stats() const = 0;
+
+            //! Get a copy of the captured command stream, in issue order
+            virtual std::vector<DeviceCommand> commands() const = 0;
+
+            //! Choose whether commands are captured, or only counted; captured by default
+            virtual void setRecordCommands(bool record) = 0;
+            virtual bool recordCommands() const = 0;
+
+            //! Clear the captured commands and counters; objects and bound state are kept
+            virtual void reset() = 0;
+
+            static RecordingDevice* create();
+
+        private:
+            RecordingDevice() {}
+            friend class RecordingDeviceInternal;
+        };
+
         class Renderer;
+        class Program;
 
         //! Representation of a GL Uniform
         /*!
          * The Uniform object is a representation of a GL Uniform. Changing a Uniform object will not change the Uniform
-         * data bound to the GPU until \ref ::bind() is called, which is usually done internally by a \ref Renderer
-         * object.
+         * data bound to the GPU until \ref flushUniforms() has run and \ref ::bind() is called, which is usually done
+         * internally by a \ref Renderer object. Uniforms that are members of a \ref Renderer's frame uniform block
+         * are not bound one by one; they are packed into the block by \ref uploadUniformBlocks().
+         *
+         * Setting a Uniform never blocks; the data is copied into a double-buffered staging area, which the render
+         * thread swaps out and applies at the start of each frame. Any thread may set a Uniform; destroying one
+         * discards whatever was staged for it but not yet applied.
          * \sa ::bind()
          */
         class Uniform {
         public:
             friend class Renderer;
+            friend class RendererInternal;
+            friend void flushUniforms();
 
             //! Uniform Constructor
             /*!
@@ -842,7 +1358,10 @@ namespace Swarm {
              * \param name name used to represent the Uniform in a GLSL shader
              * \sa ::name, ::setName()
              */
-            Uniform(const std::string &name) : _name(name) {}
+            Uniform(const std::string &name);
+            Uniform(const Uniform &other) = delete;
+            Uniform &operator=(const Uniform &other) = delete;
+            ~Uniform();
 
             //! Gets the Uniform's name
             /*!
@@ -851,18 +1370,18 @@ namespace Swarm {
              * \return name name used to represent the Uniform in a GLSL shader
              * \sa ::setName()
              */
-            std::string name() { return _name; }
+            std::string name() const { return _name; }
 
-            void setf (SWMsizei count, SWMsizei stride, SWMfloat *data);
-            void seti (SWMsizei count, SWMsizei stride, SWMint   *data);
-            void setui(SWMsizei count, SWMsizei stride, SWMuint  *data);
-            void setm (SWMsizei count, SWMsizei width,  SWMsizei height, SWMfloat *data);
+            void setf (SWMsizei count, SWMsizei stride, const SWMfloat *data);
+            void seti (SWMsizei count, SWMsizei stride, const SWMint   *data);
+            void setui(SWMsizei count, SWMsizei stride, const SWMuint  *data);
+            void setm (SWMsizei count, SWMsizei width,  SWMsizei height, const SWMfloat *data);
 
             //! Binds the Uniform
             /*!
              * Binds the current data associated with this Uniform to the \ref Program used by the specified
-             * \ref Renderer. Usually only called internally by a \ref Renderer object. Empty Uniform objects are not
-             * valid to bind with.
+             * \ref Renderer. Usually only called internally by a \ref Renderer object. Empty Uniform objects, and
+             * Uniforms the \ref Program has no active default-block Uniform for, are not bound.
              *
              * \param render \ref Renderer object to bind to
              * \sa ::empty(), ::clear()
@@ -884,27 +1403,47 @@ namespace Swarm {
              * \return true if empty, false otherwise
              * \sa ::bind(), ::clear()
              */
-            bool empty() { return _has_data; }
+            bool empty() const { return !_has_data; }
 
         protected:
-            const std::string _name;
-            bool _has_data = false;
-
-            enum {
+            enum Type : uint8_t {
                 F, I, UI, M
-            } type;
-            union {
-                struct { SWMsizei count; SWMsizei stride; SWMfloat* data; } f;
-                struct { SWMsizei count; SWMsizei stride; SWMint*   data; } i;
-                struct { SWMsizei count; SWMsizei stride; SWMuint*  data; } ui;
-                struct { SWMsizei count; SWMsizei width;  SWMsizei height; SWMfloat* data; } m;
-            } data;
-
-            #if defined(SWARM_BOOST_AVAILABLE)
-            void clear(boost::lock_guard<boost::mutex>&);
-            #endif
+            };
+
+            // Value applied by flushUniforms(); only touched by the render thread
+            struct Value {
+                Type type = F;
+                SWMsizei count = 0;
+                SWMsizei width = 0;  // Components, or matrix columns
+                SWMsizei height = 1; // Matrix rows
+                std::vector<SWMfloat> data; // Raw 32-bit elements, whatever the type
+            };
+
+            void stage(Type type, SWMsizei count, SWMsizei width, SWMsizei height, const void* data);
+
+            //! Write the current value with std140 layout; returns the bytes written, at most 'capacity'
+            size_t writeStd140(uint8_t* target, size_t capacity) const;
+
+            const std::string _name;
+            uint32_t _serial; // Tells staged records for this Uniform from those of one that had the same address
+            std::atomic<bool> _has_data{false};
+            Value _value;
+            bool _value_set = false;
+
+            // Location in the last Program bound to, so binding again needs no lookup
+            const Program* _program = nullptr;
+            SWMint _location = -1;
         };
 
+        //! Apply every \ref Uniform value set since the last call
+        /*!
+         * Swaps the staging buffers \ref Uniform setters write into, and applies what was written to the Uniforms.
+         * Called by the render thread at the start of each frame; only needs calling manually when rendering without
+         * a Window. Until then, staging that fills up keeps only the latest value of each Uniform, so setters never
+         * grow it without bound.
+         */
+        void flushUniforms();
+
         //! Object representing a collection of Render data
         /*!
          * A RenderObject object is a pure virtual class interface used for rendering. Each virtual method has certain
@@ -939,6 +1478,42 @@ namespace Swarm {
              */
             virtual void render(const Renderer &renderer) const = 0;
 
+            //! Prepare this RenderObject to be drawn by its \ref RenderObjectCollection
+            /*!
+             * Used instead of \ref render() by \ref RenderObjectCollection::render(). Writes this RenderObject's model
+             * matrix and the level of detail of its \ref Model::Model to draw, so the collection can build its draw
+             * commands on worker threads, and with \ref Renderer::setInstancing() enabled, draw it in a single
+             * instanced draw call together with every other RenderObject sharing its \ref Model::Model and
+             * \ref Texture::Texture. The default implementation returns false.
+             *
+             * Like \ref depth() and \ref bounds(), this may be called from worker threads, on several RenderObjects at
+             * once, so it must not modify shared state.
+             *
+             * \param renderer \ref Renderer object to render with
+             * \param matrix receives the model matrix; 16 floats, column-major
+             * \param lod receives the level of detail; see \ref Model::Model::selectLOD()
+             * \return true if this RenderObject can be drawn by its collection, false to have it drawn with \ref render()
+             */
+            virtual bool instance(const Renderer &/*renderer*/, SWMfloat* /*matrix*/, size_t &/*lod*/) const { return false; }
+
+            //! Get this RenderObject's distance in front of the camera, used to sort rendering front to back
+            /*!
+             * \param renderer \ref Renderer object to render with
+             * \return view-space depth; the default implementation returns '0', which sorts first
+             */
+            virtual float depth(const Renderer &/*renderer*/) const { return 0.0f; }
+
+            //! Get this RenderObject's world-space axis aligned bounding box, used for frustum culling
+            /*!
+             * Read when a \ref RenderObjectCollection indexes its RenderObjects, which happens again after every
+             * \ref RenderObjectCollection::flush() that changes it; RenderObjects that move should not report bounds.
+             *
+             * \param min receives the minimum corner; 3 floats
+             * \param max receives the maximum corner; 3 floats
+             * \return false if this RenderObject is unbounded, and never culled; the default implementation always is
+             */
+            virtual bool bounds(SWMfloat* /*min*/, SWMfloat* /*max*/) const { return false; }
+
             //! Create a new statically positioned RenderObject
             /*!
              * Constructs and returns a new statically positioned RenderObject. The RenderObject has a position, scale,
@@ -972,27 +1547,56 @@ namespace Swarm {
 
         //! A Collection of \ref RenderObject pointers
         /*!
-         * A RenderObjectCollection is a complex, thread-safe collection of \ref RenderObject pointers.
-         * \ref RenderObject objects that have the same \ref Texture::Texture are mapped together under that
-         * \ref Texture::Texture. Internally, \ref RenderObject pointers are stored in a set, so only one pointer to
-         * each actual \ref RenderObject can be stored. In addition, any inserts or erases of RenderObjects in the
+         * A RenderObjectCollection is a complex, thread-safe collection of \ref RenderObject pointers. Each
+         * \ref RenderObject is stored once, in a flat array of render items sorted by a 64 bit key packing its
+         * \ref Texture::Texture, its \ref Model::Model and its depth from the camera, so rendering walks the array in
+         * order and only binds a \ref Texture::Texture when it changes. Any inserts or erases of RenderObjects in the
          * collection are only applied after \ref ::flush() is called. Normally, this is called automatically by the
          * Window system.
          */
+        //! Results of the last \ref RenderObjectCollection::render()
+        struct RenderStats {
+            size_t objects = 0;      //!< RenderObjects in the collection
+            size_t visible = 0;      //!< RenderObjects inside the view frustum, or without bounds
+            size_t culled = 0;       //!< RenderObjects skipped for being outside the view frustum
+            size_t nodes_tested = 0; //!< Bounding volume hierarchy nodes tested against the view frustum
+            size_t threads = 1;      //!< Threads the draw commands were built on
+            double cull_ms = 0.0;      //!< Time spent testing the hierarchy
+            double hierarchy_ms = 0.0; //!< Time spent rebuilding the hierarchy, after the collection changed
+            double build_ms = 0.0;     //!< Time spent building draw commands, including sorting and culling
+            double submit_ms = 0.0;    //!< Time spent submitting draw commands to the \ref Device
+        };
+
+        //! Set how many threads build the draw commands of a \ref RenderObjectCollection, including the rendering thread
+        /*!
+         * Sort keys, culling and draw commands are built in parallel; only submitting them to the \ref Device stays on
+         * the rendering thread, so the \ref Device sees the same commands in the same order whatever the count.
+         * Building runs on the job workers; see \ref Util::parallelFor(). '0' uses every job worker, and '1' builds on
+         * the rendering thread alone. Defaults to '0'.
+         */
+        void setBuildThreads(unsigned int threads);
+        unsigned int buildThreads();
+
         class RenderObjectCollection {
         public:
 
+            //! Identifies an inserted \ref RenderObject; '0' is never a valid Handle
+            typedef uint64_t Handle;
+
             RenderObjectCollection();
+            RenderObjectCollection(const RenderObjectCollection &other) = delete;
+            RenderObjectCollection &operator=(const RenderObjectCollection &other) = delete;
             ~RenderObjectCollection();
 
             //! Insert a \ref RenderObject to this collection
             /*!
              * Queues an insert on the next \ref ::flush() for the given \ref RenderObject pointer into this
-             * collection, if it hasn't already been inserted. If a nullptr is given, does nothing.
+             * collection, if it hasn't already been inserted. If a nullptr is given, does nothing. Constant time.
              *
              * \param object \ref RenderObject pointer to insert
+             * \return Handle to erase the \ref RenderObject with, or '0' for a nullptr
              */
-            void insert(RenderObject* object);
+            Handle insert(RenderObject* object);
 
             //! Erase a \ref RenderObject from this collection
             /*!
@@ -1004,10 +1608,20 @@ namespace Swarm {
              */
             void erase(RenderObject* object);
 
+            //! Erase a \ref RenderObject from this collection by the Handle \ref insert() returned
+            /*!
+             * Same as erasing by pointer, without the pointer lookup. Handles of already erased
+             * \ref RenderObject "RenderObjects" are ignored. Constant time.
+             *
+             * \param handle Handle of the \ref RenderObject to erase
+             */
+            void erase(Handle handle);
+
             //! Flushes all changes
             /*!
              * Applies any \ref ::insert() and \ref ::erase() changes that have been queued. This is done automatically
              * by the Window system during the Render cycle, so there is no need to manually call it in most cases.
+             * Takes time proportional to the number of queued changes, not the size of the collection.
              */
             void flush();
 
@@ -1019,40 +1633,117 @@ namespace Swarm {
              */
             void clear();
 
-            void render(const Renderer &renderer);
-
-            //! Gets a set of \ref RenderObject pointers
+            //! Render every \ref RenderObject in this collection
             /*!
-             * Retrieves the set of \ref RenderObject pointers that are mapped to a specific \ref Texture::Texture, or
-             * an empty set if there are none for the specified \ref Texture::Texture.
+             * Renders in two phases. The build phase refreshes the depth of every render item and sorts them, culls them,
+             * and fills draw commands, on up to \ref buildThreads() threads. The submit phase then sends the commands to
+             * the \ref Device in order, on the calling thread; texture first, then model, then front to back.
              *
-             * \param tex \ref Texture::Texture to use as a key
-             * \return a set of \ref RenderObject pointers
-             */
-            std::set<RenderObject*> &get(const Texture::Texture &tex) { return _data[tex]; }
-
-            //! Gets the set of \ref RenderObject pointers
-            /*!
-             * Retrieves the set of \ref RenderObject pointers that are mapped to a specific \ref Texture::Texture, or
-             * an empty set if there are none for the specified \ref Texture::Texture.
-             * Alias for \ref ::get().
+             * With \ref Renderer::instancing() enabled, RenderObjects sharing a \ref Model::Model, \ref Texture::Texture
+             * and level of detail are drawn with one instanced draw call; their model matrices are packed into a single
+             * instance buffer, uploaded once per call. Otherwise each RenderObject is drawn on its own.
              *
-             * \param tex \ref Texture::Texture to use as a key
-             * \return a set of \ref RenderObject pointers
-             * \sa get()
+             * \param renderer \ref Renderer object to render with
              */
-            std::set<RenderObject*> &operator[](const Texture::Texture &tex) { return _data[tex]; }
+            void render(const Renderer &renderer);
+
+            //! Get the number of \ref RenderObject "RenderObjects" in this collection, as of the last \ref ::flush()
+            size_t size() const { return _items.size() - _erased; }
+
+            //! Check if a \ref RenderObject is in this collection, or queued to be inserted
+            bool contains(RenderObject* object) const;
 
-            std::map<Texture::Texture, std::set<RenderObject*>>::iterator       begin()       { return _data.begin(); }
-            std::map<Texture::Texture, std::set<RenderObject*>>::const_iterator begin() const { return _data.begin(); }
-            std::map<Texture::Texture, std::set<RenderObject*>>::iterator       end()       { return _data.end(); }
-            std::map<Texture::Texture, std::set<RenderObject*>>::const_iterator end() const { return _data.end(); }
+            //! Get the results of the last \ref ::render()
+            const RenderStats &stats() const { return _stats; }
 
         protected:
-            std::map<Texture::Texture, std::set<RenderObject*>> _data;
-            std::set<RenderObject*> _queue_insert;
-            std::set<RenderObject*> _queue_erase;
-            size_t _uid;
+
+            // Key layout, most significant first: 24 bits of texture, 24 bits of model, 16 bits of depth
+            struct RenderItem {
+                uint64_t key;
+                RenderObject* object;
+                uint32_t slot;
+            };
+            struct RenderSlot {
+                RenderObject* object;
+                uint32_t item;
+                uint32_t generation;
+                bool erasing;
+            };
+            static const uint32_t NO_ITEM = 0xFFFFFFFF;
+
+            uint64_t staticKey(RenderObject* object);
+            void eraseSlot(uint32_t slot);
+            void sort(const Renderer &renderer);
+
+            std::vector<RenderItem> _items; // Sorted up to _sorted, then new items; erased items are left null until sorted
+            std::vector<RenderItem> _items_sorting;
+            size_t _sorted = 0;
+            size_t _erased = 0;
+            std::vector<RenderSlot> _slots;
+            std::vector<uint32_t> _free_slots;
+            std::unordered_map<RenderObject*, uint32_t> _slot_index;
+            std::vector<uint32_t> _queue_insert;
+            std::vector<uint32_t> _queue_erase;
+
+            // Guards everything above; each collection owns its own, behind a pointer to keep Boost out of this header
+            struct Lock;
+            Lock* _lock;
+
+            // Dense ids for the key; assigned on flush, so rendering never compares Textures or Models
+            std::map<Texture::Texture, uint32_t> _texture_ids;
+            std::vector<Texture::Texture> _textures;
+            std::map<Model::Model, uint32_t> _model_ids;
+
+            // Frustum culling; a bounding volume hierarchy over every bounded RenderObject, rebuilt after changes
+            struct CullTree;
+            bool cull(const Renderer &renderer);
+            bool visible(const RenderItem &item) const { return !_culling || _visible[item.slot] != 0; }
+
+            CullTree* _cull_tree = nullptr;
+            bool _cull_dirty = true;
+            bool _culling = false; // Whether the last render() culled
+            std::vector<uint8_t> _visible; // By slot
+            RenderStats _stats;
+
+            // Draw commands, filled by the build phase; one buffer per chunk of items, so read in chunk order they
+            // keep the items' sorted order
+            struct DrawCommand {
+                uint64_t key;
+                RenderObject* object; // Set for a RenderObject that renders itself
+                Model::Model* model;  // Set otherwise
+                uint32_t lod;
+                uint32_t matrix; // Offset in the buffer's matrices
+            };
+            struct CommandBuffer {
+                std::vector<DrawCommand> commands;
+                std::vector<SWMfloat> matrices;
+            };
+            void build(const Renderer &renderer);
+            void submit(const Renderer &renderer);
+            void submitInstanced(const Renderer &renderer);
+
+            std::vector<CommandBuffer> _commands;
+
+            // VAO of each model id in the current context, resolved before each submit so drawing looks nothing up
+            void resolveVAOs();
+            std::vector<SWMuint> _model_vaos;
+
+            // Instancing
+            struct InstanceDraw {
+                uint32_t texture;
+                Model::Model* model;
+                size_t lod;
+                size_t first;
+                size_t count;
+                RenderObject* object; //!< Set for a RenderObject that is not instanced, and renders itself
+                SWMuint vao;
+            };
+
+            std::vector<InstanceDraw> _instance_draws;
+            std::vector<std::pair<size_t, const SWMfloat*>> _instance_group; // Level of detail and matrix
+            std::vector<SWMfloat> _instance_data;
+            SWMuint _instance_buffer = 0;
         };
 
         //! Class-Enum used to represent GLenum Shader types.
@@ -1109,19 +1800,28 @@ namespace Swarm {
             //! Get the GLuint ID representing this linked shader Program.
             virtual SWMuint ID() const = 0;
 
-            //! Get the ID for a specified shader Uniform variable.
+            //! Get the location of a specified shader Uniform variable.
             /*!
-             * Scans the linked Program for the specified shader Uniform and returns its ID.
-             * If the Uniform is found, it is cached in an internal map for fast future lookup.
+             * Every active Uniform of the Program is reflected once, when it is linked, so this only looks up a map
+             * and never calls into OpenGL. The location stays valid for the life of the Program; code binding a
+             * Uniform for every object should look it up once and keep it, as \ref Renderer does.
+             *
+             * \param name name of the Uniform in the GLSL source
+             * \return location of the Uniform, or '-1' if the Program has no active Uniform by that name
              */
-            virtual SWMint uniform(const std::string &name) = 0;
+            virtual SWMint uniform(const std::string &name) const = 0;
 
-            //! Clears the Uniform Cache.
+            //! Get the number of active Uniforms reflected from this Program
+            virtual size_t uniformCount() const = 0;
+
+            //! Get the layout of a uniform block, reflected when the Program was linked
             /*!
-             * Clears the internal map used for caching Uniforms. Should be done once in the beginning of each
-             * render cycle. Usually done in the start phase of a \ref Renderer;
+             * Every block is given its own binding point at link time.
+             *
+             * \param name name of the block in the GLSL source
+             * \return the block, or nullptr if the Program has no active block by that name
              */
-            virtual void clearUniformCache() = 0;
+            virtual const UniformBlock* uniformBlock(const std::string &name) const = 0;
 
             static Program* compile(Shader* shaders[], size_t count);
 
@@ -1136,8 +1836,8 @@ namespace Swarm {
                 float y;
                 float z;
                 #if defined(SWARM_INCLUDE_GLM)
-                CPos &operator=(const glm::vec3 &rhs) { x = rhs.x; y = rhs.y; z = rhs.z; }
-                CPos &operator=(const CPos &rhs) { x = rhs.x; y = rhs.y; z = rhs.z; }
+                CPos &operator=(const glm::vec3 &rhs) { x = rhs.x; y = rhs.y; z = rhs.z; return *this; }
+                CPos &operator=(const CPos &rhs) { x = rhs.x; y = rhs.y; z = rhs.z; return *this; }
                 operator glm::vec3() const { return glm::vec3(x, y, z); }
                 glm::vec3 vec() const { return glm::vec3(x, y, z); }
                 #endif
@@ -1284,17 +1984,103 @@ namespace Swarm {
             virtual void setUniformName(MatrixUniformType type, const std::string &name) = 0;
             virtual std::string uniformName(MatrixUniformType type) const = 0;
 
+            //! Get the location of a matrix Uniform in this Renderer's \ref Program; resolved when its name is set
+            virtual SWMint uniformLocation(MatrixUniformType type) const = 0;
+
             virtual void setTextureName(SWMuint active, const std::string &name) = 0;
             virtual void setTextureName(const Texture::Type::MapType &type, const std::string &name) = 0;
             virtual std::string textureName(SWMuint active) const = 0;
             virtual std::string textureName(const Texture::Type::MapType &type) const = 0;
 
+            //! Get the location of a texture Uniform in this Renderer's \ref Program, or '-1' if it has none
+            virtual SWMint textureLocation(SWMuint active) const = 0;
+
             virtual void insertUniform(Uniform &uniform) = 0;
 
             virtual void bindUniformsMatrix(const Window &window) const = 0;
+            #if defined(SWARM_INCLUDE_GLM)
+            //! Bind the given view and projection matrices, as \ref bindUniformsMatrix(const Window&) does for a Window
+            virtual void bindUniformsMatrix(const glm::mat4 &view, const glm::mat4 &projection, int height) const = 0;
+            #endif
             virtual void bindUniformsTexture() const = 0;
             virtual void bindUniformsCustom() const = 0;
 
+            //! Bind this Renderer's range of the buffer filled by the last \ref uploadUniformBlocks()
+            virtual void bindUniformsBlock() const = 0;
+
+            //! Set the name of the uniform block that holds per-frame data; "SwarmFrame" by default
+            /*!
+             * If this Renderer's \ref Program declares the block, its members are filled once per frame by
+             * \ref uploadUniformBlocks() instead of being set one by one. Members named after the \ref VIEW and
+             * \ref PROJECTION uniforms receive the camera matrices, and members named after an inserted \ref Uniform
+             * receive its value, with std140 layout.
+             */
+            virtual void setUniformBlockName(const std::string &name) = 0;
+            virtual std::string uniformBlockName() const = 0;
+
+            //! Check if this Renderer's \ref Program declares its frame uniform block
+            virtual bool hasUniformBlock() const = 0;
+
+            //! Attribute location of the per-instance model matrix; a mat4, so it takes locations 8 through 11
+            enum { INSTANCE_MATRIX_ATTRIB = 8 };
+
+            //! Draw \ref RenderObjectCollection "RenderObjectCollections" with instanced draw calls
+            /*!
+             * Off by default. When enabled, the \ref Program must read the model matrix from a mat4 vertex attribute
+             * at \ref INSTANCE_MATRIX_ATTRIB, rather than from the \ref MODEL uniform. \ref RenderObject "RenderObjects"
+             * that do not support instancing still render themselves, and still receive the \ref MODEL uniform.
+             *
+             * \sa RenderObject::instance()
+             */
+            virtual void setInstancing(bool instancing) = 0;
+            virtual bool instancing() const = 0;
+
+            //! Skip \ref RenderObject "RenderObjects" outside the view frustum when rendering collections
+            /*!
+             * On by default. Culling only happens once view and projection matrices have been bound, and only
+             * affects \ref RenderObject "RenderObjects" that report \ref RenderObject::bounds().
+             *
+             * \sa RenderObjectCollection::stats()
+             */
+            virtual void setCulling(bool culling) = 0;
+            virtual bool culling() const = 0;
+
+            //! Get the view frustum of the matrices last bound by \ref bindUniformsMatrix()
+            /*!
+             * Writes six planes; left, right, bottom, top, near, far. Each is four floats (a, b, c, d), normalized and
+             * facing inwards, so a point p is inside when a*p.x + b*p.y + c*p.z + d >= 0 for every plane.
+             *
+             * \param planes receives the planes; 24 floats
+             * \return false if no matrices have been bound yet
+             */
+            virtual bool frustum(SWMfloat* planes) const = 0;
+
+            //! Set the largest on-screen error, in pixels, that level of detail selection may introduce
+            virtual void setLODThreshold(float pixels) = 0;
+            virtual float lodThreshold() const = 0;
+
+            #if defined(SWARM_INCLUDE_GLM)
+            //! Get the on-screen radius, in pixels, of a world-space sphere
+            /*!
+             * Uses the view and projection last bound by \ref bindUniformsMatrix(). Returns infinity if no
+             * matrices have been bound yet, or if the camera is inside the sphere.
+             *
+             * \param center world-space center of the sphere
+             * \param radius world-space radius of the sphere
+             * \return projected radius in pixels
+             */
+            virtual float projectedRadius(const glm::vec3 &center, float radius) const = 0;
+
+            //! Get the distance of a world-space point in front of the camera
+            /*!
+             * Uses the view last bound by \ref bindUniformsMatrix(). Returns '0' if no matrices have been bound yet.
+             *
+             * \param point world-space point
+             * \return view-space depth; negative behind the camera
+             */
+            virtual float viewDepth(const glm::vec3 &point) const = 0;
+            #endif
+
             static Renderer* create(Program* program);
 
         private:
@@ -1302,5 +2088,16 @@ namespace Swarm {
             friend class RendererInternal;
         };
 
+        #if defined(SWARM_INCLUDE_GLM)
+        //! Fill the frame uniform blocks of the given \ref Renderer "Renderers", and upload them all at once
+        /*!
+         * Each block is packed into a linear arena that is reset every frame, aligned for binding as a buffer range,
+         * and the whole arena goes up in a single upload. Each Renderer then binds its own range with
+         * \ref Renderer::bindUniformsBlock(). Called by the render thread for every Window, after
+         * \ref flushUniforms(); only needs calling manually when rendering without a Window.
+         */
+        void uploadUniformBlocks(const std::vector<const Renderer*> &renderers, const glm::mat4 &view, const glm::mat4 &projection);
+        #endif
+
     }
 }
\ No newline at end of file
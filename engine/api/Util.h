@@ -12,9 +12,14 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cstring>
+#include <functional>
 #include <iostream>
+#include <mutex>
 #include <set>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 
 
@@ -30,14 +35,45 @@ namespace Swarm {
         }
         #endif
 
+        //! Pool of IDs, safe to take from and give back to on any thread without locking
+        /*!
+         * An ID is a slot index in the low 32 bits, and that slot's generation in the high 32 bits. Freeing an ID
+         * bumps its slot's generation, so a stale ID never matches the ID its slot is handed out as next; freeing it
+         * again does nothing. Free slots form a list threaded through a flat array of slots, so both next() and
+         * free() are constant time, and never allocate once the pool has grown to its peak.
+         */
         class UIDPool {
         public:
+            UIDPool();
+            UIDPool(const UIDPool &other) = delete;
+            UIDPool &operator=(const UIDPool &other) = delete;
+            ~UIDPool();
+
+            //! Take an ID that no other live ID equals; never '0'
             size_t next();
-            void free(size_t id);
+
+            //! Give back 'id'; false if it is not live, i.e. already freed or from before \ref freeAll()
+            bool free(size_t id);
+
+            //! Whether 'id' was handed out by \ref next() and not freed since
+            bool valid(size_t id) const;
+
+            //! Free every ID at once; not safe while other threads use this pool
             void freeAll();
+
+            //! Slot index of 'id', unique among live IDs; for indexing flat arrays by ID
+            static size_t index(size_t id) { return id & 0xFFFFFFFF; }
+
         protected:
-            size_t _next = 0;
-            std::set<size_t> _free_ids;
+            struct Slot;
+            static const size_t SEGMENTS = 26; // Segment 'k' holds 64 << k slots, for up to 2^32 slots all told
+            static const uint32_t NO_SLOT = 0xFFFFFFFF;
+
+            Slot* slot(uint32_t index) const;
+
+            std::atomic<Slot*> _segments[SEGMENTS];
+            std::atomic<size_t> _next{0};        // Slots ever handed out
+            std::atomic<uint64_t> _free_head;    // Change count in the high 32 bits, against ABA; first free slot in the low
         };
 
         class DeltaTimeController {
@@ -48,7 +84,141 @@ namespace Swarm {
             double _last_time;
         };
 
-        template<typename T> class BufferData;
+        //! Number of trailing zero bits in 'bits'; 64 when there are none set
+        inline unsigned int ctz(uint64_t bits) {
+            if(bits == 0) return 64;
+            #if defined(__GNUC__)
+            return (unsigned int)__builtin_ctzll(bits);
+            #else
+            unsigned int count = 0;
+            while(!(bits & 1)) { bits >>= 1; count++; }
+            return count;
+            #endif
+        }
+
+        //! Paces a loop to a target rate, and keeps timings of its frames
+        /*!
+         * Frames are due a fixed period apart, rather than a period after the last one ended, so a rate holds however
+         * long each frame works for; a loop that falls more than a frame behind starts afresh instead of rushing to
+         * catch up. Waits sleep for all but a margin, then yield out the rest; the margin follows how late sleeps have
+         * been waking, so waits stay precise without spinning for long. Only the paced thread may call \ref pace();
+         * anything else may be called from any thread.
+         */
+        class FramePacer {
+        public:
+            FramePacer(double rate = 0.0);
+
+            //! Set the target rate, in frames a second; '0' does not wait at all
+            void setRate(double rate) { _rate = rate; }
+            double rate() const { return _rate; }
+
+            //! Wait until the next frame is due, then start it
+            /*!
+             * \return seconds between the start of the last frame and this one
+             */
+            double pace();
+
+            //! Average milliseconds from the start of one frame to the start of the next
+            double frameTime() const { return _frame_ms; }
+            //! Average milliseconds by which frame times differ from that average
+            double jitter() const { return _jitter_ms; }
+            //! Average share of each frame spent outside of \ref pace(), from 0 to 1
+            double utilization() const { return _utilization; }
+            size_t frames() const { return _frames; }
+
+        protected:
+            typedef std::chrono::steady_clock Clock;
+
+            std::atomic<double> _rate;
+            Clock::time_point _frame_start;
+            Clock::time_point _deadline;
+            double _sleep_margin = 0.001; // Seconds
+
+            std::atomic<double> _frame_ms{0.0};
+            std::atomic<double> _jitter_ms{0.0};
+            std::atomic<double> _utilization{0.0};
+            std::atomic<size_t> _frames{0};
+        };
+
+        // ******
+        //  Jobs
+        // ******
+
+        class JobCounter;
+
+        //! Start the job worker threads
+        /*!
+         * Called by \ref Core::init(). Each worker keeps its own work-stealing deque; jobs queued from a worker go onto
+         * its deque, and idle workers steal from the others. Jobs queued from any other thread go through one shared
+         * queue. A worker waiting on a \ref JobCounter runs the queued jobs it counts meanwhile; waiting never runs
+         * unrelated jobs, as the waiter may be holding locks they need.
+         *
+         * \param workers number of worker threads; '0' uses one less than the hardware thread count, and at least one
+         */
+        void startJobs(unsigned int workers = 0);
+
+        //! Run every queued job, then join the job worker threads
+        /*!
+         * Called by \ref Core::cleanup(); no other thread may queue or wait on jobs meanwhile.
+         */
+        void stopJobs();
+
+        //! Get the number of job worker threads running
+        unsigned int jobWorkers();
+
+        //! Queue a job to run on any worker; 'counter', if given, counts it until it has finished
+        void runJob(const std::function<void()> &job, JobCounter* counter = nullptr);
+
+        //! Queue a job once every job 'after' counts has finished; 'counter', if given, counts it from now
+        void runJobAfter(JobCounter &after, const std::function<void()> &job, JobCounter* counter = nullptr);
+
+        //! Queue a job to run on the main thread, for work bound to its GL context or to GLFW
+        /*!
+         * The main thread is the one that called \ref startJobs(); it runs these jobs in \ref runMainThreadJobs(), or
+         * while it waits on the \ref JobCounter that counts them.
+         */
+        void runMainThreadJob(const std::function<void()> &job, JobCounter* counter = nullptr);
+
+        //! Run the jobs queued for the main thread; called every frame by \ref Core::start()
+        /*!
+         * \return the number of jobs run; '0' when not called from the main thread
+         */
+        size_t runMainThreadJobs();
+
+        //! Call func(begin, end) over consecutive ranges of [0, count), in parallel, and return once all have returned
+        /*!
+         * Ranges are handed out a 'grain' at a time, so uneven work evens out; the calling thread runs ranges too, and
+         * runs nothing else while it waits for the last ones. If func throws, every range is still run, and the
+         * first exception is rethrown on the calling thread once they have all returned.
+         *
+         * \param grain size of each range; '0' picks one that gives each thread a few ranges
+         * \param max_threads most threads to run on, including the calling one; '0' allows every worker
+         */
+        void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &func,
+                         unsigned int max_threads = 0);
+
+        //! Counts queued jobs that have not yet finished
+        class JobCounter {
+        public:
+            JobCounter() { /* NOOP */ }
+            JobCounter(const JobCounter &other) = delete;
+            JobCounter &operator=(const JobCounter &other) = delete;
+
+            //! Waits, as jobs still counted would finish into a counter that is gone
+            ~JobCounter() { wait(); }
+
+            bool done() const { return _pending == 0; }
+
+            //! Wait until every counted job has finished, running counted jobs still queued meanwhile
+            void wait();
+
+        protected:
+            friend struct JobQueue;
+
+            std::atomic<size_t> _pending{0};
+            std::mutex _after_mutex;
+            std::vector<std::function<void()>> _after; // Queued once _pending drops to '0'
+        };
 
         template<typename T> class ReadWriteBuffer;
         template<typename T> class BufferData;
@@ -57,45 +227,94 @@ namespace Swarm {
         private:
             template<typename T> friend class ReadWriteBuffer;
             ReadWriteBufferBase();
+            ReadWriteBufferBase(const ReadWriteBufferBase &other) = delete;
+            ReadWriteBufferBase &operator=(const ReadWriteBufferBase &other) = delete;
             virtual ~ReadWriteBufferBase();
         protected:
             template<typename T> friend class BufferData;
             void lock();
             void unlock();
-            void lock_shared();
-            void unlock_shared();
-            void lock_shared_explicit();
-            void unlock_shared_explicit();
-            size_t _uid;
+
+            // Each buffer owns its write lock; behind a pointer to keep 3rd party libraries out of this header
+            struct WriteLock;
+            WriteLock* _write_lock;
         public:
             #if defined(SWARM_BOOST_AVAILABLE)
             boost::mutex& write_mutex() const;
-            boost::shared_mutex& read_mutex() const;
             #endif
         };
 
+        //! Buffer of values written by any thread, and read by any thread as of the last flush()
+        /*!
+         * Writers change a back buffer under a lock. flush() copies it into one of three snapshots and publishes that
+         * snapshot with an atomic index swap; readers take whichever snapshot is published without locking, so they
+         * never block, and never see a flush half done. A snapshot is only reused once its last reader has left, so
+         * flush() only waits on a reader that has outlasted two flushes.
+         *
+         * Each snapshot keeps a bitmap of the slots written since it was last filled, so flush() copies only runs of
+         * changed slots instead of the whole buffer; a mostly static buffer flushes in next to no time.
+         */
         template<typename T> class ReadWriteBuffer : public ReadWriteBufferBase {
         protected:
             friend class BufferData<T>;
+
+            struct Snapshot {
+                std::vector<T> values;
+                size_t flush = 0; // Number of the flush that published it
+                std::atomic<unsigned int> readers{0};
+                std::vector<uint64_t> dirty; // One bit per slot written since this was last filled
+            };
+
             std::vector<T> _buffer_write;
-            T* _buffer_read = nullptr;
-            std::set<size_t> _free_indices;
-            size_t _next_index = 0;
+            Snapshot _snapshots[3];
+            std::atomic<unsigned int> _latest{0};
+            size_t _flushes = 0;
+            std::vector<size_t> _free_indices;
             size_t _max_capacity = 0;
+            std::atomic<size_t> _flushed_bytes{0};
+
+            // Every snapshot is behind on a written slot until it is next filled; only under lock()
+            void markDirty(size_t index) {
+                size_t word = index / 64;
+                uint64_t bit = (uint64_t)1 << (index % 64);
+                for(Snapshot &snapshot : _snapshots) {
+                    if(snapshot.dirty.size() <= word) snapshot.dirty.resize(std::max(word + 1, snapshot.dirty.size() * 2), 0);
+                    snapshot.dirty[word] |= bit;
+                }
+            }
+
+            // Join the published snapshot; it is not reused until release()
+            Snapshot &acquire() {
+                while(true) {
+                    unsigned int latest = _latest;
+                    Snapshot &snapshot = _snapshots[latest];
+                    snapshot.readers++;
+                    if(_latest == latest) return snapshot;
+                    snapshot.readers--;
+                }
+            }
+
+            void release(Snapshot &snapshot) { snapshot.readers--; }
+
+            // Either snapshot that is not published, once no reader is left on it; only flush() publishes, under lock()
+            Snapshot &back() {
+                unsigned int latest = _latest;
+                while(true) {
+                    for(unsigned int i = 1; i < 3; i++)
+                        if(_snapshots[(latest + i) % 3].readers == 0) return _snapshots[(latest + i) % 3];
+                    std::this_thread::yield();
+                }
+            }
+
         public:
             ReadWriteBuffer() : ReadWriteBufferBase() { /* NOOP */ }
-            ReadWriteBuffer(size_t capacity) : ReadWriteBufferBase(),
-                                               _buffer_write(capacity),
-                                               _max_capacity(capacity) {
-                _buffer_read = new T[capacity];
+            ReadWriteBuffer(size_t capacity) : ReadWriteBufferBase(), _max_capacity(capacity) {
+                _buffer_write.reserve(capacity);
             }
 
-            virtual ~ReadWriteBuffer() {
-                _buffer_write.clear();
-                if(_buffer_read != nullptr) delete [] _buffer_read;
-            }
+            virtual ~ReadWriteBuffer() { /* NOOP */ }
 
-            size_t capacity() const { return _buffer_write.size(); }
+            size_t capacity() const { return _max_capacity > 0 ? _max_capacity : _buffer_write.capacity(); }
             size_t size() const { return _buffer_write.size() - _free_indices.size(); }
 
             void reserve(size_t capacity) {
@@ -103,53 +322,55 @@ namespace Swarm {
                 // Can only grow, not shrink
                 if(capacity < _max_capacity || capacity < _buffer_write.size()) return;
 
-                // Lock
                 lock();
-                lock_shared_explicit();
-
-                // Resize and Flush
                 if(_max_capacity != 0) _max_capacity = capacity;
-                _buffer_write.resize(capacity);
-                if(_buffer_read != nullptr) delete [] _buffer_read;
-                _buffer_read = new T[capacity];
-                std::memcpy(_buffer_read, _buffer_write.data(), sizeof(T) * _buffer_write.size());
-
-                // Unlock
+                _buffer_write.reserve(capacity);
                 unlock();
-                unlock_shared_explicit();
             }
 
             void flush() {
-
-                // Lock
                 lock();
-                lock_shared_explicit();
-
-                // Flush
-                if(_buffer_read != nullptr) delete [] _buffer_read;
-                _buffer_read = new T[_buffer_write.size()];
-                std::memcpy(_buffer_read, _buffer_write.data(), sizeof(T) * _buffer_write.size());
+                Snapshot &target = back();
+                if(target.values.size() < _buffer_write.size()) target.values.resize(_buffer_write.size());
+
+                // Copy each run of dirty slots in one go, skipping clean words whole
+                size_t copied = 0;
+                for(size_t word = 0; word < target.dirty.size(); word++) {
+                    uint64_t bits = target.dirty[word];
+                    target.dirty[word] = 0;
+                    while(bits != 0) {
+                        unsigned int first = ctz(bits);
+                        unsigned int length = ctz(~(bits >> first));
+                        if(first + length > 64) length = 64 - first;
+                        size_t begin = word * 64 + first;
+                        std::copy(_buffer_write.begin() + begin, _buffer_write.begin() + begin + length,
+                                  target.values.begin() + begin);
+                        copied += length;
+                        bits = first + length < 64 ? bits & (~(uint64_t)0 << (first + length)) : 0;
+                    }
+                }
 
-                // Unlock
+                target.flush = ++_flushes;
+                _latest = (unsigned int)(&target - _snapshots);
+                _flushed_bytes = copied * sizeof(T);
                 unlock();
-                unlock_shared_explicit();
             }
 
-            void printBuffers() {
+            //! Bytes copied by the last \ref flush()
+            size_t flushedBytes() const { return _flushed_bytes; }
 
-                // Lock
+            void printBuffers() {
                 lock();
-                lock_shared_explicit();
+                Snapshot &snapshot = acquire();
 
                 std::cout << "Size of Buffer: " << _buffer_write.size() << std::endl;
-                for(int i = 0; i < _buffer_write.size(); i++) {
+                for(size_t i = 0; i < _buffer_write.size(); i++) {
                     std::cout << "[Write-" << i << "] " << _buffer_write[i] << std::endl;
-                    std::cout << "[Read -" << i << "] " << _buffer_read[i]  << std::endl;
+                    if(i < snapshot.values.size()) std::cout << "[Read -" << i << "] " << snapshot.values[i] << std::endl;
                 }
 
-                // Unlock
+                release(snapshot);
                 unlock();
-                unlock_shared_explicit();
             }
         };
 
@@ -157,43 +378,35 @@ namespace Swarm {
         protected:
             ReadWriteBuffer<T> &_buffer;
             size_t _index;
+            size_t _flush; // Flushes done before this was created; every later one has its value
+            T _initial;    // Read until then
 
         public:
-            BufferData(ReadWriteBuffer<T> &buffer, const T &val = T()) : _buffer(buffer) {
-
-                // Lock
+            BufferData(ReadWriteBuffer<T> &buffer, const T &val = T()) : _buffer(buffer), _initial(val) {
                 _buffer.lock();
-                _buffer.lock_shared_explicit();
-
-                // Get the next free Index
-                if(_buffer._free_indices.empty()) {
-                    if(_buffer._max_capacity > 0 && _buffer._next_index >= _buffer._max_capacity) throw std::out_of_range("ReadWriteBuffer at maximum capacity");
-                    else {
-                        _index = _buffer._next_index++;
-                        if(_buffer._max_capacity == 0) {
-                            _buffer._buffer_write.resize(_buffer._next_index);
-
-                            // Recreate read buffer
-                            if(_buffer._buffer_read != nullptr) delete [] _buffer._buffer_read;
-                            _buffer._buffer_read = new T[_buffer._buffer_write.size()];
-                        }
-                    }
+
+                // Reuse a free Index, or append one; either way amortized constant time
+                if(!_buffer._free_indices.empty()) {
+                    _index = _buffer._free_indices.back();
+                    _buffer._free_indices.pop_back();
+                    _buffer._buffer_write[_index] = val;
+                } else if(_buffer._max_capacity > 0 && _buffer._buffer_write.size() >= _buffer._max_capacity) {
+                    _buffer.unlock();
+                    throw std::out_of_range("ReadWriteBuffer at maximum capacity");
                 } else {
-                    _index = *_buffer._free_indices.begin();
-                    _buffer._free_indices.erase(_buffer._free_indices.begin());
+                    _index = _buffer._buffer_write.size();
+                    _buffer._buffer_write.push_back(val);
                 }
+                _buffer.markDirty(_index);
+                _flush = _buffer._flushes;
 
-                // Add value and flush
-                _buffer._buffer_write[_index] = val;
-                std::memcpy(_buffer._buffer_read, _buffer._buffer_write.data(), sizeof(T) * _buffer._buffer_write.size());
-
-                // Unlock
                 _buffer.unlock();
-                _buffer.unlock_shared_explicit();
             }
 
             ~BufferData() {
-                _buffer._free_indices.insert(_index);
+                _buffer.lock();
+                _buffer._free_indices.push_back(_index);
+                _buffer.unlock();
             }
 
             size_t index() { return _index; }
@@ -201,13 +414,14 @@ namespace Swarm {
             void set(const T &val) {
                 _buffer.lock();
                 _buffer._buffer_write[_index] = val;
+                _buffer.markDirty(_index);
                 _buffer.unlock();
             }
 
             T get() const {
-                _buffer.lock_shared();
-                T val = _buffer._buffer_read[_index];
-                _buffer.unlock_shared();
+                typename ReadWriteBuffer<T>::Snapshot &snapshot = _buffer.acquire();
+                T val = snapshot.flush > _flush ? snapshot.values[_index] : _initial;
+                _buffer.release(snapshot);
                 return val;
             }
 
@@ -224,9 +438,16 @@ namespace Swarm {
             operator T() { return get(); }
 
             #if defined(SWARM_BOOST_AVAILABLE)
-            void set(const T &val, boost::lock_guard<boost::mutex>&) { _buffer._buffer_write[_index] = val; }
-            T get(boost::shared_lock<boost::shared_mutex>&) const { return _buffer._buffer_read[_index]; }
-            T &getWriteAccess(boost::lock_guard<boost::mutex>&) { return _buffer._buffer_write[_index]; }
+            void set(const T &val, boost::lock_guard<boost::mutex>&) {
+                _buffer._buffer_write[_index] = val;
+                _buffer.markDirty(_index);
+            }
+
+            // The slot counts as written whether or not the reference is written through
+            T &getWriteAccess(boost::lock_guard<boost::mutex>&) {
+                _buffer.markDirty(_index);
+                return _buffer._buffer_write[_index];
+            }
             #endif
 
         };
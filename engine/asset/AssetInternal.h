@@ -0,0 +1,134 @@
+#pragma once
+
+#define SWARM_INCLUDE_GLM
+#define SWARM_BOOST_AVAILABLE
+#include "api/Asset.h"
+
+#include <boost/thread.hpp>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+
+
+// ************
+//  Code Begin
+// ************
+
+namespace Swarm {
+    namespace Asset {
+
+        class AssetEntry : public std::enable_shared_from_this<AssetEntry> {
+        public:
+            AssetEntry(const std::string &path) : _path(path), _state(LOADING), _handles(0) {}
+            virtual ~AssetEntry();
+
+            const std::string &path() const { return _path; }
+            State state() const;
+            std::string error() const;
+
+            void wait();
+
+            //! Worker thread stage; parses or decodes the file, returning the number of bytes that will be uploaded
+            virtual size_t decode() = 0;
+
+            //! GL thread stage; uploads the decoded data, then releases it
+            virtual void upload() = 0;
+
+            //! Key identifying assets of this kind and options with the given file content hash
+            virtual std::string contentKey(unsigned long long hash) const = 0;
+
+            void setState(State state);
+            void fail(const std::string &error);
+
+            size_t uploadSize() const { return _upload_size; }
+            void setUploadSize(size_t size) { _upload_size = size; }
+
+            //! Bytes this entry keeps alive; aliases and unfinished entries count nothing
+            size_t memorySize() const;
+
+            //! Make this entry share another entry's data, after finding the same file content under another path
+            void setAlias(const std::shared_ptr<AssetEntry> &canonical);
+
+            //! Get the entry that actually holds this entry's data; itself unless aliased
+            std::shared_ptr<AssetEntry> resolve();
+
+            // Count of Handles referring to this entry (plus aliases referring to it); the cache only evicts at zero
+            void acquireHandle() { _handles++; }
+            void releaseHandle() { _handles--; }
+            size_t handles() const { return _handles; }
+
+        protected:
+            std::shared_ptr<AssetEntry> alias() const;
+
+            std::string _path;
+            std::atomic<State> _state;
+            std::atomic<size_t> _handles;
+            std::string _error;
+            size_t _upload_size = 0;
+            std::shared_ptr<AssetEntry> _alias;
+
+            mutable boost::mutex _mutex;
+            boost::condition_variable _cond;
+        };
+
+        class TextureEntry : public AssetEntry {
+        public:
+            TextureEntry(const std::string &path, Texture::FileType type) : AssetEntry(path), _type(type) {}
+            virtual ~TextureEntry();
+
+            virtual size_t decode();
+            virtual void upload();
+            virtual std::string contentKey(unsigned long long hash) const;
+
+            //! Decoded pixels, until uploaded; guarded by the entry's mutex, so readers keep their snapshot past upload
+            std::shared_ptr<const Texture::RawTextureData> data() const;
+            const Texture::TexMap &texture() const { return _texture; }
+
+        protected:
+            Texture::FileType _type;
+            std::shared_ptr<const Texture::RawTextureData> _data;
+            Texture::TexMap _texture;
+        };
+
+        class ModelEntry : public AssetEntry {
+        public:
+            ModelEntry(const std::string &path, unsigned int optimize_flags) : AssetEntry(path), _optimize_flags(optimize_flags) {}
+            virtual ~ModelEntry();
+
+            virtual size_t decode();
+            virtual void upload();
+            virtual std::string contentKey(unsigned long long hash) const;
+
+            //! Parsed data, until uploaded; guarded by the entry's mutex, so readers keep their snapshot past upload
+            std::shared_ptr<const Model::RawModelDataIndexed> data() const;
+            const Model::Model &model() const { return _model; }
+
+        protected:
+            unsigned int _optimize_flags;
+            std::shared_ptr<const Model::RawModelDataIndexed> _data;
+            Model::Model _model;
+        };
+
+        //! Queue GL work to run on the next \ref processUploads(); used to free the GL objects of destroyed entries
+        void queueRelease(const std::function<void()> &release);
+
+        // *******
+        //  Cache
+        // *******
+
+        //! Find the entry cached under 'key', or create, cache and return a new one; 'created' reports which happened
+        std::shared_ptr<AssetEntry> cacheAcquire(const std::string &key,
+                                                 const std::function<std::shared_ptr<AssetEntry>()> &create,
+                                                 bool &created);
+
+        //! Find another live entry with the given content key, or register 'entry' as the owner of that content
+        std::shared_ptr<AssetEntry> cacheFindContent(const std::string &content_key, const std::shared_ptr<AssetEntry> &entry);
+
+        //! Evict unreferenced entries, least recently used first, until the cache fits its budget
+        void cacheEnforceBudget();
+
+        void cacheClear();
+
+    }
+}
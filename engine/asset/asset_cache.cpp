@@ -0,0 +1,150 @@
+#include "AssetInternal.h"
+
+#include "api/Logging.h"
+
+#include <list>
+#include <unordered_map>
+
+using namespace Swarm::Logging;
+
+namespace Swarm {
+    namespace Asset {
+
+        struct CacheSlot {
+            std::shared_ptr<AssetEntry> entry;
+            std::list<std::string>::iterator lru;
+        };
+
+        boost::mutex _static_cache_mutex;
+        std::unordered_map<std::string, CacheSlot> _static_cache;
+        std::list<std::string> _static_cache_lru; // Most recently used first
+        std::unordered_map<std::string, std::weak_ptr<AssetEntry>> _static_cache_content;
+        CacheStats _static_cache_stats;
+        size_t _static_cache_budget = 256 * 1024 * 1024;
+
+        std::shared_ptr<AssetEntry> cacheAcquire(const std::string &key,
+                                                 const std::function<std::shared_ptr<AssetEntry>()> &create,
+                                                 bool &created) {
+            std::shared_ptr<AssetEntry> replaced; // Destroyed after the lock is released
+            boost::lock_guard<boost::mutex> lock(_static_cache_mutex);
+            auto iter = _static_cache.find(key);
+            if(iter != _static_cache.end()) {
+                _static_cache_lru.splice(_static_cache_lru.begin(), _static_cache_lru, iter->second.lru);
+
+                // Failed loads are retried, in case the file has since appeared or been fixed
+                if(iter->second.entry->state() != FAILED) {
+                    _static_cache_stats.hits++;
+                    created = false;
+                    return iter->second.entry;
+                }
+                replaced = iter->second.entry;
+                iter->second.entry = create();
+            } else {
+                _static_cache_lru.push_front(key);
+                CacheSlot slot = { create(), _static_cache_lru.begin() };
+                iter = _static_cache.insert(std::make_pair(key, slot)).first;
+            }
+            _static_cache_stats.misses++;
+            created = true;
+            return iter->second.entry;
+        }
+
+        std::shared_ptr<AssetEntry> cacheFindContent(const std::string &content_key, const std::shared_ptr<AssetEntry> &entry) {
+            boost::lock_guard<boost::mutex> lock(_static_cache_mutex);
+            std::weak_ptr<AssetEntry> &owner = _static_cache_content[content_key];
+            std::shared_ptr<AssetEntry> canonical = owner.lock();
+            if(canonical && canonical != entry && canonical->state() != FAILED) {
+                _static_cache_stats.content_hits++;
+                return canonical;
+            }
+            owner = entry;
+            return std::shared_ptr<AssetEntry>();
+        }
+
+        // Entries that are unreferenced and decoded may be evicted; an evicted entry still waiting for upload is
+        // dropped by processUploads(). Aliases count no bytes, but pin their canonical entry until they are evicted
+        // themselves, so passes repeat while they make progress. With 'everything', ignores the budget.
+        void evict(size_t budget, bool everything) {
+            size_t evicted = 0;
+            {
+                boost::lock_guard<boost::mutex> lock(_static_cache_mutex);
+                size_t bytes = 0;
+                for(auto && iter : _static_cache) bytes += iter.second.entry->memorySize();
+
+                bool progress = true;
+                while(progress && (everything || bytes > budget)) {
+                    progress = false;
+                    auto key = _static_cache_lru.end();
+                    while((everything || bytes > budget) && key != _static_cache_lru.begin()) {
+                        --key;
+                        auto slot = _static_cache.find(*key);
+                        const std::shared_ptr<AssetEntry> &entry = slot->second.entry;
+                        if(entry->handles() > 0 || entry->state() == LOADING) continue;
+
+                        bytes -= entry->memorySize();
+                        _static_cache.erase(slot);
+                        key = _static_cache_lru.erase(key);
+                        evicted++;
+                        progress = true;
+                    }
+                }
+
+                for(auto iter = _static_cache_content.begin(); iter != _static_cache_content.end();) {
+                    if(iter->second.expired()) iter = _static_cache_content.erase(iter);
+                    else ++iter;
+                }
+                _static_cache_stats.evictions += evicted;
+            }
+            if(evicted > 0) Log::log_asset(DEBUG) << "Evicted " << (unsigned long)evicted << " cached assets";
+        }
+
+        void cacheEnforceBudget() {
+            size_t budget;
+            {
+                boost::lock_guard<boost::mutex> lock(_static_cache_mutex);
+                budget = _static_cache_budget;
+            }
+            evict(budget, false);
+        }
+
+        void cacheClear() {
+            std::unordered_map<std::string, CacheSlot> cache;
+            boost::lock_guard<boost::mutex> lock(_static_cache_mutex);
+            cache.swap(_static_cache);
+            _static_cache_lru.clear();
+            _static_cache_content.clear();
+        }
+
+        CacheStats cacheStats() {
+            boost::lock_guard<boost::mutex> lock(_static_cache_mutex);
+            CacheStats stats = _static_cache_stats;
+            stats.entries = _static_cache.size();
+            stats.bytes = 0;
+            for(auto && iter : _static_cache) stats.bytes += iter.second.entry->memorySize();
+            return stats;
+        }
+
+        void resetCacheStats() {
+            boost::lock_guard<boost::mutex> lock(_static_cache_mutex);
+            _static_cache_stats = CacheStats();
+        }
+
+        void setCacheBudget(size_t bytes) {
+            {
+                boost::lock_guard<boost::mutex> lock(_static_cache_mutex);
+                _static_cache_budget = bytes;
+            }
+            evict(bytes, false);
+        }
+
+        size_t cacheBudget() {
+            boost::lock_guard<boost::mutex> lock(_static_cache_mutex);
+            return _static_cache_budget;
+        }
+
+        void trimCache() {
+            evict(0, true);
+        }
+
+    }
+}
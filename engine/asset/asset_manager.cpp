@@ -0,0 +1,446 @@
+#include "AssetInternal.h"
+
+#include "api/Logging.h"
+#include "api/Util.h"
+
+#include <cstdio>
+#include <exception>
+
+using namespace Swarm::Logging;
+
+namespace Swarm {
+    namespace Asset {
+
+        // *************
+        //  Asset Entry
+        // *************
+
+        AssetEntry::~AssetEntry() {
+            if(_alias) _alias->releaseHandle();
+        }
+
+        std::shared_ptr<AssetEntry> AssetEntry::alias() const {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            return _alias;
+        }
+
+        State AssetEntry::state() const {
+            std::shared_ptr<AssetEntry> canonical = alias();
+            return canonical ? canonical->state() : _state.load();
+        }
+
+        std::string AssetEntry::error() const {
+            std::shared_ptr<AssetEntry> canonical = alias();
+            if(canonical) return canonical->error();
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            return _error;
+        }
+
+        void AssetEntry::wait() {
+            {
+                boost::unique_lock<boost::mutex> lock(_mutex);
+                while(_state == LOADING && !_alias) _cond.wait(lock);
+            }
+            std::shared_ptr<AssetEntry> canonical = alias();
+            if(canonical) canonical->wait();
+        }
+
+        size_t AssetEntry::memorySize() const {
+            if(alias()) return 0;
+            State current = _state;
+            return current == UPLOADING || current == READY ? _upload_size : 0;
+        }
+
+        void AssetEntry::setAlias(const std::shared_ptr<AssetEntry> &canonical) {
+            canonical->acquireHandle();
+            {
+                boost::lock_guard<boost::mutex> lock(_mutex);
+                _alias = canonical;
+            }
+            _cond.notify_all();
+        }
+
+        std::shared_ptr<AssetEntry> AssetEntry::resolve() {
+            std::shared_ptr<AssetEntry> canonical = alias();
+            return canonical ? canonical : shared_from_this();
+        }
+
+        void AssetEntry::setState(State state) {
+            {
+                boost::lock_guard<boost::mutex> lock(_mutex);
+                _state = state;
+            }
+            _cond.notify_all();
+        }
+
+        void AssetEntry::fail(const std::string &error) {
+            {
+                boost::lock_guard<boost::mutex> lock(_mutex);
+                _error = error;
+                _state = FAILED;
+            }
+            _cond.notify_all();
+            Log::log_asset(ERR) << "Failed to load '" << _path << "': " << error;
+        }
+
+        TextureEntry::~TextureEntry() {
+            Texture::TexMap texture = _texture;
+            if(texture.id() != 0) queueRelease([texture]() { Texture::unloadTex(texture); });
+        }
+
+        std::string TextureEntry::contentKey(unsigned long long hash) const {
+            return "T" + std::to_string((int)_type) + ":" + std::to_string(hash);
+        }
+
+        std::shared_ptr<const Texture::RawTextureData> TextureEntry::data() const {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            return _data;
+        }
+
+        size_t TextureEntry::decode() {
+            std::shared_ptr<Texture::RawTextureData> data(new Texture::RawTextureData(Texture::decodeTexFromFile(_path, _type)));
+            size_t bytes = data->pixels.size();
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _data = data;
+            return bytes;
+        }
+
+        void TextureEntry::upload() {
+            std::shared_ptr<const Texture::RawTextureData> data = this->data();
+            if(data) _texture = Texture::loadTexFromData(*data);
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _data.reset();
+        }
+
+        ModelEntry::~ModelEntry() {
+            Model::Model model = _model;
+            if(model.loaded()) queueRelease([model]() mutable { model.release(); });
+        }
+
+        std::string ModelEntry::contentKey(unsigned long long hash) const {
+            return "M" + std::to_string(_optimize_flags) + ":" + std::to_string(hash);
+        }
+
+        std::shared_ptr<const Model::RawModelDataIndexed> ModelEntry::data() const {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            return _data;
+        }
+
+        size_t ModelEntry::decode() {
+            std::shared_ptr<Model::RawModelDataIndexed> data(new Model::RawModelDataIndexed(Model::loadFromOBJ(_path.c_str()).index()));
+            if(_optimize_flags != 0) Model::optimize(*data, _optimize_flags);
+
+            size_t bytes = data->indexSize() * sizeof(unsigned int);
+            for(auto && iter : *data) bytes += data->size() * iter.first.type() * sizeof(float);
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _data = data;
+            return bytes;
+        }
+
+        void ModelEntry::upload() {
+            std::shared_ptr<const Model::RawModelDataIndexed> data = this->data();
+            if(data) _model = Model::Model(*data);
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _data.reset();
+        }
+
+
+
+        // ************
+        //  Asset Jobs
+        // ************
+
+        std::atomic<bool> _static_running(false);
+        std::atomic<bool> _static_shutting_down(false);
+
+        // Decodes run as jobs, but only 'worker_count' at a time, so slow file reads never take every job worker
+        boost::mutex _static_decode_mutex;
+        std::deque<std::shared_ptr<AssetEntry>> _static_decode_queue;
+        unsigned int _static_decode_jobs = 0;
+        unsigned int _static_decode_limit = 1;
+        Util::JobCounter _static_asset_jobs;
+
+        boost::mutex _static_upload_mutex;
+        std::deque<std::shared_ptr<AssetEntry>> _static_upload_queue;
+        std::deque<std::function<void()>> _static_release_queue;
+        std::atomic<size_t> _static_upload_budget(16 * 1024 * 1024);
+
+        // Uploaded batches waiting for the GPU; the render thread draws from other contexts, so entries only become
+        // READY once the fence after their batch has signaled. Only touched by the GL thread.
+        struct FencedUploads {
+            SWMuint fence;
+            std::vector<std::shared_ptr<AssetEntry>> entries;
+        };
+        std::deque<FencedUploads> _static_fenced_uploads;
+
+        void init(unsigned int worker_count) {
+            if(worker_count == 0) worker_count = std::max(Util::jobWorkers(), 1u);
+            {
+                boost::lock_guard<boost::mutex> lock(_static_decode_mutex);
+                _static_decode_limit = worker_count;
+            }
+            _static_shutting_down = false;
+            _static_running = true;
+            Log::log_asset(INFO) << "Decoding assets on up to " << worker_count << " job workers";
+        }
+
+        void cleanup() {
+            _static_shutting_down = true;
+            _static_asset_jobs.wait();
+            _static_running = false;
+            {
+                boost::lock_guard<boost::mutex> lock(_static_upload_mutex);
+                _static_upload_queue.clear();
+            }
+            for(FencedUploads &fenced : _static_fenced_uploads) Render::device().deleteFence(fenced.fence);
+            _static_fenced_uploads.clear();
+            cacheClear();
+
+            // GL objects still alive are deleted by the Texture and Model cleanups
+            boost::lock_guard<boost::mutex> lock(_static_upload_mutex);
+            _static_release_queue.clear();
+        }
+
+        void queueRelease(const std::function<void()> &release) {
+            boost::lock_guard<boost::mutex> lock(_static_upload_mutex);
+            _static_release_queue.push_back(release);
+        }
+
+        // FNV-1a over the whole file
+        bool hashFile(const std::string &path, unsigned long long &hash) {
+            FILE* file = fopen(path.c_str(), "rb");
+            if(file == nullptr) return false;
+            hash = 14695981039346656037ULL;
+            unsigned char buffer[65536];
+            size_t count;
+            while((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+                for(size_t i = 0; i < count; i++) {
+                    hash ^= buffer[i];
+                    hash *= 1099511628211ULL;
+                }
+            }
+            fclose(file);
+            return true;
+        }
+
+        void runDecode(const std::shared_ptr<AssetEntry> &entry) {
+            if(_static_shutting_down) {
+                entry->fail("Asset loading was shut down");
+                return;
+            }
+
+            // Identical files at different paths share whichever entry saw the content first
+            unsigned long long hash;
+            if(hashFile(entry->path(), hash)) {
+                std::shared_ptr<AssetEntry> canonical = cacheFindContent(entry->contentKey(hash), entry);
+                if(canonical) {
+                    Log::log_asset(DEBUG) << "'" << entry->path() << "' has the same content as '" << canonical->path() << "'";
+                    entry->setAlias(canonical);
+                    return;
+                }
+            }
+
+            try {
+                entry->setUploadSize(entry->decode());
+            } catch(std::exception &e) {
+                entry->fail(e.what());
+                return;
+            }
+            {
+                boost::lock_guard<boost::mutex> lock(_static_upload_mutex);
+                _static_upload_queue.push_back(entry);
+            }
+            entry->setState(UPLOADING);
+        }
+
+        void drainDecodes() {
+            while(true) {
+                std::shared_ptr<AssetEntry> entry;
+                {
+                    boost::lock_guard<boost::mutex> lock(_static_decode_mutex);
+                    if(_static_decode_queue.empty()) {
+                        _static_decode_jobs--;
+                        return;
+                    }
+                    entry = _static_decode_queue.front();
+                    _static_decode_queue.pop_front();
+                }
+                runDecode(entry);
+            }
+        }
+
+        void submit(const std::shared_ptr<AssetEntry> &entry) {
+            if(!_static_running) {
+                entry->fail("Asset system is not initialized");
+                return;
+            }
+            boost::lock_guard<boost::mutex> lock(_static_decode_mutex);
+            _static_decode_queue.push_back(entry);
+            if(_static_decode_jobs < _static_decode_limit) {
+                _static_decode_jobs++;
+                Util::runJob(drainDecodes, &_static_asset_jobs);
+            }
+        }
+
+        TextureHandle loadTexture(const std::string &path, Texture::FileType type) {
+            bool created;
+            std::shared_ptr<AssetEntry> entry = cacheAcquire("T" + std::to_string((int)type) + ":" + path, [&]() {
+                return std::make_shared<TextureEntry>(path, type);
+            }, created);
+            if(created) submit(entry);
+            return TextureHandle(entry);
+        }
+
+        ModelHandle loadModel(const std::string &path, unsigned int optimize_flags) {
+            bool created;
+            std::shared_ptr<AssetEntry> entry = cacheAcquire("M" + std::to_string(optimize_flags) + ":" + path, [&]() {
+                return std::make_shared<ModelEntry>(path, optimize_flags);
+            }, created);
+            if(created) submit(entry);
+            return ModelHandle(entry);
+        }
+
+        void waitAll() {
+            _static_asset_jobs.wait();
+        }
+
+
+
+        // **************
+        //  Upload Queue
+        // **************
+
+        // Fences signal in the order they were inserted, so only the oldest needs checking
+        void publishUploads() {
+            Render::Device &dev = Render::device();
+            while(!_static_fenced_uploads.empty() && dev.fenceSignaled(_static_fenced_uploads.front().fence)) {
+                for(std::shared_ptr<AssetEntry> &entry : _static_fenced_uploads.front().entries) entry->setState(READY);
+                dev.deleteFence(_static_fenced_uploads.front().fence);
+                _static_fenced_uploads.pop_front();
+            }
+        }
+
+        size_t processUploads(size_t byte_budget) {
+
+            // Free GL objects of destroyed entries first
+            std::deque<std::function<void()>> releases;
+            {
+                boost::lock_guard<boost::mutex> lock(_static_upload_mutex);
+                releases.swap(_static_release_queue);
+            }
+            for(auto && release : releases) release();
+            publishUploads();
+
+            std::vector<std::shared_ptr<AssetEntry>> batch;
+            size_t uploaded = 0;
+            size_t spent = 0;
+            while(uploaded == 0 || spent < byte_budget) {
+                std::shared_ptr<AssetEntry> entry;
+                {
+                    boost::lock_guard<boost::mutex> lock(_static_upload_mutex);
+                    if(_static_upload_queue.empty()) break;
+                    entry = _static_upload_queue.front();
+                    _static_upload_queue.pop_front();
+                }
+                if(entry.use_count() == 1) continue; // Evicted from the cache before it was ever uploaded
+                try {
+                    entry->upload();
+                    batch.push_back(entry);
+                } catch(std::exception &e) {
+                    entry->fail(e.what());
+                }
+                spent += entry->uploadSize();
+                uploaded++;
+            }
+            if(!batch.empty()) {
+                _static_fenced_uploads.push_back(FencedUploads{ Render::device().fenceSync(), batch });
+                publishUploads();
+            }
+            if(uploaded > 0) cacheEnforceBudget();
+            return uploaded;
+        }
+
+        void setUploadBudget(size_t bytes) { _static_upload_budget = bytes; }
+        size_t uploadBudget() { return _static_upload_budget; }
+
+        size_t pendingUploads() {
+            boost::lock_guard<boost::mutex> lock(_static_upload_mutex);
+            return _static_upload_queue.size();
+        }
+
+
+
+        // *********
+        //  Handles
+        // *********
+
+        Handle::Handle(const std::shared_ptr<AssetEntry> &entry) : _entry(entry) {
+            if(_entry) _entry->acquireHandle();
+        }
+
+        Handle::Handle(const Handle &other) : _entry(other._entry) {
+            if(_entry) _entry->acquireHandle();
+        }
+
+        Handle &Handle::operator=(const Handle &other) {
+            if(other._entry) other._entry->acquireHandle();
+            if(_entry) _entry->releaseHandle();
+            _entry = other._entry;
+            return *this;
+        }
+
+        Handle::~Handle() {
+            if(_entry) _entry->releaseHandle();
+        }
+
+        size_t Handle::references() const {
+            return _entry ? _entry->handles() : 0;
+        }
+
+        State Handle::state() const {
+            return _entry ? _entry->state() : FAILED;
+        }
+
+        void Handle::wait() const {
+            if(_entry) _entry->wait();
+        }
+
+        std::string Handle::path() const {
+            return _entry ? _entry->path() : "";
+        }
+
+        std::string Handle::error() const {
+            return _entry ? _entry->error() : "Invalid Handle";
+        }
+
+        std::shared_ptr<const Texture::RawTextureData> TextureHandle::data() const {
+            if(!_entry) return nullptr;
+            return static_cast<TextureEntry*>(_entry->resolve().get())->data();
+        }
+
+        // A Handle shared by every copy of an uploaded Texture or Model, so the cache keeps their GL objects alive
+        std::shared_ptr<const void> pin(const Handle &handle) {
+            return std::make_shared<const Handle>(handle);
+        }
+
+        Texture::TexMap TextureHandle::texture() const {
+            if(state() != READY) return Texture::TexMap();
+            Texture::TexMap texture = static_cast<TextureEntry*>(_entry->resolve().get())->texture();
+            texture.setOwner(pin(*this));
+            return texture;
+        }
+
+        std::shared_ptr<const Model::RawModelDataIndexed> ModelHandle::data() const {
+            if(!_entry) return nullptr;
+            return static_cast<ModelEntry*>(_entry->resolve().get())->data();
+        }
+
+        Model::Model ModelHandle::model() const {
+            if(state() != READY) return Model::Model();
+            Model::Model model = static_cast<ModelEntry*>(_entry->resolve().get())->model();
+            model.setOwner(pin(*this));
+            return model;
+        }
+
+    }
+}
@@ -73,7 +73,7 @@ namespace Swarm {
             const ContextInternal* _context = nullptr;
             cl_mem_flags _flags = 0;
 
-            BufferInternal(const ContextInternal* ctx, bool read, bool write);
+            BufferInternal(const ContextInternal* ctx, bool read, bool write, bool host_allocated);
             virtual ~BufferInternal();
             void recreateBuffer(size_t size_in_bytes, void* data);
         };
@@ -88,12 +88,16 @@ namespace Swarm {
             static void cleanup();
         };
 
+        //! The events of 'wait' that refer to a command, as the CL API takes them
+        std::vector<cl_event> waitList(const EventList &wait);
+
         struct CommandQueueInternal {
 
-            CommandQueueInternal(const ContextInternal* context, const DeviceInternal* device);
+            CommandQueueInternal(const ContextInternal* context, const DeviceInternal* device, unsigned int properties);
             virtual ~CommandQueueInternal();
 
             cl_command_queue _command_queue;
+            unsigned int _properties; // QueueProperties the device supported
 
             static void cleanup();
         };
@@ -8,11 +8,11 @@ using namespace Swarm::Logging;
 namespace Swarm {
     namespace CL {
 
-        BufferInternal::BufferInternal(const ContextInternal* ctx, bool read, bool write) {
+        BufferInternal::BufferInternal(const ContextInternal* ctx, bool read, bool write, bool host_allocated) {
             if(ctx == nullptr) throw Exception::CLObjectCreationException::Buffer(CL_INVALID_CONTEXT);
             if(!(read || write)) throw Exception::CLObjectCreationException::Buffer(CL_INVALID_VALUE);
 
-            _flags = CL_MEM_USE_HOST_PTR | (cl_mem_flags)(read ? (write ? CL_MEM_READ_WRITE : CL_MEM_READ_ONLY) : CL_MEM_WRITE_ONLY);
+            _flags = (host_allocated ? CL_MEM_ALLOC_HOST_PTR : CL_MEM_USE_HOST_PTR) | (cl_mem_flags)(read ? (write ? CL_MEM_READ_WRITE : CL_MEM_READ_ONLY) : CL_MEM_WRITE_ONLY);
             _context = ctx;
         }
 
@@ -30,8 +30,8 @@ namespace Swarm {
             if(err != CL_SUCCESS) throw Exception::CLObjectCreationException::Buffer(err);
         }
 
-        BufferBase::BufferBase(const Context* ctx, bool read, bool write) {
-            _buffer = new BufferInternal((ContextInternal*)ctx, read, write);
+        BufferBase::BufferBase(const Context* ctx, bool read, bool write, bool host_allocated) {
+            _buffer = new BufferInternal((ContextInternal*)ctx, read, write, host_allocated);
         }
 
         BufferBase::~BufferBase() {
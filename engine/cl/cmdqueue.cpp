@@ -3,6 +3,8 @@
 #include "api/Exception.h"
 #include "api/Logging.h"
 
+#include <cstdio>
+
 using namespace Swarm::Logging;
 
 namespace Swarm {
@@ -15,18 +17,94 @@ namespace Swarm {
             _static_registered_queues.clear();
         }
 
-        CommandQueue::CommandQueue(const Context* context, const Device* device) {
-            _command_queue = new CommandQueueInternal((ContextInternal*)context, (DeviceInternal*)device);
+        std::vector<cl_event> waitList(const EventList &wait) {
+            std::vector<cl_event> events;
+            events.reserve(wait.size());
+            for(const Event &event : wait) if(event.valid()) events.push_back(event.event());
+            return events;
+        }
+
+        CommandQueue::CommandQueue(const Context* context, const Device* device, unsigned int properties) {
+            _command_queue = new CommandQueueInternal((ContextInternal*)context, (DeviceInternal*)device, properties);
             _static_registered_queues.insert(_command_queue);
         }
 
-        void CommandQueue::enqueueCommand(const Kernel &kernel, size_t size) {
-            const size_t gws[]{ size, 0, 0 };
-            clEnqueueNDRangeKernel(_command_queue->_command_queue, kernel.kernel(), 1, nullptr, gws, nullptr, 0, nullptr, nullptr);
+        unsigned int CommandQueue::properties() const {
+            return _command_queue->_properties;
+        }
+
+        Event CommandQueue::enqueueKernel(const Kernel &kernel, const NDRange &global, const NDRange &local, const EventList &wait) {
+            std::vector<cl_event> events = waitList(wait);
+            cl_event event = nullptr;
+            cl_int err = clEnqueueNDRangeKernel(_command_queue->_command_queue, kernel.kernel(), global.dimensions, nullptr,
+                                                global.sizes, local.dimensions > 0 ? local.sizes : nullptr,
+                                                (cl_uint)events.size(), events.empty() ? nullptr : events.data(), &event);
+            if(err != CL_SUCCESS) throw Exception::CLCommandException::Enqueue(err, "Kernel");
+            return Event(event);
+        }
+
+        Event CommandQueue::enqueueReadInternal(const BufferBase &buffer, bool blocking, size_t offset, size_t size, void* data, const EventList &wait) {
+            std::vector<cl_event> events = waitList(wait);
+            cl_event event = nullptr;
+            cl_int err = clEnqueueReadBuffer(_command_queue->_command_queue, buffer.buffer(), blocking ? CL_TRUE : CL_FALSE, offset, size, data,
+                                             (cl_uint)events.size(), events.empty() ? nullptr : events.data(), &event);
+            if(err != CL_SUCCESS) throw Exception::CLCommandException::Enqueue(err, "Buffer Read");
+            return Event(event);
+        }
+
+        Event CommandQueue::enqueueWriteInternal(const BufferBase &buffer, bool blocking, size_t offset, size_t size, const void* data, const EventList &wait) {
+            std::vector<cl_event> events = waitList(wait);
+            cl_event event = nullptr;
+            cl_int err = clEnqueueWriteBuffer(_command_queue->_command_queue, buffer.buffer(), blocking ? CL_TRUE : CL_FALSE, offset, size, data,
+                                              (cl_uint)events.size(), events.empty() ? nullptr : events.data(), &event);
+            if(err != CL_SUCCESS) throw Exception::CLCommandException::Enqueue(err, "Buffer Write");
+            return Event(event);
+        }
+
+        void* CommandQueue::enqueueMapInternal(const BufferBase &buffer, bool read, bool write, bool blocking, size_t size, const EventList &wait, Event* event) {
+            std::vector<cl_event> events = waitList(wait);
+            cl_map_flags flags = (read ? CL_MAP_READ : 0) | (write ? CL_MAP_WRITE : 0);
+            cl_event mapped = nullptr;
+            cl_int err = CL_SUCCESS;
+            void* data = clEnqueueMapBuffer(_command_queue->_command_queue, buffer.buffer(), blocking ? CL_TRUE : CL_FALSE, flags, 0, size,
+                                            (cl_uint)events.size(), events.empty() ? nullptr : events.data(), &mapped, &err);
+            if(err != CL_SUCCESS) throw Exception::CLCommandException::Enqueue(err, "Buffer Map");
+            if(event != nullptr) *event = Event(mapped);
+            else clReleaseEvent(mapped);
+            return data;
+        }
+
+        Event CommandQueue::enqueueUnmap(const BufferBase &buffer, void* data, const EventList &wait) {
+            std::vector<cl_event> events = waitList(wait);
+            cl_event event = nullptr;
+            cl_int err = clEnqueueUnmapMemObject(_command_queue->_command_queue, buffer.buffer(), data,
+                                                 (cl_uint)events.size(), events.empty() ? nullptr : events.data(), &event);
+            if(err != CL_SUCCESS) throw Exception::CLCommandException::Enqueue(err, "Buffer Unmap");
+            return Event(event);
+        }
+
+        Event CommandQueue::enqueueMarker(const EventList &wait) {
+            std::vector<cl_event> events = waitList(wait);
+            cl_event event = nullptr;
+            cl_int err = clEnqueueMarkerWithWaitList(_command_queue->_command_queue, (cl_uint)events.size(), events.empty() ? nullptr : events.data(), &event);
+            if(err != CL_SUCCESS) throw Exception::CLCommandException::Enqueue(err, "Marker");
+            return Event(event);
         }
 
-        void CommandQueue::enqueueReadInternal(const BufferBase &buffer, bool blocking, size_t size, void* data) {
-            clEnqueueReadBuffer(_command_queue->_command_queue, buffer.buffer(), blocking ? CL_TRUE : CL_FALSE, 0, size, data, 0, nullptr, nullptr);
+        Event CommandQueue::enqueueBarrier(const EventList &wait) {
+            std::vector<cl_event> events = waitList(wait);
+            cl_event event = nullptr;
+            cl_int err = clEnqueueBarrierWithWaitList(_command_queue->_command_queue, (cl_uint)events.size(), events.empty() ? nullptr : events.data(), &event);
+            if(err != CL_SUCCESS) throw Exception::CLCommandException::Enqueue(err, "Barrier");
+            return Event(event);
+        }
+
+        void CommandQueue::flush() {
+            clFlush(_command_queue->_command_queue);
+        }
+
+        void CommandQueue::finish() {
+            clFinish(_command_queue->_command_queue);
         }
 
         cl_command_queue CommandQueue::queue() const {
@@ -35,14 +113,42 @@ namespace Swarm {
 
 
 
-        CommandQueueInternal::CommandQueueInternal(const ContextInternal* context, const DeviceInternal* device) {
+        CommandQueueInternal::CommandQueueInternal(const ContextInternal* context, const DeviceInternal* device, unsigned int properties) {
 
             if(context == nullptr) throw Exception::CLObjectCreationException::CommandQueue(CL_INVALID_CONTEXT);
             if(device == nullptr) throw Exception::CLObjectCreationException::CommandQueue(CL_INVALID_DEVICE);
 
+            // Out-of-order execution is optional; without it, wait lists are still honoured, with less overlap
+            cl_command_queue_properties supported = 0;
+            clGetDeviceInfo(device->device(), CL_DEVICE_QUEUE_PROPERTIES, sizeof(supported), &supported, nullptr);
+            cl_command_queue_properties flags = 0;
+            _properties = QUEUE_IN_ORDER;
+            if(properties & QUEUE_OUT_OF_ORDER) {
+                if(supported & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) {
+                    flags |= CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+                    _properties |= QUEUE_OUT_OF_ORDER;
+                } else Log::log_cl(DEBUG) << "CL Device '" << device->name() << "' only runs commands in order";
+            }
+            if(properties & QUEUE_PROFILING) {
+                flags |= CL_QUEUE_PROFILING_ENABLE;
+                _properties |= QUEUE_PROFILING;
+            }
+
+            // clCreateCommandQueue is deprecated from OpenCL 2.0, and its replacement is missing before it
+            char version[128] = { 0 };
+            clGetDeviceInfo(device->device(), CL_DEVICE_VERSION, sizeof(version) - 1, &version[0], nullptr);
+            int major = 1;
+            std::sscanf(version, "OpenCL %d", &major);
+
             cl_int err = 0;
-            // TODO: Update to non-deprecated Command Queue creation method
-            _command_queue = clCreateCommandQueue(context->context(), device->device(), 0, &err);
+            #if defined(CL_VERSION_2_0)
+            if(major >= 2) {
+                const cl_queue_properties queue_properties[]{ CL_QUEUE_PROPERTIES, flags, 0 };
+                _command_queue = clCreateCommandQueueWithProperties(context->context(), device->device(), queue_properties, &err);
+            } else _command_queue = clCreateCommandQueue(context->context(), device->device(), flags, &err);
+            #else
+            _command_queue = clCreateCommandQueue(context->context(), device->device(), flags, &err);
+            #endif
 
             // Check Error
             if(err != CL_SUCCESS) throw Exception::CLObjectCreationException::CommandQueue(err);
@@ -52,4 +158,4 @@ namespace Swarm {
             clReleaseCommandQueue(_command_queue);
         }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,47 @@
+#include "CLInternal.h"
+
+#include "api/Exception.h"
+
+namespace Swarm {
+    namespace CL {
+
+        Event::Event(const Event &other) : _event(other._event) {
+            if(_event != nullptr) clRetainEvent(_event);
+        }
+
+        Event::~Event() {
+            if(_event != nullptr) clReleaseEvent(_event);
+        }
+
+        bool Event::complete() const {
+            if(_event == nullptr) return true;
+
+            // Failed commands have a negative status; they are finished too
+            cl_int status = CL_COMPLETE;
+            clGetEventInfo(_event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr);
+            return status <= CL_COMPLETE;
+        }
+
+        void Event::wait() const {
+            if(_event == nullptr) return;
+            cl_int err = clWaitForEvents(1, &_event);
+            if(err != CL_SUCCESS) throw Exception::CLCommandException::Wait(err);
+        }
+
+        void Event::waitAll(const std::vector<Event> &events) {
+            std::vector<cl_event> list = waitList(events);
+            if(list.empty()) return;
+            cl_int err = clWaitForEvents((cl_uint)list.size(), list.data());
+            if(err != CL_SUCCESS) throw Exception::CLCommandException::Wait(err);
+        }
+
+        uint64_t Event::duration() const {
+            if(_event == nullptr) return 0;
+            cl_ulong start = 0, end = 0;
+            if(clGetEventProfilingInfo(_event, CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr) != CL_SUCCESS) return 0;
+            if(clGetEventProfilingInfo(_event, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr) != CL_SUCCESS) return 0;
+            return end > start ? end - start : 0;
+        }
+
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "api/Core.h"
+
+#include "api/Util.h"
+
+
+// ************
+//  Code Begin
+// ************
+
+namespace Swarm {
+    namespace Core {
+
+        //! Pacer of the given loop; each loop paces its own thread with it
+        Util::FramePacer &pacer(Loop loop);
+
+    }
+}
@@ -46,6 +46,7 @@ namespace Swarm {
         Log Log::log_cl("CL");
         Log Log::log_physics("Physics");
         Log Log::log_vhe("VHE");
+        Log Log::log_asset("Asset");
 
         void Log::setDefaultFilepath(const std::string &path) {
             _static_default_filepath = path;
@@ -1,13 +1,16 @@
 #define SWARM_INCLUDE_GLFW
-#include "api/Core.h"
+#include "CoreInternal.h"
 
 #include "api/Logging.h"
 #include "api/CLEngine.h"
 #include "render/RenderInternal.h"
+#include "api/Asset.h"
 #include "physics/PhysicsInternal.h"
 #include "vhe/VHEInternal.h"
 #include "api/Util.h"
 
+#include <algorithm>
+
 using namespace Swarm::Logging;
 
 namespace Swarm {
@@ -21,10 +24,12 @@ namespace Swarm {
         State _static_state = UNINITIALIZED;
         State state() { return _static_state; }
 
+        size_t _static_init_flags = SWM_INIT_MINIMAL;
+
         bool init(size_t flags) {
 
-            // Scan for Dependencies
-            if(flags & SWM_INIT_PHYSICS) flags |= SWM_INIT_CL;
+            // Job Workers; started first, as every other system may queue jobs
+            Util::startJobs();
 
             // Render Init
             if(flags & SWM_INIT_RENDER) {
@@ -46,18 +51,20 @@ namespace Swarm {
                 CL::init();
             }
 
-            // Physics Init
-            /*
+            // Physics Init; on the CL device initialized above, if any, otherwise on the CPU
             if(flags & SWM_INIT_PHYSICS) {
                 Physics::init();
             }
-             */
 
             // VHE Init
             if(flags & SWM_INIT_VHE) {
                 VHE::init();
             }
 
+            // Asset Init
+            Asset::init();
+
+            _static_init_flags = flags;
             _static_state = STOPPED;
 
             return true;
@@ -65,12 +72,17 @@ namespace Swarm {
         }
 
         void cleanup() {
+            Asset::cleanup();
             Texture::cleanup();
             Model::cleanup();
             Render::cleanup();
+            if(_static_init_flags & SWM_INIT_PHYSICS) Physics::cleanup();
             CL::cleanup();
             VHE::cleanup();
 
+            Util::runMainThreadJobs();
+            Util::stopJobs();
+
             glfwTerminate();
 
             Log::cleanupAll();
@@ -78,24 +90,75 @@ namespace Swarm {
             _static_state = UNINITIALIZED;
         }
 
+        // ************
+        //  Scheduling
+        // ************
+
+        Util::FramePacer _static_loop_pacers[3] = { { 60.0 }, { 60.0 }, { 60.0 } };
+
+        Util::FramePacer &pacer(Loop loop) { return _static_loop_pacers[loop]; }
+
+        void setTargetRate(Loop loop, double rate) { _static_loop_pacers[loop].setRate(std::max(rate, 0.0)); }
+        double targetRate(Loop loop) { return _static_loop_pacers[loop].rate(); }
+
+        LoopStats loopStats(Loop loop) {
+            const Util::FramePacer &loop_pacer = _static_loop_pacers[loop];
+            LoopStats stats;
+            stats.frame_ms = loop_pacer.frameTime();
+            stats.jitter_ms = loop_pacer.jitter();
+            stats.utilization = loop_pacer.utilization();
+            stats.frames = loop_pacer.frames();
+            return stats;
+        }
+
+        std::atomic<double> _static_simulation_rate(60.0);
+        std::atomic<double> _static_last_step_time(0.0); // Seconds on the steady clock
+        std::atomic<double> _static_step_length(1.0 / 60.0);
+
+        void setSimulationRate(double rate) { if(rate > 0.0) _static_simulation_rate = rate; }
+        double simulationRate() { return _static_simulation_rate; }
+
+        double steadySeconds() {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        double interpolation() {
+            double alpha = (steadySeconds() - _static_last_step_time) / _static_step_length;
+            return std::min(std::max(alpha, 0.0), 1.0);
+        }
+
+        // Steps one frame may run to catch up; any more are dropped, so a stall cannot snowball
+        const unsigned int MAX_STEPS_PER_FRAME = 5;
+
         void start(GameCycleFunc function) {
             if(_static_state == RUNNING) return;
             if(_static_state == UNINITIALIZED) return; // TODO: Throw Exception if not Initialized when Engine started
             _static_state = RUNNING;
 
-            Util::DeltaTimeController dtc;
+            Util::FramePacer &main_pacer = pacer(MAIN_LOOP);
+            main_pacer.pace();
+            double accumulated = 0.0;
             while(_static_state == RUNNING) {
 
-                // Get the Delta Time
-                double delta_time = dtc.get();
-
-                // Run the given cycle function
-                function(delta_time);
+                // Run the given cycle function in fixed steps, as many as have come due since the last frame
+                double step = 1.0 / _static_simulation_rate;
+                accumulated += main_pacer.pace();
+                unsigned int steps = 0;
+                while(accumulated >= step && steps < MAX_STEPS_PER_FRAME && _static_state == RUNNING) {
+                    function(step);
+                    Render::CameraInternal::updateAll(step);
+                    _static_step_length = step;
+                    _static_last_step_time = steadySeconds();
+                    accumulated -= step;
+                    steps++;
+                }
+                if(steps == MAX_STEPS_PER_FRAME) accumulated = std::min(accumulated, step);
 
                 // Do Engine Specific Updates
+                Util::runMainThreadJobs();
+                if(_static_init_flags & SWM_INIT_RENDER) Asset::processUploads(Asset::uploadBudget());
                 glfwPollEvents();
                 Render::checkWindowCloseFlags();
-                Render::CameraInternal::updateAll(delta_time);
 
             }
         }
@@ -0,0 +1,56 @@
+#define SWARM_INCLUDE_CL
+#include "api/Exception.h"
+
+namespace Swarm {
+    namespace Exception {
+
+        CLCommandException::CLCommandException(Type type, const std::string &message)
+                : runtime_error(message), _type(type) {};
+
+        CLCommandException CLCommandException::Enqueue(int err_code, const std::string &command) {
+            switch(err_code) {
+                case CL_INVALID_VALUE:
+                    return CLCommandException(ENQUEUE, "Attempted to enqueue CL " + command + " with an Invalid Value or out of range region");
+                case CL_INVALID_MEM_OBJECT:
+                    return CLCommandException(ENQUEUE, "Attempted to enqueue CL " + command + " on an Invalid Buffer");
+                case CL_INVALID_KERNEL_ARGS:
+                    return CLCommandException(ENQUEUE, "Attempted to enqueue CL " + command + " before every Kernel argument was set");
+                case CL_INVALID_WORK_DIMENSION:
+                case CL_INVALID_GLOBAL_WORK_SIZE:
+                    return CLCommandException(ENQUEUE, "Attempted to enqueue CL " + command + " with an Invalid global work size");
+                case CL_INVALID_WORK_GROUP_SIZE:
+                case CL_INVALID_WORK_ITEM_SIZE:
+                    return CLCommandException(ENQUEUE, "Attempted to enqueue CL " + command + " with a local work size that does not divide the global work size, or is too large for the device");
+                case CL_INVALID_EVENT_WAIT_LIST:
+                    return CLCommandException(ENQUEUE, "Attempted to enqueue CL " + command + " with an Invalid Event in its wait list");
+                case CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST:
+                    return CLCommandException(ENQUEUE, "CL " + command + " waited on an Event that failed");
+                case CL_MAP_FAILURE:
+                    return CLCommandException(ENQUEUE, "Failed to map CL Buffer for " + command);
+                case CL_MEM_OBJECT_ALLOCATION_FAILURE:
+                    return CLCommandException(ENQUEUE, "Failure to allocate memory for CL " + command);
+                case CL_OUT_OF_RESOURCES:
+                    return CLCommandException(ENQUEUE, "Device out of Resources when enqueueing CL " + command);
+                case CL_OUT_OF_HOST_MEMORY:
+                    return CLCommandException(ENQUEUE, "Host out of Memory when enqueueing CL " + command);
+                default:
+                    return CLCommandException(ENQUEUE, "Unknown Error when enqueueing CL " + command + "; '" + std::to_string(err_code) + "'");
+            }
+        }
+
+        CLCommandException CLCommandException::Wait(int err_code) {
+            switch(err_code) {
+                case CL_INVALID_EVENT:
+                    return CLCommandException(WAIT, "Attempted to wait on an Invalid CL Event");
+                case CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST:
+                    return CLCommandException(WAIT, "Waited on a CL Command that failed");
+                case CL_OUT_OF_RESOURCES:
+                    return CLCommandException(WAIT, "Device out of Resources when waiting on CL Events");
+                case CL_OUT_OF_HOST_MEMORY:
+                    return CLCommandException(WAIT, "Host out of Memory when waiting on CL Events");
+                default:
+                    return CLCommandException(WAIT, "Unknown Error when waiting on CL Events; '" + std::to_string(err_code) + "'");
+            }
+        }
+    }
+}
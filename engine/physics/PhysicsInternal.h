@@ -7,6 +7,12 @@
 
 #include "api/Util.h"
 
+#include "kernels/body_layout.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
 
 // ************
 //  Code Begin
@@ -15,33 +21,238 @@
 namespace Swarm {
     namespace Physics {
 
+        //! Offset of each component of a body, in units of the body stride; see \ref SWARM_BODY_LAYOUT
+        enum BodyComponent {
+            #define SWARM_BODY_COMPONENT(name, floats) BODY_##name, BODY_##name##_LAST = BODY_##name + (floats) - 1,
+            SWARM_BODY_LAYOUT(SWARM_BODY_COMPONENT)
+            #undef SWARM_BODY_COMPONENT
+            BODY_COMPONENTS
+        };
+
+        // Bodies are stored one array per component, padded to a whole number of these, so SIMD code never needs a
+        // scalar tail; padding bodies have no mass or inertia, and stay at rest
+        const size_t BODY_PADDING = 16;
+
+        // Alignment, in bytes, of the block holding every body; with the padding above, every component array starts
+        // on a cache line, and so is aligned for float4 and any SIMD width
+        const size_t BODY_ALIGNMENT = 64;
+
+        //! Memory that bodies are stored in
+        class BodyStorage {
+        public:
+            virtual ~BodyStorage() {}
+
+            //! Get a block of 'floats' floats, aligned to \ref BODY_ALIGNMENT
+            virtual float* allocate(size_t floats) = 0;
+
+            //! Free a block from \ref allocate()
+            virtual void release(float* block) = 0;
+        };
+
+        //! Plain host memory; used unless the backend asks for memory of its own
+        class HostBodyStorage : public BodyStorage {
+        public:
+            float* allocate(size_t floats);
+            void release(float* block);
+
+        protected:
+            std::unordered_map<float*, float*> _allocations; // Aligned block to what was allocated
+        };
+
         struct RigidBodyProperties {
-            float mass;
+            float* inverse_mass;
+            float* inverse_inertia[3];
+            float* radius;
         };
 
         struct RigidBodyMotion {
-            glm::vec3 position;
-            glm::vec3 rotation;
-            glm::vec3 velocity_linear;
-            glm::vec3 velocity_angular;
+            float* position[3];
+            float* orientation[4];
+            float* velocity_linear[3];
+            float* velocity_angular[3];
         };
 
         struct RigidBodyForces {
-            glm::vec3 force;
-            glm::vec3 torque;
+            float* force[3];
+            float* torque[3];
         };
 
-        class PhysicsObjectInternal {
+        //! Every body, in SoA layout, in one block laid out by \ref SWARM_BODY_LAYOUT
+        /*!
+         * The component pointers point into the block, and change whenever it does. Indices are packed, and change
+         * when a body is removed.
+         */
+        struct RigidBodies {
+            RigidBodyProperties properties;
+            RigidBodyMotion motion;
+            RigidBodyForces forces;
+            size_t count = 0;
+
+            RigidBodies(BodyStorage* storage) : _storage(storage) {}
+            RigidBodies(const RigidBodies &other) = delete;
+            RigidBodies &operator=(const RigidBodies &other) = delete;
+            ~RigidBodies();
+
+            //! Number of bodies including padding, and the stride between components; always a multiple of \ref BODY_PADDING
+            size_t padded() const { return _stride; }
+
+            //! The block every body is stored in; 'nullptr' until the first body is added
+            float* data() const { return _data; }
+
+            //! Point the components at 'data', after the block was moved by its \ref BodyStorage
+            void bind(float* data);
+
+            //! Move every body into memory from 'storage'
+            void setStorage(BodyStorage* storage);
+            BodyStorage* storage() const { return _storage; }
+
+            //! Add a body at rest at the origin, and get its index
+            size_t add(float inverse_mass, const glm::vec3 &inverse_inertia);
+
+            //! Remove a body by moving the last one into its index
+            void remove(size_t index);
+
         protected:
-            Util::BufferData<RigidBodyProperties> _properties;
-            Util::BufferData<RigidBodyMotion> _motion;
-            Util::BufferData<RigidBodyForces> _forces;
+            BodyStorage* _storage;
+            float* _data = nullptr;
+            size_t _stride = 0;
+
+            void resize(size_t size);
+        };
+
+        //! Integrates bodies; one implementation per \ref Backend
+        class Integrator {
+        public:
+            virtual ~Integrator() {}
+
+            virtual Backend backend() const = 0;
+
+            //! Memory bodies must be stored in while this integrates them; 'nullptr' for plain host memory
+            virtual BodyStorage* storage() { return nullptr; }
+
+            //! Advance every body by 'delta_time', then clear their forces
+            virtual void integrate(RigidBodies &bodies, float delta_time) = 0;
+        };
+
+        //! Integrates on the job workers, a SIMD register of bodies at a time
+        class CPUIntegrator : public Integrator {
         public:
-            PhysicsObjectInternal();
+            Backend backend() const { return BACKEND_CPU; }
+            void integrate(RigidBodies &bodies, float delta_time);
+
+            //! Integrate bodies [begin, end) on the calling thread; both must be multiples of \ref BODY_PADDING
+            static void integrateRange(RigidBodies &bodies, float delta_time, size_t begin, size_t end);
         };
 
+        //! Integrates with the movement kernel on a CL device
+        /*!
+         * Bodies are stored in a CL buffer allocated where the host can reach it, and mapped into host memory between
+         * steps; on devices that share memory with the host, no step copies them.
+         */
+        class CLIntegrator : public Integrator {
+        public:
+
+            //! Create an integrator on the CL device with the most compute units; 'nullptr' if there is none
+            static CLIntegrator* create();
+            ~CLIntegrator();
+
+            Backend backend() const { return BACKEND_CL; }
+            BodyStorage* storage();
+            void integrate(RigidBodies &bodies, float delta_time);
+
+        protected:
+            struct State;
+            State* _state;
+
+            CLIntegrator(State* state) : _state(state) {}
+        };
+
+        //! Two overlapping bodies, by index; always a < b
+        struct BodyPair {
+            uint32_t a;
+            uint32_t b;
+            bool operator==(const BodyPair &rhs) const { return a == rhs.a && b == rhs.b; }
+        };
+
+        //! Axis-aligned bounds of every body with a radius, in SoA layout
+        struct BodyBounds {
+            std::vector<uint32_t> body;
+            std::vector<float> min[3];
+            std::vector<float> max[3];
+
+            //! Gather the bounds of 'bodies'; bounds stay in body order
+            void gather(const RigidBodies &bodies);
+            size_t size() const { return body.size(); }
+        };
+
+        //! Finds the pairs of bodies whose bounds overlap; one implementation per \ref BroadPhase
+        class PairFinder {
+        public:
+            virtual ~PairFinder() {}
+
+            virtual BroadPhase type() const = 0;
+
+            //! Replace 'pairs' with every overlapping pair, ordered by a, then b
+            virtual void findPairs(const BodyBounds &bounds, std::vector<BodyPair> &pairs) = 0;
+
+            //! Order pairs found in any order by a, then b
+            static void sortPairs(std::vector<std::vector<BodyPair>> &found, size_t body_count, std::vector<BodyPair> &pairs);
+        };
+
+        //! Sorts bounds along one axis, and only tests bounds that overlap on it
+        /*!
+         * The sorted order is kept between calls; bodies move little from one step to the next, so an insertion sort
+         * puts it back in order in close to linear time. The axis is the one bounds are spread out the most along, and
+         * changing it sorts from scratch.
+         */
+        class SweepAndPrune : public PairFinder {
+        public:
+            BroadPhase type() const { return BROAD_PHASE_SWEEP; }
+            void findPairs(const BodyBounds &bounds, std::vector<BodyPair> &pairs);
+
+        protected:
+            int _axis = -1;
+            std::vector<uint32_t> _order; // Indices into the bounds, by their min along '_axis'
+            std::vector<float> _sorted_min[3], _sorted_max[3];
+            std::vector<std::vector<BodyPair>> _found;
+        };
+
+        //! Sorts bounds into the cells of a uniform grid, and only tests bounds that share a cell
+        /*!
+         * Cells are keyed by their packed coordinates, so no two cells ever share a key. A pair that shares several
+         * cells is only reported from the one holding the min corner of their overlap.
+         */
+        class UniformGrid : public PairFinder {
+        public:
+            BroadPhase type() const { return BROAD_PHASE_GRID; }
+            void findPairs(const BodyBounds &bounds, std::vector<BodyPair> &pairs);
+
+            //! Set the cell size; '0' uses twice the median bounds size
+            void setCellSize(float size) { _cell_size = size; }
+            float cellSize() const { return _cell_size; }
+
+        protected:
+            struct Entry {
+                uint64_t cell;
+                uint32_t bounds;
+            };
+
+            float _cell_size = 0.0f;
+            std::vector<float> _extents, _scratch_extents;  // Largest side of each bounds
+            std::vector<uint32_t> _grid, _large;            // Bounds placed in cells, and those larger than a cell
+            std::vector<Entry> _entries, _scratch;
+            std::vector<size_t> _offsets;
+            std::vector<std::vector<BodyPair>> _found;
+        };
+
+        //! Move every body into 'storage', or into host memory if 'nullptr'; done as a backend starts and stops
+        void useStorage(BodyStorage* storage);
+
+        //! Integrate every body with 'integrator', then find overlapping pairs; only integrating and gathering bounds hold the body lock
+        void stepBodies(Integrator &integrator, float delta_time);
+
         void startPhysicsThread();
         void stopPhysicsThread();
 
     }
-}
\ No newline at end of file
+}
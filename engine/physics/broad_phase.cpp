@@ -0,0 +1,297 @@
+#include "PhysicsInternal.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Swarm {
+    namespace Physics {
+
+        // Bounds per parallelFor range when finding pairs; each range writes its own list
+        const size_t PAIR_GRAIN = 1024;
+
+        // Bits per radix sort pass
+        const unsigned int RADIX_BITS = 11;
+
+        inline bool overlaps(const BodyBounds &bounds, uint32_t i, uint32_t j, int axis) {
+            return bounds.min[axis][i] <= bounds.max[axis][j] && bounds.min[axis][j] <= bounds.max[axis][i];
+        }
+
+        inline BodyPair makePair(uint32_t a, uint32_t b) {
+            return a < b ? BodyPair{ a, b } : BodyPair{ b, a };
+        }
+
+        // Clears the lists of every range, so ranges that go unrun leave nothing behind
+        void resetFound(std::vector<std::vector<BodyPair>> &found, size_t count) {
+            found.resize((count + PAIR_GRAIN - 1) / PAIR_GRAIN);
+            for(std::vector<BodyPair> &list : found) list.clear();
+        }
+
+        void BodyBounds::gather(const RigidBodies &bodies) {
+            body.clear();
+            for(int c = 0; c < 3; c++) { min[c].clear(); max[c].clear(); }
+            const float* radius = bodies.properties.radius;
+            for(size_t i = 0; i < bodies.count; i++) {
+                if(radius[i] <= 0.0f) continue;
+                body.push_back((uint32_t)i);
+                for(int c = 0; c < 3; c++) {
+                    min[c].push_back(bodies.motion.position[c][i] - radius[i]);
+                    max[c].push_back(bodies.motion.position[c][i] + radius[i]);
+                }
+            }
+        }
+
+        void PairFinder::sortPairs(std::vector<std::vector<BodyPair>> &found, size_t body_count, std::vector<BodyPair> &pairs) {
+
+            // Counting sort by a, then each run of the same a by b; runs are short, so sorting them is cheap
+            std::vector<size_t> offsets(body_count + 1, 0);
+            for(const std::vector<BodyPair> &list : found)
+                for(const BodyPair &pair : list) offsets[pair.a + 1]++;
+            for(size_t i = 0; i < body_count; i++) offsets[i + 1] += offsets[i];
+
+            pairs.resize(offsets[body_count]);
+            std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+            for(const std::vector<BodyPair> &list : found)
+                for(const BodyPair &pair : list) pairs[cursor[pair.a]++] = pair;
+
+            Util::parallelFor(body_count, 4096, [&](size_t begin, size_t end) {
+                for(size_t a = begin; a < end; a++) {
+                    if(offsets[a + 1] - offsets[a] < 2) continue;
+                    std::sort(pairs.begin() + offsets[a], pairs.begin() + offsets[a + 1],
+                              [](const BodyPair &lhs, const BodyPair &rhs) { return lhs.b < rhs.b; });
+                }
+            });
+        }
+
+
+
+        // ****************
+        //  Sweep and Prune
+        // ****************
+
+        void SweepAndPrune::findPairs(const BodyBounds &bounds, std::vector<BodyPair> &pairs) {
+            size_t count = bounds.size();
+            if(count < 2) {
+                pairs.clear();
+                return;
+            }
+
+            // Sweep along the axis the centers spread out the most along
+            int axis = 0;
+            double best = -1.0;
+            for(int c = 0; c < 3; c++) {
+                double sum = 0.0, sum_squared = 0.0;
+                for(size_t i = 0; i < count; i++) {
+                    double center = 0.5 * ((double)bounds.min[c][i] + (double)bounds.max[c][i]);
+                    sum += center;
+                    sum_squared += center * center;
+                }
+                double variance = sum_squared / count - (sum / count) * (sum / count);
+                if(variance > best) { best = variance; axis = c; }
+            }
+
+            // Ties go by index, so the order is the same however it was reached
+            const std::vector<float> &key = bounds.min[axis];
+            auto before = [&](uint32_t lhs, uint32_t rhs) { return key[lhs] < key[rhs] || (key[lhs] == key[rhs] && lhs < rhs); };
+            if(axis != _axis || _order.size() != count) {
+                _order.resize(count);
+                for(size_t i = 0; i < count; i++) _order[i] = (uint32_t)i;
+                std::sort(_order.begin(), _order.end(), before);
+                _axis = axis;
+            } else {
+                for(size_t i = 1; i < count; i++) {
+                    uint32_t moving = _order[i];
+                    size_t j = i;
+                    for(; j > 0 && before(moving, _order[j - 1]); j--) _order[j] = _order[j - 1];
+                    _order[j] = moving;
+                }
+            }
+
+            // Copy bounds into sorted order, so the sweep reads memory in order
+            for(int c = 0; c < 3; c++) {
+                _sorted_min[c].resize(count);
+                _sorted_max[c].resize(count);
+            }
+            Util::parallelFor(count, 4096, [&](size_t begin, size_t end) {
+                for(size_t i = begin; i < end; i++) {
+                    for(int c = 0; c < 3; c++) {
+                        _sorted_min[c][i] = bounds.min[c][_order[i]];
+                        _sorted_max[c][i] = bounds.max[c][_order[i]];
+                    }
+                }
+            });
+
+            // Each bounds is tested against those after it, up to the first that starts past its end
+            int o1 = (axis + 1) % 3, o2 = (axis + 2) % 3;
+            resetFound(_found, count);
+            Util::parallelFor(count, PAIR_GRAIN, [&](size_t begin, size_t end) {
+                std::vector<BodyPair> &found = _found[begin / PAIR_GRAIN];
+                for(size_t i = begin; i < end; i++) {
+                    float reach = _sorted_max[axis][i];
+                    for(size_t j = i + 1; j < count && _sorted_min[axis][j] <= reach; j++) {
+                        if(_sorted_min[o1][i] > _sorted_max[o1][j] || _sorted_min[o1][j] > _sorted_max[o1][i]) continue;
+                        if(_sorted_min[o2][i] > _sorted_max[o2][j] || _sorted_min[o2][j] > _sorted_max[o2][i]) continue;
+                        found.push_back(makePair(bounds.body[_order[i]], bounds.body[_order[j]]));
+                    }
+                }
+            });
+
+            sortPairs(_found, bounds.body.back() + 1, pairs);
+        }
+
+
+
+        // **************
+        //  Uniform Grid
+        // **************
+
+        void UniformGrid::findPairs(const BodyBounds &bounds, std::vector<BodyPair> &pairs) {
+            size_t count = bounds.size();
+            if(count < 2) {
+                pairs.clear();
+                return;
+            }
+
+            // Without a set cell size, cells are twice the median body's size, so a few huge bodies cannot make every
+            // cell huge; bodies larger than a cell would fill many cells, so they stay out of the grid and are tested
+            // against every other body instead
+            _extents.resize(count);
+            for(size_t i = 0; i < count; i++) {
+                float extent = 0.0f;
+                for(int c = 0; c < 3; c++) extent = std::max(extent, bounds.max[c][i] - bounds.min[c][i]);
+                _extents[i] = extent;
+            }
+            double cell = _cell_size;
+            if(cell <= 0.0) {
+                _scratch_extents.assign(_extents.begin(), _extents.end());
+                std::nth_element(_scratch_extents.begin(), _scratch_extents.begin() + count / 2, _scratch_extents.end());
+                cell = 2.0 * _scratch_extents[count / 2];
+                if(cell <= 0.0) cell = 1.0;
+            }
+            const double large_extent = cell;
+            _large.clear();
+            _grid.clear();
+            for(size_t i = 0; i < count; i++) {
+                if(_extents[i] > large_extent) _large.push_back((uint32_t)i);
+                else _grid.push_back((uint32_t)i);
+            }
+
+            float lowest[3] = { 0.0f, 0.0f, 0.0f }, highest[3] = { 0.0f, 0.0f, 0.0f };
+            for(int c = 0; c < 3 && !_grid.empty(); c++) {
+                lowest[c] = bounds.min[c][_grid[0]];
+                highest[c] = bounds.max[c][_grid[0]];
+                for(uint32_t i : _grid) {
+                    lowest[c] = std::min(lowest[c], bounds.min[c][i]);
+                    highest[c] = std::max(highest[c], bounds.max[c][i]);
+                }
+            }
+
+            // Cells are keyed by their packed coordinates; a world too big for the key gets bigger cells
+            uint64_t dims[3];
+            while(true) {
+                double total = 1.0;
+                for(int c = 0; c < 3; c++) {
+                    dims[c] = (uint64_t)std::floor((highest[c] - lowest[c]) / cell) + 1;
+                    total *= (double)dims[c];
+                }
+                if(total < 9.0e18) break;
+                cell *= 2.0;
+            }
+            const double inverse_cell = 1.0 / cell;
+            auto cellOf = [&](float value, int c) {
+                uint64_t index = (uint64_t)std::max(0.0, std::floor((value - lowest[c]) * inverse_cell));
+                return std::min(index, dims[c] - 1);
+            };
+            auto pack = [&](uint64_t x, uint64_t y, uint64_t z) { return (x * dims[1] + y) * dims[2] + z; };
+
+            // One entry per cell each bounds in the grid touches; counted first, so entries can be written in parallel
+            size_t grid_count = _grid.size();
+            _offsets.resize(grid_count + 1);
+            _offsets[0] = 0;
+            Util::parallelFor(grid_count, 4096, [&](size_t begin, size_t end) {
+                for(size_t g = begin; g < end; g++) {
+                    uint32_t i = _grid[g];
+                    size_t cells = 1;
+                    for(int c = 0; c < 3; c++) cells *= cellOf(bounds.max[c][i], c) - cellOf(bounds.min[c][i], c) + 1;
+                    _offsets[g + 1] = cells;
+                }
+            });
+            for(size_t g = 0; g < grid_count; g++) _offsets[g + 1] += _offsets[g];
+            _entries.resize(_offsets[grid_count]);
+            Util::parallelFor(grid_count, 4096, [&](size_t begin, size_t end) {
+                for(size_t g = begin; g < end; g++) {
+                    uint32_t i = _grid[g];
+                    uint64_t lo[3], hi[3];
+                    for(int c = 0; c < 3; c++) { lo[c] = cellOf(bounds.min[c][i], c); hi[c] = cellOf(bounds.max[c][i], c); }
+                    size_t e = _offsets[g];
+                    for(uint64_t x = lo[0]; x <= hi[0]; x++)
+                        for(uint64_t y = lo[1]; y <= hi[1]; y++)
+                            for(uint64_t z = lo[2]; z <= hi[2]; z++) _entries[e++] = Entry{ pack(x, y, z), i };
+                }
+            });
+
+            // Radix sort entries by cell; stable, so each cell lists its bounds in order
+            uint64_t last_cell = dims[0] * dims[1] * dims[2] - 1;
+            unsigned int bits = 0;
+            while(bits < 64 && (last_cell >> bits) != 0) bits++;
+            _scratch.resize(_entries.size());
+            std::vector<size_t> histogram((size_t)1 << RADIX_BITS);
+            for(unsigned int shift = 0; shift < bits; shift += RADIX_BITS) {
+                std::fill(histogram.begin(), histogram.end(), 0);
+                const uint64_t mask = ((uint64_t)1 << RADIX_BITS) - 1;
+                for(const Entry &entry : _entries) histogram[(entry.cell >> shift) & mask]++;
+                size_t sum = 0;
+                for(size_t &bucket : histogram) { size_t next = sum + bucket; bucket = sum; sum = next; }
+                for(const Entry &entry : _entries) _scratch[histogram[(entry.cell >> shift) & mask]++] = entry;
+                _entries.swap(_scratch);
+            }
+
+            // Runs of entries in the same cell
+            std::vector<size_t> runs;
+            for(size_t e = 0; e < _entries.size(); e++)
+                if(e == 0 || _entries[e].cell != _entries[e - 1].cell) runs.push_back(e);
+            runs.push_back(_entries.size());
+
+            // A pair sharing several cells is only reported from the one holding the min corner of their overlap. The
+            // lists after those of the runs are for the large bounds, one per range of every bounds.
+            size_t run_count = runs.size() - 1;
+            size_t run_lists = (run_count + PAIR_GRAIN - 1) / PAIR_GRAIN;
+            size_t large_lists = _large.empty() ? 0 : (count + PAIR_GRAIN - 1) / PAIR_GRAIN;
+            resetFound(_found, (run_lists + large_lists) * PAIR_GRAIN);
+            Util::parallelFor(run_count, PAIR_GRAIN, [&](size_t begin, size_t end) {
+                std::vector<BodyPair> &found = _found[begin / PAIR_GRAIN];
+                for(size_t r = begin; r < end; r++) {
+                    for(size_t e = runs[r]; e < runs[r + 1]; e++) {
+                        uint32_t i = _entries[e].bounds;
+                        for(size_t f = e + 1; f < runs[r + 1]; f++) {
+                            uint32_t j = _entries[f].bounds;
+                            if(!overlaps(bounds, i, j, 0) || !overlaps(bounds, i, j, 1) || !overlaps(bounds, i, j, 2)) continue;
+                            uint64_t corner = pack(cellOf(std::max(bounds.min[0][i], bounds.min[0][j]), 0),
+                                                   cellOf(std::max(bounds.min[1][i], bounds.min[1][j]), 1),
+                                                   cellOf(std::max(bounds.min[2][i], bounds.min[2][j]), 2));
+                            if(corner == _entries[e].cell) found.push_back(makePair(bounds.body[i], bounds.body[j]));
+                        }
+                    }
+                }
+            });
+
+            // Each large bounds against every other; a pair of two large ones is found from the later of them
+            if(!_large.empty()) {
+                Util::parallelFor(count, PAIR_GRAIN, [&](size_t begin, size_t end) {
+                    std::vector<BodyPair> &found = _found[run_lists + begin / PAIR_GRAIN];
+                    for(size_t j = begin; j < end; j++) {
+                        bool large = _extents[j] > large_extent;
+                        for(uint32_t i : _large) {
+                            if(large && i >= j) break;
+                            if(!overlaps(bounds, i, (uint32_t)j, 0) || !overlaps(bounds, i, (uint32_t)j, 1)
+                               || !overlaps(bounds, i, (uint32_t)j, 2)) continue;
+                            found.push_back(makePair(bounds.body[i], bounds.body[j]));
+                        }
+                    }
+                });
+            }
+
+            sortPairs(_found, bounds.body.back() + 1, pairs);
+        }
+
+    }
+}
@@ -1,48 +1,44 @@
 #include "PhysicsInternal.h"
 
-#include "api/CLEngine.h"
 #include "api/Logging.h"
+#include "core/CoreInternal.h"
 
 #include <boost/thread.hpp>
 
-using namespace Swarm::Logging;
+#include <algorithm>
+#include <exception>
 
-// Kernel String Constants
-#include "kernels/kernel_listing.cpp"
+using namespace Swarm::Logging;
 
 namespace Swarm {
     namespace Physics {
 
-        // CL Data
-        //CL::Context* _static_cl_context;
+        Integrator* _static_integrator = nullptr;
 
-        void init() {
+        void init(Backend backend) {
 
-            // CL Creation
-            // -----------
+            // Backend Creation
+            // ----------------
 
-            // Check if there are any Devices
-            if(CL::Device::getAll().empty()) {
-                Log::log_physics(ERR) << "No CL Devices Found to run Physics on (not even a CPU ?!)";
-                // TODO: Throw Physics Init Exception
-                return;
+            if(backend != BACKEND_CPU) {
+                _static_integrator = CLIntegrator::create();
+                if(_static_integrator == nullptr) {
+                    if(backend == BACKEND_CL) Log::log_physics(ERR) << "No CL Devices Found to run Physics on; using the CPU instead";
+                    else Log::log_physics(DEBUG) << "No CL Devices Found to run Physics on; using the CPU";
+                }
             }
-
-            // Get the Best Device to use
-            // TODO: Allow selecting of different and/or more CL Devices for Physics once a GUI exists
-            CL::Device* device = nullptr;
-            for(CL::Device* d : CL::Device::getAll()) {
-                if(device == nullptr) device = d;
-                else if(d->computeUnits() > device->computeUnits()) device = d;
+            if(_static_integrator == nullptr) _static_integrator = new CPUIntegrator();
+
+            // Bodies already created move into the memory the backend integrates them in
+            try {
+                useStorage(_static_integrator->storage());
+            } catch(std::exception &e) {
+                Log::log_physics(ERR) << "Failed to move bodies into CL memory, using the CPU instead: " << e.what();
+                useStorage(nullptr);
+                delete _static_integrator;
+                _static_integrator = new CPUIntegrator();
             }
-            Log::log_physics(DEBUG) << "CL Device Selected for PHysics Calculations: " << device->name();
-
-            // Create the Context
-            const CL::Device* ctx_device_listing[]{ device };
-            CL::Context* context = CL::Context::create(ctx_device_listing, 1);
-
-            CL::Program program_movement(std::string(_static_kernel_calculation_movement), context);
-            CL::Kernel kernel_movement = program_movement.kernel("SimpleMovement");
+            Log::log_physics(INFO) << "Integrating Physics on the " << (_static_integrator->backend() == BACKEND_CL ? "CL Device" : "CPU");
 
             // Start Thread
             startPhysicsThread();
@@ -51,6 +47,18 @@ namespace Swarm {
         void cleanup() {
 
             stopPhysicsThread();
+
+            useStorage(nullptr);
+            delete _static_integrator;
+            _static_integrator = nullptr;
+        }
+
+        Backend backend() {
+            return _static_integrator == nullptr ? BACKEND_AUTO : _static_integrator->backend();
+        }
+
+        void step(float delta_time) {
+            if(_static_integrator != nullptr) stepBodies(*_static_integrator, delta_time);
         }
 
 
@@ -63,14 +71,32 @@ namespace Swarm {
         boost::thread _static_physics_thread;
         std::atomic<bool> _static_run_physics_thread(false);
 
+        // Steps one physics cycle may run to catch up; any more are dropped, so a stall cannot snowball
+        const unsigned int MAX_STEPS_PER_CYCLE = 5;
+
         struct ThreadFunctr_Physics {
             void operator()() {
                 try {
 
                     Log::log_physics(DEBUG) << "Starting Physics Thread";
+                    Util::FramePacer &frame_pacer = Core::pacer(Core::PHYSICS_LOOP);
+                    double accumulated = 0.0;
                     while (_static_run_physics_thread) {
 
-
+                        // Simulate in fixed steps, as many as have come due, so results never depend on the pacing;
+                        // only while the engine runs, and time spent stopped is not caught up on
+                        double delta_time = frame_pacer.pace();
+                        if(Core::state() == Core::RUNNING) {
+                            double step_length = 1.0 / Core::simulationRate();
+                            accumulated += delta_time;
+                            unsigned int steps = 0;
+                            while(accumulated >= step_length && steps < MAX_STEPS_PER_CYCLE) {
+                                step((float)step_length);
+                                accumulated -= step_length;
+                                steps++;
+                            }
+                            if(steps == MAX_STEPS_PER_CYCLE) accumulated = std::min(accumulated, step_length);
+                        } else accumulated = 0.0;
                         boost::this_thread::interruption_point();
                     }
 
@@ -0,0 +1,125 @@
+#include "PhysicsInternal.h"
+
+#include "api/CLEngine.h"
+#include "api/Logging.h"
+
+#include <algorithm>
+#include <exception>
+#include <sstream>
+#include <stdexcept>
+
+using namespace Swarm::Logging;
+
+// Kernel String Constants
+#include "kernels/kernel_listing.cpp"
+
+namespace Swarm {
+    namespace Physics {
+
+        // The kernels get the host's layout as a #define per component group, ahead of their own source
+        std::string layoutSource() {
+            std::ostringstream source;
+            #define SWARM_BODY_DEFINE(name, floats) source << "#define " #name " " << BODY_##name << "\n";
+            SWARM_BODY_LAYOUT(SWARM_BODY_DEFINE)
+            #undef SWARM_BODY_DEFINE
+            return source.str();
+        }
+
+        // Blocks of bodies, each a buffer kept mapped into host memory while it is not integrating
+        struct CLBodyStorage : public BodyStorage {
+            CL::Context* context;
+            CL::CommandQueue &queue;
+            std::vector<std::pair<float*, CL::MappedBuffer<float>*>> blocks;
+
+            CLBodyStorage(CL::Context* ctx, CL::CommandQueue &queue) : context(ctx), queue(queue) {}
+
+            ~CLBodyStorage() {
+                for(auto &block : blocks) delete block.second;
+            }
+
+            float* allocate(size_t floats) {
+                CL::MappedBuffer<float>* buffer = new CL::MappedBuffer<float>(context, true, true, floats);
+                float* data = queue.enqueueMap(*buffer, true, true);
+                blocks.emplace_back(data, buffer);
+                return data;
+            }
+
+            void release(float* data) {
+                auto iter = std::find_if(blocks.begin(), blocks.end(), [&](const std::pair<float*, CL::MappedBuffer<float>*> &block) {
+                    return block.first == data;
+                });
+                if(iter == blocks.end()) return;
+                queue.enqueueUnmap(*iter->second, iter->first);
+                queue.finish();
+                delete iter->second;
+                blocks.erase(iter);
+            }
+
+            std::pair<float*, CL::MappedBuffer<float>*> &block(float* data) {
+                for(auto &block : blocks) if(block.first == data) return block;
+                throw std::logic_error("Bodies are not stored in a CL buffer");
+            }
+        };
+
+        struct CLIntegrator::State {
+            CL::Program program;
+            CL::Kernel kernel;
+            CL::CommandQueue queue;
+            CLBodyStorage storage;
+
+            State(CL::Context* ctx, const CL::Device* device)
+                    : program(layoutSource() + _static_kernel_calculation_movement, ctx),
+                      kernel(program.kernel("SimpleMovement")),
+                      queue(ctx, device),
+                      storage(ctx, queue) {}
+        };
+
+        CLIntegrator* CLIntegrator::create() {
+            if(CL::Device::getAll().empty()) return nullptr;
+
+            // Get the Best Device to use
+            // TODO: Allow selecting of different and/or more CL Devices for Physics once a GUI exists
+            CL::Device* device = nullptr;
+            for(CL::Device* d : CL::Device::getAll()) {
+                if(device == nullptr) device = d;
+                else if(d->computeUnits() > device->computeUnits()) device = d;
+            }
+            Log::log_physics(DEBUG) << "CL Device Selected for Physics Calculations: " << device->name();
+
+            try {
+                const CL::Device* ctx_device_listing[]{ device };
+                CL::Context* context = CL::Context::create(ctx_device_listing, 1);
+                return new CLIntegrator(new State(context, device));
+            } catch(std::exception &e) {
+                Log::log_physics(ERR) << "Failed to create the CL Physics backend: " << e.what();
+                return nullptr;
+            }
+        }
+
+        CLIntegrator::~CLIntegrator() {
+            delete _state;
+        }
+
+        BodyStorage* CLIntegrator::storage() {
+            return &_state->storage;
+        }
+
+        void CLIntegrator::integrate(RigidBodies &bodies, float delta_time) {
+            if(bodies.count == 0) return;
+
+            // Unmapped for the kernel, then mapped back; the bodies move with the mapping, but are never copied
+            std::pair<float*, CL::MappedBuffer<float>*> &block = _state->storage.block(bodies.data());
+            _state->queue.enqueueUnmap(*block.second, block.first);
+
+            unsigned int stride = (unsigned int)bodies.padded();
+            _state->kernel.argument(0, *block.second);
+            _state->kernel.argument(1, 1, &stride);
+            _state->kernel.argument(2, 1, &delta_time);
+            _state->queue.enqueueCommand(_state->kernel, bodies.padded());
+
+            block.first = _state->queue.enqueueMap(*block.second, true, true);
+            bodies.bind(block.first);
+        }
+
+    }
+}
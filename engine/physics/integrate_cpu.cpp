@@ -0,0 +1,100 @@
+#include "PhysicsInternal.h"
+
+#include "util/SIMD.h"
+
+using namespace Swarm::SIMD;
+
+namespace Swarm {
+    namespace Physics {
+
+        // Bodies per parallelFor range; big enough that each range outweighs handing it out
+        const size_t INTEGRATE_GRAIN = 4096;
+
+        struct vvec3 {
+            vfloat x, y, z;
+        };
+
+        inline vvec3 load3(float* const* components, size_t i) {
+            return { vfloat::load(&components[0][i]), vfloat::load(&components[1][i]), vfloat::load(&components[2][i]) };
+        }
+
+        inline void store3(float* const* components, size_t i, const vvec3 &value) {
+            value.x.store(&components[0][i]);
+            value.y.store(&components[1][i]);
+            value.z.store(&components[2][i]);
+        }
+
+        inline vvec3 cross(const vvec3 &a, const vvec3 &b) {
+            return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+        }
+
+        // Rotates 'v' by the unit quaternion (u, s)
+        inline vvec3 rotate(const vvec3 &u, vfloat s, const vvec3 &v) {
+            const vfloat two(2.0f);
+            vvec3 uv = cross(u, v);
+            vvec3 t = { two * uv.x, two * uv.y, two * uv.z };
+            vvec3 ut = cross(u, t);
+            return { madd(s, t.x, v.x) + ut.x, madd(s, t.y, v.y) + ut.y, madd(s, t.z, v.z) + ut.z };
+        }
+
+        void CPUIntegrator::integrateRange(RigidBodies &bodies, float delta_time, size_t begin, size_t end) {
+            RigidBodyProperties &props = bodies.properties;
+            RigidBodyMotion &motion = bodies.motion;
+            RigidBodyForces &forces = bodies.forces;
+
+            const vfloat dt(delta_time);
+            const vfloat half_dt(0.5f * delta_time);
+            const vfloat zero(0.0f), one(1.0f);
+
+            for(size_t i = begin; i < end; i += vfloat::width) {
+
+                // Linear; velocity first, then position from the new velocity
+                vfloat step = dt * vfloat::load(&props.inverse_mass[i]);
+                vvec3 force = load3(forces.force, i);
+                vvec3 velocity = load3(motion.velocity_linear, i);
+                velocity = { madd(force.x, step, velocity.x), madd(force.y, step, velocity.y), madd(force.z, step, velocity.z) };
+                vvec3 position = load3(motion.position, i);
+                position = { madd(velocity.x, dt, position.x), madd(velocity.y, dt, position.y), madd(velocity.z, dt, position.z) };
+                store3(motion.velocity_linear, i, velocity);
+                store3(motion.position, i, position);
+
+                // Angular; the inertia is diagonal about the body's axes, so the torque is taken into body space,
+                // scaled, and brought back. The gyroscopic term is left out, as it is unstable with explicit steps.
+                vvec3 q = load3(motion.orientation, i);
+                vfloat qw = vfloat::load(&motion.orientation[3][i]);
+                vvec3 q_inverse = { -q.x, -q.y, -q.z };
+                vvec3 torque = rotate(q_inverse, qw, load3(forces.torque, i));
+                torque = { torque.x * vfloat::load(&props.inverse_inertia[0][i]),
+                           torque.y * vfloat::load(&props.inverse_inertia[1][i]),
+                           torque.z * vfloat::load(&props.inverse_inertia[2][i]) };
+                vvec3 acceleration = rotate(q, qw, torque);
+                vvec3 spin = load3(motion.velocity_angular, i);
+                spin = { madd(acceleration.x, dt, spin.x), madd(acceleration.y, dt, spin.y), madd(acceleration.z, dt, spin.z) };
+                store3(motion.velocity_angular, i, spin);
+
+                // dq/dt = 0.5 * (spin, 0) * q, then renormalized
+                vvec3 spin_cross = cross(spin, q);
+                vfloat rx = madd(half_dt, madd(qw, spin.x, spin_cross.x), q.x);
+                vfloat ry = madd(half_dt, madd(qw, spin.y, spin_cross.y), q.y);
+                vfloat rz = madd(half_dt, madd(qw, spin.z, spin_cross.z), q.z);
+                vfloat rw = qw - half_dt * dot3(spin.x, spin.y, spin.z, q.x, q.y, q.z);
+                vfloat scale = one / sqrt(rx * rx + ry * ry + rz * rz + rw * rw);
+                (rx * scale).store(&motion.orientation[0][i]);
+                (ry * scale).store(&motion.orientation[1][i]);
+                (rz * scale).store(&motion.orientation[2][i]);
+                (rw * scale).store(&motion.orientation[3][i]);
+
+                store3(forces.force, i, { zero, zero, zero });
+                store3(forces.torque, i, { zero, zero, zero });
+            }
+        }
+
+        void CPUIntegrator::integrate(RigidBodies &bodies, float delta_time) {
+            size_t count = (bodies.count + BODY_PADDING - 1) / BODY_PADDING * BODY_PADDING;
+            Util::parallelFor(count / BODY_PADDING, INTEGRATE_GRAIN / BODY_PADDING, [&](size_t begin, size_t end) {
+                integrateRange(bodies, delta_time, begin * BODY_PADDING, end * BODY_PADDING);
+            });
+        }
+
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// The one definition of how a body is laid out; each entry is a component group and the number of floats in it.
+// Host code gets an offset per group from this, and the CL kernels the same offsets as #defines, so both always agree.
+// Component 'c' of body 'i' is at 'c * stride + i', where the stride is the padded body count.
+#define SWARM_BODY_LAYOUT(ENTRY) \
+    ENTRY(INVERSE_MASS,     1)  \
+    ENTRY(INVERSE_INERTIA,  3)  /* Principal moments, about the body's own axes */ \
+    ENTRY(RADIUS,           1)  /* Bounding sphere; '0' leaves the body out of the broad phase */ \
+    ENTRY(POSITION,         3)  \
+    ENTRY(ORIENTATION,      4)  /* Quaternion x, y, z, w */ \
+    ENTRY(VELOCITY_LINEAR,  3)  \
+    ENTRY(VELOCITY_ANGULAR, 3)  /* About the world axes */ \
+    ENTRY(FORCE,            3)  \
+    ENTRY(TORQUE,           3)  /* About the world axes */
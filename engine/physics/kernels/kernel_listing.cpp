@@ -1,11 +1,10 @@
 
-
 namespace Swarm {
     namespace Physics {
 
-        const char *_static_kernel_calculation_movement = R"(
+        const char *_static_kernel_calculation_movement =
 #include "movement.cl"
-)";
+;
 
     }
-}
\ No newline at end of file
+}
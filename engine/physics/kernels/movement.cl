@@ -1,35 +1,52 @@
+// Included by kernel_listing.cpp as one string literal, so the CL compiler sees only what is between the delimiters
+R"CL(
 
-typedef struct {
-    float mass;
-} RigidBodyProperties;
+// Bodies are packed one component after another; component c of body i is at state[c * stride + i]. The offset of
+// each component group (INVERSE_MASS, POSITION, ...) is #defined ahead of this source, from body_layout.h
 
-typedef struct {
-    float3 position;
-    float3 rotation;
-    float3 velocity_linear;
-    float3 velocity_angular;
-} RigidBodyMotion;
-
-typedef struct {
-    float3 force;
-    float3 torque;
-} RigidBodyForces;
+float3 load3(__global const float* state, uint stride, uint component, uint i) {
+    return (float3)(state[component * stride + i], state[(component + 1) * stride + i], state[(component + 2) * stride + i]);
+}
 
+void store3(__global float* state, uint stride, uint component, uint i, float3 value) {
+    state[component * stride + i] = value.x;
+    state[(component + 1) * stride + i] = value.y;
+    state[(component + 2) * stride + i] = value.z;
+}
 
+// Rotates v by the unit quaternion q
+float3 quatRotate(float4 q, float3 v) {
+    float3 t = 2.0f * cross(q.xyz, v);
+    return v + q.w * t + cross(q.xyz, t);
+}
 
+// Semi-implicit Euler; velocities from forces first, then positions and orientations from the new velocities
 __kernel void SimpleMovement (
-        __global RigidBodyProperties* rb_props,
-        __global RigidBodyMotion* rb_motion,
-        __global RigidBodyForces* rb_forces,
-        __global float delta_time)
+        __global float* state,
+        const uint stride,
+        const float delta_time)
 {
-    const int i = get_global_id(0);
-
-    rb_motion[i].velocity_linear += delta_time * rb_props[i].mass / rb_forces[i].force;
-
-    // This needs to be changed to actual angular velocity formula
-    rb_motion[i].velocity_angular += delta_time * rb_props[i].mass / rb_forces[i].torque;
-
-    rb_motion[i].position = delta_time * rb_motion[i].velocity_linear;
-    rb_motion[i].rotation = delta_time * rb_motion[i].velocity_angular;
-}
\ No newline at end of file
+    const uint i = get_global_id(0);
+
+    float3 velocity = load3(state, stride, VELOCITY_LINEAR, i)
+                    + delta_time * state[INVERSE_MASS * stride + i] * load3(state, stride, FORCE, i);
+    store3(state, stride, VELOCITY_LINEAR, i, velocity);
+    store3(state, stride, POSITION, i, load3(state, stride, POSITION, i) + delta_time * velocity);
+
+    // The inertia is diagonal about the body's axes, so the torque is taken into body space, scaled, and brought back
+    float4 q = (float4)(load3(state, stride, ORIENTATION, i), state[(ORIENTATION + 3) * stride + i]);
+    float3 torque = quatRotate((float4)(-q.xyz, q.w), load3(state, stride, TORQUE, i)) * load3(state, stride, INVERSE_INERTIA, i);
+    float3 spin = load3(state, stride, VELOCITY_ANGULAR, i) + delta_time * quatRotate(q, torque);
+    store3(state, stride, VELOCITY_ANGULAR, i, spin);
+
+    // dq/dt = 0.5 * (spin, 0) * q, then renormalized
+    float4 dq = (float4)(q.w * spin + cross(spin, q.xyz), -dot(spin, q.xyz));
+    q = normalize(q + 0.5f * delta_time * dq);
+    store3(state, stride, ORIENTATION, i, q.xyz);
+    state[(ORIENTATION + 3) * stride + i] = q.w;
+
+    store3(state, stride, FORCE, i, (float3)(0.0f));
+    store3(state, stride, TORQUE, i, (float3)(0.0f));
+}
+
+)CL"
@@ -2,22 +2,358 @@
 
 #include "api/Logging.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
 using namespace Swarm::Logging;
 
 namespace Swarm {
     namespace Physics {
 
-        Util::ReadWriteBuffer<RigidBodyProperties> _static_buffer_rigidbody_properties;
-        Util::ReadWriteBuffer<RigidBodyForces> _static_buffer_rigidbody_forces;
-        Util::ReadWriteBuffer<RigidBodyMotion> _static_buffer_rigidbody_motion;
+        // ***************
+        //  Rigid Bodies
+        // ***************
+
+        float* HostBodyStorage::allocate(size_t floats) {
+            const size_t extra = BODY_ALIGNMENT / sizeof(float);
+            float* allocation = new float[floats + extra];
+            float* block = allocation + (BODY_ALIGNMENT - (uintptr_t)allocation % BODY_ALIGNMENT) % BODY_ALIGNMENT / sizeof(float);
+            _allocations[block] = allocation;
+            return block;
+        }
+
+        void HostBodyStorage::release(float* block) {
+            auto iter = _allocations.find(block);
+            if(iter == _allocations.end()) return;
+            delete [] iter->second;
+            _allocations.erase(iter);
+        }
+
+        // Value of a padding body; at rest, with an identity orientation
+        inline float restValue(size_t component) {
+            return component == BODY_ORIENTATION + 3 ? 1.0f : 0.0f;
+        }
+
+        RigidBodies::~RigidBodies() {
+            if(_data != nullptr) _storage->release(_data);
+        }
+
+        void RigidBodies::bind(float* data) {
+            _data = data;
+            auto component = [&](size_t c) { return data + c * _stride; };
+            properties.inverse_mass = component(BODY_INVERSE_MASS);
+            properties.radius = component(BODY_RADIUS);
+            for(int c = 0; c < 3; c++) {
+                properties.inverse_inertia[c] = component(BODY_INVERSE_INERTIA + c);
+                motion.position[c] = component(BODY_POSITION + c);
+                motion.velocity_linear[c] = component(BODY_VELOCITY_LINEAR + c);
+                motion.velocity_angular[c] = component(BODY_VELOCITY_ANGULAR + c);
+                forces.force[c] = component(BODY_FORCE + c);
+                forces.torque[c] = component(BODY_TORQUE + c);
+            }
+            for(int c = 0; c < 4; c++) motion.orientation[c] = component(BODY_ORIENTATION + c);
+        }
+
+        void RigidBodies::resize(size_t size) {
+            float* data = _storage->allocate(BODY_COMPONENTS * size);
+            for(size_t c = 0; c < BODY_COMPONENTS; c++) {
+                float* component = data + c * size;
+                if(_data != nullptr) std::copy(_data + c * _stride, _data + c * _stride + std::min(_stride, size), component);
+                std::fill(component + std::min(_stride, size), component + size, restValue(c));
+            }
+            if(_data != nullptr) _storage->release(_data);
+            _stride = size;
+            bind(data);
+        }
+
+        void RigidBodies::setStorage(BodyStorage* storage) {
+            if(storage == _storage) return;
+            float* data = nullptr;
+            if(_data != nullptr) {
+                data = storage->allocate(BODY_COMPONENTS * _stride);
+                std::copy(_data, _data + BODY_COMPONENTS * _stride, data);
+                _storage->release(_data);
+            }
+            _storage = storage;
+            if(data != nullptr) bind(data);
+        }
+
+        size_t RigidBodies::add(float inverse_mass, const glm::vec3 &inverse_inertia) {
+            // Never a power of two, which would put every component array in the same cache sets
+            if(count == padded()) resize(padded() * 2 + BODY_PADDING);
+            size_t index = count++;
+            properties.inverse_mass[index] = inverse_mass;
+            for(int c = 0; c < 3; c++) properties.inverse_inertia[c][index] = inverse_inertia[c];
+            return index;
+        }
+
+        void RigidBodies::remove(size_t index) {
+            size_t last = --count;
+            for(size_t c = 0; c < BODY_COMPONENTS; c++) {
+                float* component = _data + c * _stride;
+                if(index != last) component[index] = component[last];
+
+                // The freed lane becomes padding again
+                component[last] = restValue(c);
+            }
+        }
+
+        HostBodyStorage _static_host_storage;
+        RigidBodies _static_bodies(&_static_host_storage);
+        boost::mutex _static_bodies_mutex;
+
+        // Objects keep a slot for life, while the index of their body moves as others are removed
+        std::vector<size_t> _static_slot_index;
+        std::vector<PhysicsObject*> _static_slot_object;
+        std::vector<size_t> _static_index_slot;
+        std::vector<size_t> _static_free_slots;
+
+        // Bumped whenever a body is removed, which moves the indices pairs refer to
+        size_t _static_body_removals = 0;
+
+        // The broad phase has its own lock, and runs on bounds gathered under the body lock, so reading or moving a
+        // body never waits for it. Taken before the body lock when both are needed.
+        boost::mutex _static_broad_phase_mutex;
+        SweepAndPrune _static_sweep_and_prune;
+        UniformGrid _static_uniform_grid;
+        PairFinder* _static_pair_finder = &_static_sweep_and_prune;
+        BodyBounds _static_bounds;
+        std::vector<BodyPair> _static_pairs;
+        size_t _static_pairs_removals = 0; // _static_body_removals when the pairs' bounds were gathered
+        StepStats _static_step_stats;
+
+        double millisecondsSince(std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        void useStorage(BodyStorage* storage) {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            _static_bodies.setStorage(storage != nullptr ? storage : &_static_host_storage);
+        }
+
+        void stepBodies(Integrator &integrator, float delta_time) {
+            boost::lock_guard<boost::mutex> broad_phase_lock(_static_broad_phase_mutex);
+            double gather_ms = 0.0;
+            {
+                boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+                auto start = std::chrono::steady_clock::now();
+                integrator.integrate(_static_bodies, delta_time);
+                _static_step_stats.integrate_ms = millisecondsSince(start);
+
+                start = std::chrono::steady_clock::now();
+                if(_static_pair_finder != nullptr) _static_bounds.gather(_static_bodies);
+                gather_ms = millisecondsSince(start);
+                _static_step_stats.bodies = _static_bodies.count;
+                _static_pairs_removals = _static_body_removals;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            if(_static_pair_finder != nullptr) _static_pair_finder->findPairs(_static_bounds, _static_pairs);
+            else _static_pairs.clear();
+            _static_step_stats.broad_phase_ms = gather_ms + millisecondsSince(start);
+            _static_step_stats.pairs = _static_pairs.size();
+        }
+
+        void setBroadPhase(BroadPhase broad_phase) {
+            boost::lock_guard<boost::mutex> lock(_static_broad_phase_mutex);
+            switch(broad_phase) {
+                case BROAD_PHASE_NONE:  _static_pair_finder = nullptr; break;
+                case BROAD_PHASE_SWEEP: _static_pair_finder = &_static_sweep_and_prune; break;
+                case BROAD_PHASE_GRID:  _static_pair_finder = &_static_uniform_grid; break;
+            }
+        }
+
+        BroadPhase broadPhase() {
+            boost::lock_guard<boost::mutex> lock(_static_broad_phase_mutex);
+            return _static_pair_finder == nullptr ? BROAD_PHASE_NONE : _static_pair_finder->type();
+        }
+
+        void setGridCellSize(float size) {
+            boost::lock_guard<boost::mutex> lock(_static_broad_phase_mutex);
+            _static_uniform_grid.setCellSize(std::max(size, 0.0f));
+        }
+
+        float gridCellSize() {
+            boost::lock_guard<boost::mutex> lock(_static_broad_phase_mutex);
+            return _static_uniform_grid.cellSize();
+        }
+
+        std::vector<std::pair<PhysicsObject*, PhysicsObject*>> overlaps() {
+            boost::lock_guard<boost::mutex> broad_phase_lock(_static_broad_phase_mutex);
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            std::vector<std::pair<PhysicsObject*, PhysicsObject*>> result;
+            if(_static_pairs_removals != _static_body_removals) return result;
+            result.reserve(_static_pairs.size());
+            for(const BodyPair &pair : _static_pairs)
+                result.emplace_back(_static_slot_object[_static_index_slot[pair.a]], _static_slot_object[_static_index_slot[pair.b]]);
+            return result;
+        }
 
-        PhysicsObjectInternal::PhysicsObjectInternal()
-                : _properties(_static_buffer_rigidbody_properties),
-                  _forces(_static_buffer_rigidbody_forces),
-                  _motion(_static_buffer_rigidbody_motion)
-        {
+        StepStats stepStats() {
+            boost::lock_guard<boost::mutex> lock(_static_broad_phase_mutex);
+            return _static_step_stats;
+        }
+
+        size_t bodyCount() {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            return _static_bodies.count;
+        }
+
+
+
+        // ****************
+        //  Physics Object
+        // ****************
+
+        float inverse(float value) { return value > 0.0f ? 1.0f / value : 0.0f; }
+
+        PhysicsObject::PhysicsObject(float mass, const Vec3 &inertia) {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            size_t index = _static_bodies.add(inverse(mass), glm::vec3(inverse(inertia.x), inverse(inertia.y), inverse(inertia.z)));
+            if(_static_free_slots.empty()) {
+                _slot = _static_slot_index.size();
+                _static_slot_index.push_back(index);
+                _static_slot_object.push_back(this);
+            } else {
+                _slot = _static_free_slots.back();
+                _static_free_slots.pop_back();
+                _static_slot_index[_slot] = index;
+                _static_slot_object[_slot] = this;
+            }
+            if(_static_index_slot.size() <= index) _static_index_slot.resize(index + 1);
+            _static_index_slot[index] = _slot;
+        }
+
+        PhysicsObject::~PhysicsObject() {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            size_t index = _static_slot_index[_slot];
+            size_t last = _static_bodies.count - 1;
+            _static_bodies.remove(index);
+            if(index != last) {
+                _static_index_slot[index] = _static_index_slot[last];
+                _static_slot_index[_static_index_slot[index]] = index;
+            }
+            _static_slot_object[_slot] = nullptr;
+            _static_free_slots.push_back(_slot);
+
+            // Pairs are by index, and indices have moved
+            _static_body_removals++;
+        }
+
+        Vec3 read3(float* const* components, size_t slot) {
+            size_t index = _static_slot_index[slot];
+            return Vec3(components[0][index], components[1][index], components[2][index]);
+        }
+
+        void write3(float* const* components, size_t slot, const Vec3 &value) {
+            size_t index = _static_slot_index[slot];
+            components[0][index] = value.x;
+            components[1][index] = value.y;
+            components[2][index] = value.z;
+        }
+
+        Vec3 PhysicsObject::position() const {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            return read3(_static_bodies.motion.position, _slot);
+        }
+
+        void PhysicsObject::setPosition(const Vec3 &position) {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            write3(_static_bodies.motion.position, _slot, position);
+        }
+
+        Quat PhysicsObject::orientation() const {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            size_t index = _static_slot_index[_slot];
+            float* const* q = _static_bodies.motion.orientation;
+            return Quat(q[0][index], q[1][index], q[2][index], q[3][index]);
+        }
+
+        void PhysicsObject::setOrientation(const Quat &orientation) {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            size_t index = _static_slot_index[_slot];
+            float* const* q = _static_bodies.motion.orientation;
+            float length = std::sqrt(orientation.x * orientation.x + orientation.y * orientation.y +
+                                     orientation.z * orientation.z + orientation.w * orientation.w);
+            if(length <= 0.0f) {
+                Log::log_physics(ERR) << "Ignoring zero-length orientation";
+                return;
+            }
+            q[0][index] = orientation.x / length;
+            q[1][index] = orientation.y / length;
+            q[2][index] = orientation.z / length;
+            q[3][index] = orientation.w / length;
+        }
+
+        Vec3 PhysicsObject::velocity() const {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            return read3(_static_bodies.motion.velocity_linear, _slot);
+        }
+
+        void PhysicsObject::setVelocity(const Vec3 &velocity) {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            write3(_static_bodies.motion.velocity_linear, _slot, velocity);
+        }
+
+        Vec3 PhysicsObject::angularVelocity() const {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            return read3(_static_bodies.motion.velocity_angular, _slot);
+        }
+
+        void PhysicsObject::setAngularVelocity(const Vec3 &velocity) {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            write3(_static_bodies.motion.velocity_angular, _slot, velocity);
+        }
+
+        void PhysicsObject::applyForce(const Vec3 &force) {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            Vec3 total = read3(_static_bodies.forces.force, _slot);
+            write3(_static_bodies.forces.force, _slot, Vec3(total.x + force.x, total.y + force.y, total.z + force.z));
+        }
+
+        void PhysicsObject::applyTorque(const Vec3 &torque) {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            Vec3 total = read3(_static_bodies.forces.torque, _slot);
+            write3(_static_bodies.forces.torque, _slot, Vec3(total.x + torque.x, total.y + torque.y, total.z + torque.z));
+        }
+
+        void PhysicsObject::modelMatrix(float* matrix) const {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            size_t index = _static_slot_index[_slot];
+            float* const* q = _static_bodies.motion.orientation;
+            float* const* position = _static_bodies.motion.position;
+            float x = q[0][index], y = q[1][index], z = q[2][index], w = q[3][index];
+
+            // Rotation of the unit quaternion, then translation
+            matrix[0] = 1.0f - 2.0f * (y * y + z * z);
+            matrix[1] = 2.0f * (x * y + z * w);
+            matrix[2] = 2.0f * (x * z - y * w);
+            matrix[3] = 0.0f;
+            matrix[4] = 2.0f * (x * y - z * w);
+            matrix[5] = 1.0f - 2.0f * (x * x + z * z);
+            matrix[6] = 2.0f * (y * z + x * w);
+            matrix[7] = 0.0f;
+            matrix[8] = 2.0f * (x * z + y * w);
+            matrix[9] = 2.0f * (y * z - x * w);
+            matrix[10] = 1.0f - 2.0f * (x * x + y * y);
+            matrix[11] = 0.0f;
+            matrix[12] = position[0][index];
+            matrix[13] = position[1][index];
+            matrix[14] = position[2][index];
+            matrix[15] = 1.0f;
+        }
+
+        float PhysicsObject::radius() const {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            return _static_bodies.properties.radius[_static_slot_index[_slot]];
+        }
 
+        void PhysicsObject::setRadius(float radius) {
+            boost::lock_guard<boost::mutex> lock(_static_bodies_mutex);
+            _static_bodies.properties.radius[_static_slot_index[_slot]] = std::max(radius, 0.0f);
         }
 
     }
-}
\ No newline at end of file
+}
@@ -7,8 +7,15 @@
 
 #include "api/Util.h"
 
+#include "util/SIMD.h"
+
 #include <boost/thread.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+
 
 // ************
 //  Code Begin
@@ -17,6 +24,199 @@
 namespace Swarm {
     namespace Render {
 
+        class DeviceGL : public Device {
+        public:
+            virtual bool compileShader(SWMuint &id, SWMenum type, const std::string &src, std::string &log);
+            virtual void deleteShader(SWMuint shader);
+
+            virtual bool linkProgram(SWMuint &id, const std::vector<SWMuint> &shaders, std::string &log);
+            virtual void deleteProgram(SWMuint program);
+            virtual void useProgram(SWMuint program);
+            virtual SWMint uniformLocation(SWMuint program, const std::string &name);
+            virtual void activeUniforms(SWMuint program, std::vector<std::pair<std::string, SWMint>> &uniforms);
+            virtual void activeUniformBlocks(SWMuint program, std::vector<UniformBlock> &blocks);
+            virtual void uniformBlockBinding(SWMuint program, SWMuint block, SWMuint binding);
+
+            virtual void uniformf (SWMint location, SWMsizei components, SWMsizei count, const SWMfloat* data);
+            virtual void uniformi (SWMint location, SWMsizei components, SWMsizei count, const SWMint*   data);
+            virtual void uniformui(SWMint location, SWMsizei components, SWMsizei count, const SWMuint*  data);
+            virtual void uniformMatrix(SWMint location, SWMsizei columns, SWMsizei rows, SWMsizei count, const SWMfloat* data);
+
+            virtual SWMuint createBuffer();
+            virtual void deleteBuffer(SWMuint buffer);
+            virtual void bindBuffer(SWMenum target, SWMuint buffer);
+            virtual void bindBufferRange(SWMenum target, SWMuint index, SWMuint buffer, size_t offset, size_t bytes);
+            virtual void bufferData(SWMenum target, size_t bytes, const void* data);
+            virtual void bufferStream(SWMenum target, size_t bytes, const void* data);
+
+            virtual SWMuint createVertexArray();
+            virtual void deleteVertexArray(SWMuint vao);
+            virtual void bindVertexArray(SWMuint vao);
+            virtual void vertexAttribute(SWMuint attrib, SWMint components, SWMenum type, bool normalized,
+                                         SWMsizei stride, size_t offset, SWMuint divisor);
+
+            virtual SWMuint createTexture();
+            virtual void deleteTexture(SWMuint texture);
+            virtual void bindTexture(SWMuint active, SWMenum target, SWMuint texture);
+            virtual void textureImage2D(SWMuint texture, unsigned int width, unsigned int height, const void* pixels);
+
+            virtual void viewport(SWMint x, SWMint y, SWMsizei width, SWMsizei height);
+            virtual void clear(float r, float g, float b, float a);
+            virtual void enable(SWMenum capability, bool enabled);
+            virtual void drawElements(SWMenum mode, SWMsizei count, SWMenum type, size_t offset);
+            virtual void drawElementsInstanced(SWMenum mode, SWMsizei count, SWMenum type, size_t offset, SWMsizei instances);
+
+            virtual SWMuint fenceSync();
+            virtual bool fenceSignaled(SWMuint fence);
+            virtual void deleteFence(SWMuint fence);
+
+        protected:
+            // GL fences are pointers; they are named like every other object, by a number
+            boost::mutex _fence_mutex;
+            std::unordered_map<SWMuint, GLsync> _fences;
+            SWMuint _next_fence = 1;
+        };
+
+        class RecordingDeviceInternal : public RecordingDevice {
+        public:
+            virtual bool compileShader(SWMuint &id, SWMenum type, const std::string &src, std::string &log);
+            virtual void deleteShader(SWMuint shader);
+
+            virtual bool linkProgram(SWMuint &id, const std::vector<SWMuint> &shaders, std::string &log);
+            virtual void deleteProgram(SWMuint program);
+            virtual void useProgram(SWMuint program);
+            virtual SWMint uniformLocation(SWMuint program, const std::string &name);
+            virtual void activeUniforms(SWMuint program, std::vector<std::pair<std::string, SWMint>> &uniforms);
+            virtual void activeUniformBlocks(SWMuint program, std::vector<UniformBlock> &blocks);
+            virtual void uniformBlockBinding(SWMuint program, SWMuint block, SWMuint binding);
+
+            virtual void uniformf (SWMint location, SWMsizei components, SWMsizei count, const SWMfloat* data);
+            virtual void uniformi (SWMint location, SWMsizei components, SWMsizei count, const SWMint*   data);
+            virtual void uniformui(SWMint location, SWMsizei components, SWMsizei count, const SWMuint*  data);
+            virtual void uniformMatrix(SWMint location, SWMsizei columns, SWMsizei rows, SWMsizei count, const SWMfloat* data);
+
+            virtual SWMuint createBuffer();
+            virtual void deleteBuffer(SWMuint buffer);
+            virtual void bindBuffer(SWMenum target, SWMuint buffer);
+            virtual void bindBufferRange(SWMenum target, SWMuint index, SWMuint buffer, size_t offset, size_t bytes);
+            virtual void bufferData(SWMenum target, size_t bytes, const void* data);
+            virtual void bufferStream(SWMenum target, size_t bytes, const void* data);
+
+            virtual SWMuint createVertexArray();
+            virtual void deleteVertexArray(SWMuint vao);
+            virtual void bindVertexArray(SWMuint vao);
+            virtual void vertexAttribute(SWMuint attrib, SWMint components, SWMenum type, bool normalized,
+                                         SWMsizei stride, size_t offset, SWMuint divisor);
+
+            virtual SWMuint createTexture();
+            virtual void deleteTexture(SWMuint texture);
+            virtual void bindTexture(SWMuint active, SWMenum target, SWMuint texture);
+            virtual void textureImage2D(SWMuint texture, unsigned int width, unsigned int height, const void* pixels);
+
+            virtual void viewport(SWMint x, SWMint y, SWMsizei width, SWMsizei height);
+            virtual void clear(float r, float g, float b, float a);
+            virtual void enable(SWMenum capability, bool enabled);
+            virtual void drawElements(SWMenum mode, SWMsizei count, SWMenum type, size_t offset);
+            virtual void drawElementsInstanced(SWMenum mode, SWMsizei count, SWMenum type, size_t offset, SWMsizei instances);
+
+            virtual SWMuint fenceSync();
+            virtual bool fenceSignaled(SWMuint fence);
+            virtual void deleteFence(SWMuint fence);
+
+            virtual DeviceStats stats() const;
+            virtual std::vector<DeviceCommand> commands() const;
+            virtual void setRecordCommands(bool record);
+            virtual bool recordCommands() const;
+            virtual void reset();
+
+            static void cleanup();
+
+        protected:
+            void record(DeviceCommandType type, SWMuint target, SWMuint object, size_t count, size_t bytes,
+                        const void* data = nullptr);
+            void uniform(SWMint location, SWMsizei count, size_t bytes, const void* data);
+
+            mutable boost::mutex _mutex;
+            bool _record_commands = true;
+            std::vector<DeviceCommand> _commands;
+            DeviceStats _stats;
+
+            // One counter names every kind of object, so names are unique across the whole command stream
+            SWMuint _next_name = 1;
+            std::unordered_map<SWMuint, std::vector<std::string>> _shader_uniforms; // Declared in each shader's source
+            std::unordered_map<SWMuint, std::vector<UniformBlock>> _shader_blocks;
+            std::unordered_map<SWMuint, std::unordered_map<std::string, SWMint>> _uniform_locations;
+            std::unordered_map<SWMuint, std::vector<UniformBlock>> _uniform_blocks;
+
+            // Bound State
+            SWMuint _program = 0;
+            SWMuint _vertex_array = 0;
+            std::unordered_map<SWMenum, SWMuint> _buffers;
+            std::unordered_map<SWMuint, SWMuint> _textures;
+        };
+
+        //! State cache \ref device() puts in front of the Device set with \ref setDevice()
+        /*!
+         * Binds and enables are compared against what the calling thread last passed on, and dropped if they would not
+         * change anything; every other call is passed straight on. Tracked state is kept per thread, and forgotten
+         * whenever \ref setDevice() changes the Device.
+         */
+        class StateCacheDevice : public Device {
+        public:
+            virtual bool compileShader(SWMuint &id, SWMenum type, const std::string &src, std::string &log);
+            virtual void deleteShader(SWMuint shader);
+
+            virtual bool linkProgram(SWMuint &id, const std::vector<SWMuint> &shaders, std::string &log);
+            virtual void deleteProgram(SWMuint program);
+            virtual void useProgram(SWMuint program);
+            virtual SWMint uniformLocation(SWMuint program, const std::string &name);
+            virtual void activeUniforms(SWMuint program, std::vector<std::pair<std::string, SWMint>> &uniforms);
+            virtual void activeUniformBlocks(SWMuint program, std::vector<UniformBlock> &blocks);
+            virtual void uniformBlockBinding(SWMuint program, SWMuint block, SWMuint binding);
+
+            virtual void uniformf (SWMint location, SWMsizei components, SWMsizei count, const SWMfloat* data);
+            virtual void uniformi (SWMint location, SWMsizei components, SWMsizei count, const SWMint*   data);
+            virtual void uniformui(SWMint location, SWMsizei components, SWMsizei count, const SWMuint*  data);
+            virtual void uniformMatrix(SWMint location, SWMsizei columns, SWMsizei rows, SWMsizei count, const SWMfloat* data);
+
+            virtual SWMuint createBuffer();
+            virtual void deleteBuffer(SWMuint buffer);
+            virtual void bindBuffer(SWMenum target, SWMuint buffer);
+            virtual void bindBufferRange(SWMenum target, SWMuint index, SWMuint buffer, size_t offset, size_t bytes);
+            virtual void bufferData(SWMenum target, size_t bytes, const void* data);
+            virtual void bufferStream(SWMenum target, size_t bytes, const void* data);
+
+            virtual SWMuint createVertexArray();
+            virtual void deleteVertexArray(SWMuint vao);
+            virtual void bindVertexArray(SWMuint vao);
+            virtual void vertexAttribute(SWMuint attrib, SWMint components, SWMenum type, bool normalized,
+                                         SWMsizei stride, size_t offset, SWMuint divisor);
+
+            virtual SWMuint createTexture();
+            virtual void deleteTexture(SWMuint texture);
+            virtual void bindTexture(SWMuint active, SWMenum target, SWMuint texture);
+            virtual void textureImage2D(SWMuint texture, unsigned int width, unsigned int height, const void* pixels);
+
+            virtual void viewport(SWMint x, SWMint y, SWMsizei width, SWMsizei height);
+            virtual void clear(float r, float g, float b, float a);
+            virtual void enable(SWMenum capability, bool enabled);
+            virtual void drawElements(SWMenum mode, SWMsizei count, SWMenum type, size_t offset);
+            virtual void drawElementsInstanced(SWMenum mode, SWMsizei count, SWMenum type, size_t offset, SWMsizei instances);
+
+            virtual SWMuint fenceSync();
+            virtual bool fenceSignaled(SWMuint fence);
+            virtual void deleteFence(SWMuint fence);
+        };
+
+        //! Get the Device set with \ref setDevice(), bypassing the state cache
+        Device &backendDevice();
+
+        //! Forget the state every thread's cache has tracked
+        void invalidateAllStateCaches();
+
+        //! Keep the calling thread's state cache counters as the last frame's, and reset them; called by the render thread
+        void finishFrameStateStats();
+
         class RenderObjectStatic : public RenderObject {
         public:
             RenderObjectStatic(Model::Model &model, Texture::Texture &texture, glm::vec3 position, glm::vec3 scale, glm::vec3 rotate);
@@ -25,13 +225,135 @@ namespace Swarm {
             virtual Texture::Texture &texture() const { return _texture; }
 
             virtual void render(const Renderer &renderer) const;
+            virtual bool instance(const Renderer &renderer, SWMfloat* matrix, size_t &lod) const;
+            virtual float depth(const Renderer &renderer) const;
+            virtual bool bounds(SWMfloat* min, SWMfloat* max) const;
 
             static void cleanup();
 
         protected:
+            size_t selectLOD(const Renderer &renderer) const;
+
             Model::Model &_model;
             Texture::Texture &_texture;
             glm::mat4 _matrix = glm::mat4(1);
+            float _scale = 1.0f; // Largest axis scale; bounds the world-space radius
+        };
+
+        //! Delete the instance buffers of every \ref RenderObjectCollection still alive, or destroyed since the last draw
+        void cleanupInstanceBuffers();
+
+        //! VAOs of one OpenGL context, by Model element buffer
+        /*!
+         * VAO names belong to a single context, so each context has its own table, filled and read only by the thread
+         * that context is current on. The mutex is held around a whole batch of \ref resolve() calls rather than each
+         * one; it is otherwise only taken by \ref Model::Model::release() and cleanup, from any thread.
+         */
+        class VAOTable {
+        public:
+            VAOTable(GLFWwindow* window) : _window(window) {}
+
+            boost::mutex &mutex() { return _mutex; }
+
+            //! Get a Model's VAO, generating it if this context has none yet; '0' for an unloaded Model, or when
+            //! there is no context to generate it in. Call with \ref mutex() held
+            SWMuint resolve(Model::Model &model);
+
+            //! Call with \ref mutex() held
+            void insert(SWMuint element_buffer, SWMuint vao) { _vaos[element_buffer] = vao; }
+
+            //! Forget the VAO of an element buffer, returning it, or '0' if there was none. Call with \ref mutex() held
+            SWMuint erase(SWMuint element_buffer);
+
+            //! Call with \ref mutex() held
+            void clear() { _vaos.clear(); }
+
+            GLFWwindow* window() const { return _window; }
+
+        protected:
+            GLFWwindow* _window; // nullptr for a thread with no context, e.g. rendering on a headless Device
+            boost::mutex _mutex;
+            std::unordered_map<SWMuint, SWMuint> _vaos;
+        };
+
+        //! Get the VAO table of the context current on the calling thread; only looks the context up in the registry
+        //! when it has changed since the thread last asked
+        VAOTable &currentVAOTable();
+
+        //! Drop the VAO table of a context being destroyed; its VAOs go with it
+        void forgetVAOTable(GLFWwindow* window);
+
+        //! Linear allocator for data rebuilt every frame; reset rather than freed, so it stops allocating once warm
+        class FrameArena {
+        public:
+            void reset() { _used = 0; }
+
+            //! Reserve zeroed bytes at an offset aligned to 'alignment'; offsets stay valid, pointers until the next allocate
+            size_t allocate(size_t bytes, size_t alignment) {
+                size_t offset = (_used + alignment - 1) / alignment * alignment;
+                if(_data.size() < offset + bytes) _data.resize(std::max(offset + bytes, _data.size() * 2));
+                std::fill(_data.begin() + offset, _data.begin() + offset + bytes, (uint8_t)0);
+                _used = offset + bytes;
+                return offset;
+            }
+
+            uint8_t* data() { return _data.data(); }
+            size_t used() const { return _used; }
+
+        protected:
+            std::vector<uint8_t> _data;
+            size_t _used = 0;
+        };
+
+        //! Get the buffer \ref uploadUniformBlocks() fills; '0' before the first upload
+        SWMuint uniformBlockBuffer();
+
+        //! Delete the buffer \ref uploadUniformBlocks() fills
+        void cleanupUniformBlocks();
+
+        //! Get the number of threads the build phase runs on; \ref buildThreads(), with '0' resolved to every job worker
+        unsigned int buildThreadCount();
+
+        //! Run task(0) through task(count-1) as jobs, on up to \ref buildThreadCount() threads including the calling one
+        void runBuildTasks(size_t count, const std::function<void(size_t)> &task);
+
+        //! Bounding volume hierarchy of a \ref RenderObjectCollection, tested against the view frustum with SIMD
+        /*!
+         * Each node holds the boxes of up to BRANCH children in SoA layout, so one node is tested against a plane
+         * in BRANCH / SIMD::vfloat::width operations. A child is another node, or a single RenderObject.
+         */
+        struct RenderObjectCollection::CullTree {
+            static const size_t BRANCH = SIMD::vfloat::width > 4 ? SIMD::vfloat::width : 4;
+            static const int32_t EMPTY = INT32_MIN;
+
+            struct Node {
+                float min_x[BRANCH], min_y[BRANCH], min_z[BRANCH];
+                float max_x[BRANCH], max_y[BRANCH], max_z[BRANCH];
+                int32_t child[BRANCH]; // Node index if positive, ~slot for a single RenderObject, or EMPTY
+            };
+            struct Entry {
+                float min[3], max[3], center[3];
+                uint32_t slot;
+            };
+
+            //! Index every bounded item; unbounded ones are listed separately, and always visible
+            void build(const std::vector<RenderItem> &items);
+
+            //! Mark the slot of every RenderObject under the given node that may be inside the given frustum planes
+            void cull(const SWMfloat* planes, int32_t root, std::vector<uint8_t> &visible, size_t &nodes_tested) const;
+
+            //! Test the children of one node; marks those inside, and adds nodes crossing a plane to 'descend'
+            void cullNode(const SWMfloat* planes, int32_t index, std::vector<uint8_t> &visible,
+                          std::vector<int32_t> &descend) const;
+
+            std::vector<Node> nodes;
+            std::vector<uint32_t> unbounded;
+
+        protected:
+            int32_t buildNode(size_t begin, size_t end);
+            void markAll(int32_t child, std::vector<uint8_t> &visible) const;
+
+            std::vector<Entry> _entries;
         };
 
         class ShaderInternal : public Shader {
@@ -56,13 +378,15 @@ namespace Swarm {
             virtual ~ProgramInternal();
 
             virtual SWMuint ID() const { return _ID; }
-            virtual SWMint uniform(const std::string &name);
-            virtual void clearUniformCache() { _uniform_cache.clear(); }
+            virtual SWMint uniform(const std::string &name) const;
+            virtual size_t uniformCount() const { return _uniforms.size(); }
+            virtual const UniformBlock* uniformBlock(const std::string &name) const;
 
             static void cleanup();
         protected:
             GLuint _ID;
-            std::unordered_map<std::string, GLint> _uniform_cache;
+            std::unordered_map<std::string, SWMint> _uniforms; // Reflected at link; only read afterwards
+            std::vector<UniformBlock> _blocks;
         };
 
         class RendererInternal;
@@ -150,7 +474,7 @@ namespace Swarm {
             virtual float viewDistance() const { return _view_distance; }
             virtual void setViewDistance(float distance) { _view_distance = distance; }
 
-            virtual void setPosition(const CameraPosition &pos, bool instant = false) { (instant ? _position_current : _position_target) = pos; }
+            virtual void setPosition(const CameraPosition &pos, bool instant = false);
             virtual CameraPosition position(bool instant = false) { return (instant ? _position_current : _position_target).get(); }
 
             virtual void update(double delta_time);
@@ -166,6 +490,7 @@ namespace Swarm {
             float _move_speed = 1.0f;
             float _fov = 45.0f;
             float _view_distance = 1000.0f;
+            Util::BufferData<CameraPosition> _position_previous; // As of the simulation step before; rendering blends from it
             Util::BufferData<CameraPosition> _position_current;
             Util::BufferData<CameraPosition> _position_target;
         };
@@ -182,6 +507,7 @@ namespace Swarm {
 
             virtual void setUniformName(MatrixUniformType type, const std::string &name);
             virtual std::string uniformName(MatrixUniformType type) const;
+            virtual SWMint uniformLocation(MatrixUniformType type) const { return _uniform_location_matrix[type]; }
 
             virtual void setTextureName(SWMuint active, const std::string &name);
             virtual void setTextureName(const Texture::Type::MapType &type, const std::string &name) {
@@ -192,23 +518,65 @@ namespace Swarm {
             virtual std::string textureName(const Texture::Type::MapType &type) const {
                 return textureName(type.active());
             }
+            virtual SWMint textureLocation(SWMuint active) const;
 
             virtual void insertUniform(Uniform &uniform);
 
             virtual void bindUniformsMatrix(const Window &window) const;
+            virtual void bindUniformsMatrix(const glm::mat4 &view, const glm::mat4 &projection, int height) const;
             virtual void bindUniformsTexture() const;
             virtual void bindUniformsCustom() const;
+            virtual void bindUniformsBlock() const;
+
+            virtual void setUniformBlockName(const std::string &name);
+            virtual std::string uniformBlockName() const { return _block_name; }
+            virtual bool hasUniformBlock() const { return _block.size > 0; }
+
+            //! Reserve and fill this Renderer's range of the frame uniform buffer
+            void fillUniformBlock(FrameArena &arena, const glm::mat4 &view, const glm::mat4 &projection) const;
+
+            virtual void setInstancing(bool instancing) { _instancing = instancing; }
+            virtual bool instancing() const { return _instancing; }
+
+            virtual void setCulling(bool culling) { _culling = culling; }
+            virtual bool culling() const { return _culling; }
+            virtual bool frustum(SWMfloat* planes) const;
+
+            virtual void setLODThreshold(float pixels) { _lod_threshold = pixels; }
+            virtual float lodThreshold() const { return _lod_threshold; }
+
+            virtual float projectedRadius(const glm::vec3 &center, float radius) const;
+            virtual float viewDepth(const glm::vec3 &point) const;
 
             static void cleanup();
 
         protected:
             Program* _program;
 
+            bool _instancing = false;
+            bool _culling = true;
+            float _lod_threshold = 1.0f;
+
+            // Captured by bindUniformsMatrix() for level of detail selection and culling; only touched by the render thread
+            mutable glm::mat4 _frame_view = glm::mat4(1);
+            mutable float _frame_pixel_scale = 0.0f;
+            mutable SWMfloat _frame_frustum[24];
+
             std::map<RenderCyclePhase, RenderCycleFunc> _cycle_func_map;
             std::map<MatrixUniformType, std::string> _uniform_map_matrix;
             std::map<SWMuint, std::string> _uniform_map_texture;
 
+            // Locations of the names above, kept so binding per object needs no string lookups
+            SWMint _uniform_location_matrix[3] = { -1, -1, -1 };
+            std::map<SWMuint, SWMint> _uniform_location_texture;
+
             std::set<Uniform*> _uniform_set;
+
+            // Frame uniform block; copied from the Program, empty if it has none
+            std::string _block_name;
+            UniformBlock _block;
+            mutable size_t _block_offset = 0;
+            mutable bool _block_filled = false;
         };
     }
 }
\ No newline at end of file
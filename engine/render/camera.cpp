@@ -1,5 +1,6 @@
 #include "RenderInternal.h"
 
+#include "api/Core.h"
 #include "api/Logging.h"
 
 #include <glm/gtc/matrix_transform.hpp>
@@ -37,22 +38,35 @@ namespace Swarm {
         }
 
         CameraInternal::CameraInternal(const CameraPosition &pos, float speed, MoveType type)
-                : _position_current(_static_camera_position_buffer, pos),
+                : _position_previous(_static_camera_position_buffer, pos),
+                  _position_current(_static_camera_position_buffer, pos),
                   _position_target (_static_camera_position_buffer, pos),
                   _move_speed(speed), _move_type(type) {}
 
+        void CameraInternal::setPosition(const CameraPosition &pos, bool instant) {
+            boost::lock_guard<boost::mutex> write_lock(_static_camera_position_buffer.write_mutex());
+            _position_target.set(pos, write_lock);
+
+            // Jumps straight there, without blending
+            if(instant) {
+                _position_current.set(pos, write_lock);
+                _position_previous.set(pos, write_lock);
+            }
+        }
+
         void CameraInternal::update(double delta_time) {
+            boost::lock_guard<boost::mutex> write_lock(_static_camera_position_buffer.write_mutex());
+            CameraPosition &current = _position_current.getWriteAccess(write_lock);
+            CameraPosition &target  = _position_target.getWriteAccess(write_lock);
+            _position_previous.set(current, write_lock);
 
             switch(_move_type) {
                 case INSTANT:
-                    _position_current = _position_target;
+                    current = target;
                     break;
                 case SMOOTH:
                 case LERP: {
                     // TODO: Introduce Actual Lerp
-                    boost::lock_guard<boost::mutex> write_lock(_static_camera_position_buffer.write_mutex());
-                    CameraPosition &current = _position_current.getWriteAccess(write_lock);
-                    CameraPosition &target  = _position_target.getWriteAccess(write_lock);
                     if (current.position != target.position)
                         current.position = Util::movePoint(current.position.vec(),
                                                                       target.position.vec(),
@@ -69,8 +83,12 @@ namespace Swarm {
         }
 
         glm::mat4 CameraInternal::viewMatrix() const {
+            const CameraPosition previous = _position_previous.get();
             const CameraPosition current = _position_current.get();
-            return glm::lookAt(current.position.vec(), current.look_at.vec(), current.up.vec());
+            float alpha = (float)Core::interpolation();
+            return glm::lookAt(glm::mix(previous.position.vec(), current.position.vec(), alpha),
+                               glm::mix(previous.look_at.vec(),  current.look_at.vec(),  alpha),
+                               glm::mix(previous.up.vec(),       current.up.vec(),       alpha));
         }
 
         glm::mat4 CameraInternal::projectionMatrix(int width, int height) const {
@@ -0,0 +1,183 @@
+#include "RenderInternal.h"
+
+#include <chrono>
+
+namespace Swarm {
+    namespace Render {
+
+        using SIMD::vfloat;
+
+        void RenderObjectCollection::CullTree::build(const std::vector<RenderItem> &items) {
+            nodes.clear();
+            unbounded.clear();
+            _entries.clear();
+            for(const RenderItem &item : items) {
+                Entry entry;
+                if(!item.object->bounds(entry.min, entry.max)) {
+                    unbounded.push_back(item.slot);
+                    continue;
+                }
+                for(int i = 0; i < 3; i++) entry.center[i] = (entry.min[i] + entry.max[i]) * 0.5f;
+                entry.slot = item.slot;
+                _entries.push_back(entry);
+            }
+            if(!_entries.empty()) buildNode(0, _entries.size());
+        }
+
+        int32_t RenderObjectCollection::CullTree::buildNode(size_t begin, size_t end) {
+            int32_t index = (int32_t)nodes.size();
+            nodes.push_back(Node());
+
+            // Split the range into up to BRANCH groups, halving the largest group at its median along its widest axis
+            std::pair<size_t, size_t> groups[BRANCH];
+            size_t group_count = 1;
+            groups[0] = std::make_pair(begin, end);
+            while(group_count < BRANCH) {
+                size_t largest = 0;
+                for(size_t g = 1; g < group_count; g++)
+                    if(groups[g].second - groups[g].first > groups[largest].second - groups[largest].first) largest = g;
+                size_t first = groups[largest].first, last = groups[largest].second;
+                if(last - first < 2) break;
+
+                float lo[3], hi[3];
+                for(int i = 0; i < 3; i++) lo[i] = hi[i] = _entries[first].center[i];
+                for(size_t e = first + 1; e < last; e++) {
+                    for(int i = 0; i < 3; i++) {
+                        lo[i] = std::min(lo[i], _entries[e].center[i]);
+                        hi[i] = std::max(hi[i], _entries[e].center[i]);
+                    }
+                }
+                int axis = 0;
+                for(int i = 1; i < 3; i++) if(hi[i] - lo[i] > hi[axis] - lo[axis]) axis = i;
+
+                size_t middle = first + (last - first) / 2;
+                std::nth_element(_entries.begin() + first, _entries.begin() + middle, _entries.begin() + last,
+                                 [axis](const Entry &lhs, const Entry &rhs) { return lhs.center[axis] < rhs.center[axis]; });
+                groups[largest] = std::make_pair(first, middle);
+                groups[group_count++] = std::make_pair(middle, last);
+            }
+
+            // Unused lanes get an inverted box, which lies outside any plane
+            for(size_t lane = 0; lane < BRANCH; lane++) {
+                float lo[3] = { 1e30f, 1e30f, 1e30f }, hi[3] = { -1e30f, -1e30f, -1e30f };
+                int32_t child = EMPTY;
+                if(lane < group_count) {
+                    size_t first = groups[lane].first, last = groups[lane].second;
+                    for(size_t e = first; e < last; e++) {
+                        for(int i = 0; i < 3; i++) {
+                            lo[i] = std::min(lo[i], _entries[e].min[i]);
+                            hi[i] = std::max(hi[i], _entries[e].max[i]);
+                        }
+                    }
+                    child = last - first == 1 ? ~(int32_t)_entries[first].slot : buildNode(first, last);
+                }
+                Node &node = nodes[index];
+                node.min_x[lane] = lo[0]; node.min_y[lane] = lo[1]; node.min_z[lane] = lo[2];
+                node.max_x[lane] = hi[0]; node.max_y[lane] = hi[1]; node.max_z[lane] = hi[2];
+                node.child[lane] = child;
+            }
+            return index;
+        }
+
+        void RenderObjectCollection::CullTree::cull(const SWMfloat* planes, int32_t root, std::vector<uint8_t> &visible, size_t &nodes_tested) const {
+            std::vector<int32_t> stack(1, root);
+            while(!stack.empty()) {
+                int32_t index = stack.back();
+                stack.pop_back();
+                cullNode(planes, index, visible, stack);
+                nodes_tested++;
+            }
+        }
+
+        void RenderObjectCollection::CullTree::cullNode(const SWMfloat* planes, int32_t index, std::vector<uint8_t> &visible,
+                                                        std::vector<int32_t> &descend) const {
+            const Node &node = nodes[index];
+
+            // For each plane, the corner furthest along its normal decides whether a box is outside, and the
+            // nearest corner whether it crosses the plane
+            int outside = 0, crossing = 0;
+            for(size_t lane = 0; lane < BRANCH; lane += vfloat::width) {
+                vfloat min_x = vfloat::load(node.min_x + lane), max_x = vfloat::load(node.max_x + lane);
+                vfloat min_y = vfloat::load(node.min_y + lane), max_y = vfloat::load(node.max_y + lane);
+                vfloat min_z = vfloat::load(node.min_z + lane), max_z = vfloat::load(node.max_z + lane);
+                vfloat out(0.0f), cross(0.0f), zero(0.0f);
+                for(int p = 0; p < 6; p++) {
+                    const SWMfloat* plane = planes + p * 4;
+                    vfloat a(plane[0]), b(plane[1]), c(plane[2]), d(plane[3]);
+                    vfloat far_distance = a * (plane[0] > 0.0f ? max_x : min_x) + b * (plane[1] > 0.0f ? max_y : min_y)
+                                        + c * (plane[2] > 0.0f ? max_z : min_z) + d;
+                    vfloat near_distance = a * (plane[0] > 0.0f ? min_x : max_x) + b * (plane[1] > 0.0f ? min_y : max_y)
+                                         + c * (plane[2] > 0.0f ? min_z : max_z) + d;
+                    out = out | (far_distance < zero);
+                    cross = cross | (near_distance < zero);
+                }
+                outside |= SIMD::movemask(out) << lane;
+                crossing |= SIMD::movemask(cross) << lane;
+            }
+
+            // Boxes wholly inside need no more tests
+            for(size_t lane = 0; lane < BRANCH; lane++) {
+                int32_t child = node.child[lane];
+                if(child == EMPTY || (outside >> lane) & 1) continue;
+                if(child < 0) visible[~child] = 1;
+                else if((crossing >> lane) & 1) descend.push_back(child);
+                else markAll(child, visible);
+            }
+        }
+
+        void RenderObjectCollection::CullTree::markAll(int32_t child, std::vector<uint8_t> &visible) const {
+            if(child < 0) {
+                visible[~child] = 1;
+                return;
+            }
+            const Node &node = nodes[child];
+            for(size_t lane = 0; lane < BRANCH; lane++)
+                if(node.child[lane] != EMPTY) markAll(node.child[lane], visible);
+        }
+
+        bool RenderObjectCollection::cull(const Renderer &renderer) {
+            _stats.objects = _stats.visible = _items.size();
+            SWMfloat planes[24];
+            if(!renderer.culling() || !renderer.frustum(planes)) return false;
+
+            // Static RenderObjects only move by being erased and inserted again, so the tree is kept until then
+            if(_cull_tree == nullptr) _cull_tree = new CullTree();
+            if(_cull_dirty) {
+                auto start = std::chrono::high_resolution_clock::now();
+                _cull_tree->build(_items);
+                _cull_dirty = false;
+                _stats.hierarchy_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            }
+
+            auto start = std::chrono::high_resolution_clock::now();
+            _visible.assign(_slots.size(), 0);
+            for(uint32_t slot : _cull_tree->unbounded) _visible[slot] = 1;
+            if(!_cull_tree->nodes.empty()) {
+
+                // Test the top of the tree here until there are enough subtrees to share out; subtrees never share
+                // a RenderObject, so tasks mark disjoint parts of _visible
+                std::vector<int32_t> frontier(1, 0), next;
+                size_t wanted = _stats.threads > 1 ? _stats.threads * 4 : 1;
+                while(!frontier.empty() && frontier.size() < wanted) {
+                    next.clear();
+                    for(int32_t index : frontier) _cull_tree->cullNode(planes, index, _visible, next);
+                    _stats.nodes_tested += frontier.size();
+                    frontier.swap(next);
+                }
+
+                std::vector<size_t> nodes_tested(frontier.size(), 0);
+                runBuildTasks(frontier.size(), [this, &planes, &frontier, &nodes_tested](size_t task) {
+                    _cull_tree->cull(planes, frontier[task], _visible, nodes_tested[task]);
+                });
+                for(size_t tested : nodes_tested) _stats.nodes_tested += tested;
+            }
+            _stats.cull_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+            _stats.visible = 0;
+            for(const RenderItem &item : _items) _stats.visible += _visible[item.slot];
+            _stats.culled = _stats.objects - _stats.visible;
+            return true;
+        }
+
+    }
+}
@@ -0,0 +1,313 @@
+#include "RenderInternal.h"
+
+#include "api/Logging.h"
+
+using namespace Swarm::Logging;
+
+namespace Swarm {
+    namespace Render {
+
+        DeviceGL _static_device_gl;
+        Device* _static_device = &_static_device_gl;
+
+        Device* Device::gl() { return &_static_device_gl; }
+
+        Device &backendDevice() { return *_static_device; }
+
+        void setDevice(Device* device) {
+            _static_device = device == nullptr ? &_static_device_gl : device;
+            invalidateAllStateCaches();
+        }
+
+        bool DeviceGL::compileShader(SWMuint &id, SWMenum type, const std::string &src, std::string &log) {
+            id = glCreateShader(type);
+            const GLchar *source = (const GLchar*)src.c_str();
+            glShaderSource(id, 1, &source, nullptr);
+            glCompileShader(id);
+
+            GLint result = GL_FALSE;
+            GLint log_length = 0;
+            glGetShaderiv(id, GL_COMPILE_STATUS,  &result);
+            glGetShaderiv(id, GL_INFO_LOG_LENGTH, &log_length);
+            std::vector<char> log_contents(log_length+1, '\0');
+            glGetShaderInfoLog(id, log_length, nullptr, &log_contents[0]);
+            log = std::string(&log_contents[0]);
+            return result != GL_FALSE;
+        }
+
+        void DeviceGL::deleteShader(SWMuint shader) {
+            glDeleteShader(shader);
+        }
+
+        bool DeviceGL::linkProgram(SWMuint &id, const std::vector<SWMuint> &shaders, std::string &log) {
+            id = glCreateProgram();
+            for(SWMuint shader : shaders) glAttachShader(id, shader);
+            glLinkProgram(id);
+
+            GLint result = GL_FALSE;
+            GLint log_length = 0;
+            glGetProgramiv(id, GL_LINK_STATUS,     &result);
+            glGetProgramiv(id, GL_INFO_LOG_LENGTH, &log_length);
+            std::vector<char> log_contents(log_length+1, '\0');
+            glGetProgramInfoLog(id, log_length, nullptr, &log_contents[0]);
+            log = std::string(&log_contents[0]);
+            return result != GL_FALSE;
+        }
+
+        void DeviceGL::deleteProgram(SWMuint program) {
+            glDeleteProgram(program);
+        }
+
+        void DeviceGL::useProgram(SWMuint program) {
+            glUseProgram(program);
+        }
+
+        SWMint DeviceGL::uniformLocation(SWMuint program, const std::string &name) {
+            return glGetUniformLocation(program, (const GLchar*)name.c_str());
+        }
+
+        void DeviceGL::activeUniforms(SWMuint program, std::vector<std::pair<std::string, SWMint>> &uniforms) {
+            GLint count = 0, max_length = 0;
+            glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+            glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+            std::vector<GLchar> name_buffer(max_length+1, '\0');
+            for(GLint i = 0; i < count; i++) {
+                GLsizei length = 0;
+                GLint size = 0;
+                GLenum type = 0;
+                glGetActiveUniform(program, (GLuint)i, (GLsizei)name_buffer.size(), &length, &size, &type, &name_buffer[0]);
+                std::string name(&name_buffer[0], (size_t)length);
+                if(name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) name.resize(name.size() - 3);
+
+                // Members of uniform blocks have no location
+                GLint location = glGetUniformLocation(program, (const GLchar*)name.c_str());
+                if(location >= 0) uniforms.push_back(std::make_pair(name, (SWMint)location));
+            }
+        }
+
+        void DeviceGL::activeUniformBlocks(SWMuint program, std::vector<UniformBlock> &blocks) {
+            GLint count = 0, max_length = 0;
+            glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+            glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_length);
+            std::vector<GLchar> name_buffer(max_length+1, '\0');
+            for(GLint i = 0; i < count; i++) {
+                UniformBlock block;
+                GLsizei length = 0;
+                glGetActiveUniformBlockName(program, (GLuint)i, (GLsizei)name_buffer.size(), &length, &name_buffer[0]);
+                block.name = std::string(&name_buffer[0], (size_t)length);
+                block.index = (SWMuint)i;
+
+                GLint size = 0, members = 0;
+                glGetActiveUniformBlockiv(program, (GLuint)i, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+                glGetActiveUniformBlockiv(program, (GLuint)i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &members);
+                block.size = (size_t)size;
+
+                // Members are reported as indices into the program's active uniforms
+                std::vector<GLint> indices((size_t)members);
+                if(members > 0) glGetActiveUniformBlockiv(program, (GLuint)i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, &indices[0]);
+                GLint member_length = 0;
+                glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &member_length);
+                std::vector<GLchar> member_buffer(member_length+1, '\0');
+                for(GLint index : indices) {
+                    GLint offset = 0;
+                    GLuint member = (GLuint)index;
+                    glGetActiveUniformsiv(program, 1, &member, GL_UNIFORM_OFFSET, &offset);
+                    glGetActiveUniformName(program, member, (GLsizei)member_buffer.size(), &length, &member_buffer[0]);
+                    std::string name(&member_buffer[0], (size_t)length);
+                    if(name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) name.resize(name.size() - 3);
+
+                    // Members of a named block instance are reported as "Block.member"
+                    size_t dot = name.rfind('.');
+                    if(dot != std::string::npos) name = name.substr(dot + 1);
+                    block.offsets[name] = (size_t)offset;
+                }
+                blocks.push_back(block);
+            }
+        }
+
+        void DeviceGL::uniformBlockBinding(SWMuint program, SWMuint block, SWMuint binding) {
+            glUniformBlockBinding(program, block, binding);
+        }
+
+        void DeviceGL::uniformf(SWMint location, SWMsizei components, SWMsizei count, const SWMfloat* data) {
+            switch(components) {
+                case 1:  glUniform1fv(location, count, data); break;
+                case 2:  glUniform2fv(location, count, data); break;
+                case 3:  glUniform3fv(location, count, data); break;
+                default: glUniform4fv(location, count, data); break;
+            }
+        }
+
+        void DeviceGL::uniformi(SWMint location, SWMsizei components, SWMsizei count, const SWMint* data) {
+            switch(components) {
+                case 1:  glUniform1iv(location, count, data); break;
+                case 2:  glUniform2iv(location, count, data); break;
+                case 3:  glUniform3iv(location, count, data); break;
+                default: glUniform4iv(location, count, data); break;
+            }
+        }
+
+        void DeviceGL::uniformui(SWMint location, SWMsizei components, SWMsizei count, const SWMuint* data) {
+            switch(components) {
+                case 1:  glUniform1uiv(location, count, data); break;
+                case 2:  glUniform2uiv(location, count, data); break;
+                case 3:  glUniform3uiv(location, count, data); break;
+                default: glUniform4uiv(location, count, data); break;
+            }
+        }
+
+        void DeviceGL::uniformMatrix(SWMint location, SWMsizei columns, SWMsizei rows, SWMsizei count, const SWMfloat* data) {
+            switch(columns) {
+                case 2: {
+                    switch(rows) {
+                        case 2:  glUniformMatrix2fv  (location, count, GL_FALSE, data); break;
+                        case 3:  glUniformMatrix2x3fv(location, count, GL_FALSE, data); break;
+                        default: glUniformMatrix2x4fv(location, count, GL_FALSE, data); break;
+                    } } break;
+                case 3: {
+                    switch(rows) {
+                        case 2:  glUniformMatrix3x2fv(location, count, GL_FALSE, data); break;
+                        case 3:  glUniformMatrix3fv  (location, count, GL_FALSE, data); break;
+                        default: glUniformMatrix3x4fv(location, count, GL_FALSE, data); break;
+                    } } break;
+                default: {
+                    switch(rows) {
+                        case 2:  glUniformMatrix4x2fv(location, count, GL_FALSE, data); break;
+                        case 3:  glUniformMatrix4x3fv(location, count, GL_FALSE, data); break;
+                        default: glUniformMatrix4fv  (location, count, GL_FALSE, data); break;
+                    } } break;
+            }
+        }
+
+        SWMuint DeviceGL::createBuffer() {
+            GLuint buffer;
+            glGenBuffers(1, &buffer);
+            return buffer;
+        }
+
+        void DeviceGL::deleteBuffer(SWMuint buffer) {
+            glDeleteBuffers(1, &buffer);
+        }
+
+        void DeviceGL::bindBuffer(SWMenum target, SWMuint buffer) {
+            glBindBuffer(target, buffer);
+        }
+
+        void DeviceGL::bindBufferRange(SWMenum target, SWMuint index, SWMuint buffer, size_t offset, size_t bytes) {
+            glBindBufferRange(target, index, buffer, (GLintptr)offset, (GLsizeiptr)bytes);
+        }
+
+        void DeviceGL::bufferData(SWMenum target, size_t bytes, const void* data) {
+            glBufferData(target, bytes, data, GL_STATIC_DRAW);
+        }
+
+        void DeviceGL::bufferStream(SWMenum target, size_t bytes, const void* data) {
+            glBufferData(target, bytes, nullptr, GL_STREAM_DRAW);
+            glBufferSubData(target, 0, bytes, data);
+        }
+
+        SWMuint DeviceGL::createVertexArray() {
+            GLuint vao;
+            glGenVertexArrays(1, &vao);
+            return vao;
+        }
+
+        void DeviceGL::deleteVertexArray(SWMuint vao) {
+            glDeleteVertexArrays(1, &vao);
+        }
+
+        void DeviceGL::bindVertexArray(SWMuint vao) {
+            glBindVertexArray(vao);
+        }
+
+        void DeviceGL::vertexAttribute(SWMuint attrib, SWMint components, SWMenum type, bool normalized,
+                                       SWMsizei stride, size_t offset, SWMuint divisor) {
+            glEnableVertexAttribArray(attrib);
+            glVertexAttribPointer(attrib, components, type, normalized ? GL_TRUE : GL_FALSE, stride, (void*)offset);
+            glVertexAttribDivisor(attrib, divisor);
+        }
+
+        SWMuint DeviceGL::createTexture() {
+            GLuint texture;
+            glGenTextures(1, &texture);
+            return texture;
+        }
+
+        void DeviceGL::deleteTexture(SWMuint texture) {
+            glDeleteTextures(1, &texture);
+        }
+
+        void DeviceGL::bindTexture(SWMuint active, SWMenum target, SWMuint texture) {
+            glActiveTexture(GL_TEXTURE0 + active);
+            glBindTexture(target, texture);
+        }
+
+        void DeviceGL::textureImage2D(SWMuint texture, unsigned int width, unsigned int height, const void* pixels) {
+            glBindTexture(GL_TEXTURE_2D, texture);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexImage2D(GL_TEXTURE_2D, 0, 4, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+            glGenerateMipmap(GL_TEXTURE_2D); // Is this really needed?
+
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+        void DeviceGL::viewport(SWMint x, SWMint y, SWMsizei width, SWMsizei height) {
+            glViewport(x, y, width, height);
+        }
+
+        void DeviceGL::clear(float r, float g, float b, float a) {
+            glClearColor(r, g, b, a);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+
+        void DeviceGL::enable(SWMenum capability, bool enabled) {
+            if(enabled) glEnable(capability);
+            else glDisable(capability);
+        }
+
+        void DeviceGL::drawElements(SWMenum mode, SWMsizei count, SWMenum type, size_t offset) {
+            glDrawElements(mode, count, type, (void*)offset);
+        }
+
+        void DeviceGL::drawElementsInstanced(SWMenum mode, SWMsizei count, SWMenum type, size_t offset, SWMsizei instances) {
+            glDrawElementsInstanced(mode, count, type, (void*)offset, instances);
+        }
+
+        SWMuint DeviceGL::fenceSync() {
+            GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+            boost::lock_guard<boost::mutex> lock(_fence_mutex);
+            SWMuint fence = _next_fence++;
+            _fences[fence] = sync;
+            return fence;
+        }
+
+        bool DeviceGL::fenceSignaled(SWMuint fence) {
+            GLsync sync;
+            {
+                boost::lock_guard<boost::mutex> lock(_fence_mutex);
+                auto iter = _fences.find(fence);
+                if(iter == _fences.end()) return true;
+                sync = iter->second;
+            }
+            // A failed wait will not succeed later either, so it does not hold the objects back forever
+            GLenum result = glClientWaitSync(sync, 0, 0);
+            return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED;
+        }
+
+        void DeviceGL::deleteFence(SWMuint fence) {
+            GLsync sync;
+            {
+                boost::lock_guard<boost::mutex> lock(_fence_mutex);
+                auto iter = _fences.find(fence);
+                if(iter == _fences.end()) return;
+                sync = iter->second;
+                _fences.erase(iter);
+            }
+            glDeleteSync(sync);
+        }
+
+    }
+}
@@ -16,10 +16,13 @@ namespace Swarm {
             stopRenderThread();
 
             Render::RenderObjectStatic::cleanup();
+            Render::cleanupInstanceBuffers();
+            Render::cleanupUniformBlocks();
             Render::CameraInternal::cleanup();
             Render::WindowInternal::cleanup();
             Render::ProgramInternal::cleanup();
             Render::ShaderInternal::cleanup();
+            Render::RecordingDeviceInternal::cleanup();
 
         }
     }
@@ -3,14 +3,73 @@
 
 #include "api/Logging.h"
 
+#include <cmath>
+#include <cstring>
+
 using namespace Swarm::Logging;
 
+using Swarm::Render::device;
+
 namespace Swarm {
-    namespace Model {
+    namespace Render {
+
+        // ************
+        //  VAO Tables
+        // ************
+
+        boost::mutex _static_vao_tables_mutex;
+        std::unordered_map<GLFWwindow*, std::unique_ptr<VAOTable>> _static_vao_tables;
+        std::atomic<size_t> _static_vao_tables_epoch(0); // Bumped whenever a table is dropped
+
+        SWMuint VAOTable::resolve(Model::Model &model) {
+            if(!model._loaded) return 0;
+            auto iter = _vaos.find(model._element_buffer);
+            if(iter != _vaos.end()) return iter->second;
+
+            // Without a context, only the VAO made at creation exists
+            if(_window == nullptr) return 0;
+            SWMuint vao = model.genVAO();
+            _vaos[model._element_buffer] = vao;
+            return vao;
+        }
+
+        SWMuint VAOTable::erase(SWMuint element_buffer) {
+            auto iter = _vaos.find(element_buffer);
+            if(iter == _vaos.end()) return 0;
+            SWMuint vao = iter->second;
+            _vaos.erase(iter);
+            return vao;
+        }
+
+        VAOTable &currentVAOTable() {
+            struct Current {
+                GLFWwindow* window;
+                VAOTable* table;
+                size_t epoch;
+            };
+            static thread_local Current current = { nullptr, nullptr, 0 };
+
+            GLFWwindow* window = glfwGetCurrentContext();
+            if(current.table == nullptr || current.window != window || current.epoch != _static_vao_tables_epoch) {
+                boost::lock_guard<boost::mutex> lock(_static_vao_tables_mutex);
+                std::unique_ptr<VAOTable> &table = _static_vao_tables[window];
+                if(!table) table.reset(new VAOTable(window));
+                current = { window, table.get(), _static_vao_tables_epoch };
+            }
+            return *current.table;
+        }
 
-        // Mapping: GLFWwindow -> Element Buffer ID -> VAO ID
-        std::unordered_map<GLFWwindow*, std::unordered_map<GLuint, GLuint>> static_vao_map;
+        void forgetVAOTable(GLFWwindow* window) {
+            boost::lock_guard<boost::mutex> lock(_static_vao_tables_mutex);
+            _static_vao_tables.erase(window);
+            _static_vao_tables_epoch++;
+        }
+    }
 
+    namespace Model {
+
+        // Every Buffer and VAO created, for cleanup
+        boost::mutex _static_registered_mutex;
         std::set<GLuint> registeredVAOs;
         std::set<GLuint> registeredBuffers;
 
@@ -19,23 +78,35 @@ namespace Swarm {
         }
 
         void Model::cleanup() {
+            {
+                boost::lock_guard<boost::mutex> lock(Render::_static_vao_tables_mutex);
+                for(auto && iter : Render::_static_vao_tables) {
+                    boost::lock_guard<boost::mutex> table_lock(iter.second->mutex());
+                    iter.second->clear();
+                }
+            }
+            boost::lock_guard<boost::mutex> lock(_static_registered_mutex);
 
             // Cleanup Buffers
             for(GLuint buffer : registeredBuffers) {
                 Log::log_render(INFO) << "Deleting Buffer [" << buffer << "]";
-                glDeleteBuffers(1, &buffer);
+                device().deleteBuffer(buffer);
             }
 
             // Cleanup VAOs
             for(GLuint vao : registeredVAOs) {
                 Log::log_render(INFO) << "Deleting VAO [" << vao << "]";
-                glDeleteVertexArrays(1, &vao);
+                device().deleteVertexArray(vao);
             }
 
         }
 
         Model::Model(const RawModelDataIndexed &data) {
-            genBuffers(data);
+            genBuffers(data, std::vector<LODLevel>(), VertexFormat());
+        }
+
+        Model::Model(const RawModelDataIndexed &data, const std::vector<LODLevel> &lods, const VertexFormat &format) {
+            genBuffers(data, lods, format);
         }
 
         Model::Model(const Model &other) {
@@ -45,16 +116,28 @@ namespace Swarm {
         Model &Model::operator=(const Model &other) {
             _loaded = other._loaded;
             _element_count = other._element_count;
+            _element_type = other._element_type;
+            _lods = other._lods;
+            for(int i = 0; i < 3; i++) {
+                _bounds_center[i] = other._bounds_center[i];
+                _bounds_min[i] = other._bounds_min[i];
+                _bounds_max[i] = other._bounds_max[i];
+            }
+            _bounds_radius = other._bounds_radius;
             _element_buffer = other._element_buffer;
-            _data_buffers = other._data_buffers;
+            _vertex_buffer = other._vertex_buffer;
+            _attributes = other._attributes;
+            _vertex_bytes = other._vertex_bytes;
+            _owner = other._owner;
             return *this;
         }
 
         SWMuint Model::vao() {
-            GLFWwindow* window = glfwGetCurrentContext();
-            if(window == nullptr || !_loaded) return 0; // Safety check
-            if(static_vao_map[window].count(_element_buffer) < 1) genVAO();
-            return static_vao_map[window][_element_buffer];
+            if(!_loaded) return 0; // Safety check
+
+            Render::VAOTable &table = Render::currentVAOTable();
+            boost::lock_guard<boost::mutex> lock(table.mutex());
+            return table.resolve(*this);
         }
 
         bool Model::operator==(const Model &rhs) const {
@@ -67,99 +150,283 @@ namespace Swarm {
             return _element_buffer < rhs._element_buffer;
         }
 
-        void Model::genBuffers(const RawModelDataIndexed &data) {
+        void Model::release() {
+            if(!_loaded) return;
 
-            // Create Data Context VAO
-            GLuint vao;
-            glGenVertexArrays(1, &vao);
-            registeredVAOs.insert(vao);
-            glBindVertexArray(vao);
-
-            // Create Data Buffers
-            for(auto && iter : data) {
-                GLuint bufferID;
-                glGenBuffers(1, &bufferID);
-                _data_buffers.insert(BufferEntry{ bufferID, iter.first.attribID(), iter.first.type() });
-                registeredBuffers.insert(bufferID);
-                glBindBuffer(GL_ARRAY_BUFFER, bufferID);
-                size_t size = data.size();
-                unsigned int stride = iter.first.type();
-                float fdata[ size * stride ];
-                for(size_t i = 0; i < size; i++) {
-                    for(unsigned int j = 0; j < stride; j++) {
-                        fdata[i*stride+j] = j < 2 ?
-                                            j == 0 ? iter.second.at(i).val.v4.x
-                                                   : iter.second.at(i).val.v4.y :
-                                            j == 2 ? iter.second.at(i).val.v4.z
-                                                   : iter.second.at(i).val.v4.w ;
+            {
+                boost::lock_guard<boost::mutex> lock(_static_registered_mutex);
+                device().deleteBuffer(_vertex_buffer);
+                registeredBuffers.erase(_vertex_buffer);
+                device().deleteBuffer(_element_buffer);
+                registeredBuffers.erase(_element_buffer);
+            }
 
+            // VAO names belong to a single context, so only the current context's VAO can be deleted here; the rest
+            // are forgotten, and freed along with their contexts
+            Render::VAOTable* current = &Render::currentVAOTable();
+            boost::lock_guard<boost::mutex> lock(Render::_static_vao_tables_mutex);
+            for(auto && iter : Render::_static_vao_tables) {
+                boost::lock_guard<boost::mutex> table_lock(iter.second->mutex());
+                GLuint vao = iter.second->erase(_element_buffer);
+                if(vao != 0 && iter.second.get() == current) {
+                    device().deleteVertexArray(vao);
+                    boost::lock_guard<boost::mutex> registered_lock(_static_registered_mutex);
+                    registeredVAOs.erase(vao);
+                }
+            }
+
+            Log::log_render(INFO) << "Model Released [ElementBuffer: " << _element_buffer << "]";
+
+            _vertex_buffer = 0;
+            _attributes.clear();
+            _vertex_bytes = 0;
+            _element_buffer = 0;
+            _element_count = 0;
+            _lods.clear();
+            _loaded = false;
+            _owner.reset();
+        }
+
+        size_t Model::selectLOD(float radius_pixels, float threshold_pixels) const {
+            size_t lod = 0;
+            while(lod + 1 < _lods.size() && _lods[lod + 1].error * radius_pixels <= threshold_pixels) lod++;
+            return lod;
+        }
+
+        // ****************
+        //  Vertex Packing
+        // ****************
+
+        enum AttributeEncoding {
+            ENCODE_FLOAT,
+            ENCODE_UNORM16,
+            ENCODE_HALF,
+            ENCODE_SNORM_1010102
+        };
+
+        // IEEE half float, rounded to nearest even; out of range values become infinity
+        uint16_t halfBits(float value) {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            uint32_t sign = (bits >> 16) & 0x8000, mantissa = bits & 0x7FFFFF;
+            int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+            if(((bits >> 23) & 0xFF) == 0xFF) return (uint16_t)(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));
+            if(exponent >= 31) return (uint16_t)(sign | 0x7C00);
+
+            uint32_t half, shift;
+            if(exponent > 0) {
+                half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+                shift = 13;
+            } else {
+                if(exponent < -10) return (uint16_t)sign;
+                mantissa |= 0x800000;
+                shift = (uint32_t)(14 - exponent);
+                half = mantissa >> shift;
+            }
+            uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+            if(rest > halfway || (rest == halfway && (half & 1))) half++; // A carry into the exponent is still correct
+            return (uint16_t)(sign | half);
+        }
+
+        uint16_t unorm16(float value) {
+            return (uint16_t)std::lround(std::max(0.0f, std::min(1.0f, value)) * 65535.0f);
+        }
+
+        // Layout of GL_INT_2_10_10_10_REV; 'w' is left 0
+        uint32_t snorm1010102(float x, float y, float z) {
+            auto snorm = [](float value) {
+                return (uint32_t)(int32_t)std::lround(std::max(-1.0f, std::min(1.0f, value)) * 511.0f) & 0x3FF;
+            };
+            return snorm(x) | snorm(y) << 10 | snorm(z) << 20;
+        }
+
+        bool inUnitRange(const VecArray &values, size_t count) {
+            for(size_t i = 0; i < count; i++) {
+                const VecVar &value = values.at(i);
+                if(!(value.val.v2.x >= 0.0f && value.val.v2.x <= 1.0f && value.val.v2.y >= 0.0f && value.val.v2.y <= 1.0f)) return false;
+            }
+            return true;
+        }
+
+        // Write one attribute of every vertex; 'target' points at the first vertex's copy
+        void packAttribute(uint8_t* target, size_t stride, const VecArray &values, size_t count, size_t components,
+                           AttributeEncoding encoding) {
+            switch(encoding) {
+                case ENCODE_FLOAT:
+                    for(size_t i = 0; i < count; i++)
+                        std::memcpy(target + i * stride, &values.at(i).val, components * sizeof(float));
+                    break;
+                case ENCODE_UNORM16:
+                    for(size_t i = 0; i < count; i++) {
+                        const VecVar &value = values.at(i);
+                        uint16_t packed[]{ unorm16(value.val.v2.x), unorm16(value.val.v2.y) };
+                        std::memcpy(target + i * stride, packed, sizeof(packed));
+                    }
+                    break;
+                case ENCODE_HALF:
+                    for(size_t i = 0; i < count; i++) {
+                        const VecVar &value = values.at(i);
+                        uint16_t packed[]{ halfBits(value.val.v2.x), halfBits(value.val.v2.y) };
+                        std::memcpy(target + i * stride, packed, sizeof(packed));
                     }
+                    break;
+                case ENCODE_SNORM_1010102:
+                    for(size_t i = 0; i < count; i++) {
+                        const VecVar &value = values.at(i);
+                        uint32_t packed = snorm1010102(value.val.v3.x, value.val.v3.y, value.val.v3.z);
+                        std::memcpy(target + i * stride, &packed, sizeof(packed));
+                    }
+                    break;
+            }
+        }
+
+        void Model::genBuffers(const RawModelDataIndexed &data, const std::vector<LODLevel> &lods, const VertexFormat &format) {
+
+            // Bounding Box and Sphere
+            if(data.exists(Type::VERTEX) && data.size() > 0) {
+                const VecArray &positions = data.at(Type::VERTEX);
+                glm::vec3 lo(positions.at(0).val.v3.x, positions.at(0).val.v3.y, positions.at(0).val.v3.z), hi(lo);
+                for(size_t i = 1; i < data.size(); i++) {
+                    const VecVar &p = positions.at(i);
+                    lo = glm::min(lo, glm::vec3(p.val.v3.x, p.val.v3.y, p.val.v3.z));
+                    hi = glm::max(hi, glm::vec3(p.val.v3.x, p.val.v3.y, p.val.v3.z));
+                }
+                glm::vec3 center = (lo + hi) * 0.5f;
+                for(int i = 0; i < 3; i++) {
+                    _bounds_center[i] = center[i];
+                    _bounds_min[i] = lo[i];
+                    _bounds_max[i] = hi[i];
                 }
+                _bounds_radius = glm::length(hi - lo) * 0.5f;
+            }
+
+            Render::Device &dev = device();
 
-                glBufferData(GL_ARRAY_BUFFER, size * stride * sizeof(float), &fdata[0], GL_STATIC_DRAW);
-                glEnableVertexAttribArray(iter.first.attribID());
-                glVertexAttribPointer(
-                        iter.first.attribID(),
-                        (int)iter.first.type(),
-                        GL_FLOAT,
-                        GL_FALSE,
-                        0,
-                        (void*)0
-                );
+            // Create Data Context VAO
+            GLuint vao = dev.createVertexArray();
+            dev.bindVertexArray(vao);
+
+            // Lay out every attribute in one vertex buffer, in attribute order
+            std::vector<std::pair<const Type::DataType*, const VecArray*>> sources;
+            for(auto && iter : data) sources.push_back(std::make_pair(&iter.first, &iter.second));
+            std::sort(sources.begin(), sources.end(), [](const std::pair<const Type::DataType*, const VecArray*> &lhs,
+                                                         const std::pair<const Type::DataType*, const VecArray*> &rhs) {
+                return lhs.first->attribID() < rhs.first->attribID();
+            });
+
+            size_t count = data.size(), vertex_size = 0;
+            std::vector<AttributeEncoding> encodings;
+            _attributes.clear();
+            for(auto && source : sources) {
+                const Type::DataType &type = *source.first;
+                AttributeEntry entry = { type.attribID(), (SWMint)type.type(), GL_FLOAT, false, 0, 0 };
+                AttributeEncoding encoding = ENCODE_FLOAT;
+                if(format.compressed && type == Type::UV && type.type() == TWO) {
+                    encoding = inUnitRange(*source.second, count) ? ENCODE_UNORM16 : ENCODE_HALF;
+                    entry.type = encoding == ENCODE_UNORM16 ? GL_UNSIGNED_SHORT : GL_HALF_FLOAT;
+                    entry.normalized = encoding == ENCODE_UNORM16;
+                }
+                if(format.compressed && type.type() == THREE && (type == Type::NORMAL || type == Type::TANGENT || type == Type::BITANGENT)) {
+                    encoding = ENCODE_SNORM_1010102;
+                    entry.components = 4;
+                    entry.type = GL_INT_2_10_10_10_REV;
+                    entry.normalized = true;
+                }
+                size_t bytes = encoding == ENCODE_FLOAT ? type.type() * sizeof(float) : 4;
+
+                // Planar attributes follow one another; interleaved ones share a stride, set once it is known
+                entry.offset = format.interleaved ? vertex_size : vertex_size * count;
+                entry.stride = (SWMsizei)bytes;
+                vertex_size += bytes;
+                _attributes.push_back(entry);
+                encodings.push_back(encoding);
             }
+            if(format.interleaved) for(AttributeEntry &entry : _attributes) entry.stride = (SWMsizei)vertex_size;
+
+            // Pack on the heap; meshes easily outgrow the stack
+            std::vector<uint8_t> vertices(vertex_size * count);
+            for(size_t a = 0; a < _attributes.size(); a++) {
+                const AttributeEntry &entry = _attributes[a];
+                packAttribute(vertices.data() + entry.offset, (size_t)entry.stride, *sources[a].second, count,
+                              sources[a].first->type(), encodings[a]);
+            }
+
+            _vertex_buffer = dev.createBuffer();
+            _vertex_bytes = vertices.size();
+            dev.bindBuffer(GL_ARRAY_BUFFER, _vertex_buffer);
+            dev.bufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.data());
+            bindAttributes(dev);
 
             // Create Index Buffer
-            glGenBuffers(1, &_element_buffer);
-            registeredBuffers.insert(_element_buffer);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _element_buffer);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indexSize() * sizeof(unsigned int), &data.indices()[0], GL_STATIC_DRAW);
+            _element_buffer = dev.createBuffer();
+            dev.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _element_buffer);
+
+            // All levels of detail share one element buffer, one after another
+            std::vector<unsigned int> elements(data.indices(), data.indices() + data.indexSize());
+            _lods.clear();
+            _lods.push_back(LODRange{ 0, data.indexSize(), 0.0f });
+            for(const LODLevel &lod : lods) {
+                _lods.push_back(LODRange{ elements.size(), lod.indices.size(), lod.error });
+                elements.insert(elements.end(), lod.indices.begin(), lod.indices.end());
+            }
+
+            if(data.size() <= 0x10000) {
+                // Every index fits in 16 bits; halves index bandwidth
+                std::vector<GLushort> compact(elements.begin(), elements.end());
+                dev.bufferData(GL_ELEMENT_ARRAY_BUFFER, compact.size() * sizeof(GLushort), compact.data());
+                _element_type = GL_UNSIGNED_SHORT;
+            } else {
+                dev.bufferData(GL_ELEMENT_ARRAY_BUFFER, elements.size() * sizeof(unsigned int), elements.data());
+                _element_type = GL_UNSIGNED_INT;
+            }
 
             _element_count = data.indexSize();
 
-            static_vao_map[glfwGetCurrentContext()][_element_buffer] = vao;
-            glBindVertexArray(0);
+            {
+                boost::lock_guard<boost::mutex> lock(_static_registered_mutex);
+                registeredVAOs.insert(vao);
+                registeredBuffers.insert(_vertex_buffer);
+                registeredBuffers.insert(_element_buffer);
+            }
+            {
+                Render::VAOTable &table = Render::currentVAOTable();
+                boost::lock_guard<boost::mutex> lock(table.mutex());
+                table.insert(_element_buffer, vao);
+            }
+            dev.bindVertexArray(0);
 
-            glfwSwapBuffers(glfwGetCurrentContext());
+            GLFWwindow* context = glfwGetCurrentContext();
+            if(context != nullptr) glfwSwapBuffers(context);
 
-            Log::log_render(INFO) << "Model Created [Buffers: ";
-            for(BufferEntry entry : _data_buffers) Log::log_render << entry.buffer << ", ";
-            Log::log_render << "ElementCount: " << _element_count << "]";
+            Log::log_render(INFO) << "Model Created [Buffers: " << _vertex_buffer << " (" << (unsigned long)_vertex_bytes
+                                  << " bytes), " << _element_buffer << ", ElementCount: " << _element_count
+                                  << ", LODs: " << (unsigned long)_lods.size() << "]";
 
             _loaded = true;
         }
 
-        void Model::genVAO() {
-
-            // Get current context in this thread
-            GLFWwindow* window = glfwGetCurrentContext();
-            if(window == nullptr || !_loaded) return;
-
+        SWMuint Model::genVAO() {
             Log::log_render(DEBUG) << "VAO Generating...";
 
             // Create new VAO object
-            GLuint vao;
-            glGenVertexArrays(1, &vao);
-            registeredVAOs.insert(vao);
-            glBindVertexArray(vao);
+            Render::Device &dev = device();
+            GLuint vao = dev.createVertexArray();
+            dev.bindVertexArray(vao);
 
-            for(BufferEntry buffer : _data_buffers) {
-                glBindBuffer(GL_ARRAY_BUFFER, buffer.buffer);
-                glEnableVertexAttribArray(buffer.attrib);
-                glVertexAttribPointer(
-                        buffer.attrib,
-                        (int)buffer.type,
-                        GL_FLOAT,
-                        GL_FALSE,
-                        0,
-                        (void*)0
-                );
-            }
+            bindAttributes(dev);
+            dev.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _element_buffer);
 
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _element_buffer);
+            dev.bindVertexArray(0);
 
-            glBindVertexArray(0);
+            boost::lock_guard<boost::mutex> lock(_static_registered_mutex);
+            registeredVAOs.insert(vao);
+            return vao;
+        }
 
-            static_vao_map[window][_element_buffer] = vao;
+        void Model::bindAttributes(Render::Device &dev) const {
+            dev.bindBuffer(GL_ARRAY_BUFFER, _vertex_buffer);
+            for(const AttributeEntry &entry : _attributes)
+                dev.vertexAttribute(entry.attrib, entry.components, entry.type, entry.normalized, entry.stride, entry.offset, 0);
         }
 
         /*
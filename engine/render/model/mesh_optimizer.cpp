@@ -0,0 +1,300 @@
+#define SWARM_INCLUDE_GLM
+#include "api/Render.h"
+
+#include "api/Logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace Swarm::Logging;
+
+namespace Swarm {
+    namespace Model {
+
+        // ******************
+        //  Cache Simulation
+        // ******************
+
+        // Counts vertex shader invocations for the given index order with a FIFO post-transform cache
+        size_t simulateVertexCache(const unsigned int* indices, size_t index_count, size_t vertex_count, unsigned int cache_size) {
+            if(cache_size == 0) return index_count;
+            std::vector<size_t> timestamps(vertex_count, 0);
+            size_t time = cache_size + 1; // Any timestamp at or below (time - cache_size) has been evicted
+            size_t misses = 0;
+            for(size_t i = 0; i < index_count; i++) {
+                unsigned int v = indices[i];
+                if(time - timestamps[v] > cache_size) {
+                    timestamps[v] = time++;
+                    misses++;
+                }
+            }
+            return misses;
+        }
+
+        VertexCacheStats analyzeVertexCache(const RawModelDataIndexed &data, unsigned int cache_size) {
+            VertexCacheStats stats{ 0.0f, 0.0f };
+            size_t triangles = data.indexSize() / 3;
+            if(triangles == 0 || data.size() == 0) return stats;
+            size_t misses = simulateVertexCache(data.indices(), triangles * 3, data.size(), cache_size);
+            stats.acmr = (float)misses / (float)triangles;
+            stats.atvr = (float)misses / (float)data.size();
+            return stats;
+        }
+
+
+
+        // ***************************
+        //  Forsyth Triangle Ordering
+        // ***************************
+        // See Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"; scoring constants are the ones from the article
+
+        const int FORSYTH_CACHE_SIZE = 32;
+        const unsigned int FORSYTH_VALENCE_TABLE_SIZE = 32;
+
+        struct ForsythScores {
+            float cache[FORSYTH_CACHE_SIZE];
+            float valence[FORSYTH_VALENCE_TABLE_SIZE];
+
+            ForsythScores() {
+                for(int i = 0; i < FORSYTH_CACHE_SIZE; i++) {
+                    // The most recent triangle's vertices get a fixed score, so the next triangle isn't forced to share them
+                    if(i < 3) cache[i] = 0.75f;
+                    else cache[i] = std::pow(1.0f - (float)(i - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+                }
+                valence[0] = 0.0f;
+                for(unsigned int i = 1; i < FORSYTH_VALENCE_TABLE_SIZE; i++) valence[i] = 2.0f / std::sqrt((float)i);
+            }
+
+            float score(int cache_pos, unsigned int remaining) const {
+                if(remaining == 0) return -1.0f;
+                float s = cache_pos >= 0 ? cache[cache_pos] : 0.0f;
+                return s + (remaining < FORSYTH_VALENCE_TABLE_SIZE ? valence[remaining] : 2.0f / std::sqrt((float)remaining));
+            }
+        };
+
+        std::vector<unsigned int> orderForsyth(const unsigned int* indices, size_t tri_count, size_t vertex_count) {
+            static const ForsythScores scores;
+            const size_t NONE = (size_t)-1;
+
+            // Vertex -> Triangle adjacency; the first 'remaining[v]' entries of each range are still un-emitted
+            std::vector<unsigned int> remaining(vertex_count, 0);
+            for(size_t i = 0; i < tri_count * 3; i++) remaining[indices[i]]++;
+            std::vector<size_t> offsets(vertex_count + 1, 0);
+            for(size_t v = 0; v < vertex_count; v++) offsets[v+1] = offsets[v] + remaining[v];
+            std::vector<unsigned int> adjacency(tri_count * 3);
+            {
+                std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+                for(size_t t = 0; t < tri_count; t++)
+                    for(int c = 0; c < 3; c++) adjacency[fill[indices[t*3+c]]++] = (unsigned int)t;
+            }
+
+            std::vector<int> cache_pos(vertex_count, -1);
+            std::vector<float> vertex_score(vertex_count);
+            for(size_t v = 0; v < vertex_count; v++) vertex_score[v] = scores.score(-1, remaining[v]);
+
+            std::vector<float> tri_score(tri_count);
+            std::vector<bool> emitted(tri_count, false);
+            size_t best = NONE;
+            for(size_t t = 0; t < tri_count; t++) {
+                tri_score[t] = vertex_score[indices[t*3]] + vertex_score[indices[t*3+1]] + vertex_score[indices[t*3+2]];
+                if(best == NONE || tri_score[t] > tri_score[best]) best = t;
+            }
+
+            std::vector<unsigned int> cache, next_cache;
+            cache.reserve(FORSYTH_CACHE_SIZE + 3);
+            next_cache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+            std::vector<unsigned int> output;
+            output.reserve(tri_count * 3);
+            size_t scan_cursor = 0;
+
+            for(size_t emitted_count = 0; emitted_count < tri_count; emitted_count++) {
+
+                // Dead end; continue from the first triangle not yet emitted
+                if(best == NONE) {
+                    while(emitted[scan_cursor]) scan_cursor++;
+                    best = scan_cursor;
+                }
+
+                const unsigned int* tri = &indices[best*3];
+                output.insert(output.end(), tri, tri+3);
+                emitted[best] = true;
+
+                // Detach the triangle from its vertices
+                for(int c = 0; c < 3; c++) {
+                    unsigned int v = tri[c];
+                    unsigned int* adj = &adjacency[offsets[v]];
+                    for(unsigned int a = 0; a < remaining[v]; a++) {
+                        if(adj[a] == best) {
+                            std::swap(adj[a], adj[remaining[v]-1]);
+                            remaining[v]--;
+                            break;
+                        }
+                    }
+                }
+
+                // Move the triangle's vertices to the front of the LRU cache
+                next_cache.assign(tri, tri+3);
+                for(unsigned int v : cache) if(v != tri[0] && v != tri[1] && v != tri[2]) next_cache.push_back(v);
+                cache.swap(next_cache);
+
+                // Re-score everything that was in or fell out of the cache, propagating the change to triangles
+                for(size_t i = 0; i < cache.size(); i++) {
+                    unsigned int v = cache[i];
+                    cache_pos[v] = i < (size_t)FORSYTH_CACHE_SIZE ? (int)i : -1;
+                    float score = scores.score(cache_pos[v], remaining[v]);
+                    float delta = score - vertex_score[v];
+                    vertex_score[v] = score;
+                    for(unsigned int a = 0; a < remaining[v]; a++) tri_score[adjacency[offsets[v] + a]] += delta;
+                }
+                if(cache.size() > (size_t)FORSYTH_CACHE_SIZE) cache.resize(FORSYTH_CACHE_SIZE);
+
+                // The next best triangle is almost always one that touches the cache
+                best = NONE;
+                for(unsigned int v : cache) {
+                    for(unsigned int a = 0; a < remaining[v]; a++) {
+                        unsigned int t = adjacency[offsets[v] + a];
+                        if(best == NONE || tri_score[t] > tri_score[best]) best = t;
+                    }
+                }
+            }
+
+            return output;
+        }
+
+
+
+        // ********************
+        //  Overdraw Reduction
+        // ********************
+        // Tipsify-style: cut the cache-ordered triangles into clusters wherever the cache fully misses, then draw
+        // clusters that face outward from the mesh center first, so they tend to occlude the rest
+
+        std::vector<unsigned int> orderOverdraw(const std::vector<unsigned int> &indices, const RawModelDataIndexed &data,
+                                                const Type::DataType &vertex_type, unsigned int cache_size) {
+            size_t tri_count = indices.size() / 3;
+            const VecArray &positions = data.at(vertex_type);
+
+            // Cluster boundaries
+            std::vector<size_t> cluster_start;
+            std::vector<size_t> timestamps(data.size(), 0);
+            size_t time = cache_size + 1;
+            for(size_t t = 0; t < tri_count; t++) {
+                int misses = 0;
+                for(int c = 0; c < 3; c++) {
+                    unsigned int v = indices[t*3+c];
+                    if(time - timestamps[v] > cache_size) { timestamps[v] = time++; misses++; }
+                }
+                if(t == 0 || misses == 3) cluster_start.push_back(t);
+            }
+            cluster_start.push_back(tri_count);
+            size_t cluster_count = cluster_start.size() - 1;
+            if(cluster_count < 2) return indices;
+
+            // Mesh centroid
+            glm::vec3 mesh_center(0.0f);
+            for(size_t v = 0; v < data.size(); v++) {
+                const VecVar &p = positions.at(v);
+                mesh_center += glm::vec3(p.val.v3.x, p.val.v3.y, p.val.v3.z);
+            }
+            mesh_center = mesh_center / (float)data.size();
+
+            // Sort key: how far the cluster's area-weighted centroid lies along its average normal
+            std::vector<std::pair<float, size_t>> keys(cluster_count);
+            for(size_t c = 0; c < cluster_count; c++) {
+                glm::vec3 centroid(0.0f), normal(0.0f);
+                float area = 0.0f;
+                for(size_t t = cluster_start[c]; t < cluster_start[c+1]; t++) {
+                    const VecVar &a = positions.at(indices[t*3]), &b = positions.at(indices[t*3+1]), &d = positions.at(indices[t*3+2]);
+                    glm::vec3 p0(a.val.v3.x, a.val.v3.y, a.val.v3.z);
+                    glm::vec3 p1(b.val.v3.x, b.val.v3.y, b.val.v3.z);
+                    glm::vec3 p2(d.val.v3.x, d.val.v3.y, d.val.v3.z);
+                    glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                    float tri_area = glm::length(n);
+                    centroid += (p0 + p1 + p2) * (tri_area / 3.0f);
+                    normal += n;
+                    area += tri_area;
+                }
+                float normal_length = glm::length(normal);
+                float key = 0.0f;
+                if(area > 0.0f && normal_length > 0.0f) key = glm::dot(centroid / area - mesh_center, normal / normal_length);
+                keys[c] = std::make_pair(-key, c);
+            }
+            std::stable_sort(keys.begin(), keys.end());
+
+            std::vector<unsigned int> output;
+            output.reserve(indices.size());
+            for(auto && key : keys)
+                output.insert(output.end(), indices.begin() + cluster_start[key.second] * 3, indices.begin() + cluster_start[key.second + 1] * 3);
+            return output;
+        }
+
+
+
+        // **********************
+        //  Vertex Fetch Reorder
+        // **********************
+
+        void orderVertexFetch(RawModelDataIndexed &data, std::vector<unsigned int> &indices) {
+            const unsigned int UNUSED = (unsigned int)-1;
+            size_t vertex_count = data.size();
+
+            // Number vertices by first use; vertices no triangle references are dropped
+            std::vector<unsigned int> remap(vertex_count, UNUSED);
+            unsigned int next = 0;
+            for(unsigned int &index : indices) {
+                if(remap[index] == UNUSED) remap[index] = next++;
+                index = remap[index];
+            }
+
+            // Build every array before putting any back, since put() resizes the whole collection
+            std::vector<std::pair<Type::DataType, VecArray>> reordered;
+            for(auto && iter : data) {
+                VecArray new_array(iter.first.type(), next);
+                for(size_t v = 0; v < vertex_count; v++) if(remap[v] != UNUSED) new_array[remap[v]] = iter.second.at(v);
+                reordered.push_back(std::make_pair(iter.first, new_array));
+            }
+            data.resize(next);
+            for(auto && entry : reordered) data.put(entry.first, entry.second);
+        }
+
+
+
+        // ************
+        //  Public API
+        // ************
+
+        OptimizeResult optimize(RawModelDataIndexed &data, unsigned int flags, unsigned int cache_size, const Type::DataType &vertex_type) {
+            OptimizeResult result;
+            result.before = result.after = analyzeVertexCache(data, cache_size);
+
+            size_t tri_count = data.indexSize() / 3;
+            if(tri_count == 0 || data.indices() == nullptr) return result;
+            for(size_t i = 0; i < tri_count * 3; i++) if(data.indices()[i] >= data.size()) return result;
+
+            std::vector<unsigned int> indices(data.indices(), data.indices() + tri_count * 3);
+
+            if(flags & OPTIMIZE_VERTEX_CACHE) indices = orderForsyth(indices.data(), tri_count, data.size());
+
+            if((flags & OPTIMIZE_OVERDRAW) && data.exists(vertex_type) && vertex_type.type() >= THREE) {
+                // Only keep the overdraw order if it doesn't give back too much of the cache efficiency
+                std::vector<unsigned int> overdraw = orderOverdraw(indices, data, vertex_type, cache_size);
+                size_t misses_cache    = simulateVertexCache(indices.data(),  indices.size(),  data.size(), cache_size);
+                size_t misses_overdraw = simulateVertexCache(overdraw.data(), overdraw.size(), data.size(), cache_size);
+                if(misses_overdraw <= misses_cache * 105 / 100) indices.swap(overdraw);
+            }
+
+            if(flags & OPTIMIZE_VERTEX_FETCH) orderVertexFetch(data, indices);
+
+            data.putIndices(indices.data(), indices.size());
+            result.after = analyzeVertexCache(data, cache_size);
+
+            Log::log_render(DEBUG) << "Optimized Mesh [Triangles: " << (unsigned long)tri_count
+                                   << ", ACMR: " << (double)result.before.acmr << " -> " << (double)result.after.acmr
+                                   << ", ATVR: " << (double)result.before.atvr << " -> " << (double)result.after.atvr << "]";
+            return result;
+        }
+
+    }
+}
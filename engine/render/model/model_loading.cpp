@@ -23,7 +23,6 @@ namespace Swarm {
 
             FILE * file = fopen(path, "r");
             if( file == NULL ) {
-                getchar();
                 throw ModelLoadingException::FileLoad(std::string(path));
             }
 
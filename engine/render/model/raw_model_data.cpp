@@ -145,81 +145,6 @@ namespace Swarm {
 
 
 
-        bool computeTangents(RawModelData &raw_model_data,
-                             const Type::DataType &vertex_type, const Type::DataType &uv_type, const Type::DataType &normal_type,
-                             const Type::DataType &tangent_type, const Type::DataType &bitangent_type) {
-
-            // Are the DataTypes compatible?
-            if( vertex_type.type() < 3) return false;
-            if( uv_type.type() < 2) return false;
-            if( normal_type.type() < 3) return false;
-            if( tangent_type.type() != 3) return false;
-            if( bitangent_type.type() != 3) return false;
-
-            // Does this RawModelData have everything we need?
-            if( !(raw_model_data.exists(vertex_type) && raw_model_data.exists(uv_type) && raw_model_data.exists(normal_type)) ) return false;
-
-            size_t size = raw_model_data.size();
-
-            // Get the input data arrays
-            VecArray &vertex_data = raw_model_data[vertex_type];
-            VecArray &uv_data     = raw_model_data[uv_type];
-            VecArray &normal_data = raw_model_data[normal_type];
-
-            // Create the output data arrays
-            VecArray tangent_data  (THREE, size);
-            VecArray bitangent_data(THREE, size);
-
-            for(size_t i = 0; i < size; i+=3) {
-
-                // Must do calculations in pairs, but have to accomodate for sizes that aren't multiples of 3
-                if(i >= size-2) i = size-3;
-
-                // Retrieve the needed data
-                glm::vec3 v0 (vertex_data[i+0].val.v3.x, vertex_data[i+0].val.v3.y, vertex_data[i+0].val.v3.z);
-                glm::vec3 v1 (vertex_data[i+1].val.v3.x, vertex_data[i+1].val.v3.y, vertex_data[i+1].val.v3.z);
-                glm::vec3 v2 (vertex_data[i+2].val.v3.x, vertex_data[i+2].val.v3.y, vertex_data[i+2].val.v3.z);
-                glm::vec2 uv0(uv_data    [i+0].val.v2.x, uv_data    [i+0].val.v2.y);
-                glm::vec2 uv1(uv_data    [i+1].val.v2.x, uv_data    [i+1].val.v2.y);
-                glm::vec2 uv2(uv_data    [i+2].val.v2.x, uv_data    [i+2].val.v2.y);
-                glm::vec3 n0 (normal_data[i+0].val.v3.x, normal_data[i+0].val.v3.y, normal_data[i+0].val.v3.z);
-                glm::vec3 n1 (normal_data[i+1].val.v3.x, normal_data[i+1].val.v3.y, normal_data[i+1].val.v3.z);
-                glm::vec3 n2 (normal_data[i+2].val.v3.x, normal_data[i+2].val.v3.y, normal_data[i+2].val.v3.z);
-
-                // Calculate Deltas
-                glm::vec3 dV1  = v1-v0;
-                glm::vec3 dV2  = v2-v0;
-                glm::vec2 dUV1 = uv1-uv0;
-                glm::vec2 dUV2 = uv2-uv0;
-
-                // Calculate Tangent and Bitangent values
-                float r = 1.0f / ( dUV1.x * dUV2.y - dUV1.y * dUV2.x );
-                glm::vec3 tangent =   r * ( dV1 * dUV2.y - dV2 * dUV1.y );
-                glm::vec3 bitangent = r * ( dV2 * dUV1.x - dV1 * dUV2.x );
-                glm::vec3 t0 = glm::normalize(tangent - n0 * glm::dot(n0, tangent));
-                glm::vec3 t1 = glm::normalize(tangent - n1 * glm::dot(n1, tangent));
-                glm::vec3 t2 = glm::normalize(tangent - n2 * glm::dot(n2, tangent));
-
-                // Calculate final Tangents and Bitangents
-                // CLion (and possibly other IDEs) will see an error when comparing a glm::dot result to a float,
-                //   but it compiles just fine (it can't read the GLM template)
-                tangent_data[i+0] = VecVar( t0 * ( glm::dot(glm::cross(n0, t0), bitangent) < 0.0f ? -1.0f : 1.0f) );
-                tangent_data[i+1] = VecVar( t1 * ( glm::dot(glm::cross(n1, t1), bitangent) < 0.0f ? -1.0f : 1.0f) );
-                tangent_data[i+2] = VecVar( t2 * ( glm::dot(glm::cross(n2, t2), bitangent) < 0.0f ? -1.0f : 1.0f) );
-                VecVar btvv( bitangent );
-                bitangent_data[i+0] = btvv;
-                bitangent_data[i+1] = btvv;
-                bitangent_data[i+2] = btvv;
-
-            }
-
-            // Store the resulting tangents in the RawModelData
-            raw_model_data.put(tangent_type,   tangent_data);
-            raw_model_data.put(bitangent_type, bitangent_data);
-
-            return true;
-        }
-
         struct IndexDatum {
             struct SubDatum {
                 int cmp_1, cmp_2, cmp_3, cmp_4;
@@ -341,7 +266,9 @@ namespace Swarm {
         }
 
         RawModelDataIndexed &RawModelDataIndexed::operator=(const RawModelDataIndexed &other) {
+            if(this == &other) return *this;
             RawModelData::operator=(other); // Might be an issue
+            if(_indices != nullptr) delete [] _indices;
             _index_size = other._index_size;
             _indices = new unsigned int[_index_size];
             for(int i = 0; i < _index_size; i++) _indices[i] = other._indices[i];
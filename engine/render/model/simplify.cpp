@@ -0,0 +1,304 @@
+#define SWARM_INCLUDE_GLM
+#include "api/Render.h"
+
+#include "api/Logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace Swarm::Logging;
+
+namespace Swarm {
+    namespace Model {
+
+        // **********
+        //  Quadrics
+        // **********
+        // Symmetric 4x4 error quadric (Garland & Heckbert); the error of a point is the area-weighted sum of its
+        // squared distances to the accumulated planes, divided by the total weight
+
+        struct Quadric {
+            double a00 = 0, a11 = 0, a22 = 0, a10 = 0, a20 = 0, a21 = 0;
+            double b0 = 0, b1 = 0, b2 = 0, c = 0, w = 0;
+
+            Quadric() {}
+
+            Quadric(const glm::vec3 &n, float d, float weight) {
+                a00 = n.x * n.x * weight; a11 = n.y * n.y * weight; a22 = n.z * n.z * weight;
+                a10 = n.y * n.x * weight; a20 = n.z * n.x * weight; a21 = n.z * n.y * weight;
+                b0 = n.x * d * weight; b1 = n.y * d * weight; b2 = n.z * d * weight;
+                c = (double)d * d * weight;
+                w = weight;
+            }
+
+            Quadric &operator+=(const Quadric &q) {
+                a00 += q.a00; a11 += q.a11; a22 += q.a22; a10 += q.a10; a20 += q.a20; a21 += q.a21;
+                b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c; w += q.w;
+                return *this;
+            }
+
+            double error(const glm::vec3 &p) const {
+                double rx = a00 * p.x + a10 * p.y + a20 * p.z;
+                double ry = a10 * p.x + a11 * p.y + a21 * p.z;
+                double rz = a20 * p.x + a21 * p.y + a22 * p.z;
+                double r = rx * p.x + ry * p.y + rz * p.z + 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+                return w > 0.0 ? std::fabs(r) / w : 0.0;
+            }
+        };
+
+        // Open edges are weighted heavily so silhouettes of open meshes stay in place
+        const float SIMPLIFY_BORDER_WEIGHT = 10.0f;
+
+
+
+        // ************
+        //  Simplifier
+        // ************
+        // Edge-collapse simplifier that only ever moves a data point onto a neighbouring one, so every level can share
+        // the original data points and differ only in indices. Data points that share a position with another data
+        // point (attribute seams) are never moved, which keeps UV and normal seams intact.
+
+        class Simplifier {
+        public:
+            enum Kind : unsigned char { MANIFOLD, BORDER, LOCKED };
+
+            struct Collapse {
+                unsigned int from, to;
+                float cost;
+                bool operator<(const Collapse &rhs) const { return cost < rhs.cost; }
+            };
+
+            Simplifier(const RawModelDataIndexed &data, const Type::DataType &vertex_type)
+                    : _indices(data.indices(), data.indices() + data.indexSize()) {
+                size_t vertex_count = data.size();
+                const VecArray &positions = data.at(vertex_type);
+
+                // Normalize to the bounding sphere, so errors are relative to the size of the mesh
+                glm::vec3 lo(0.0f), hi(0.0f);
+                _positions.resize(vertex_count);
+                for(size_t v = 0; v < vertex_count; v++) {
+                    const VecVar &p = positions.at(v);
+                    _positions[v] = glm::vec3(p.val.v3.x, p.val.v3.y, p.val.v3.z);
+                    lo = v == 0 ? _positions[v] : glm::min(lo, _positions[v]);
+                    hi = v == 0 ? _positions[v] : glm::max(hi, _positions[v]);
+                }
+                glm::vec3 center = (lo + hi) * 0.5f;
+                float radius = glm::length(hi - lo) * 0.5f;
+                if(radius <= 0.0f) radius = 1.0f;
+                for(glm::vec3 &p : _positions) p = (p - center) / radius;
+
+                // Seams
+                _seam.assign(vertex_count, false);
+                std::vector<unsigned int> order(vertex_count);
+                for(size_t v = 0; v < vertex_count; v++) order[v] = (unsigned int)v;
+                std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+                    const glm::vec3 &pa = _positions[a], &pb = _positions[b];
+                    return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+                });
+                for(size_t i = 1; i < vertex_count; i++) {
+                    if(_positions[order[i]] == _positions[order[i-1]]) _seam[order[i]] = _seam[order[i-1]] = true;
+                }
+
+                // Quadrics
+                _quadrics.assign(vertex_count, Quadric());
+                buildAdjacency();
+                for(size_t t = 0; t < _indices.size() / 3; t++) {
+                    const unsigned int* tri = &_indices[t*3];
+                    glm::vec3 p0 = _positions[tri[0]], p1 = _positions[tri[1]], p2 = _positions[tri[2]];
+                    glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                    float length = glm::length(n);
+                    if(length <= 0.0f) continue;
+                    n = n / length;
+                    Quadric face(n, -glm::dot(n, p0), length * 0.5f);
+                    for(int c = 0; c < 3; c++) _quadrics[tri[c]] += face;
+
+                    for(int c = 0; c < 3; c++) {
+                        unsigned int a = tri[c], b = tri[(c+1)%3];
+                        if(hasEdge(b, a)) continue;
+                        glm::vec3 edge = _positions[b] - _positions[a];
+                        float edge_length = glm::length(edge);
+                        if(edge_length <= 0.0f) continue;
+                        glm::vec3 bn = glm::normalize(glm::cross(edge / edge_length, n));
+                        Quadric border(bn, -glm::dot(bn, _positions[a]), edge_length * edge_length * SIMPLIFY_BORDER_WEIGHT);
+                        _quadrics[a] += border;
+                        _quadrics[b] += border;
+                    }
+                }
+            }
+
+            const std::vector<unsigned int> &indices() const { return _indices; }
+            float error() const { return _error; }
+
+            //! Collapses edges until the index count reaches the target, or no collapse stays under the error limit
+            void run(size_t target_index_count, float max_error) {
+                double max_cost = (double)max_error * max_error;
+                while(_indices.size() > target_index_count) {
+                    buildAdjacency();
+                    classify();
+
+                    std::vector<Collapse> collapses;
+                    collapses.reserve(_indices.size());
+                    for(size_t t = 0; t < _indices.size() / 3; t++) {
+                        for(int c = 0; c < 3; c++) {
+                            unsigned int a = _indices[t*3+c], b = _indices[t*3+(c+1)%3];
+                            bool border = !hasEdge(b, a);
+                            bool ab = canCollapse(a, border), ba = canCollapse(b, border);
+                            if(!ab && !ba) continue;
+                            float cost_ab = ab ? (float)_quadrics[a].error(_positions[b]) : 0.0f;
+                            float cost_ba = ba ? (float)_quadrics[b].error(_positions[a]) : 0.0f;
+                            if(ab && (!ba || cost_ab <= cost_ba)) collapses.push_back(Collapse{ a, b, cost_ab });
+                            else collapses.push_back(Collapse{ b, a, cost_ba });
+                        }
+                    }
+                    std::sort(collapses.begin(), collapses.end());
+
+                    // Apply as many independent collapses as the target allows; each one touches two data points,
+                    // and neither may take part in another collapse this pass
+                    size_t triangle_goal = (_indices.size() - target_index_count + 2) / 3;
+                    size_t triangles_removed = 0;
+                    std::vector<bool> touched(_positions.size(), false);
+                    std::vector<unsigned int> remap(_positions.size());
+                    for(size_t v = 0; v < remap.size(); v++) remap[v] = (unsigned int)v;
+                    size_t applied = 0;
+                    for(const Collapse &collapse : collapses) {
+                        if(collapse.cost > max_cost) break;
+                        if(touched[collapse.from] || touched[collapse.to]) continue;
+                        if(flips(collapse.from, collapse.to)) continue;
+
+                        remap[collapse.from] = collapse.to;
+                        _quadrics[collapse.to] += _quadrics[collapse.from];
+                        touched[collapse.from] = touched[collapse.to] = true;
+                        _error = std::max(_error, std::sqrt(collapse.cost));
+                        applied++;
+
+                        for(size_t i = _offsets[collapse.from]; i < _offsets[collapse.from + 1]; i++) {
+                            const unsigned int* tri = &_indices[_adjacency[i] * 3];
+                            if(tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) triangles_removed++;
+                        }
+                        if(triangles_removed >= triangle_goal) break;
+                    }
+                    if(applied == 0) break;
+
+                    // Remap, dropping triangles that became degenerate
+                    size_t write = 0;
+                    for(size_t t = 0; t < _indices.size() / 3; t++) {
+                        unsigned int a = remap[_indices[t*3]], b = remap[_indices[t*3+1]], c = remap[_indices[t*3+2]];
+                        if(a == b || b == c || a == c) continue;
+                        _indices[write++] = a; _indices[write++] = b; _indices[write++] = c;
+                    }
+                    _indices.resize(write);
+                }
+            }
+
+        protected:
+            void buildAdjacency() {
+                _offsets.assign(_positions.size() + 1, 0);
+                for(unsigned int index : _indices) _offsets[index + 1]++;
+                for(size_t v = 0; v < _positions.size(); v++) _offsets[v+1] += _offsets[v];
+                _adjacency.resize(_indices.size());
+                std::vector<size_t> fill(_offsets.begin(), _offsets.end() - 1);
+                for(size_t i = 0; i < _indices.size(); i++) _adjacency[fill[_indices[i]]++] = (unsigned int)(i / 3);
+            }
+
+            // Is there a triangle with the directed edge a -> b
+            bool hasEdge(unsigned int a, unsigned int b) const {
+                for(size_t i = _offsets[a]; i < _offsets[a+1]; i++) {
+                    const unsigned int* tri = &_indices[_adjacency[i] * 3];
+                    for(int c = 0; c < 3; c++) if(tri[c] == a && tri[(c+1)%3] == b) return true;
+                }
+                return false;
+            }
+
+            void classify() {
+                std::vector<unsigned int> border_out(_positions.size(), 0), border_in(_positions.size(), 0);
+                for(size_t t = 0; t < _indices.size() / 3; t++) {
+                    for(int c = 0; c < 3; c++) {
+                        unsigned int a = _indices[t*3+c], b = _indices[t*3+(c+1)%3];
+                        if(!hasEdge(b, a)) { border_out[a]++; border_in[b]++; }
+                    }
+                }
+                _kinds.resize(_positions.size());
+                for(size_t v = 0; v < _positions.size(); v++) {
+                    if(_seam[v] || border_out[v] != border_in[v] || border_out[v] > 1) _kinds[v] = LOCKED;
+                    else _kinds[v] = border_out[v] == 1 ? BORDER : MANIFOLD;
+                }
+            }
+
+            // Border data points may only slide along the border
+            bool canCollapse(unsigned int from, bool border_edge) const {
+                return _kinds[from] == MANIFOLD || (_kinds[from] == BORDER && border_edge);
+            }
+
+            // Would moving 'from' onto 'to' turn any remaining triangle around 'from' over
+            bool flips(unsigned int from, unsigned int to) const {
+                for(size_t i = _offsets[from]; i < _offsets[from + 1]; i++) {
+                    const unsigned int* tri = &_indices[_adjacency[i] * 3];
+                    if(tri[0] == to || tri[1] == to || tri[2] == to) continue;
+                    int c = tri[0] == from ? 0 : tri[1] == from ? 1 : 2;
+                    const glm::vec3 &p1 = _positions[tri[(c+1)%3]], &p2 = _positions[tri[(c+2)%3]];
+                    glm::vec3 before = glm::cross(p1 - _positions[from], p2 - _positions[from]);
+                    glm::vec3 after  = glm::cross(p1 - _positions[to],   p2 - _positions[to]);
+                    if(glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after)) return true;
+                }
+                return false;
+            }
+
+            std::vector<glm::vec3> _positions;
+            std::vector<bool> _seam;
+            std::vector<Kind> _kinds;
+            std::vector<Quadric> _quadrics;
+            std::vector<unsigned int> _indices;
+            std::vector<size_t> _offsets;
+            std::vector<unsigned int> _adjacency;
+            float _error = 0.0f;
+        };
+
+        bool validForSimplify(const RawModelDataIndexed &data, const Type::DataType &vertex_type) {
+            if(data.indices() == nullptr || data.indexSize() < 3) return false;
+            if(!data.exists(vertex_type) || vertex_type.type() < THREE) return false;
+            for(size_t i = 0; i < data.indexSize(); i++) if(data.indices()[i] >= data.size()) return false;
+            return true;
+        }
+
+
+
+        // ************
+        //  Public API
+        // ************
+
+        std::vector<unsigned int> simplify(const RawModelDataIndexed &data, size_t target_index_count, float max_error,
+                                           float* result_error, const Type::DataType &vertex_type) {
+            if(result_error != nullptr) *result_error = 0.0f;
+            if(!validForSimplify(data, vertex_type))
+                return std::vector<unsigned int>(data.indices(), data.indices() + (data.indices() ? data.indexSize() : 0));
+
+            Simplifier simplifier(data, vertex_type);
+            simplifier.run(target_index_count, max_error);
+            if(result_error != nullptr) *result_error = simplifier.error();
+            return simplifier.indices();
+        }
+
+        std::vector<LODLevel> generateLODs(const RawModelDataIndexed &data, const std::vector<float> &ratios,
+                                           float max_error, const Type::DataType &vertex_type) {
+            std::vector<LODLevel> levels;
+            if(!validForSimplify(data, vertex_type)) return levels;
+
+            // Each level continues from the previous one, so quadrics (and errors) accumulate down the chain
+            Simplifier simplifier(data, vertex_type);
+            size_t triangles = data.indexSize() / 3;
+            size_t previous = data.indexSize();
+            for(float ratio : ratios) {
+                size_t target = (size_t)(triangles * std::max(0.0f, std::min(1.0f, ratio))) * 3;
+                simplifier.run(target, max_error);
+                if(simplifier.indices().size() >= previous) break; // Error limit reached; further levels would repeat
+                previous = simplifier.indices().size();
+                levels.push_back(LODLevel{ simplifier.indices(), simplifier.error() });
+                Log::log_render(DEBUG) << "LOD " << (unsigned long)levels.size() << " [Triangles: "
+                                       << (unsigned long)(previous / 3) << ", Error: " << (double)simplifier.error() << "]";
+            }
+            return levels;
+        }
+
+    }
+}
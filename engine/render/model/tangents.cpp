@@ -0,0 +1,338 @@
+#define SWARM_INCLUDE_GLM
+#include "api/Render.h"
+
+#include "api/Logging.h"
+#include "api/Util.h"
+#include "util/SIMD.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+using namespace Swarm::Logging;
+using namespace Swarm::SIMD;
+
+namespace Swarm {
+    namespace Model {
+
+        // Meshes with fewer triangles than this are not worth spinning up extra threads for
+        const size_t TANGENT_THREAD_THRESHOLD = 1 << 15;
+
+        // Flattened, per-vertex input streams
+        struct TangentInput {
+            std::vector<float> px, py, pz;
+            std::vector<float> u, v;
+            std::vector<float> nx, ny, nz;
+
+            void resize(size_t size) {
+                px.resize(size); py.resize(size); pz.resize(size);
+                u.resize(size);  v.resize(size);
+                nx.resize(size); ny.resize(size); nz.resize(size);
+            }
+
+            void set(size_t i, const VecVar &pos, const VecVar &uv, const VecVar &normal) {
+                px[i] = pos.val.v3.x;    py[i] = pos.val.v3.y;    pz[i] = pos.val.v3.z;
+                u[i]  = uv.val.v2.x;     v[i]  = uv.val.v2.y;
+                nx[i] = normal.val.v3.x; ny[i] = normal.val.v3.y; nz[i] = normal.val.v3.z;
+            }
+        };
+
+        // Per-vertex tangent/bitangent sums; also reused for the final orthonormalized output
+        struct TangentAccum {
+            std::vector<float> tx, ty, tz;
+            std::vector<float> bx, by, bz;
+
+            void resize(size_t size) {
+                tx.assign(size, 0.0f); ty.assign(size, 0.0f); tz.assign(size, 0.0f);
+                bx.assign(size, 0.0f); by.assign(size, 0.0f); bz.assign(size, 0.0f);
+            }
+        };
+
+        // Splits [0, count) into one contiguous range per thread; range 0 runs on the calling thread, the rest as jobs
+        template<typename F> void parallelRanges(size_t count, size_t threads, F func) {
+            if(threads <= 1 || count < threads) { func(0, count, 0); return; }
+            size_t chunk = (count + threads - 1) / threads;
+            Util::JobCounter counter;
+            for(size_t t = 1; t < threads; t++) {
+                size_t begin = std::min(count, t * chunk);
+                size_t end   = std::min(count, begin + chunk);
+                Util::runJob([=]() { func(begin, end, t); }, &counter);
+            }
+            func(0, std::min(count, chunk), 0);
+            counter.wait();
+        }
+
+        // Computes the face tangents for a range of triangles, SIMD-width triangles at a time, and scatters
+        // them onto the triangle corners
+        void accumulateTriangles(const TangentInput &in, const unsigned int* indices,
+                                 size_t tri_begin, size_t tri_end, TangentAccum &acc) {
+
+            const size_t W = vfloat::width;
+            const vfloat zero(0.0f);
+            const vfloat epsilon(1e-12f);
+
+            unsigned int i0[W], i1[W], i2[W];
+            float out_tx[W], out_ty[W], out_tz[W], out_bx[W], out_by[W], out_bz[W];
+
+            for(size_t tri = tri_begin; tri < tri_end; tri += W) {
+
+                // Pad a trailing partial batch by repeating the last triangle; the extra lanes are not scattered
+                size_t lanes = std::min(W, tri_end - tri);
+                for(size_t l = 0; l < W; l++) {
+                    size_t t = tri + std::min(l, lanes-1);
+                    i0[l] = indices[t*3+0];
+                    i1[l] = indices[t*3+1];
+                    i2[l] = indices[t*3+2];
+                }
+
+                // Position and UV deltas
+                vfloat p0x = gather(in.px.data(), i0), p0y = gather(in.py.data(), i0), p0z = gather(in.pz.data(), i0);
+                vfloat dv1x = gather(in.px.data(), i1) - p0x;
+                vfloat dv1y = gather(in.py.data(), i1) - p0y;
+                vfloat dv1z = gather(in.pz.data(), i1) - p0z;
+                vfloat dv2x = gather(in.px.data(), i2) - p0x;
+                vfloat dv2y = gather(in.py.data(), i2) - p0y;
+                vfloat dv2z = gather(in.pz.data(), i2) - p0z;
+
+                vfloat uv0u = gather(in.u.data(), i0), uv0v = gather(in.v.data(), i0);
+                vfloat du1 = gather(in.u.data(), i1) - uv0u;
+                vfloat dw1 = gather(in.v.data(), i1) - uv0v;
+                vfloat du2 = gather(in.u.data(), i2) - uv0u;
+                vfloat dw2 = gather(in.v.data(), i2) - uv0v;
+
+                // Degenerate UV triangles contribute nothing instead of poisoning the sums with inf/NaN
+                vfloat det = du1 * dw2 - dw1 * du2;
+                vfloat valid = epsilon < abs(det);
+                vfloat r = select(valid, vfloat(1.0f) / select(valid, det, vfloat(1.0f)), zero);
+
+                (r * (dv1x * dw2 - dv2x * dw1)).store(out_tx);
+                (r * (dv1y * dw2 - dv2y * dw1)).store(out_ty);
+                (r * (dv1z * dw2 - dv2z * dw1)).store(out_tz);
+                (r * (dv2x * du1 - dv1x * du2)).store(out_bx);
+                (r * (dv2y * du1 - dv1y * du2)).store(out_by);
+                (r * (dv2z * du1 - dv1z * du2)).store(out_bz);
+
+                for(size_t l = 0; l < lanes; l++) {
+                    const unsigned int corners[3]{ i0[l], i1[l], i2[l] };
+                    for(unsigned int c : corners) {
+                        acc.tx[c] += out_tx[l]; acc.ty[c] += out_ty[l]; acc.tz[c] += out_tz[l];
+                        acc.bx[c] += out_bx[l]; acc.by[c] += out_by[l]; acc.bz[c] += out_bz[l];
+                    }
+                }
+            }
+        }
+
+        // Gram-Schmidt orthonormalizes the summed tangents against the vertex normals, and rebuilds the bitangents
+        // from the normal and tangent with the handedness of the summed bitangent. Vertices without any usable
+        // UV-mapped face get an arbitrary tangent perpendicular to their normal.
+        void orthonormalizeRange(const TangentInput &in, TangentAccum &acc, size_t begin, size_t end) {
+
+            const size_t W = vfloat::width;
+            const vfloat zero(0.0f), one(1.0f), epsilon(1e-20f), axis_limit(0.9f);
+
+            size_t i = begin;
+            for(; i + W <= end; i += W) {
+                vfloat nx = vfloat::load(&in.nx[i]), ny = vfloat::load(&in.ny[i]), nz = vfloat::load(&in.nz[i]);
+                vfloat tx = vfloat::load(&acc.tx[i]), ty = vfloat::load(&acc.ty[i]), tz = vfloat::load(&acc.tz[i]);
+                vfloat bx = vfloat::load(&acc.bx[i]), by = vfloat::load(&acc.by[i]), bz = vfloat::load(&acc.bz[i]);
+
+                // t' = t - n * dot(n, t)
+                vfloat ndt = dot3(nx, ny, nz, tx, ty, tz);
+                tx = tx - nx * ndt;
+                ty = ty - ny * ndt;
+                tz = tz - nz * ndt;
+
+                // Fallback: cross(n, X) when n is not close to X, otherwise cross(n, Y)
+                vfloat use_x = abs(nx) < axis_limit;
+                vfloat len2 = dot3(tx, ty, tz, tx, ty, tz);
+                vfloat degenerate = len2 < epsilon;
+                tx = select(degenerate, select(use_x, zero, -nz), tx);
+                ty = select(degenerate, select(use_x, nz, zero),  ty);
+                tz = select(degenerate, select(use_x, -ny, nx),   tz);
+
+                vfloat inv_len = one / sqrt(dot3(tx, ty, tz, tx, ty, tz));
+                tx = tx * inv_len; ty = ty * inv_len; tz = tz * inv_len;
+
+                // b' = cross(n, t') * sign(dot(cross(n, t'), b))
+                vfloat cx = ny * tz - nz * ty;
+                vfloat cy = nz * tx - nx * tz;
+                vfloat cz = nx * ty - ny * tx;
+                vfloat w = select(dot3(cx, cy, cz, bx, by, bz) < zero, -one, one);
+
+                tx.store(&acc.tx[i]); ty.store(&acc.ty[i]); tz.store(&acc.tz[i]);
+                (cx * w).store(&acc.bx[i]); (cy * w).store(&acc.by[i]); (cz * w).store(&acc.bz[i]);
+            }
+
+            // Scalar tail
+            for(; i < end; i++) {
+                glm::vec3 n(in.nx[i], in.ny[i], in.nz[i]);
+                glm::vec3 t(acc.tx[i], acc.ty[i], acc.tz[i]);
+                glm::vec3 b(acc.bx[i], acc.by[i], acc.bz[i]);
+                t = t - n * glm::dot(n, t);
+                if(glm::dot(t, t) < 1e-20f) t = std::fabs(n.x) < 0.9f ? glm::vec3(0.0f, n.z, -n.y) : glm::vec3(-n.z, 0.0f, n.x);
+                t = glm::normalize(t);
+                glm::vec3 c = glm::cross(n, t);
+                if(glm::dot(c, b) < 0.0f) c = -c;
+                acc.tx[i] = t.x; acc.ty[i] = t.y; acc.tz[i] = t.z;
+                acc.bx[i] = c.x; acc.by[i] = c.y; acc.bz[i] = c.z;
+            }
+        }
+
+        // Shared core of both computeTangents() variants; results are left in 'out'
+        void generateTangents(const TangentInput &in, const unsigned int* indices, size_t tri_count, TangentAccum &out) {
+
+            size_t vert_count = in.px.size();
+            size_t threads = 1;
+            if(tri_count >= TANGENT_THREAD_THRESHOLD) threads = Util::jobWorkers() + 1;
+
+            // Pass 1: per-thread accumulation, so no two threads ever scatter into the same sums
+            std::vector<TangentAccum> partial(threads);
+            parallelRanges(tri_count, threads, [&](size_t begin, size_t end, size_t t) {
+                partial[t].resize(vert_count);
+                accumulateTriangles(in, indices, begin, end, partial[t]);
+            });
+
+            // Reduce the partial sums over disjoint vertex ranges
+            out = std::move(partial[0]);
+            if(threads > 1) {
+                parallelRanges(vert_count, threads, [&](size_t begin, size_t end, size_t) {
+                    for(size_t t = 1; t < partial.size(); t++) {
+                        if(partial[t].tx.empty()) continue;
+                        std::vector<float>* dst[6]{ &out.tx, &out.ty, &out.tz, &out.bx, &out.by, &out.bz };
+                        const std::vector<float>* src[6]{ &partial[t].tx, &partial[t].ty, &partial[t].tz,
+                                                          &partial[t].bx, &partial[t].by, &partial[t].bz };
+                        for(int s = 0; s < 6; s++) {
+                            size_t i = begin;
+                            for(; i + vfloat::width <= end; i += vfloat::width)
+                                (vfloat::load(&(*dst[s])[i]) + vfloat::load(&(*src[s])[i])).store(&(*dst[s])[i]);
+                            for(; i < end; i++) (*dst[s])[i] += (*src[s])[i];
+                        }
+                    }
+                });
+            }
+
+            // Pass 2: orthonormalize
+            parallelRanges(vert_count, threads, [&](size_t begin, size_t end, size_t) {
+                orthonormalizeRange(in, out, begin, end);
+            });
+        }
+
+        bool compatibleTangentTypes(const Type::DataType &vertex_type, const Type::DataType &uv_type, const Type::DataType &normal_type,
+                                    const Type::DataType &tangent_type, const Type::DataType &bitangent_type) {
+            if( vertex_type.type() < 3) return false;
+            if( uv_type.type() < 2) return false;
+            if( normal_type.type() < 3) return false;
+            if( tangent_type.type() != 3) return false;
+            if( bitangent_type.type() != 3) return false;
+            return true;
+        }
+
+        // Bitwise key of the attributes a tangent depends on; used to weld identical corners of unindexed data
+        struct TangentWeldKey {
+            float val[8];
+            bool operator==(const TangentWeldKey &rhs) const { return std::memcmp(val, rhs.val, sizeof(val)) == 0; }
+        };
+
+        struct TangentWeldHash {
+            size_t operator()(const TangentWeldKey &key) const {
+                size_t hash = 14695981039346656037ULL;
+                const unsigned char* bytes = (const unsigned char*)key.val;
+                for(size_t i = 0; i < sizeof(key.val); i++) hash = (hash ^ bytes[i]) * 1099511628211ULL;
+                return hash;
+            }
+        };
+
+        bool computeTangents(RawModelData &raw_model_data,
+                             const Type::DataType &vertex_type, const Type::DataType &uv_type, const Type::DataType &normal_type,
+                             const Type::DataType &tangent_type, const Type::DataType &bitangent_type) {
+
+            // Are the DataTypes compatible?
+            if(!compatibleTangentTypes(vertex_type, uv_type, normal_type, tangent_type, bitangent_type)) return false;
+
+            // Does this RawModelData have everything we need?
+            if( !(raw_model_data.exists(vertex_type) && raw_model_data.exists(uv_type) && raw_model_data.exists(normal_type)) ) return false;
+
+            size_t size = raw_model_data.size();
+
+            VecArray &vertex_data = raw_model_data[vertex_type];
+            VecArray &uv_data     = raw_model_data[uv_type];
+            VecArray &normal_data = raw_model_data[normal_type];
+
+            // Unindexed data has every corner of every triangle stored separately; weld corners that share all
+            // of their attributes so tangents are averaged across the faces that will share a vertex once indexed
+            std::unordered_map<TangentWeldKey, unsigned int, TangentWeldHash> weld_map;
+            std::vector<unsigned int> corner_index(size);
+            TangentInput input;
+            input.resize(size);
+            unsigned int unique_count = 0;
+            for(size_t i = 0; i < size; i++) {
+                const VecVar &p = vertex_data.at(i), &uv = uv_data.at(i), &n = normal_data.at(i);
+                TangentWeldKey key{{ p.val.v3.x, p.val.v3.y, p.val.v3.z, uv.val.v2.x, uv.val.v2.y, n.val.v3.x, n.val.v3.y, n.val.v3.z }};
+                auto inserted = weld_map.insert(std::make_pair(key, unique_count));
+                if(inserted.second) input.set(unique_count++, p, uv, n);
+                corner_index[i] = inserted.first->second;
+            }
+            input.resize(unique_count);
+
+            // Trailing corners that don't make up a whole triangle still get a tangent, just no face contribution
+            TangentAccum result;
+            generateTangents(input, corner_index.data(), size / 3, result);
+
+            // Expand back out to one value per corner
+            VecArray tangent_data  (THREE, size);
+            VecArray bitangent_data(THREE, size);
+            for(size_t i = 0; i < size; i++) {
+                unsigned int c = corner_index[i];
+                tangent_data[i]   = VecVar(result.tx[c], result.ty[c], result.tz[c]);
+                bitangent_data[i] = VecVar(result.bx[c], result.by[c], result.bz[c]);
+            }
+
+            // Store the resulting tangents in the RawModelData
+            raw_model_data.put(tangent_type,   tangent_data);
+            raw_model_data.put(bitangent_type, bitangent_data);
+
+            return true;
+        }
+
+        bool computeTangents(RawModelDataIndexed &raw_model_data,
+                             const Type::DataType &vertex_type, const Type::DataType &uv_type, const Type::DataType &normal_type,
+                             const Type::DataType &tangent_type, const Type::DataType &bitangent_type) {
+
+            // Are the DataTypes compatible?
+            if(!compatibleTangentTypes(vertex_type, uv_type, normal_type, tangent_type, bitangent_type)) return false;
+
+            // Does this RawModelDataIndexed have everything we need?
+            if( !(raw_model_data.exists(vertex_type) && raw_model_data.exists(uv_type) && raw_model_data.exists(normal_type)) ) return false;
+            if(raw_model_data.indices() == nullptr) return false;
+
+            size_t size = raw_model_data.size();
+            const unsigned int* indices = raw_model_data.indices();
+            for(size_t i = 0; i < raw_model_data.indexSize(); i++) if(indices[i] >= size) return false;
+
+            VecArray &vertex_data = raw_model_data[vertex_type];
+            VecArray &uv_data     = raw_model_data[uv_type];
+            VecArray &normal_data = raw_model_data[normal_type];
+
+            TangentInput input;
+            input.resize(size);
+            for(size_t i = 0; i < size; i++) input.set(i, vertex_data.at(i), uv_data.at(i), normal_data.at(i));
+
+            TangentAccum result;
+            generateTangents(input, indices, raw_model_data.indexSize() / 3, result);
+
+            VecArray tangent_data  (THREE, size);
+            VecArray bitangent_data(THREE, size);
+            for(size_t i = 0; i < size; i++) {
+                tangent_data[i]   = VecVar(result.tx[i], result.ty[i], result.tz[i]);
+                bitangent_data[i] = VecVar(result.bx[i], result.by[i], result.bz[i]);
+            }
+
+            // Store the resulting tangents in the RawModelDataIndexed; indices are untouched
+            raw_model_data.put(tangent_type,   tangent_data);
+            raw_model_data.put(bitangent_type, bitangent_data);
+
+            return true;
+        }
+
+    }
+}
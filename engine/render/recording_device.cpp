@@ -0,0 +1,449 @@
+#include "RenderInternal.h"
+
+#include "api/Logging.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+using namespace Swarm::Logging;
+
+namespace Swarm {
+    namespace Render {
+
+        std::set<RecordingDeviceInternal*> registered_recording_devices;
+
+        void RecordingDeviceInternal::cleanup() {
+            for(RecordingDeviceInternal* device : registered_recording_devices) {
+                if(&Render::device() == device) setDevice(nullptr);
+                delete device;
+            }
+            registered_recording_devices.clear();
+        }
+
+        RecordingDevice* RecordingDevice::create() {
+            RecordingDeviceInternal* device = new RecordingDeviceInternal();
+            registered_recording_devices.insert(device);
+            return device;
+        }
+
+        // FNV-1a; only needs to tell command payloads apart
+        unsigned long long hashBytes(const void* data, size_t bytes) {
+            unsigned long long hash = 14695981039346656037ULL;
+            const unsigned char* p = (const unsigned char*)data;
+            for(size_t i = 0; i < bytes; i++) {
+                hash ^= p[i];
+                hash *= 1099511628211ULL;
+            }
+            return hash;
+        }
+
+        void RecordingDeviceInternal::record(DeviceCommandType type, SWMuint target, SWMuint object, size_t count,
+                                             size_t bytes, const void* data) {
+            _stats.commands++;
+            if(!_record_commands) return;
+            _commands.push_back(DeviceCommand{ type, target, object, count, bytes, data ? hashBytes(data, bytes) : 0,
+                                               type == CMD_DRAW_ELEMENTS ? (size_t)1 : 0 });
+        }
+
+        DeviceStats RecordingDeviceInternal::stats() const {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            return _stats;
+        }
+
+        std::vector<DeviceCommand> RecordingDeviceInternal::commands() const {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            return _commands;
+        }
+
+        void RecordingDeviceInternal::setRecordCommands(bool record) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _record_commands = record;
+        }
+
+        bool RecordingDeviceInternal::recordCommands() const {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            return _record_commands;
+        }
+
+        void RecordingDeviceInternal::reset() {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _commands.clear();
+            _stats = DeviceStats();
+        }
+
+
+
+        // *********************
+        //  Shaders and Programs
+        // *********************
+
+        bool isIdentifier(char c) {
+            return std::isalnum((unsigned char)c) || c == '_';
+        }
+
+        // Last identifier in 'text', ignoring any array size
+        std::string lastIdentifier(const std::string &text, size_t &begin) {
+            size_t end = text.find('[');
+            if(end == std::string::npos) end = text.size();
+            while(end > 0 && !isIdentifier(text[end-1])) end--;
+            begin = end;
+            while(begin > 0 && isIdentifier(text[begin-1])) begin--;
+            return text.substr(begin, end - begin);
+        }
+
+        // Alignment and size of a GLSL type under std140; false for types it does not know
+        bool std140Type(const std::string &type, size_t &align, size_t &size) {
+            if(type == "float" || type == "int" || type == "uint" || type == "bool") {
+                align = size = 4;
+                return true;
+            }
+            size_t vec = type.find("vec");
+            if(vec != std::string::npos && vec <= 1 && type.size() == vec + 4) {
+                size_t components = (size_t)(type[vec+3] - '0');
+                align = components == 2 ? 8 : 16;
+                size = components * 4;
+                return components >= 2 && components <= 4;
+            }
+            if(type.compare(0, 3, "mat") == 0 && type.size() >= 4) {
+
+                // Each column is a vector padded out to 16 bytes
+                size_t columns = (size_t)(type[3] - '0');
+                align = 16;
+                size = columns * 16;
+                return columns >= 2 && columns <= 4;
+            }
+            return false;
+        }
+
+        // Uniforms a GLSL source declares, as in "uniform mat4 _m;" or "uniform vec4 _a, _b[2];", and uniform
+        // blocks, as in "uniform Frame { mat4 _v; };", laid out with std140
+        void declaredUniforms(const std::string &src, std::vector<std::string> &names, std::vector<UniformBlock> &blocks) {
+            size_t next = 0;
+            for(size_t pos = src.find("uniform"); pos != std::string::npos; pos = src.find("uniform", next)) {
+                next = pos + 7;
+                if((pos > 0 && isIdentifier(src[pos-1])) || (pos + 7 < src.size() && isIdentifier(src[pos+7]))) continue;
+                size_t end = src.find(';', pos);
+                if(end == std::string::npos) break;
+                size_t open = src.find('{', pos);
+
+                // Block
+                if(open < end) {
+                    size_t close = src.find('}', open);
+                    if(close == std::string::npos) break;
+                    UniformBlock block;
+                    size_t begin;
+                    block.name = lastIdentifier(src.substr(pos + 7, open - pos - 7), begin);
+                    block.index = (SWMuint)blocks.size();
+                    size_t offset = 0;
+                    std::string body = src.substr(open + 1, close - open - 1);
+                    for(size_t start = 0, stop; (stop = body.find(';', start)) != std::string::npos; start = stop + 1) {
+                        std::string member = body.substr(start, stop - start);
+                        std::string name = lastIdentifier(member, begin);
+                        std::string type = lastIdentifier(member.substr(0, begin), begin);
+                        size_t align, size;
+                        if(name.empty() || !std140Type(type, align, size)) continue;
+
+                        // Arrays round every element up to 16 bytes
+                        size_t bracket = member.find('[');
+                        if(bracket != std::string::npos) {
+                            size_t count = (size_t)std::max(std::atoi(member.c_str() + bracket + 1), 1);
+                            align = 16;
+                            size = (size + 15) / 16 * 16 * count;
+                        }
+                        offset = (offset + align - 1) / align * align;
+                        block.offsets[name] = offset;
+                        offset += size;
+                    }
+                    block.size = (offset + 15) / 16 * 16;
+                    blocks.push_back(block);
+                    next = close;
+                    continue;
+                }
+
+                // The first declarator follows the type; every later one follows a comma
+                std::string declaration = src.substr(pos + 7, end - pos - 7);
+                bool first = true;
+                for(size_t start = 0; start <= declaration.size();) {
+                    size_t comma = declaration.find(',', start);
+                    std::string declarator = declaration.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+                    size_t begin;
+                    std::string name = lastIdentifier(declarator, begin);
+                    if(!name.empty()) {
+                        if(!first || declarator.find_first_not_of(" \t\r\n") < begin) names.push_back(name);
+                        first = false;
+                    }
+                    if(comma == std::string::npos) break;
+                    start = comma + 1;
+                }
+            }
+        }
+
+        bool RecordingDeviceInternal::compileShader(SWMuint &id, SWMenum /*type*/, const std::string &src, std::string &log) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            id = _next_name++;
+            declaredUniforms(src, _shader_uniforms[id], _shader_blocks[id]);
+            log.clear();
+            return true;
+        }
+
+        void RecordingDeviceInternal::deleteShader(SWMuint shader) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _shader_uniforms.erase(shader);
+            _shader_blocks.erase(shader);
+        }
+
+        bool RecordingDeviceInternal::linkProgram(SWMuint &id, const std::vector<SWMuint> &shaders, std::string &log) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            id = _next_name++;
+
+            // Every uniform a shader declares is active, numbered in the order they are declared
+            std::unordered_map<std::string, SWMint> &locations = _uniform_locations[id];
+            for(SWMuint shader : shaders) {
+                for(const std::string &name : _shader_uniforms[shader])
+                    if(locations.count(name) < 1) locations[name] = (SWMint)locations.size();
+            }
+            std::vector<UniformBlock> &blocks = _uniform_blocks[id];
+            for(SWMuint shader : shaders) {
+                for(const UniformBlock &block : _shader_blocks[shader]) {
+                    bool linked = false;
+                    for(const UniformBlock &other : blocks) linked |= other.name == block.name;
+                    if(linked) continue;
+                    blocks.push_back(block);
+                    blocks.back().index = (SWMuint)(blocks.size() - 1);
+                }
+            }
+            log.clear();
+            return true;
+        }
+
+        void RecordingDeviceInternal::deleteProgram(SWMuint program) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _uniform_locations.erase(program);
+            _uniform_blocks.erase(program);
+            if(_program == program) _program = 0;
+        }
+
+        void RecordingDeviceInternal::useProgram(SWMuint program) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _stats.program_binds++;
+            if(_program == program) _stats.redundant_binds++;
+            _program = program;
+            record(CMD_USE_PROGRAM, 0, program, 0, 0);
+        }
+
+        SWMint RecordingDeviceInternal::uniformLocation(SWMuint program, const std::string &name) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            auto program_iter = _uniform_locations.find(program);
+            if(program_iter == _uniform_locations.end()) return -1;
+            auto iter = program_iter->second.find(name);
+            return iter != program_iter->second.end() ? iter->second : -1;
+        }
+
+        void RecordingDeviceInternal::activeUniforms(SWMuint program, std::vector<std::pair<std::string, SWMint>> &uniforms) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            auto program_iter = _uniform_locations.find(program);
+            if(program_iter == _uniform_locations.end()) return;
+            size_t first = uniforms.size();
+            for(auto && iter : program_iter->second) uniforms.push_back(std::make_pair(iter.first, iter.second));
+            std::sort(uniforms.begin() + first, uniforms.end(),
+                      [](const std::pair<std::string, SWMint> &lhs, const std::pair<std::string, SWMint> &rhs) { return lhs.second < rhs.second; });
+        }
+
+        void RecordingDeviceInternal::activeUniformBlocks(SWMuint program, std::vector<UniformBlock> &blocks) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            auto iter = _uniform_blocks.find(program);
+            if(iter != _uniform_blocks.end()) blocks.insert(blocks.end(), iter->second.begin(), iter->second.end());
+        }
+
+        void RecordingDeviceInternal::uniformBlockBinding(SWMuint program, SWMuint block, SWMuint binding) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            auto iter = _uniform_blocks.find(program);
+            if(iter != _uniform_blocks.end() && block < iter->second.size()) iter->second[block].binding = binding;
+        }
+
+
+
+        // **********
+        //  Uniforms
+        // **********
+
+        void RecordingDeviceInternal::uniform(SWMint location, SWMsizei count, size_t bytes, const void* data) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _stats.uniform_uploads++;
+            _stats.uniform_bytes += bytes;
+            record(CMD_UNIFORM, (SWMuint)location, _program, (size_t)count, bytes, data);
+        }
+
+        void RecordingDeviceInternal::uniformf(SWMint location, SWMsizei components, SWMsizei count, const SWMfloat* data) {
+            uniform(location, count, components * count * sizeof(SWMfloat), data);
+        }
+
+        void RecordingDeviceInternal::uniformi(SWMint location, SWMsizei components, SWMsizei count, const SWMint* data) {
+            uniform(location, count, components * count * sizeof(SWMint), data);
+        }
+
+        void RecordingDeviceInternal::uniformui(SWMint location, SWMsizei components, SWMsizei count, const SWMuint* data) {
+            uniform(location, count, components * count * sizeof(SWMuint), data);
+        }
+
+        void RecordingDeviceInternal::uniformMatrix(SWMint location, SWMsizei columns, SWMsizei rows, SWMsizei count, const SWMfloat* data) {
+            uniform(location, count, columns * rows * count * sizeof(SWMfloat), data);
+        }
+
+
+
+        // ***************************
+        //  Buffers and Vertex Arrays
+        // ***************************
+
+        SWMuint RecordingDeviceInternal::createBuffer() {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            return _next_name++;
+        }
+
+        void RecordingDeviceInternal::deleteBuffer(SWMuint buffer) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            for(auto && iter : _buffers) if(iter.second == buffer) iter.second = 0;
+        }
+
+        void RecordingDeviceInternal::bindBuffer(SWMenum target, SWMuint buffer) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _stats.buffer_binds++;
+            if(_buffers[target] == buffer) _stats.redundant_binds++;
+            _buffers[target] = buffer;
+            record(CMD_BIND_BUFFER, target, buffer, 0, 0);
+        }
+
+        void RecordingDeviceInternal::bindBufferRange(SWMenum /*target*/, SWMuint index, SWMuint buffer, size_t offset, size_t bytes) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _stats.buffer_binds++;
+            record(CMD_BIND_BUFFER_RANGE, index, buffer, offset, bytes);
+        }
+
+        void RecordingDeviceInternal::bufferData(SWMenum target, size_t bytes, const void* data) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _stats.buffer_uploads++;
+            _stats.buffer_bytes += bytes;
+            record(CMD_BUFFER_DATA, target, _buffers[target], 0, bytes, data);
+        }
+
+        void RecordingDeviceInternal::bufferStream(SWMenum target, size_t bytes, const void* data) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _stats.buffer_uploads++;
+            _stats.buffer_bytes += bytes;
+            record(CMD_BUFFER_STREAM, target, _buffers[target], 0, bytes, data);
+        }
+
+        SWMuint RecordingDeviceInternal::createVertexArray() {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            return _next_name++;
+        }
+
+        void RecordingDeviceInternal::deleteVertexArray(SWMuint vao) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            if(_vertex_array == vao) _vertex_array = 0;
+        }
+
+        void RecordingDeviceInternal::bindVertexArray(SWMuint vao) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _stats.vertex_array_binds++;
+            if(_vertex_array == vao) _stats.redundant_binds++;
+            else _buffers.erase(GL_ELEMENT_ARRAY_BUFFER); // The element buffer binding belongs to the vertex array
+            _vertex_array = vao;
+            record(CMD_BIND_VERTEX_ARRAY, 0, vao, 0, 0);
+        }
+
+        void RecordingDeviceInternal::vertexAttribute(SWMuint attrib, SWMint components, SWMenum /*type*/, bool /*normalized*/,
+                                                      SWMsizei /*stride*/, size_t offset, SWMuint /*divisor*/) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            record(CMD_VERTEX_ATTRIBUTE, attrib, _buffers[GL_ARRAY_BUFFER], (size_t)components, offset);
+        }
+
+
+
+        // **********
+        //  Textures
+        // **********
+
+        SWMuint RecordingDeviceInternal::createTexture() {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            return _next_name++;
+        }
+
+        void RecordingDeviceInternal::deleteTexture(SWMuint texture) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            for(auto && iter : _textures) if(iter.second == texture) iter.second = 0;
+        }
+
+        void RecordingDeviceInternal::bindTexture(SWMuint active, SWMenum /*target*/, SWMuint texture) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _stats.texture_binds++;
+            if(_textures.count(active) > 0 && _textures[active] == texture) _stats.redundant_binds++;
+            _textures[active] = texture;
+            record(CMD_BIND_TEXTURE, active, texture, 0, 0);
+        }
+
+        void RecordingDeviceInternal::textureImage2D(SWMuint texture, unsigned int width, unsigned int height, const void* pixels) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            size_t bytes = (size_t)width * height * 4;
+            _stats.texture_uploads++;
+            _stats.texture_bytes += bytes;
+            record(CMD_TEXTURE_IMAGE, 0, texture, 0, bytes, pixels);
+        }
+
+
+
+        // *********
+        //  Drawing
+        // *********
+
+        void RecordingDeviceInternal::viewport(SWMint /*x*/, SWMint /*y*/, SWMsizei width, SWMsizei height) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            record(CMD_VIEWPORT, 0, 0, (size_t)width * height, 0);
+        }
+
+        void RecordingDeviceInternal::clear(float /*r*/, float /*g*/, float /*b*/, float /*a*/) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            record(CMD_CLEAR, 0, 0, 0, 0);
+        }
+
+        void RecordingDeviceInternal::enable(SWMenum capability, bool enabled) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _stats.capability_changes++;
+            record(CMD_ENABLE, capability, 0, enabled ? 1 : 0, 0);
+        }
+
+        void RecordingDeviceInternal::drawElements(SWMenum /*mode*/, SWMsizei count, SWMenum type, size_t offset) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _stats.draw_calls++;
+            _stats.instances++;
+            _stats.indices += count;
+            record(CMD_DRAW_ELEMENTS, type, _vertex_array, (size_t)count, offset);
+        }
+
+        void RecordingDeviceInternal::drawElementsInstanced(SWMenum /*mode*/, SWMsizei count, SWMenum type, size_t offset, SWMsizei instances) {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            _stats.draw_calls++;
+            _stats.instances += instances;
+            _stats.indices += (size_t)count * instances;
+            record(CMD_DRAW_INSTANCED, type, _vertex_array, (size_t)count, offset);
+            if(_record_commands) _commands.back().instances = (size_t)instances;
+        }
+
+        // Commands complete as they are recorded, so every fence is signaled at once
+        SWMuint RecordingDeviceInternal::fenceSync() {
+            boost::lock_guard<boost::mutex> lock(_mutex);
+            SWMuint fence = _next_name++;
+            record(CMD_FENCE_SYNC, 0, fence, 0, 0);
+            return fence;
+        }
+
+        bool RecordingDeviceInternal::fenceSignaled(SWMuint /*fence*/) {
+            return true;
+        }
+
+        void RecordingDeviceInternal::deleteFence(SWMuint /*fence*/) { /* NOOP */ }
+
+    }
+}
@@ -0,0 +1,168 @@
+#include "RenderInternal.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace Swarm {
+    namespace Render {
+
+        // ***************
+        //  Build Threads
+        // ***************
+
+        std::atomic<unsigned int> _static_build_threads(0);
+
+        void setBuildThreads(unsigned int threads) {
+            _static_build_threads = threads;
+        }
+
+        unsigned int buildThreads() {
+            return _static_build_threads;
+        }
+
+        unsigned int buildThreadCount() {
+            unsigned int threads = _static_build_threads;
+            if(threads == 0) threads = Util::jobWorkers() + 1;
+            return threads;
+        }
+
+        void runBuildTasks(size_t count, const std::function<void(size_t)> &task) {
+            Util::parallelFor(count, 1, [&](size_t begin, size_t end) {
+                for(size_t i = begin; i < end; i++) task(i);
+            }, buildThreadCount());
+        }
+
+        // *************
+        //  Build Phase
+        // *************
+
+        // Items per build task; big enough that each task outweighs handing it out
+        const size_t BUILD_CHUNK = 1024;
+
+        size_t buildChunks(size_t count) {
+            return (count + BUILD_CHUNK - 1) / BUILD_CHUNK;
+        }
+
+        // Positive floats order the same as their bits; the top 16 bits keep the exponent and 7 bits of mantissa
+        uint64_t depthBits(float depth) {
+            if(!(depth > 0.0f)) return 0;
+            uint32_t bits;
+            std::memcpy(&bits, &depth, sizeof(bits));
+            return bits >> 16;
+        }
+
+        void RenderObjectCollection::sort(const Renderer &renderer) {
+
+            // Drop erased items, keeping the sorted part in front
+            if(_erased > 0) {
+                size_t count = 0, sorted_count = 0;
+                for(size_t i = 0; i < _items.size(); i++) {
+                    const RenderItem &item = _items[i];
+                    if(item.object == nullptr) continue;
+                    if(i < _sorted) sorted_count = count + 1;
+                    if(i != count) _slots[item.slot].item = (uint32_t)count;
+                    _items[count++] = item;
+                }
+                _items.resize(count);
+                _sorted = sorted_count;
+                _erased = 0;
+            }
+            size_t count = _items.size(), sorted_count = _sorted;
+
+            // Depth changes with the camera, so it is refreshed every frame; each chunk checks its own part of the
+            // sorted order, and the boundaries between chunks are checked after
+            size_t chunks = buildChunks(count);
+            std::vector<uint8_t> chunk_sorted(chunks, 1);
+            runBuildTasks(chunks, [this, &renderer, &chunk_sorted, count, sorted_count](size_t chunk) {
+                size_t begin = chunk * BUILD_CHUNK, end = std::min(count, begin + BUILD_CHUNK);
+                for(size_t i = begin; i < end; i++) {
+                    RenderItem &item = _items[i];
+                    item.key = (item.key & ~(uint64_t)0xFFFF) | depthBits(item.object->depth(renderer));
+                    if(i > begin && i < sorted_count && item.key < _items[i-1].key) chunk_sorted[chunk] = 0;
+                }
+            });
+            bool sorted = std::find(chunk_sorted.begin(), chunk_sorted.end(), 0) == chunk_sorted.end();
+            for(size_t i = BUILD_CHUNK; sorted && i < sorted_count; i += BUILD_CHUNK)
+                if(_items[i].key < _items[i-1].key) sorted = false;
+
+            _sorted = count;
+            if(sorted && sorted_count == count) return;
+
+            // A few new items on an order that still holds are sorted on their own, then merged in
+            if(sorted && (count - sorted_count) * 8 < count) {
+                auto by_key = [](const RenderItem &lhs, const RenderItem &rhs) { return lhs.key < rhs.key; };
+                std::sort(_items.begin() + sorted_count, _items.end(), by_key);
+                _items_sorting.resize(count);
+                std::merge(_items.begin(), _items.begin() + sorted_count, _items.begin() + sorted_count, _items.end(),
+                           _items_sorting.begin(), by_key);
+                _items.swap(_items_sorting);
+                for(uint32_t i = 0; i < (uint32_t)count; i++) _slots[_items[i].slot].item = i;
+                return;
+            }
+
+            // Stable LSD radix sort, 8 bits per pass; passes where every key has the same digit are skipped, so
+            // collections with few textures and models, or no depth, take only a pass or two
+            size_t histogram[8][256] = {};
+            for(const RenderItem &item : _items)
+                for(int pass = 0; pass < 8; pass++) histogram[pass][(item.key >> (pass * 8)) & 0xFF]++;
+
+            _items_sorting.resize(count);
+            RenderItem* source = _items.data();
+            RenderItem* target = _items_sorting.data();
+            for(int pass = 0; pass < 8; pass++) {
+                int shift = pass * 8;
+                size_t* offsets = histogram[pass];
+                if(offsets[(source[0].key >> shift) & 0xFF] == count) continue;
+
+                size_t offset = 0;
+                for(size_t &digit : histogram[pass]) {
+                    size_t digit_count = digit;
+                    digit = offset;
+                    offset += digit_count;
+                }
+                for(size_t i = 0; i < count; i++) target[offsets[(source[i].key >> shift) & 0xFF]++] = source[i];
+                std::swap(source, target);
+            }
+            if(source != _items.data()) _items.swap(_items_sorting);
+
+            for(uint32_t i = 0; i < (uint32_t)count; i++) _slots[_items[i].slot].item = i;
+        }
+
+        void RenderObjectCollection::build(const Renderer &renderer) {
+            auto start = std::chrono::high_resolution_clock::now();
+            _stats = RenderStats();
+            _stats.threads = buildThreadCount();
+
+            sort(renderer);
+            _culling = cull(renderer);
+
+            // Commands only read the RenderObjects and the Renderer, and each task fills its own buffer, so tasks
+            // need no locking; submit() reads the buffers back in order
+            size_t count = _items.size(), chunks = buildChunks(count);
+            _commands.resize(chunks);
+            runBuildTasks(chunks, [this, &renderer, count](size_t chunk) {
+                CommandBuffer &buffer = _commands[chunk];
+                buffer.commands.clear();
+                buffer.matrices.clear();
+                size_t begin = chunk * BUILD_CHUNK, end = std::min(count, begin + BUILD_CHUNK);
+                for(size_t i = begin; i < end; i++) {
+                    const RenderItem &item = _items[i];
+                    if(!visible(item)) continue;
+                    SWMfloat matrix[16];
+                    size_t lod = 0;
+                    DrawCommand command = { item.key, nullptr, nullptr, 0, (uint32_t)buffer.matrices.size() };
+                    if(item.object->instance(renderer, matrix, lod)) {
+                        command.model = &item.object->model();
+                        command.lod = (uint32_t)lod;
+                        buffer.matrices.insert(buffer.matrices.end(), matrix, matrix + 16);
+                    } else command.object = item.object;
+                    buffer.commands.push_back(command);
+                }
+            });
+
+            _stats.build_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        }
+
+    }
+}
@@ -5,6 +5,9 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/transform.hpp>
 
+#include <algorithm>
+#include <chrono>
+
 using namespace Swarm::Logging;
 
 namespace Swarm {
@@ -39,70 +42,218 @@ namespace Swarm {
             _matrix = glm::translate(position);
             if(rotate.x != 0.0f || rotate.y != 0.0f || rotate.z != 0.0f) _matrix = _matrix * glm::rotate(1.0f, rotate);
             _matrix = _matrix * glm::scale(scale);
+            _scale = std::max(std::fabs(scale.x), std::max(std::fabs(scale.y), std::fabs(scale.z)));
         }
 
         void RenderObjectStatic::render(const Renderer &renderer) const {
             if(renderer.program() == nullptr) return;
 
             // Bind the Model Matrix
-            glUniformMatrix4fv(renderer.program()->uniform(renderer.uniformName(Renderer::MODEL)), 1, GL_FALSE, &_matrix[0][0]);
+            Device &dev = device();
+            dev.uniformMatrix(renderer.uniformLocation(Renderer::MODEL), 4, 4, 1, &_matrix[0][0]);
 
             // Each Object has its own VAO
             SWMuint vao = _model.vao();
-            glBindVertexArray(vao);
+            dev.bindVertexArray(vao);
+
+            size_t lod = selectLOD(renderer);
+            size_t index_size = _model.elementType() == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
 
             // Draw the triangles
-            glDrawElements(
-                    GL_TRIANGLES,                   // mode
-                    (GLuint)_model.elementCount(), // count
-                    GL_UNSIGNED_INT,                // type
-                    (void*)0                        // element array buffer offset
+            dev.drawElements(
+                    GL_TRIANGLES,                                               // mode
+                    (SWMsizei)_model.elementCount(lod),                         // count
+                    _model.elementType(),                                       // type
+                    _model.elementOffset(lod) * index_size                      // element array buffer offset
             );
 
-            glBindVertexArray(0);
+            // The VAO is left bound; when the next object shares the Model, the state cache drops its bind
         }
 
+        bool RenderObjectStatic::instance(const Renderer &renderer, SWMfloat* matrix, size_t &lod) const {
+            const SWMfloat* source = &_matrix[0][0];
+            std::copy(source, source + 16, matrix);
+            lod = selectLOD(renderer);
+            return true;
+        }
 
+        float RenderObjectStatic::depth(const Renderer &renderer) const {
+            return renderer.viewDepth(glm::vec3(_matrix * glm::vec4(_model.boundsCenter(), 1.0f)));
+        }
 
-        Util::UIDPool roc_uids;
+        bool RenderObjectStatic::bounds(SWMfloat* min, SWMfloat* max) const {
 
-        RenderObjectCollection::RenderObjectCollection() {
-            _uid = roc_uids.next();
+            // Transformed box; each axis of the result spans the extremes of every transformed model axis
+            glm::vec3 lo(_model.boundsMin()), hi(_model.boundsMax());
+            glm::vec3 world_min(_matrix[3]), world_max(_matrix[3]);
+            for(int column = 0; column < 3; column++) {
+                glm::vec3 a(_matrix[column] * lo[column]), b(_matrix[column] * hi[column]);
+                world_min += glm::min(a, b);
+                world_max += glm::max(a, b);
+            }
+            for(int i = 0; i < 3; i++) {
+                min[i] = world_min[i];
+                max[i] = world_max[i];
+            }
+            return true;
         }
 
+        size_t RenderObjectStatic::selectLOD(const Renderer &renderer) const {
+
+            // Pick a Level of Detail from the on-screen size
+            if(_model.lodCount() < 2) return 0;
+            glm::vec3 center(_matrix * glm::vec4(_model.boundsCenter(), 1.0f));
+            return _model.selectLOD(renderer.projectedRadius(center, _model.boundsRadius() * _scale), renderer.lodThreshold());
+        }
+
+
+
+        // Instance buffers of live collections; freed on cleanup, in case a collection outlives the context. A destroyed
+        // collection's buffer waits in the released list until the render thread, which has a context, deletes it.
+        boost::mutex _static_roc_instance_mutex;
+        std::set<SWMuint> _static_roc_instance_buffers;
+        std::vector<SWMuint> _static_roc_released_buffers;
+
+        void releaseInstanceBuffers(Device &dev) {
+            std::vector<SWMuint> released;
+            {
+                boost::lock_guard<boost::mutex> lock(_static_roc_instance_mutex);
+                if(_static_roc_released_buffers.empty()) return;
+                released.swap(_static_roc_released_buffers);
+            }
+            for(SWMuint buffer : released) dev.deleteBuffer(buffer);
+        }
+
+        void cleanupInstanceBuffers() {
+            boost::lock_guard<boost::mutex> lock(_static_roc_instance_mutex);
+            for(SWMuint buffer : _static_roc_instance_buffers) device().deleteBuffer(buffer);
+            for(SWMuint buffer : _static_roc_released_buffers) device().deleteBuffer(buffer);
+            _static_roc_instance_buffers.clear();
+            _static_roc_released_buffers.clear();
+        }
+
+        struct RenderObjectCollection::Lock {
+            boost::mutex mutex;
+        };
+
+        RenderObjectCollection::RenderObjectCollection() : _lock(new Lock()) { /* NOOP */ }
+
         RenderObjectCollection::~RenderObjectCollection() {
-            roc_uids.free(_uid);
+            delete _lock;
+            {
+                boost::lock_guard<boost::mutex> lock(_static_roc_instance_mutex);
+                if(_static_roc_instance_buffers.erase(_instance_buffer) > 0) _static_roc_released_buffers.push_back(_instance_buffer);
+            }
+            delete _cull_tree;
         }
 
-        std::unordered_map<size_t, boost::mutex> _static_roc_mutex_map;
+        // Handles pack the slot in the low 32 bits and its generation in the high 32 bits
+        RenderObjectCollection::Handle makeHandle(uint32_t slot, uint32_t generation) {
+            return ((RenderObjectCollection::Handle)generation << 32) | slot;
+        }
 
-        void RenderObjectCollection::insert(RenderObject* object) {
-            if(object == nullptr) return;
-            _queue_insert.insert(object);
-            _queue_erase.erase(object);
+        RenderObjectCollection::Handle RenderObjectCollection::insert(RenderObject* object) {
+            if(object == nullptr) return 0;
+            boost::lock_guard<boost::mutex> lock(_lock->mutex);
+
+            // Already inserted, or queued to be; cancels a queued erase
+            auto found = _slot_index.find(object);
+            if(found != _slot_index.end()) {
+                RenderSlot &slot = _slots[found->second];
+                slot.erasing = false;
+                return makeHandle(found->second, slot.generation);
+            }
+
+            uint32_t index;
+            if(_free_slots.empty()) {
+                index = (uint32_t)_slots.size();
+                _slots.push_back(RenderSlot{ nullptr, NO_ITEM, 1, false });
+            } else {
+                index = _free_slots.back();
+                _free_slots.pop_back();
+            }
+            RenderSlot &slot = _slots[index];
+            slot.object = object;
+            slot.item = NO_ITEM;
+            slot.erasing = false;
+            _slot_index[object] = index;
+            _queue_insert.push_back(index);
+            return makeHandle(index, slot.generation);
         }
 
         void RenderObjectCollection::erase(RenderObject* object) {
             if(object == nullptr) return;
-            _queue_insert.erase(object);
-            _queue_erase.insert(object);
+            boost::lock_guard<boost::mutex> lock(_lock->mutex);
+            auto found = _slot_index.find(object);
+            if(found == _slot_index.end()) return;
+            RenderSlot &slot = _slots[found->second];
+            if(slot.erasing) return;
+            slot.erasing = true;
+            _queue_erase.push_back(found->second);
+        }
+
+        void RenderObjectCollection::erase(Handle handle) {
+            uint32_t index = (uint32_t)(handle & 0xFFFFFFFF);
+            boost::lock_guard<boost::mutex> lock(_lock->mutex);
+            if(index >= _slots.size()) return;
+            RenderSlot &slot = _slots[index];
+            if(slot.object == nullptr || slot.generation != (uint32_t)(handle >> 32) || slot.erasing) return;
+            slot.erasing = true;
+            _queue_erase.push_back(index);
+        }
+
+        bool RenderObjectCollection::contains(RenderObject* object) const {
+            boost::lock_guard<boost::mutex> lock(_lock->mutex);
+            auto found = _slot_index.find(object);
+            return found != _slot_index.end() && !_slots[found->second].erasing;
+        }
+
+        uint64_t RenderObjectCollection::staticKey(RenderObject* object) {
+            Texture::Texture &texture = object->texture();
+            auto texture_id = _texture_ids.find(texture);
+            if(texture_id == _texture_ids.end()) {
+                texture_id = _texture_ids.insert(std::make_pair(texture, (uint32_t)_textures.size())).first;
+                _textures.push_back(texture);
+            }
+            auto model_id = _model_ids.find(object->model());
+            if(model_id == _model_ids.end())
+                model_id = _model_ids.insert(std::make_pair(object->model(), (uint32_t)_model_ids.size())).first;
+            return ((uint64_t)texture_id->second << 40) | ((uint64_t)model_id->second << 16);
+        }
+
+        // Leaves the item in place, so the order is kept; the next sort drops it
+        void RenderObjectCollection::eraseSlot(uint32_t index) {
+            RenderSlot &slot = _slots[index];
+            if(slot.item != NO_ITEM) {
+                _items[slot.item].object = nullptr;
+                _erased++;
+            }
+            _slot_index.erase(slot.object);
+            slot.object = nullptr;
+            slot.item = NO_ITEM;
+            slot.generation++;
+            slot.erasing = false;
+            _free_slots.push_back(index);
         }
 
         void RenderObjectCollection::flush() {
 
             // Lock
-            boost::lock_guard<boost::mutex> lock(_static_roc_mutex_map[_uid]);
-
-            // Insert
-            for(RenderObject* object : _queue_insert) {
-                _data[object->texture()].insert(object);
+            boost::lock_guard<boost::mutex> lock(_lock->mutex);
+            if(!_queue_insert.empty() || !_queue_erase.empty()) _cull_dirty = true;
+
+            // Insert; skips anything erased again since
+            for(uint32_t index : _queue_insert) {
+                RenderSlot &slot = _slots[index];
+                if(slot.object == nullptr || slot.erasing || slot.item != NO_ITEM) continue;
+                slot.item = (uint32_t)_items.size();
+                _items.push_back(RenderItem{ staticKey(slot.object), slot.object, index });
             }
             _queue_insert.clear();
 
-            // Erase
-            for(RenderObject* object : _queue_erase) {
-                Texture::Texture &tex = object->texture();
-                if(_data.count(tex) > 0) _data[tex].erase(object);
+            // Erase; skips anything inserted again since
+            for(uint32_t index : _queue_erase) {
+                if(_slots[index].object != nullptr && _slots[index].erasing) eraseSlot(index);
             }
             _queue_erase.clear();
         }
@@ -110,27 +261,169 @@ namespace Swarm {
         void RenderObjectCollection::clear() {
 
             // Lock
-            boost::lock_guard<boost::mutex> lock(_static_roc_mutex_map[_uid]);
+            boost::lock_guard<boost::mutex> lock(_lock->mutex);
 
             // Clear
-            _data.clear();
+            _items.clear();
+            _sorted = 0;
+            _erased = 0;
+            _slot_index.clear();
+            _free_slots.clear();
+            for(uint32_t index = 0; index < _slots.size(); index++) {
+                RenderSlot &slot = _slots[index];
+                if(slot.object != nullptr) slot.generation++;
+                slot = RenderSlot{ nullptr, NO_ITEM, slot.generation, false };
+                _free_slots.push_back(index);
+            }
             _queue_insert.clear();
             _queue_erase.clear();
+            _texture_ids.clear();
+            _textures.clear();
+            _model_ids.clear();
+            _cull_dirty = true;
         }
 
         void RenderObjectCollection::render(const Renderer &renderer) {
 
             // Lock
-            boost::lock_guard<boost::mutex> lock(_static_roc_mutex_map[_uid]);
+            boost::lock_guard<boost::mutex> lock(_lock->mutex);
 
-            // Render All
-            for(auto && iter : _data) {
+            build(renderer);
 
-                iter.first.bind();
-                for(RenderObject* object : iter.second)
-                    if(object != nullptr) object->render(renderer);
+            auto start = std::chrono::high_resolution_clock::now();
+            if(renderer.instancing()) submitInstanced(renderer);
+            else submit(renderer);
+            _stats.submit_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        }
+
+        // Model id from a render key
+        uint32_t modelID(uint64_t key) {
+            return (uint32_t)(key >> 16) & 0xFFFFFF;
+        }
+
+        void RenderObjectCollection::resolveVAOs() {
+
+            // One lock and context lookup for the whole batch; any VAO this context lacks is generated here, before
+            // drawing starts
+            _model_vaos.assign(_model_ids.size(), (SWMuint)NO_ITEM);
+            VAOTable &table = currentVAOTable();
+            boost::lock_guard<boost::mutex> lock(table.mutex());
+            for(const CommandBuffer &buffer : _commands) {
+                for(const DrawCommand &command : buffer.commands) {
+                    if(command.model == nullptr) continue;
+                    SWMuint &vao = _model_vaos[modelID(command.key)];
+                    if(vao == NO_ITEM) vao = table.resolve(*command.model);
+                }
+            }
+        }
+
+        void RenderObjectCollection::submit(const Renderer &renderer) {
+            Device &dev = device();
+            SWMint model_uniform = renderer.uniformLocation(Renderer::MODEL);
+            resolveVAOs();
+
+            // Same commands RenderObjectStatic::render() issues, in the order they were built
+            uint32_t bound = NO_ITEM;
+            for(const CommandBuffer &buffer : _commands) {
+                for(const DrawCommand &command : buffer.commands) {
+                    uint32_t texture = (uint32_t)(command.key >> 40);
+                    if(texture != bound) {
+                        _textures[texture].bind();
+                        bound = texture;
+                    }
+                    if(command.object != nullptr) {
+                        command.object->render(renderer);
+                        continue;
+                    }
+                    if(renderer.program() == nullptr) continue;
+
+                    Model::Model &model = *command.model;
+                    dev.uniformMatrix(model_uniform, 4, 4, 1, &buffer.matrices[command.matrix]);
+                    dev.bindVertexArray(_model_vaos[modelID(command.key)]);
+                    size_t index_size = model.elementType() == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+                    dev.drawElements(GL_TRIANGLES, (SWMsizei)model.elementCount(command.lod), model.elementType(),
+                                     model.elementOffset(command.lod) * index_size);
+                }
+            }
+            dev.bindVertexArray(0);
+        }
+
+        void RenderObjectCollection::submitInstanced(const Renderer &renderer) {
+            Device &dev = device();
+            resolveVAOs();
+
+            // Pack every matrix first, grouped by level of detail, so they go up in a single upload; commands are
+            // sorted, so each texture and model pair is one contiguous run
+            _instance_draws.clear();
+            _instance_data.clear();
+            _instance_group.clear();
+            uint64_t group = 0;
+            Model::Model* model = nullptr;
+            auto packGroup = [this, &group, &model]() {
+                if(_instance_group.empty()) return;
+                uint32_t texture = (uint32_t)(group >> 24);
+                SWMuint vao = _model_vaos[modelID(group << 16)];
+                for(size_t lod = 0; lod < std::max(model->lodCount(), (size_t)1); lod++) {
+                    size_t first = _instance_data.size() / 16;
+                    for(const std::pair<size_t, const SWMfloat*> &instance : _instance_group)
+                        if(instance.first == lod) _instance_data.insert(_instance_data.end(), instance.second, instance.second + 16);
+                    size_t instances = _instance_data.size() / 16 - first;
+                    if(instances > 0) _instance_draws.push_back(InstanceDraw{ texture, model, lod, first, instances, nullptr, vao });
+                }
+                _instance_group.clear();
+            };
+            for(const CommandBuffer &buffer : _commands) {
+                for(const DrawCommand &command : buffer.commands) {
+                    if(command.object != nullptr) {
+                        _instance_draws.push_back(InstanceDraw{ (uint32_t)(command.key >> 40), command.model, 0, 0, 0, command.object, 0 });
+                        continue;
+                    }
+                    if((command.key >> 16) != group) packGroup();
+                    group = command.key >> 16;
+                    model = command.model;
+                    _instance_group.push_back(std::make_pair((size_t)command.lod, &buffer.matrices[command.matrix]));
+                }
+            }
+            packGroup();
+            if(_instance_draws.empty()) return;
+
+            releaseInstanceBuffers(dev);
+            if(_instance_buffer == 0) {
+                _instance_buffer = dev.createBuffer();
+                boost::lock_guard<boost::mutex> lock(_static_roc_instance_mutex);
+                _static_roc_instance_buffers.insert(_instance_buffer);
+            }
+            dev.bindBuffer(GL_ARRAY_BUFFER, _instance_buffer);
+            dev.bufferStream(GL_ARRAY_BUFFER, _instance_data.size() * sizeof(SWMfloat), _instance_data.data());
+
+            // Draw
+            uint32_t bound = NO_ITEM;
+            for(const InstanceDraw &draw : _instance_draws) {
+                if(draw.texture != bound) {
+                    _textures[draw.texture].bind();
+                    bound = draw.texture;
+                }
+                if(draw.object != nullptr) {
+                    draw.object->render(renderer);
+                    continue;
+                }
+
+                Model::Model &model = *draw.model;
+                dev.bindVertexArray(draw.vao);
+
+                // Point the matrix columns at this draw's instances
+                dev.bindBuffer(GL_ARRAY_BUFFER, _instance_buffer);
+                for(SWMuint column = 0; column < 4; column++) {
+                    dev.vertexAttribute(Renderer::INSTANCE_MATRIX_ATTRIB + column, 4, GL_FLOAT, false, 16 * sizeof(SWMfloat),
+                                        (draw.first * 16 + column * 4) * sizeof(SWMfloat), 1);
+                }
+
+                size_t index_size = model.elementType() == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+                dev.drawElementsInstanced(GL_TRIANGLES, (SWMsizei)model.elementCount(draw.lod), model.elementType(),
+                                          model.elementOffset(draw.lod) * index_size, (SWMsizei)draw.count);
             }
+            dev.bindVertexArray(0);
         }
 
     }
-}
\ No newline at end of file
+}
@@ -2,6 +2,10 @@
 
 #include "api/Logging.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
 using namespace Swarm::Logging;
 
 namespace Swarm {
@@ -23,10 +27,10 @@ namespace Swarm {
         void defaultRenderCycle_start(const Renderer &renderer, const Window &window) {
 
             // Bind Program
-            glUseProgram(renderer.program()->ID());
-            renderer.program()->clearUniformCache();
+            device().useProgram(renderer.program()->ID());
 
             // Set Uniforms
+            renderer.bindUniformsBlock();
             renderer.bindUniformsMatrix(window);
             renderer.bindUniformsTexture();
             renderer.bindUniformsCustom();
@@ -35,16 +39,16 @@ namespace Swarm {
 
         void defaultRenderCycle_end(const Renderer &renderer, const Window &window) {
 
-            // Unbind Program
-            glUseProgram(0);
+            // The Program is left in use, so a following Renderer with the same Program binds nothing
         }
 
         RendererInternal::RendererInternal(Program* program) : _program(program) {
 
             // Set Default Matrix Uniforms
-            _uniform_map_matrix[MODEL] = "_m";
-            _uniform_map_matrix[VIEW] = "_v";
-            _uniform_map_matrix[PROJECTION] = "_p";
+            setUniformName(MODEL, "_m");
+            setUniformName(VIEW, "_v");
+            setUniformName(PROJECTION, "_p");
+            setUniformBlockName("SwarmFrame");
 
             // Set Default Cycle Phase Functions
             _cycle_func_map[START] = defaultRenderCycle_start;
@@ -59,13 +63,51 @@ namespace Swarm {
 
         void RendererInternal::bindUniformsMatrix(const Window &window) const {
             if(window.camera() == nullptr) return;
-            if(_uniform_map_matrix.count(VIEW))       glUniformMatrix4fv(_program->uniform(_uniform_map_matrix.at(VIEW)),       1, GL_FALSE, &window.camera()->viewMatrix()      [0][0]);
-            if(_uniform_map_matrix.count(PROJECTION)) glUniformMatrix4fv(_program->uniform(_uniform_map_matrix.at(PROJECTION)), 1, GL_FALSE, &window.camera()->projectionMatrix(window.width(), window.height())[0][0]);
+            bindUniformsMatrix(window.camera()->viewMatrix(), window.camera()->projectionMatrix(window.width(), window.height()),
+                               window.height());
+        }
+
+        void RendererInternal::bindUniformsMatrix(const glm::mat4 &view, const glm::mat4 &projection, int height) const {
+            if(_uniform_location_matrix[VIEW] >= 0)       device().uniformMatrix(_uniform_location_matrix[VIEW],       4, 4, 1, &view[0][0]);
+            if(_uniform_location_matrix[PROJECTION] >= 0) device().uniformMatrix(_uniform_location_matrix[PROJECTION], 4, 4, 1, &projection[0][0]);
+
+            _frame_view = view;
+            _frame_pixel_scale = projection[1][1] * height * 0.5f;
+
+            // Frustum planes are sums and differences of the rows of the combined matrix; glm is column-major
+            glm::mat4 combined = projection * view;
+            glm::vec4 rows[4];
+            for(int r = 0; r < 4; r++) rows[r] = glm::vec4(combined[0][r], combined[1][r], combined[2][r], combined[3][r]);
+            for(int p = 0; p < 6; p++) {
+                glm::vec4 plane = (p % 2 == 0) ? rows[3] + rows[p / 2] : rows[3] - rows[p / 2];
+                plane /= glm::length(glm::vec3(plane));
+                for(int c = 0; c < 4; c++) _frame_frustum[p*4 + c] = plane[c];
+            }
+        }
+
+        bool RendererInternal::frustum(SWMfloat* planes) const {
+            if(_frame_pixel_scale <= 0.0f) return false;
+            std::copy(_frame_frustum, _frame_frustum + 24, planes);
+            return true;
+        }
+
+        float RendererInternal::projectedRadius(const glm::vec3 &center, float radius) const {
+            if(_frame_pixel_scale <= 0.0f) return std::numeric_limits<float>::infinity();
+            float distance = glm::length(glm::vec3(_frame_view * glm::vec4(center, 1.0f)));
+            if(distance <= radius) return std::numeric_limits<float>::infinity();
+            return radius * _frame_pixel_scale / distance;
+        }
+
+        float RendererInternal::viewDepth(const glm::vec3 &point) const {
+            if(_frame_pixel_scale <= 0.0f) return 0.0f;
+            return -(_frame_view * glm::vec4(point, 1.0f)).z;
         }
 
         void RendererInternal::bindUniformsTexture() const {
-            for(auto && iter : _uniform_map_texture)
-                glUniform1i(_program->uniform(iter.second), iter.first);
+            for(auto && iter : _uniform_location_texture) {
+                SWMint unit = (SWMint)iter.first;
+                device().uniformi(iter.second, 1, 1, &unit);
+            }
         }
 
         void RendererInternal::bindUniformsCustom() const {
@@ -73,12 +115,51 @@ namespace Swarm {
                 uniform->bind(*this);
         }
 
+        void RendererInternal::bindUniformsBlock() const {
+            if(!_block_filled) return;
+            device().bindBufferRange(GL_UNIFORM_BUFFER, _block.binding, uniformBlockBuffer(), _block_offset, _block.size);
+        }
+
+        void RendererInternal::fillUniformBlock(FrameArena &arena, const glm::mat4 &view, const glm::mat4 &projection) const {
+            _block_filled = false;
+            if(!hasUniformBlock()) return;
+
+            // Buffer ranges must start on GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, which is at most 256 bytes
+            _block_offset = arena.allocate(_block.size, 256);
+            uint8_t* block = arena.data() + _block_offset;
+
+            auto matrix = [this, block](MatrixUniformType type, const glm::mat4 &value) {
+                auto name = _uniform_map_matrix.find(type);
+                if(name == _uniform_map_matrix.end()) return;
+                auto offset = _block.offsets.find(name->second);
+                if(offset != _block.offsets.end() && offset->second + sizeof(value) <= _block.size)
+                    std::memcpy(block + offset->second, &value[0][0], sizeof(value));
+            };
+            matrix(VIEW, view);
+            matrix(PROJECTION, projection);
+
+            for(Uniform* uniform : _uniform_set) {
+                if(!uniform->_value_set) continue;
+                auto offset = _block.offsets.find(uniform->_name);
+                if(offset != _block.offsets.end()) uniform->writeStd140(block + offset->second, _block.size - offset->second);
+            }
+            _block_filled = true;
+        }
+
         void RendererInternal::setRenderCycleFunction(RenderCyclePhase phase, RenderCycleFunc function) {
             _cycle_func_map[phase] = function;
         }
 
         void RendererInternal::setUniformName(MatrixUniformType type, const std::string &name) {
             _uniform_map_matrix[type] = name;
+            _uniform_location_matrix[type] = _program->uniform(name);
+        }
+
+        void RendererInternal::setUniformBlockName(const std::string &name) {
+            _block_name = name;
+            const UniformBlock* block = _program->uniformBlock(name);
+            _block = block != nullptr ? *block : UniformBlock();
+            _block_filled = false;
         }
 
         std::string RendererInternal::uniformName(MatrixUniformType type) const {
@@ -88,6 +169,7 @@ namespace Swarm {
 
         void RendererInternal::setTextureName(SWMuint active, const std::string &name) {
             _uniform_map_texture[active] = name;
+            _uniform_location_texture[active] = _program->uniform(name);
         }
 
         std::string RendererInternal::textureName(SWMuint active) const {
@@ -95,6 +177,11 @@ namespace Swarm {
             else return "";
         }
 
+        SWMint RendererInternal::textureLocation(SWMuint active) const {
+            auto iter = _uniform_location_texture.find(active);
+            return iter != _uniform_location_texture.end() ? iter->second : -1;
+        }
+
         void RendererInternal::insertUniform(Uniform &uniform) {
             _uniform_set.insert(&uniform);
         }
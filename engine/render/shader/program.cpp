@@ -18,7 +18,7 @@ namespace Swarm {
         }
 
         ProgramInternal::~ProgramInternal() {
-            glDeleteProgram(_ID);
+            device().deleteProgram(_ID);
         }
 
         Program* Program::compile(Shader* shaders[], size_t count) {
@@ -29,42 +29,50 @@ namespace Swarm {
 
         ProgramInternal::ProgramInternal(Shader* shaders[], size_t count) {
 
-            // Create ID
-            _ID = glCreateProgram();
-            Log::log_render(DEBUG) << "Linking Program with ID '" << _ID << "'";
-
-            // Attach Shaders
+            // Gather Shaders
+            std::vector<SWMuint> shader_ids;
             for(size_t i = 0; i < count; i++) {
                 if(shaders[i] != nullptr) {
-                    glAttachShader(_ID, shaders[i]->ID());
+                    shader_ids.push_back(shaders[i]->ID());
                     Log::log_render(DEBUG) << "Attaching " << shaders[i]->type().name() << " Shader with ID '" << shaders[i]->ID() << "'";
                 }
             }
 
             // Link Program
-            glLinkProgram(_ID);
+            std::string log;
+            bool result = device().linkProgram(_ID, shader_ids, log);
+            Log::log_render(DEBUG) << "Linking Program with ID '" << _ID << "'";
 
             // Check Link Status
-            GLint result = GL_FALSE;
-            GLint log_length = 0;
-            glGetProgramiv(_ID, GL_LINK_STATUS,     &result);
-            glGetProgramiv(_ID, GL_INFO_LOG_LENGTH, &log_length);
-            char log_contents[log_length+1];
-            glGetProgramInfoLog(_ID, log_length, nullptr, &log_contents[0]);
-            if(!result) throw Exception::RenderProgramException::Link(_ID, std::string(&log_contents[0]));
+            if(!result) throw Exception::RenderProgramException::Link(_ID, log);
+
+            device().useProgram(0);
 
-            glUseProgram(0);
+            // Reflect Uniforms
+            std::vector<std::pair<std::string, SWMint>> uniforms;
+            device().activeUniforms(_ID, uniforms);
+            for(auto && iter : uniforms) _uniforms[iter.first] = iter.second;
 
-            Log::log_render(DEBUG) << "Successfully Linked Program with ID '" << _ID << "'";
+            // Reflect Uniform Blocks; each is bound to the binding point matching its index
+            device().activeUniformBlocks(_ID, _blocks);
+            for(size_t i = 0; i < _blocks.size(); i++) {
+                _blocks[i].binding = (SWMuint)i;
+                device().uniformBlockBinding(_ID, _blocks[i].index, _blocks[i].binding);
+            }
+
+            Log::log_render(DEBUG) << "Successfully Linked Program with ID '" << _ID << "' [Uniforms: " << _uniforms.size()
+                                   << ", Blocks: " << _blocks.size() << "]";
         }
 
-        SWMint ProgramInternal::uniform(const std::string &name) {
-            if(_uniform_cache.count(name) < 1) {
-                GLint unif = glGetUniformLocation(_ID, (const GLchar*)name.c_str());
-                _uniform_cache[name] = unif;
+        SWMint ProgramInternal::uniform(const std::string &name) const {
+            auto iter = _uniforms.find(name);
+            return iter != _uniforms.end() ? iter->second : -1;
+        }
 
-            }
-            return _uniform_cache[name];
+        const UniformBlock* ProgramInternal::uniformBlock(const std::string &name) const {
+            for(const UniformBlock &block : _blocks)
+                if(block.name == name) return &block;
+            return nullptr;
         }
     }
 }
\ No newline at end of file
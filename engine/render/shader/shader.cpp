@@ -15,7 +15,7 @@ namespace Swarm {
         }
 
         ShaderInternal::~ShaderInternal() {
-            glDeleteShader(_ID);
+            device().deleteShader(_ID);
         }
 
         Shader* Shader::compileFromFile(const std::string &path, const ShaderType &type) {
@@ -44,23 +44,13 @@ namespace Swarm {
         ShaderInternal::ShaderInternal(const std::string &src, const ShaderType &type)
                 : _type(type) {
 
-            // Create ID
-            _ID = glCreateShader(type.type());
-            Log::log_render(DEBUG) << "Compiling " << type.name() << " Shader with ID '" << _ID << "'";
-
             // Compile Shader
-            const GLchar *source = (const GLchar*)src.c_str();
-            glShaderSource(_ID, 1, &source, nullptr);
-            glCompileShader(_ID);
+            std::string log;
+            bool result = device().compileShader(_ID, type.type(), src, log);
+            Log::log_render(DEBUG) << "Compiling " << type.name() << " Shader with ID '" << _ID << "'";
 
             // Check Compile Status
-            GLint result = GL_FALSE;
-            GLint log_length = 0;
-            glGetShaderiv(_ID, GL_COMPILE_STATUS,  &result);
-            glGetShaderiv(_ID, GL_INFO_LOG_LENGTH, &log_length);
-            char log_contents[log_length+1];
-            glGetShaderInfoLog(_ID, log_length, nullptr, &log_contents[0]);
-            if(!result) throw Exception::RenderShaderException::Compile(_ID, std::string(&log_contents[0]));
+            if(!result) throw Exception::RenderShaderException::Compile(_ID, log);
 
             Log::log_render(DEBUG) << "Successfully Compiled " << type.name() << " Shader with ID '" << _ID << "'";
         }
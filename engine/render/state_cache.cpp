@@ -0,0 +1,316 @@
+#include "RenderInternal.h"
+
+namespace Swarm {
+    namespace Render {
+
+        // ***************
+        //  Tracked State
+        // ***************
+
+        const int64_t UNKNOWN = -1;
+
+        struct BufferRange {
+            SWMuint buffer;
+            size_t offset;
+            size_t bytes;
+
+            bool operator==(const BufferRange &rhs) const {
+                return buffer == rhs.buffer && offset == rhs.offset && bytes == rhs.bytes;
+            }
+        };
+
+        // State of the calling thread's current context, as last passed on; anything missing is unknown
+        struct TrackedState {
+            size_t epoch = 0;
+            int64_t program = UNKNOWN;
+            int64_t vertex_array = UNKNOWN;
+            std::unordered_map<SWMenum, SWMuint> buffers;
+            std::unordered_map<uint64_t, BufferRange> ranges;     // Target << 32 | index
+            std::unordered_map<uint64_t, SWMuint> textures;       // Unit << 32 | target
+            std::unordered_map<SWMenum, bool> capabilities;
+            StateStats stats;
+        };
+
+        std::atomic<size_t> _static_state_epoch(0);
+        std::atomic<bool> _static_state_caching(true);
+        StateCacheDevice _static_state_cache;
+
+        boost::mutex _static_frame_state_mutex;
+        StateStats _static_frame_state_stats;
+
+        TrackedState &trackedState() {
+            static thread_local TrackedState state;
+
+            // A changed Device leaves nothing known
+            size_t epoch = _static_state_epoch;
+            if(state.epoch != epoch) {
+                StateStats stats = state.stats;
+                state = TrackedState();
+                state.epoch = epoch;
+                state.stats = stats;
+            }
+            return state;
+        }
+
+        // Record 'value' for 'key', and whether that changed anything
+        template<typename K, typename V>
+        bool change(std::unordered_map<K, V> &map, K key, const V &value, StateStats &stats) {
+            auto iter = map.find(key);
+            if(iter != map.end() && iter->second == value) {
+                stats.dropped++;
+                return false;
+            }
+            if(iter != map.end()) iter->second = value;
+            else map.emplace(key, value);
+            stats.changes++;
+            return true;
+        }
+
+        bool change(int64_t &current, SWMuint value, StateStats &stats) {
+            if(current == (int64_t)value) {
+                stats.dropped++;
+                return false;
+            }
+            current = value;
+            stats.changes++;
+            return true;
+        }
+
+        // Deleting a bound object reverts its bindings to '0'
+        template<typename K>
+        void unbind(std::unordered_map<K, SWMuint> &map, SWMuint object) {
+            for(auto && iter : map) if(iter.second == object) iter.second = 0;
+        }
+
+        // ***************
+        //  Cache Control
+        // ***************
+
+        Device &device() {
+            if(_static_state_caching) return _static_state_cache;
+            return backendDevice();
+        }
+
+        void invalidateAllStateCaches() {
+            _static_state_epoch++;
+        }
+
+        void setStateCaching(bool caching) {
+            _static_state_caching = caching;
+            invalidateAllStateCaches();
+        }
+
+        bool stateCaching() {
+            return _static_state_caching;
+        }
+
+        void invalidateStateCache() {
+            TrackedState &state = trackedState();
+            StateStats stats = state.stats;
+            state = TrackedState();
+            state.epoch = _static_state_epoch;
+            state.stats = stats;
+        }
+
+        StateStats stateStats() {
+            return trackedState().stats;
+        }
+
+        void resetStateStats() {
+            trackedState().stats = StateStats();
+        }
+
+        StateStats frameStateStats() {
+            boost::lock_guard<boost::mutex> lock(_static_frame_state_mutex);
+            return _static_frame_state_stats;
+        }
+
+        void finishFrameStateStats() {
+            TrackedState &state = trackedState();
+            boost::lock_guard<boost::mutex> lock(_static_frame_state_mutex);
+            _static_frame_state_stats = state.stats;
+            state.stats = StateStats();
+        }
+
+        // ******************
+        //  StateCacheDevice
+        // ******************
+
+        bool StateCacheDevice::compileShader(SWMuint &id, SWMenum type, const std::string &src, std::string &log) {
+            return backendDevice().compileShader(id, type, src, log);
+        }
+
+        void StateCacheDevice::deleteShader(SWMuint shader) {
+            backendDevice().deleteShader(shader);
+        }
+
+        bool StateCacheDevice::linkProgram(SWMuint &id, const std::vector<SWMuint> &shaders, std::string &log) {
+            return backendDevice().linkProgram(id, shaders, log);
+        }
+
+        void StateCacheDevice::deleteProgram(SWMuint program) {
+            backendDevice().deleteProgram(program);
+
+            // A deleted program stays in use until another is, but its name may be handed out again
+            TrackedState &state = trackedState();
+            if(state.program == (int64_t)program) state.program = UNKNOWN;
+        }
+
+        void StateCacheDevice::useProgram(SWMuint program) {
+            TrackedState &state = trackedState();
+            if(change(state.program, program, state.stats)) backendDevice().useProgram(program);
+        }
+
+        SWMint StateCacheDevice::uniformLocation(SWMuint program, const std::string &name) {
+            return backendDevice().uniformLocation(program, name);
+        }
+
+        void StateCacheDevice::activeUniforms(SWMuint program, std::vector<std::pair<std::string, SWMint>> &uniforms) {
+            backendDevice().activeUniforms(program, uniforms);
+        }
+
+        void StateCacheDevice::activeUniformBlocks(SWMuint program, std::vector<UniformBlock> &blocks) {
+            backendDevice().activeUniformBlocks(program, blocks);
+        }
+
+        void StateCacheDevice::uniformBlockBinding(SWMuint program, SWMuint block, SWMuint binding) {
+            backendDevice().uniformBlockBinding(program, block, binding);
+        }
+
+        void StateCacheDevice::uniformf(SWMint location, SWMsizei components, SWMsizei count, const SWMfloat* data) {
+            backendDevice().uniformf(location, components, count, data);
+        }
+
+        void StateCacheDevice::uniformi(SWMint location, SWMsizei components, SWMsizei count, const SWMint* data) {
+            backendDevice().uniformi(location, components, count, data);
+        }
+
+        void StateCacheDevice::uniformui(SWMint location, SWMsizei components, SWMsizei count, const SWMuint* data) {
+            backendDevice().uniformui(location, components, count, data);
+        }
+
+        void StateCacheDevice::uniformMatrix(SWMint location, SWMsizei columns, SWMsizei rows, SWMsizei count, const SWMfloat* data) {
+            backendDevice().uniformMatrix(location, columns, rows, count, data);
+        }
+
+        SWMuint StateCacheDevice::createBuffer() {
+            return backendDevice().createBuffer();
+        }
+
+        void StateCacheDevice::deleteBuffer(SWMuint buffer) {
+            backendDevice().deleteBuffer(buffer);
+            TrackedState &state = trackedState();
+            unbind(state.buffers, buffer);
+            for(auto iter = state.ranges.begin(); iter != state.ranges.end();) {
+                if(iter->second.buffer == buffer) iter = state.ranges.erase(iter);
+                else ++iter;
+            }
+        }
+
+        void StateCacheDevice::bindBuffer(SWMenum target, SWMuint buffer) {
+            TrackedState &state = trackedState();
+            if(change(state.buffers, target, buffer, state.stats)) backendDevice().bindBuffer(target, buffer);
+        }
+
+        void StateCacheDevice::bindBufferRange(SWMenum target, SWMuint index, SWMuint buffer, size_t offset, size_t bytes) {
+            TrackedState &state = trackedState();
+            BufferRange range = { buffer, offset, bytes };
+            if(!change(state.ranges, (uint64_t)target << 32 | index, range, state.stats)) return;
+            backendDevice().bindBufferRange(target, index, buffer, offset, bytes);
+
+            // Binding a range binds the buffer to the generic binding point as well
+            state.buffers[target] = buffer;
+        }
+
+        void StateCacheDevice::bufferData(SWMenum target, size_t bytes, const void* data) {
+            backendDevice().bufferData(target, bytes, data);
+        }
+
+        void StateCacheDevice::bufferStream(SWMenum target, size_t bytes, const void* data) {
+            backendDevice().bufferStream(target, bytes, data);
+        }
+
+        SWMuint StateCacheDevice::createVertexArray() {
+            return backendDevice().createVertexArray();
+        }
+
+        void StateCacheDevice::deleteVertexArray(SWMuint vao) {
+            backendDevice().deleteVertexArray(vao);
+            TrackedState &state = trackedState();
+            if(state.vertex_array == (int64_t)vao) {
+                state.vertex_array = 0;
+                state.buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+            }
+        }
+
+        void StateCacheDevice::bindVertexArray(SWMuint vao) {
+            TrackedState &state = trackedState();
+            if(!change(state.vertex_array, vao, state.stats)) return;
+            backendDevice().bindVertexArray(vao);
+
+            // The element buffer binding belongs to the vertex array
+            state.buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+        }
+
+        void StateCacheDevice::vertexAttribute(SWMuint attrib, SWMint components, SWMenum type, bool normalized,
+                                               SWMsizei stride, size_t offset, SWMuint divisor) {
+            backendDevice().vertexAttribute(attrib, components, type, normalized, stride, offset, divisor);
+        }
+
+        SWMuint StateCacheDevice::createTexture() {
+            return backendDevice().createTexture();
+        }
+
+        void StateCacheDevice::deleteTexture(SWMuint texture) {
+            backendDevice().deleteTexture(texture);
+            unbind(trackedState().textures, texture);
+        }
+
+        void StateCacheDevice::bindTexture(SWMuint active, SWMenum target, SWMuint texture) {
+            TrackedState &state = trackedState();
+            if(change(state.textures, (uint64_t)active << 32 | target, texture, state.stats))
+                backendDevice().bindTexture(active, target, texture);
+        }
+
+        void StateCacheDevice::textureImage2D(SWMuint texture, unsigned int width, unsigned int height, const void* pixels) {
+            backendDevice().textureImage2D(texture, width, height, pixels);
+
+            // Uploads go through whichever unit is active, leaving nothing bound to it
+            trackedState().textures.clear();
+        }
+
+        void StateCacheDevice::viewport(SWMint x, SWMint y, SWMsizei width, SWMsizei height) {
+            backendDevice().viewport(x, y, width, height);
+        }
+
+        void StateCacheDevice::clear(float r, float g, float b, float a) {
+            backendDevice().clear(r, g, b, a);
+        }
+
+        void StateCacheDevice::enable(SWMenum capability, bool enabled) {
+            TrackedState &state = trackedState();
+            if(change(state.capabilities, capability, enabled, state.stats)) backendDevice().enable(capability, enabled);
+        }
+
+        void StateCacheDevice::drawElements(SWMenum mode, SWMsizei count, SWMenum type, size_t offset) {
+            backendDevice().drawElements(mode, count, type, offset);
+        }
+
+        void StateCacheDevice::drawElementsInstanced(SWMenum mode, SWMsizei count, SWMenum type, size_t offset, SWMsizei instances) {
+            backendDevice().drawElementsInstanced(mode, count, type, offset, instances);
+        }
+
+        SWMuint StateCacheDevice::fenceSync() {
+            return backendDevice().fenceSync();
+        }
+
+        bool StateCacheDevice::fenceSignaled(SWMuint fence) {
+            return backendDevice().fenceSignaled(fence);
+        }
+
+        void StateCacheDevice::deleteFence(SWMuint fence) {
+            backendDevice().deleteFence(fence);
+        }
+
+    }
+}
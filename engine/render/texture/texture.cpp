@@ -8,8 +8,7 @@ namespace Swarm {
     namespace Texture {
 
         void TexMap::bind(SWMuint active) const {
-            glActiveTexture(GL_TEXTURE0 + active);
-            glBindTexture(_target, _id);
+            Render::device().bindTexture(active, _target, _id);
         }
 
         bool TexMap::operator==(const TexMap &rhs) const {
@@ -20,7 +19,7 @@ namespace Swarm {
             return _target == rhs._target ? _id < rhs._id : _target < rhs._target;
         }
 
-        // TODO: Check to see if already bound
+        // Units that already have their texture bound are dropped by the state cache behind device()
         void Texture::bind() const {
             for(auto && iter : _data) iter.second.bind(iter.first);
         }
@@ -11,39 +11,43 @@ namespace Swarm {
         std::set<GLuint> registered_textures;
 
         void cleanup() {
-            for(GLuint tex : registered_textures) glDeleteTextures(1, &tex);
+            for(GLuint tex : registered_textures) Render::device().deleteTexture(tex);
         }
 
-        GLuint loadTexInternal_PNG(const std::string &path) {
-            std::vector<unsigned char> image;
-            unsigned width, height;
-            unsigned error = lodepng::decode(image, width, height, path.c_str());
+        RawTextureData decodeTexInternal_PNG(const std::string &path) {
+            RawTextureData data;
+            unsigned error = lodepng::decode(data.pixels, data.width, data.height, path.c_str());
 
             if(error != 0) throw Exception::TextureException::FileLoadPNG(path, std::string(lodepng_error_text(error)));
 
-            GLuint textureID;
-            glGenTextures(1, &textureID);
+            return data;
+        }
 
-            glBindTexture(GL_TEXTURE_2D, textureID);
+        RawTextureData decodeTexFromFile(const std::string &path, FileType type) {
+            switch(type) {
+                case PNG: return decodeTexInternal_PNG(path);
+                default: return RawTextureData();
+            }
+        }
 
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexImage2D(GL_TEXTURE_2D, 0, 4, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &image[0]);
-            glGenerateMipmap(GL_TEXTURE_2D); // Is this really needed?
+        TexMap loadTexFromData(const RawTextureData &data) {
+            if(data.pixels.empty()) return TexMap();
 
-            glBindTexture(GL_TEXTURE_2D, 0);
+            GLuint textureID = Render::device().createTexture();
+            Render::device().textureImage2D(textureID, data.width, data.height, &data.pixels[0]);
 
-            return textureID;
+            registered_textures.insert(textureID);
+            return TexMap(Type::TargetType::TEX_2D, textureID);
         }
 
         TexMap loadTexFromFile(const std::string &path, FileType type) {
-            GLuint texID = 0;
-            switch(type) {
-                case PNG: texID = loadTexInternal_PNG(path); break;
-                default: texID = 0; break;
-            }
-            registered_textures.insert(texID);
-            return TexMap(Type::TargetType::TEX_2D, texID);
+            return loadTexFromData(decodeTexFromFile(path, type));
+        }
+
+        void unloadTex(const TexMap &tex) {
+            GLuint id = tex.id();
+            if(id == 0 || registered_textures.erase(id) < 1) return;
+            Render::device().deleteTexture(id);
         }
     }
 }
\ No newline at end of file
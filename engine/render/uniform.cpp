@@ -1,141 +1,285 @@
-#define SWARM_INCLUDE_GLEW
-#define SWARM_BOOST_AVAILABLE
-#define SWARM_REQUEST_BOOST_MUTEX
-#include "api/Render.h"
-#undef SWARM_REQUEST_BOOST_MUTEX
+#include "RenderInternal.h"
 
 #include "api/Logging.h"
 
+#include <cstring>
+#include <unordered_set>
+
 using namespace Swarm::Logging;
 
 namespace Swarm {
     namespace Render {
 
-            std::unordered_map<std::string, boost::mutex> _static_uniform_mutex_map;
-
-            void Uniform::setf (SWMsizei count, SWMsizei stride, SWMfloat *data) {
-                boost::lock_guard<boost::mutex> lock(_static_uniform_mutex_map[_name]);
-                if(_has_data) clear(lock);
-                type = F;
-                this->data.f = {count, stride, new SWMfloat[count*stride]};
-                for(int i = 0; i < count; i++) {
-                    for(int j = 0; j < stride; j++) {
-                        int index = i*stride + j;
-                        this->data.f.data[index] = data[index];
-                    }
-                }
-                _has_data = true;
+        // *****************
+        //  Uniform Staging
+        // *****************
+
+        // Setters append a record to the active stage; flushUniforms() swaps stages and applies the records of the
+        // one that was active. Records are a header followed by the raw data, each 8-byte aligned.
+        struct UniformRecord {
+            Uniform* uniform;
+            uint32_t serial;
+            uint8_t type;
+            uint8_t clear;
+            SWMsizei count;
+            SWMsizei width;
+            SWMsizei height;
+            uint32_t bytes;
+        };
+
+        const size_t UNIFORM_RECORD_ALIGN = 8;
+
+        // Largest a stage grows to; with no render thread flushing, setters go on into the overflow instead
+        const size_t UNIFORM_STAGE_MAX_BYTES = 4 * 1024 * 1024;
+
+        // Overflow size that triggers compacting it down to the last record of each Uniform; doubles with what remains
+        const size_t UNIFORM_OVERFLOW_COMPACT_BYTES = 1024 * 1024;
+
+        struct UniformStage {
+            std::vector<uint8_t> bytes = std::vector<uint8_t>(64 * 1024); // Only resized while no setter can reach it
+            std::atomic<size_t> used{0};
+            std::atomic<size_t> end{64 * 1024}; // Start of the one record that straddled the end of 'bytes', if any
+            std::atomic<unsigned int> writers{0};
+
+            // Records that did not fit; rare once the stage has grown to fit a frame's worth
+            boost::mutex overflow_mutex;
+            std::vector<uint8_t> overflow;
+            size_t overflow_compact = UNIFORM_OVERFLOW_COMPACT_BYTES;
+        };
+
+        UniformStage _static_uniform_stages[2];
+        std::atomic<unsigned int> _static_uniform_stage(0);
+
+        // Uniforms that exist; records for any other are skipped. Held through each flush, so a Uniform is never
+        // destroyed while its records are applied.
+        boost::mutex _static_uniforms_mutex;
+        std::unordered_set<const Uniform*> _static_uniforms;
+        uint32_t _static_uniform_serial = 0;
+
+        size_t recordSize(size_t data_bytes) {
+            size_t size = sizeof(UniformRecord) + data_bytes;
+            return (size + UNIFORM_RECORD_ALIGN - 1) / UNIFORM_RECORD_ALIGN * UNIFORM_RECORD_ALIGN;
+        }
+
+        void writeRecord(uint8_t* target, const UniformRecord &record, const void* data) {
+            std::memcpy(target, &record, sizeof(record));
+            if(record.bytes > 0) std::memcpy(target + sizeof(record), data, record.bytes);
+        }
+
+        // Drop every overflow record that a later one for the same Uniform replaces, keeping the order of the rest;
+        // only the last value set matters, and serials tell Uniforms apart
+        void compactOverflow(UniformStage &stage) {
+            std::unordered_set<uint32_t> seen;
+            std::vector<std::pair<size_t, size_t>> kept;
+            std::vector<size_t> offsets;
+            for(size_t offset = 0; offset < stage.overflow.size();) {
+                offsets.push_back(offset);
+                UniformRecord record;
+                std::memcpy(&record, stage.overflow.data() + offset, sizeof(record));
+                offset += recordSize(record.bytes);
+            }
+            size_t kept_bytes = 0;
+            for(auto offset = offsets.rbegin(); offset != offsets.rend(); ++offset) {
+                UniformRecord record;
+                std::memcpy(&record, stage.overflow.data() + *offset, sizeof(record));
+                if(!seen.insert(record.serial).second) continue;
+                kept.emplace_back(*offset, recordSize(record.bytes));
+                kept_bytes += kept.back().second;
             }
 
-            void Uniform::seti (SWMsizei count, SWMsizei stride, SWMint   *data) {
-                boost::lock_guard<boost::mutex> lock(_static_uniform_mutex_map[_name]);
-                if(_has_data) clear(lock);
-                type = I;
-                this->data.i = {count, stride, new SWMint[count*stride]};
-                for(int i = 0; i < count; i++) {
-                    for(int j = 0; j < stride; j++) {
-                        int index = i*stride + j;
-                        this->data.i.data[index] = data[index];
-                    }
-                }
-                _has_data = true;
+            std::vector<uint8_t> compacted(kept_bytes);
+            size_t end = 0;
+            for(auto iter = kept.rbegin(); iter != kept.rend(); ++iter) {
+                std::memcpy(compacted.data() + end, stage.overflow.data() + iter->first, iter->second);
+                end += iter->second;
             }
+            stage.overflow.swap(compacted);
+            stage.overflow_compact = std::max(UNIFORM_OVERFLOW_COMPACT_BYTES, kept_bytes * 2);
+        }
 
-            void Uniform::setui(SWMsizei count, SWMsizei stride, SWMuint  *data) {
-                boost::lock_guard<boost::mutex> lock(_static_uniform_mutex_map[_name]);
-                if(_has_data) clear(lock);
-                type = UI;
-                this->data.ui = {count, stride, new SWMuint[count*stride]};
-                for(int i = 0; i < count; i++) {
-                    for(int j = 0; j < stride; j++) {
-                        int index = i*stride + j;
-                        this->data.ui.data[index] = data[index];
-                    }
-                }
-                _has_data = true;
+        void stageRecord(const UniformRecord &record, const void* data) {
+            size_t size = recordSize(record.bytes);
+
+            // Join the active stage; if a flush swapped it out in the meantime, join the other one instead
+            UniformStage* stage;
+            while(true) {
+                unsigned int active = _static_uniform_stage;
+                stage = &_static_uniform_stages[active];
+                stage->writers++;
+                if(_static_uniform_stage == active) break;
+                stage->writers--;
+            }
+
+            size_t offset = stage->used.fetch_add(size);
+            if(offset + size <= stage->bytes.size()) writeRecord(stage->bytes.data() + offset, record, data);
+            else {
+                if(offset < stage->bytes.size()) stage->end = offset;
+                boost::lock_guard<boost::mutex> lock(stage->overflow_mutex);
+                size_t end = stage->overflow.size();
+                stage->overflow.resize(end + size);
+                writeRecord(stage->overflow.data() + end, record, data);
+                if(stage->overflow.size() > stage->overflow_compact) compactOverflow(*stage);
             }
+            stage->writers--;
+        }
+
+        void flushUniforms() {
+            boost::lock_guard<boost::mutex> lock(_static_uniforms_mutex);
+            unsigned int previous = _static_uniform_stage.exchange(_static_uniform_stage ^ 1u);
+            UniformStage &stage = _static_uniform_stages[previous];
+            while(stage.writers > 0) boost::this_thread::yield();
 
-            void Uniform::setm (SWMsizei count, SWMsizei width, SWMsizei height, SWMfloat *data) {
-                boost::lock_guard<boost::mutex> lock(_static_uniform_mutex_map[_name]);
-                if(_has_data) clear(lock);
-                type = M;
-                this->data.m = {count, width, height, new SWMfloat[count*width*height]};
-                for(int i = 0; i < count; i++) {
-                    for(int x = 0; x < width; x++) {
-                        for(int y = 0; y < height; y++) {
-                            int index = i*width*height + x*height + y;
-                            this->data.m.data[index] = data[index];
-                        }
+            // Assigning keeps each value's capacity, so a Uniform set every frame stops allocating
+            auto apply = [](const uint8_t* begin, const uint8_t* end) {
+                while(begin < end) {
+                    UniformRecord record;
+                    std::memcpy(&record, begin, sizeof(record));
+                    const uint8_t* data = begin + sizeof(record);
+                    begin += recordSize(record.bytes);
+                    if(_static_uniforms.count(record.uniform) == 0 || record.uniform->_serial != record.serial) continue;
+
+                    Uniform &uniform = *record.uniform;
+                    uniform._value_set = !record.clear;
+                    if(!record.clear) {
+                        Uniform::Value &value = uniform._value;
+                        value.type = (Uniform::Type)record.type;
+                        value.count = record.count;
+                        value.width = record.width;
+                        value.height = record.height;
+                        value.data.resize(record.bytes / sizeof(SWMfloat));
+                        std::memcpy(value.data.data(), data, record.bytes);
                     }
                 }
-                _has_data = true;
+            };
+
+            size_t used = stage.used;
+            apply(stage.bytes.data(), stage.bytes.data() + std::min(used, stage.end.load()));
+            if(!stage.overflow.empty()) {
+                apply(stage.overflow.data(), stage.overflow.data() + stage.overflow.size());
+                stage.overflow.clear();
+                stage.overflow.shrink_to_fit();
+                stage.overflow_compact = UNIFORM_OVERFLOW_COMPACT_BYTES;
             }
-            
-            void Uniform::bind(const Renderer &render) {
-                if(!_has_data) return;
-                boost::lock_guard<boost::mutex> lock(_static_uniform_mutex_map[_name]);
-                Program* program = render.program();
-                switch(type) {
-                    case Uniform::F: {
-                        switch(data.f.stride) {
-                            case 1:  glUniform1fv(program->uniform(_name), data.f.count, data.f.data); break;
-                            case 2:  glUniform2fv(program->uniform(_name), data.f.count, data.f.data); break;
-                            case 3:  glUniform3fv(program->uniform(_name), data.f.count, data.f.data); break;
-                            default: glUniform4fv(program->uniform(_name), data.f.count, data.f.data); break;
-                        } } break;
-                    case Uniform::I: {
-                        switch(data.i.stride) {
-                            case 1:  glUniform1iv(program->uniform(_name), data.i.count, data.i.data); break;
-                            case 2:  glUniform2iv(program->uniform(_name), data.i.count, data.i.data); break;
-                            case 3:  glUniform3iv(program->uniform(_name), data.i.count, data.i.data); break;
-                            default: glUniform4iv(program->uniform(_name), data.i.count, data.i.data); break;
-                        } } break;
-                    case Uniform::UI: {
-                        switch(data.ui.stride) {
-                            case 1:  glUniform1uiv(program->uniform(_name), data.ui.count, data.ui.data); break;
-                            case 2:  glUniform2uiv(program->uniform(_name), data.ui.count, data.ui.data); break;
-                            case 3:  glUniform3uiv(program->uniform(_name), data.ui.count, data.ui.data); break;
-                            default: glUniform4uiv(program->uniform(_name), data.ui.count, data.ui.data); break;
-                        } } break;
-                    case Uniform::M: {
-                        switch(data.m.width) {
-                            case 2: {
-                                switch(data.m.height) {
-                                    case 2:  glUniformMatrix2fv  (program->uniform(_name), data.m.count, GL_FALSE, data.m.data); break;
-                                    case 3:  glUniformMatrix2x3fv(program->uniform(_name), data.m.count, GL_FALSE, data.m.data); break;
-                                    default: glUniformMatrix2x4fv(program->uniform(_name), data.m.count, GL_FALSE, data.m.data); break;
-                                } } break;
-                            case 3: {
-                                switch(data.m.height) {
-                                    case 2:  glUniformMatrix3x2fv(program->uniform(_name), data.m.count, GL_FALSE, data.m.data); break;
-                                    case 3:  glUniformMatrix3fv  (program->uniform(_name), data.m.count, GL_FALSE, data.m.data); break;
-                                    default: glUniformMatrix3x4fv(program->uniform(_name), data.m.count, GL_FALSE, data.m.data); break;
-                                } } break;
-                            default: {
-                                switch(data.m.height) {
-                                    case 2:  glUniformMatrix4x2fv(program->uniform(_name), data.m.count, GL_FALSE, data.m.data); break;
-                                    case 3:  glUniformMatrix4x3fv(program->uniform(_name), data.m.count, GL_FALSE, data.m.data); break;
-                                    default: glUniformMatrix4fv  (program->uniform(_name), data.m.count, GL_FALSE, data.m.data); break;
-                                } } break;
-                        } } break;
-                    default: break;
-                }
+
+            // Grow to fit what overflowed, so the next frame like this one needs no lock
+            size_t grown = std::min(used * 2, UNIFORM_STAGE_MAX_BYTES);
+            if(grown > stage.bytes.size()) {
+                Log::log_render(DEBUG) << "Growing Uniform staging to " << (unsigned long)grown << " bytes";
+                stage.bytes.resize(grown);
             }
+            stage.end = stage.bytes.size();
+            stage.used = 0;
+        }
+
+        // *****************
+        //  Uniform Methods
+        // *****************
 
-            void Uniform::clear() {
-                boost::lock_guard<boost::mutex> lock(_static_uniform_mutex_map[_name]);
-                clear(lock);
+        Uniform::Uniform(const std::string &name) : _name(name) {
+            boost::lock_guard<boost::mutex> lock(_static_uniforms_mutex);
+            _serial = ++_static_uniform_serial;
+            _static_uniforms.insert(this);
+        }
+
+        Uniform::~Uniform() {
+            boost::lock_guard<boost::mutex> lock(_static_uniforms_mutex);
+            _static_uniforms.erase(this);
+        }
+
+        void Uniform::stage(Type type, SWMsizei count, SWMsizei width, SWMsizei height, const void* data) {
+            UniformRecord record = { this, _serial, (uint8_t)type, 0, count, width, height,
+                                     (uint32_t)(count * width * height * sizeof(SWMfloat)) };
+            stageRecord(record, data);
+            _has_data = true;
+        }
+
+        void Uniform::setf (SWMsizei count, SWMsizei stride, const SWMfloat *data) {
+            stage(F, count, stride, 1, data);
+        }
+
+        void Uniform::seti (SWMsizei count, SWMsizei stride, const SWMint   *data) {
+            stage(I, count, stride, 1, data);
+        }
+
+        void Uniform::setui(SWMsizei count, SWMsizei stride, const SWMuint  *data) {
+            stage(UI, count, stride, 1, data);
+        }
+
+        void Uniform::setm (SWMsizei count, SWMsizei width, SWMsizei height, const SWMfloat *data) {
+            stage(M, count, width, height, data);
+        }
+
+        void Uniform::clear() {
+            UniformRecord record = { this, _serial, 0, 1, 0, 0, 0, 0 };
+            stageRecord(record, nullptr);
+            _has_data = false;
+        }
+
+        void Uniform::bind(const Renderer &render) {
+            if(!_value_set) return;
+            const Program* program = render.program();
+            if(program != _program) {
+                _location = program->uniform(_name);
+                _program = program;
             }
+            if(_location < 0) return;
 
-        void Uniform::clear(boost::lock_guard<boost::mutex>&) {
-            switch(type) {
-                case F:  delete data.f.data;  data.f.data = nullptr;  break;
-                case I:  delete data.i.data;  data.i.data = nullptr;  break;
-                case UI: delete data.ui.data; data.ui.data = nullptr; break;
-                case M:  delete data.m.data;  data.m.data = nullptr;  break;
+            Device &dev = device();
+            const SWMfloat* data = _value.data.data();
+            switch(_value.type) {
+                case F:  dev.uniformf (_location, _value.width, _value.count, data); break;
+                case I:  dev.uniformi (_location, _value.width, _value.count, reinterpret_cast<const SWMint*>(data));  break;
+                case UI: dev.uniformui(_location, _value.width, _value.count, reinterpret_cast<const SWMuint*>(data)); break;
+                case M:  dev.uniformMatrix(_location, _value.width, _value.height, _value.count, data); break;
                 default: break;
             }
-            _has_data = false;
+        }
+
+        size_t Uniform::writeStd140(uint8_t* target, size_t capacity) const {
+            if(!_value_set) return 0;
+
+            // std140 pads array elements and matrix columns out to 16 bytes; a lone vector is packed
+            bool matrix = _value.type == M;
+            size_t element_bytes = (size_t)(matrix ? _value.height : _value.width) * sizeof(SWMfloat);
+            size_t elements = (size_t)(matrix ? _value.count * _value.width : _value.count);
+            size_t stride = (elements > 1 || matrix) ? 16 : element_bytes;
+
+            size_t written = 0;
+            for(size_t i = 0; i < elements; i++) {
+                if(i * stride + element_bytes > capacity) break;
+                std::memcpy(target + i * stride, _value.data.data() + i * element_bytes / sizeof(SWMfloat), element_bytes);
+                written = i * stride + element_bytes;
+            }
+            return written;
+        }
+
+        // ****************
+        //  Uniform Blocks
+        // ****************
+
+        FrameArena _static_frame_arena;
+        SWMuint _static_uniform_block_buffer = 0;
+
+        void uploadUniformBlocks(const std::vector<const Renderer*> &renderers, const glm::mat4 &view, const glm::mat4 &projection) {
+            _static_frame_arena.reset();
+            for(const Renderer* renderer : renderers)
+                if(renderer != nullptr) static_cast<const RendererInternal*>(renderer)->fillUniformBlock(_static_frame_arena, view, projection);
+            if(_static_frame_arena.used() == 0) return;
+
+            // Every block shares one buffer, streamed in a single upload
+            Device &dev = device();
+            if(_static_uniform_block_buffer == 0) _static_uniform_block_buffer = dev.createBuffer();
+            dev.bindBuffer(GL_UNIFORM_BUFFER, _static_uniform_block_buffer);
+            dev.bufferStream(GL_UNIFORM_BUFFER, _static_frame_arena.used(), _static_frame_arena.data());
+        }
+
+        SWMuint uniformBlockBuffer() {
+            return _static_uniform_block_buffer;
+        }
+
+        void cleanupUniformBlocks() {
+            if(_static_uniform_block_buffer != 0) device().deleteBuffer(_static_uniform_block_buffer);
+            _static_uniform_block_buffer = 0;
         }
     }
-}
\ No newline at end of file
+}
@@ -1,6 +1,7 @@
 #include "RenderInternal.h"
 
 #include "api/Core.h"
+#include "core/CoreInternal.h"
 #include "api/Logging.h"
 #include "api/Exception.h"
 
@@ -26,6 +27,7 @@ namespace Swarm {
 
         void WindowInternal::cleanup() {
             for(auto && iter : _static_registered_windows) delete iter.second;
+            forgetVAOTable(_static_primary_context);
             glfwDestroyWindow(_static_primary_context);
         }
 
@@ -96,6 +98,7 @@ namespace Swarm {
             void operator()() {
                 try {
                     Log::log_render(DEBUG) << "Starting Render Thread";
+                    Util::FramePacer &frame_pacer = Core::pacer(Core::RENDER_LOOP);
                     while (_static_run_render_thread) {
 
 
@@ -121,6 +124,9 @@ namespace Swarm {
 
 
 
+                        // Apply Uniform values set since the last frame
+                        flushUniforms();
+
                         _static_window_context_mutex.lock();
                         for (WindowInternal *window : _static_visible_windows) {
 
@@ -128,8 +134,12 @@ namespace Swarm {
                             window->renderAll();
                         }
                         glfwMakeContextCurrent(nullptr);
+                        finishFrameStateStats();
                         _static_window_context_mutex.unlock();
 
+                        // Wait out the rest of the frame, rather than spinning on to the next
+                        frame_pacer.pace();
+
                         boost::this_thread::interruption_point();
                     }
                 } catch(std::exception &e) {
@@ -168,6 +178,7 @@ namespace Swarm {
         // ************************
 
         WindowInternal::~WindowInternal() {
+            forgetVAOTable(_window);
             glfwDestroyWindow(_window);
         }
 
@@ -194,6 +205,7 @@ namespace Swarm {
 
             // Bind the Context
             glfwMakeContextCurrent(_window);
+            invalidateStateCache();
 
             // GLEW initialization
             glewExperimental = GL_TRUE; // Needed for core profile
@@ -201,12 +213,13 @@ namespace Swarm {
             if( err != GLEW_OK ) throw Exception::WindowException::GlewInit(_name, std::string((const char*)glewGetErrorString(err)));
 
             // Set GL Flags
-            glEnable(GL_DEPTH_TEST);    // Enable depth test
-            glDepthFunc(GL_LESS);       // Accept fragment if it closer to the camera than the former one
-            glEnable(GL_CULL_FACE);     // Cull triangles which normal is not towards the camera
+            device().enable(GL_DEPTH_TEST, true);   // Enable depth test
+            glDepthFunc(GL_LESS);                   // Accept fragment if it closer to the camera than the former one
+            device().enable(GL_CULL_FACE, true);    // Cull triangles which normal is not towards the camera
 
             // Unbind the Context
             glfwMakeContextCurrent(_static_primary_context);
+            invalidateStateCache();
         }
 
         /*
@@ -253,20 +266,29 @@ namespace Swarm {
         void WindowInternal::renderAll() {
             std::set<RenderObjectCollection*> render_collection_cache;
 
-            // Make this Window's Context Current
+            // Make this Window's Context Current; it has its own state
             glfwMakeContextCurrent(_window);
+            invalidateStateCache();
 
             if(_queued_framebuffer_resize) {
-                glViewport(0, 0, _framebuffer_width, _framebuffer_height);
+                device().viewport(0, 0, _framebuffer_width, _framebuffer_height);
                 _queued_framebuffer_resize = false;
             }
 
-            glClearColor(_clear_color.r, _clear_color.g, _clear_color.b, _clear_color.a);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            device().clear(_clear_color.r, _clear_color.g, _clear_color.b, _clear_color.a);
 
             // Lock Anything Render Related
             boost::lock_guard<boost::mutex> lock(_render_mutex);
 
+            // Fill every frame uniform block, and upload them in one go
+            if(_camera != nullptr) {
+                std::vector<const Renderer*> renderers;
+                for(RenderAttachment render : _renderers)
+                    if(render.renderer != nullptr && std::find(renderers.begin(), renderers.end(), render.renderer) == renderers.end())
+                        renderers.push_back(render.renderer);
+                uploadUniformBlocks(renderers, _camera->viewMatrix(), _camera->projectionMatrix(_width, _height));
+            }
+
             for(RenderAttachment render : _renderers) {
                 if(render.renderer == nullptr || render.collection == nullptr) continue;
 
@@ -0,0 +1,142 @@
+#pragma once
+
+// *****************
+//  SIMD Intrinsics
+// *****************
+// AVX is only used when the compiler is told it may emit it (see SWARM_ENABLE_AVX in CMake);
+// otherwise SSE2 is used, which every x86-64 target has. Other targets fall back to scalar code.
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+
+
+// ************
+//  Code Begin
+// ************
+
+namespace Swarm {
+    namespace SIMD {
+
+        //! Packed float lanes of the widest width available to this build
+        /*!
+         * A thin wrapper around the native SIMD register type, so algorithms can be written once and compiled as
+         * 8-wide AVX, 4-wide SSE or scalar code. Loads and stores are unaligned.
+         */
+        struct vfloat {
+
+            #if defined(__AVX__)
+            static const size_t width = 8;
+            __m256 v;
+            vfloat() {}
+            vfloat(__m256 v) : v(v) {}
+            explicit vfloat(float s) : v(_mm256_set1_ps(s)) {}
+            static vfloat load(const float* ptr) { return vfloat(_mm256_loadu_ps(ptr)); }
+            void store(float* ptr) const { _mm256_storeu_ps(ptr, v); }
+            #elif defined(__SSE2__) || defined(_M_X64)
+            static const size_t width = 4;
+            __m128 v;
+            vfloat() {}
+            vfloat(__m128 v) : v(v) {}
+            explicit vfloat(float s) : v(_mm_set1_ps(s)) {}
+            static vfloat load(const float* ptr) { return vfloat(_mm_loadu_ps(ptr)); }
+            void store(float* ptr) const { _mm_storeu_ps(ptr, v); }
+            #else
+            static const size_t width = 1;
+            float v;
+            vfloat() {}
+            explicit vfloat(float s) : v(s) {}
+            static vfloat load(const float* ptr) { return vfloat(*ptr); }
+            void store(float* ptr) const { *ptr = v; }
+            #endif
+
+        };
+
+        #if defined(__AVX__)
+
+        inline vfloat operator+(vfloat a, vfloat b) { return _mm256_add_ps(a.v, b.v); }
+        inline vfloat operator-(vfloat a, vfloat b) { return _mm256_sub_ps(a.v, b.v); }
+        inline vfloat operator*(vfloat a, vfloat b) { return _mm256_mul_ps(a.v, b.v); }
+        inline vfloat operator/(vfloat a, vfloat b) { return _mm256_div_ps(a.v, b.v); }
+        inline vfloat operator&(vfloat a, vfloat b) { return _mm256_and_ps(a.v, b.v); }
+        inline vfloat operator|(vfloat a, vfloat b) { return _mm256_or_ps (a.v, b.v); }
+        inline vfloat operator<(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+        inline vfloat operator>(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+        inline vfloat min(vfloat a, vfloat b) { return _mm256_min_ps(a.v, b.v); }
+        inline vfloat max(vfloat a, vfloat b) { return _mm256_max_ps(a.v, b.v); }
+        inline vfloat sqrt(vfloat a) { return _mm256_sqrt_ps(a.v); }
+        inline vfloat abs(vfloat a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+        inline vfloat select(vfloat mask, vfloat a, vfloat b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+        inline int movemask(vfloat mask) { return _mm256_movemask_ps(mask.v); }
+
+        #elif defined(__SSE2__) || defined(_M_X64)
+
+        inline vfloat operator+(vfloat a, vfloat b) { return _mm_add_ps(a.v, b.v); }
+        inline vfloat operator-(vfloat a, vfloat b) { return _mm_sub_ps(a.v, b.v); }
+        inline vfloat operator*(vfloat a, vfloat b) { return _mm_mul_ps(a.v, b.v); }
+        inline vfloat operator/(vfloat a, vfloat b) { return _mm_div_ps(a.v, b.v); }
+        inline vfloat operator&(vfloat a, vfloat b) { return _mm_and_ps(a.v, b.v); }
+        inline vfloat operator|(vfloat a, vfloat b) { return _mm_or_ps (a.v, b.v); }
+        inline vfloat operator<(vfloat a, vfloat b) { return _mm_cmplt_ps(a.v, b.v); }
+        inline vfloat operator>(vfloat a, vfloat b) { return _mm_cmpgt_ps(a.v, b.v); }
+        inline vfloat min(vfloat a, vfloat b) { return _mm_min_ps(a.v, b.v); }
+        inline vfloat max(vfloat a, vfloat b) { return _mm_max_ps(a.v, b.v); }
+        inline vfloat sqrt(vfloat a) { return _mm_sqrt_ps(a.v); }
+        inline vfloat abs(vfloat a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+        inline vfloat select(vfloat mask, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+        inline int movemask(vfloat mask) { return _mm_movemask_ps(mask.v); }
+
+        #else
+
+        inline float maskBits(bool b) { float f; unsigned int u = b ? 0xFFFFFFFFu : 0u; std::memcpy(&f, &u, 4); return f; }
+        inline bool maskSet(float f) { unsigned int u; std::memcpy(&u, &f, 4); return u != 0; }
+
+        inline vfloat operator+(vfloat a, vfloat b) { return vfloat(a.v + b.v); }
+        inline vfloat operator-(vfloat a, vfloat b) { return vfloat(a.v - b.v); }
+        inline vfloat operator*(vfloat a, vfloat b) { return vfloat(a.v * b.v); }
+        inline vfloat operator/(vfloat a, vfloat b) { return vfloat(a.v / b.v); }
+        inline vfloat operator&(vfloat a, vfloat b) { return vfloat(maskBits(maskSet(a.v) && maskSet(b.v))); }
+        inline vfloat operator|(vfloat a, vfloat b) { return vfloat(maskBits(maskSet(a.v) || maskSet(b.v))); }
+        inline vfloat operator<(vfloat a, vfloat b) { return vfloat(maskBits(a.v < b.v)); }
+        inline vfloat operator>(vfloat a, vfloat b) { return vfloat(maskBits(a.v > b.v)); }
+        inline vfloat min(vfloat a, vfloat b) { return vfloat(a.v < b.v ? a.v : b.v); }
+        inline vfloat max(vfloat a, vfloat b) { return vfloat(a.v > b.v ? a.v : b.v); }
+        inline vfloat sqrt(vfloat a) { return vfloat(std::sqrt(a.v)); }
+        inline vfloat abs(vfloat a) { return vfloat(std::fabs(a.v)); }
+        inline vfloat select(vfloat mask, vfloat a, vfloat b) { return maskSet(mask.v) ? a : b; }
+        inline int movemask(vfloat mask) { return maskSet(mask.v) ? 1 : 0; }
+
+        #endif
+
+        inline vfloat operator-(vfloat a) { return vfloat(0.0f) - a; }
+
+        //! a * b + c; fused into one instruction when FMA is available
+        inline vfloat madd(vfloat a, vfloat b, vfloat c) {
+            #if defined(__FMA__) && defined(__AVX__)
+            return _mm256_fmadd_ps(a.v, b.v, c.v);
+            #else
+            return a * b + c;
+            #endif
+        }
+
+        //! Dot product of two 3-component vectors stored as separate lanes
+        inline vfloat dot3(vfloat ax, vfloat ay, vfloat az, vfloat bx, vfloat by, vfloat bz) {
+            return ax*bx + ay*by + az*bz;
+        }
+
+        //! Loads \ref vfloat::width values from scattered indices
+        inline vfloat gather(const float* base, const unsigned int* indices) {
+            float tmp[vfloat::width];
+            for(size_t i = 0; i < vfloat::width; i++) tmp[i] = base[indices[i]];
+            return vfloat::load(tmp);
+        }
+
+    }
+}
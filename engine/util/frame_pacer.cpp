@@ -0,0 +1,67 @@
+#include "api/Util.h"
+
+#include <cmath>
+
+namespace Swarm {
+    namespace Util {
+
+        // Weight of each new frame in the averages
+        const double STATS_WEIGHT = 0.05;
+
+        // Bounds, in seconds, of how early a wait wakes from sleeping to yield out the rest
+        const double MIN_SLEEP_MARGIN = 0.0002;
+        const double MAX_SLEEP_MARGIN = 0.02;
+
+        double seconds(std::chrono::steady_clock::duration duration) {
+            return std::chrono::duration<double>(duration).count();
+        }
+
+        FramePacer::FramePacer(double rate) : _rate(rate), _frame_start(Clock::now()), _deadline(_frame_start) { /* NOOP */ }
+
+        double FramePacer::pace() {
+            Clock::time_point now = Clock::now();
+            double busy = seconds(now - _frame_start);
+
+            double rate = _rate;
+            if(rate > 0.0) {
+                Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate));
+                _deadline += period;
+                if(_deadline + period < now) _deadline = now;
+
+                while(now < _deadline) {
+                    double remaining = seconds(_deadline - now);
+                    if(remaining > _sleep_margin) {
+
+                        // Wake a margin early; a sleep that still wakes late widens the margin, which then slowly narrows
+                        double requested = remaining - _sleep_margin;
+                        std::this_thread::sleep_for(std::chrono::duration<double>(requested));
+                        Clock::time_point woke = Clock::now();
+                        double late = seconds(woke - now) - requested;
+                        if(late > _sleep_margin) _sleep_margin = std::min(late * 1.25, MAX_SLEEP_MARGIN);
+                        else _sleep_margin = std::max(_sleep_margin * 0.99, MIN_SLEEP_MARGIN);
+                        now = woke;
+                    } else {
+                        std::this_thread::yield();
+                        now = Clock::now();
+                    }
+                }
+            }
+
+            double frame = seconds(now - _frame_start);
+            _frame_start = now;
+
+            // First frame seeds the averages
+            if(_frames == 0) {
+                _frame_ms = frame * 1000.0;
+                _utilization = frame > 0.0 ? std::min(busy / frame, 1.0) : 1.0;
+            } else {
+                double frame_ms = _frame_ms;
+                _jitter_ms = _jitter_ms + (std::fabs(frame * 1000.0 - frame_ms) - _jitter_ms) * STATS_WEIGHT;
+                _frame_ms = frame_ms + (frame * 1000.0 - frame_ms) * STATS_WEIGHT;
+                _utilization = _utilization + ((frame > 0.0 ? std::min(busy / frame, 1.0) : 1.0) - _utilization) * STATS_WEIGHT;
+            }
+            _frames++;
+            return frame;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,392 @@
+#define SWARM_BOOST_AVAILABLE
+#include "api/Util.h"
+
+#include "api/Logging.h"
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <memory>
+
+using namespace Swarm::Logging;
+
+namespace Swarm {
+    namespace Util {
+
+        struct Job {
+            std::function<void()> func;
+            JobCounter* counter;
+        };
+
+        // ***********************
+        //  Work-Stealing Deques
+        // ***********************
+
+        // Chase-Lev deque; the owning worker pushes and pops at the bottom, any other thread steals from the top.
+        // Rings only grow, and a replaced ring is kept until the deque goes, since a thief may still be reading it.
+        class WorkDeque {
+        public:
+            WorkDeque() : _ring(new Ring(256)) { _rings.emplace_back(_ring.load()); }
+
+            void push(Job* job) {
+                int64_t bottom = _bottom.load(std::memory_order_relaxed);
+                int64_t top = _top.load(std::memory_order_acquire);
+                Ring* ring = _ring.load(std::memory_order_relaxed);
+                if(bottom - top >= (int64_t)ring->size) {
+                    Ring* grown = new Ring(ring->size * 2);
+                    for(int64_t i = top; i < bottom; i++) grown->put(i, ring->get(i));
+                    _rings.emplace_back(grown);
+                    _ring.store(grown, std::memory_order_release);
+                    ring = grown;
+                }
+                ring->put(bottom, job);
+                _bottom.store(bottom + 1, std::memory_order_seq_cst);
+            }
+
+            Job* pop() {
+                int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+                Ring* ring = _ring.load(std::memory_order_relaxed);
+                _bottom.store(bottom, std::memory_order_seq_cst);
+                int64_t top = _top.load(std::memory_order_seq_cst);
+                if(top > bottom) {
+                    _bottom.store(bottom + 1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                Job* job = ring->get(bottom);
+                if(top == bottom) {
+
+                    // Last job; race any thief for it
+                    if(!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                        job = nullptr;
+                    _bottom.store(bottom + 1, std::memory_order_relaxed);
+                }
+                return job;
+            }
+
+            // Takes the oldest job; 'nullptr' when empty, or when another thread took it first
+            Job* steal() {
+                int64_t top = _top.load(std::memory_order_seq_cst);
+                int64_t bottom = _bottom.load(std::memory_order_seq_cst);
+                if(top >= bottom) return nullptr;
+                Job* job = _ring.load(std::memory_order_acquire)->get(top);
+                if(!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    return nullptr;
+                return job;
+            }
+
+            bool empty() const {
+                return _top.load(std::memory_order_relaxed) >= _bottom.load(std::memory_order_relaxed);
+            }
+
+        protected:
+            struct Ring {
+                size_t size;
+                std::unique_ptr<std::atomic<Job*>[]> slots;
+
+                Ring(size_t ring_size) : size(ring_size), slots(new std::atomic<Job*>[ring_size]) { /* NOOP */ }
+                Job* get(int64_t index) const { return slots[(size_t)index & (size - 1)].load(std::memory_order_relaxed); }
+                void put(int64_t index, Job* job) { slots[(size_t)index & (size - 1)].store(job, std::memory_order_relaxed); }
+            };
+
+            std::atomic<int64_t> _top{0};
+            std::atomic<int64_t> _bottom{0};
+            std::atomic<Ring*> _ring;
+            std::vector<std::unique_ptr<Ring>> _rings;
+        };
+
+        // *************
+        //  Job Workers
+        // *************
+
+        struct JobWorker {
+            WorkDeque deque;
+            boost::thread thread;
+        };
+
+        std::vector<std::unique_ptr<JobWorker>> _static_job_workers;
+        std::atomic<unsigned int> _static_job_worker_count(0);
+        std::atomic<bool> _static_jobs_running(false);
+        boost::thread::id _static_main_thread;
+
+        // Index of the calling thread's worker; -1 on any other thread
+        thread_local int _static_job_worker_index = -1;
+
+        // Jobs queued from threads that are not workers
+        boost::mutex _static_injected_mutex;
+        std::deque<Job*> _static_injected_jobs;
+        std::atomic<size_t> _static_injected_count(0);
+
+        boost::mutex _static_main_jobs_mutex;
+        std::vector<Job*> _static_main_jobs;
+
+        // Workers only sleep while nothing is queued anywhere
+        std::atomic<size_t> _static_queued_jobs(0);
+        std::atomic<unsigned int> _static_sleeping_workers(0);
+        boost::mutex _static_sleep_mutex;
+        boost::condition_variable _static_sleep_cond;
+
+        // Yields an idle worker spends looking for jobs before it sleeps
+        const unsigned int IDLE_SPINS = 64;
+
+        struct JobQueue {
+            static void add(JobCounter* counter) {
+                if(counter != nullptr) counter->_pending++;
+            }
+
+            // The count drops under the lock, and a waiter takes the lock before returning, so the counter is never
+            // touched here once it could be gone
+            static void finish(JobCounter* counter) {
+                if(counter == nullptr) return;
+                std::vector<std::function<void()>> after;
+                {
+                    std::lock_guard<std::mutex> lock(counter->_after_mutex);
+                    if(--counter->_pending == 0) after.swap(counter->_after);
+                }
+                for(std::function<void()> &queue : after) queue();
+            }
+
+            static bool defer(JobCounter &after, const std::function<void()> &queue) {
+                std::lock_guard<std::mutex> lock(after._after_mutex);
+                if(after._pending == 0) return false;
+                after._after.push_back(queue);
+                return true;
+            }
+        };
+
+        void queueJob(Job* job) {
+            int index = _static_job_worker_index;
+            if(index >= 0) _static_job_workers[index]->deque.push(job);
+            else {
+                boost::lock_guard<boost::mutex> lock(_static_injected_mutex);
+                _static_injected_jobs.push_back(job);
+                _static_injected_count++;
+            }
+            _static_queued_jobs++;
+            if(_static_sleeping_workers > 0) {
+                boost::lock_guard<boost::mutex> lock(_static_sleep_mutex);
+                _static_sleep_cond.notify_one();
+            }
+        }
+
+        Job* takeJob() {
+            int self = _static_job_worker_index;
+            Job* job = nullptr;
+            if(self >= 0) job = _static_job_workers[self]->deque.pop();
+
+            if(job == nullptr && _static_injected_count > 0) {
+                boost::lock_guard<boost::mutex> lock(_static_injected_mutex);
+                if(!_static_injected_jobs.empty()) {
+                    job = _static_injected_jobs.front();
+                    _static_injected_jobs.pop_front();
+                    _static_injected_count--;
+                }
+            }
+
+            // Steal, starting from a different victim each time so thieves spread out
+            unsigned int count = _static_job_worker_count;
+            if(job == nullptr && count > 0) {
+                static thread_local unsigned int victim = (unsigned int)(self + 1);
+                for(unsigned int attempt = 0; attempt < count * 2 && job == nullptr; attempt++) {
+                    unsigned int index = victim++ % count;
+                    if((int)index == self || _static_job_workers[index]->deque.empty()) continue;
+                    job = _static_job_workers[index]->deque.steal();
+                }
+            }
+
+            if(job != nullptr) _static_queued_jobs--;
+            return job;
+        }
+
+        // Takes a queued job that 'counter' counts, for a thread waiting on it. Only a worker's own deque and the shared
+        // queue are looked at, and only by workers; a waiter may hold locks, so it never picks up unrelated work.
+        Job* takeCountedJob(JobCounter* counter) {
+            int self = _static_job_worker_index;
+            if(self < 0) return nullptr;
+            WorkDeque &deque = _static_job_workers[self]->deque;
+            Job* job = deque.pop();
+            if(job != nullptr && job->counter != counter) {
+                deque.push(job);
+                job = nullptr;
+            }
+
+            if(job == nullptr && _static_injected_count > 0) {
+                boost::lock_guard<boost::mutex> lock(_static_injected_mutex);
+                std::deque<Job*>::iterator found = std::find_if(_static_injected_jobs.begin(), _static_injected_jobs.end(),
+                                                                [counter](Job* queued) { return queued->counter == counter; });
+                if(found != _static_injected_jobs.end()) {
+                    job = *found;
+                    _static_injected_jobs.erase(found);
+                    _static_injected_count--;
+                }
+            }
+
+            if(job != nullptr) _static_queued_jobs--;
+            return job;
+        }
+
+        void execute(Job* job) {
+            try {
+                job->func();
+            } catch(std::exception &e) {
+                Log::log_core(ERR) << "Job Failed: " << e.what();
+            }
+            JobQueue::finish(job->counter);
+            delete job;
+        }
+
+        void workJobs(int index) {
+            _static_job_worker_index = index;
+            while(true) {
+                Job* job = takeJob();
+                if(job != nullptr) {
+                    execute(job);
+                    continue;
+                }
+
+                // Look a little longer before sleeping, as jobs tend to come in bursts
+                for(unsigned int spin = 0; spin < IDLE_SPINS && _static_queued_jobs == 0; spin++) boost::this_thread::yield();
+                if(_static_queued_jobs > 0) continue;
+
+                boost::unique_lock<boost::mutex> lock(_static_sleep_mutex);
+                _static_sleeping_workers++;
+                while(_static_queued_jobs == 0 && _static_jobs_running) _static_sleep_cond.wait(lock);
+                _static_sleeping_workers--;
+                if(_static_queued_jobs == 0 && !_static_jobs_running) return;
+            }
+        }
+
+        void startJobs(unsigned int workers) {
+            if(_static_jobs_running) return;
+            if(workers == 0) {
+                unsigned int hardware = boost::thread::hardware_concurrency();
+                workers = hardware > 1 ? hardware - 1 : 1;
+            }
+            _static_main_thread = boost::this_thread::get_id();
+
+            // Every deque exists before any worker can steal from it
+            for(unsigned int i = 0; i < workers; i++) _static_job_workers.emplace_back(new JobWorker());
+            _static_job_worker_count = workers;
+            _static_jobs_running = true;
+            for(unsigned int i = 0; i < workers; i++) _static_job_workers[i]->thread = boost::thread(workJobs, (int)i);
+            Log::log_core(INFO) << "Started " << workers << " job workers";
+        }
+
+        void stopJobs() {
+            if(!_static_jobs_running) return;
+            {
+                boost::lock_guard<boost::mutex> lock(_static_sleep_mutex);
+                _static_jobs_running = false;
+            }
+            _static_sleep_cond.notify_all();
+            for(std::unique_ptr<JobWorker> &worker : _static_job_workers) worker->thread.join();
+            _static_job_worker_count = 0;
+            _static_job_workers.clear();
+        }
+
+        unsigned int jobWorkers() {
+            return _static_job_worker_count;
+        }
+
+        void runJob(const std::function<void()> &job, JobCounter* counter) {
+            JobQueue::add(counter);
+            queueJob(new Job{ job, counter });
+        }
+
+        void runJobAfter(JobCounter &after, const std::function<void()> &job, JobCounter* counter) {
+            JobQueue::add(counter);
+            Job* queued = new Job{ job, counter };
+            if(!JobQueue::defer(after, [queued]() { queueJob(queued); })) queueJob(queued);
+        }
+
+        void runMainThreadJob(const std::function<void()> &job, JobCounter* counter) {
+            JobQueue::add(counter);
+            boost::lock_guard<boost::mutex> lock(_static_main_jobs_mutex);
+            _static_main_jobs.push_back(new Job{ job, counter });
+        }
+
+        // Runs the main thread jobs that 'counter' counts, leaving the rest for runMainThreadJobs()
+        size_t runCountedMainThreadJobs(JobCounter* counter) {
+            std::vector<Job*> jobs;
+            {
+                boost::lock_guard<boost::mutex> lock(_static_main_jobs_mutex);
+                std::vector<Job*>::iterator kept = std::stable_partition(_static_main_jobs.begin(), _static_main_jobs.end(),
+                                                                         [counter](Job* job) { return job->counter != counter; });
+                jobs.assign(kept, _static_main_jobs.end());
+                _static_main_jobs.erase(kept, _static_main_jobs.end());
+            }
+            for(Job* job : jobs) execute(job);
+            return jobs.size();
+        }
+
+        size_t runMainThreadJobs() {
+            if(boost::this_thread::get_id() != _static_main_thread) return 0;
+            std::vector<Job*> jobs;
+            {
+                boost::lock_guard<boost::mutex> lock(_static_main_jobs_mutex);
+                jobs.swap(_static_main_jobs);
+            }
+            for(Job* job : jobs) execute(job);
+            return jobs.size();
+        }
+
+        void JobCounter::wait() {
+            bool main_thread = boost::this_thread::get_id() == _static_main_thread;
+            while(_pending != 0) {
+                Job* job = takeCountedJob(this);
+                if(job != nullptr) execute(job);
+                else if(!main_thread || runCountedMainThreadJobs(this) == 0) boost::this_thread::yield();
+            }
+            std::lock_guard<std::mutex> lock(_after_mutex);
+        }
+
+        void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &func, unsigned int max_threads) {
+            unsigned int threads = _static_job_worker_count + 1;
+            if(max_threads > 0) threads = std::min(threads, max_threads);
+            if(grain == 0) grain = std::max(count / (threads * 4), (size_t)1);
+            size_t ranges = (count + grain - 1) / grain;
+            if(threads < 2 || ranges < 2) {
+                if(count > 0) func(0, count);
+                return;
+            }
+
+            // Every thread takes ranges until none are left. Helpers that start late find none and touch nothing else,
+            // so the caller only waits for ranges still running, and never for helpers, or other jobs, to be picked up.
+            // A range that throws still counts as done; the first exception is kept for the caller to rethrow.
+            struct Ranges {
+                const std::function<void(size_t, size_t)>* func;
+                size_t count, grain, total;
+                std::atomic<size_t> next{0};
+                std::atomic<size_t> done{0};
+                std::mutex error_mutex;
+                std::exception_ptr error;
+
+                void take() {
+                    for(size_t range = next++; range < total; range = next++) {
+                        try {
+                            (*func)(range * grain, std::min(count, (range + 1) * grain));
+                        } catch(...) {
+                            std::lock_guard<std::mutex> lock(error_mutex);
+                            if(!error) error = std::current_exception();
+                        }
+                        done++;
+                    }
+                }
+            };
+            std::shared_ptr<Ranges> shared = std::make_shared<Ranges>();
+            shared->func = &func;
+            shared->count = count;
+            shared->grain = grain;
+            shared->total = ranges;
+            size_t helpers = std::min((size_t)threads - 1, ranges - 1);
+            for(size_t i = 0; i < helpers; i++) runJob([shared]() { shared->take(); });
+            shared->take();
+
+            // Every range has been handed out; the caller may hold locks, so it only yields while the last ones finish
+            while(shared->done < ranges) boost::this_thread::yield();
+            if(shared->error) std::rethrow_exception(shared->error);
+        }
+
+    }
+}
\ No newline at end of file
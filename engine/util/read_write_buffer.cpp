@@ -1,57 +1,30 @@
 #define SWARM_BOOST_AVAILABLE
 #include "api/Util.h"
 
-#include <cstring>
-
-#include <unordered_map>
-
 namespace Swarm {
     namespace Util {
 
-        // Static Mutex maps because can't put them in the Header definition; keeping 3rd party libraries out of headers
-        std::unordered_map<size_t, boost::shared_mutex> _static_buffer_mutex_read;
-        std::unordered_map<size_t, boost::mutex> _static_buffer_mutex_write;
+        // Readers take no lock at all
+        struct ReadWriteBufferBase::WriteLock {
+            boost::mutex mutex;
+        };
 
-        UIDPool _static_buffer_id_pool;
-
-        ReadWriteBufferBase::ReadWriteBufferBase() {
-            _uid = _static_buffer_id_pool.next();
-        }
+        ReadWriteBufferBase::ReadWriteBufferBase() : _write_lock(new WriteLock()) { /* NOOP */ }
 
         ReadWriteBufferBase::~ReadWriteBufferBase() {
-            _static_buffer_id_pool.free(_uid);
+            delete _write_lock;
         }
 
         void ReadWriteBufferBase::lock() {
-            _static_buffer_mutex_write[_uid].lock();
+            _write_lock->mutex.lock();
         }
 
         void ReadWriteBufferBase::unlock() {
-            _static_buffer_mutex_write[_uid].unlock();
-        }
-
-        void ReadWriteBufferBase::lock_shared() {
-            _static_buffer_mutex_read[_uid].lock_shared();
-        }
-
-        void ReadWriteBufferBase::unlock_shared() {
-            _static_buffer_mutex_read[_uid].unlock_shared();
-        }
-
-        void ReadWriteBufferBase::lock_shared_explicit() {
-            _static_buffer_mutex_read[_uid].lock();
-        }
-
-        void ReadWriteBufferBase::unlock_shared_explicit() {
-            _static_buffer_mutex_read[_uid].unlock();
+            _write_lock->mutex.unlock();
         }
 
         boost::mutex& ReadWriteBufferBase::write_mutex() const {
-            return _static_buffer_mutex_write[_uid];
-        }
-
-        boost::shared_mutex& ReadWriteBufferBase::read_mutex() const {
-            return _static_buffer_mutex_read[_uid];
+            return _write_lock->mutex;
         }
 
     }
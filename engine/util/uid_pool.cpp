@@ -1,31 +1,108 @@
 #include "api/Util.h"
 
-#include <stdio.h>
-
 namespace Swarm {
     namespace Util {
 
+        struct UIDPool::Slot {
+            std::atomic<uint32_t> generation{0}; // Of the live ID using this slot, or of the next one while free
+            std::atomic<uint32_t> next_free{0};
+        };
+
+        // Segment holding slot 'index', and where in it
+        void locate(size_t index, size_t &segment, size_t &offset) {
+            uint64_t blocks = index / 64 + 1;
+            #if defined(__GNUC__)
+            segment = 63 - (size_t)__builtin_clzll(blocks);
+            #else
+            segment = 0;
+            while(blocks >> (segment + 1)) segment++;
+            #endif
+            offset = index - (((size_t)1 << segment) - 1) * 64;
+        }
+
+        // Generations skip '0', so no ID is ever '0'
+        uint32_t nextGeneration(uint32_t generation) {
+            return generation == 0xFFFFFFFF ? 1 : generation + 1;
+        }
+
+        UIDPool::UIDPool() : _free_head(NO_SLOT) {
+            for(size_t i = 0; i < SEGMENTS; i++) _segments[i] = nullptr;
+        }
+
+        UIDPool::~UIDPool() {
+            for(size_t i = 0; i < SEGMENTS; i++) delete [] _segments[i].load();
+        }
+
+        UIDPool::Slot* UIDPool::slot(uint32_t index) const {
+            size_t segment, offset;
+            locate(index, segment, offset);
+            Slot* slots = _segments[segment];
+            return slots == nullptr ? nullptr : &slots[offset];
+        }
+
         size_t UIDPool::next() {
-            if(_free_ids.empty()) return _next++;
-            else {
-                size_t id = *_free_ids.begin();
-                if(id < _next) {
-                    _free_ids.erase(_free_ids.begin());
-                    return id;
-                } else if(id == _next) {
-                    _free_ids.erase(_free_ids.begin());
-                    return _next++;
-                } else return _next++;
+
+            // Pop a free slot; slots are never deallocated, so reading one just popped by another thread is harmless,
+            // and the change count makes that pop fail
+            uint64_t head = _free_head.load(std::memory_order_acquire);
+            while((uint32_t)head != NO_SLOT) {
+                Slot* free_slot = slot((uint32_t)head);
+                uint64_t popped = ((head >> 32) + 1) << 32 | free_slot->next_free.load(std::memory_order_relaxed);
+                if(_free_head.compare_exchange_weak(head, popped, std::memory_order_acquire))
+                    return (size_t)free_slot->generation.load(std::memory_order_relaxed) << 32 | (uint32_t)head;
             }
+
+            // Otherwise a new slot, allocating its segment if this is the first slot in it
+            size_t index = _next.fetch_add(1, std::memory_order_relaxed);
+            size_t segment, offset;
+            locate(index, segment, offset);
+            Slot* slots = _segments[segment];
+            if(slots == nullptr) {
+                Slot* created = new Slot[(size_t)64 << segment];
+                if(_segments[segment].compare_exchange_strong(slots, created)) slots = created;
+                else delete [] created;
+            }
+            slots[offset].generation.store(1, std::memory_order_relaxed);
+            return (size_t)1 << 32 | index;
+        }
+
+        bool UIDPool::free(size_t id) {
+            uint32_t position = (uint32_t)index(id);
+            if(position >= _next.load(std::memory_order_relaxed)) return false;
+            Slot* freed = slot(position);
+            if(freed == nullptr) return false;
+
+            // Only one free of a live ID can bump its generation
+            uint32_t generation = (uint32_t)(id >> 32);
+            if(generation == 0 || !freed->generation.compare_exchange_strong(generation, nextGeneration(generation),
+                                                                             std::memory_order_relaxed)) return false;
+
+            // Publishing the slot on the list publishes its link and generation with it
+            uint64_t head = _free_head.load(std::memory_order_relaxed);
+            do {
+                freed->next_free.store((uint32_t)head, std::memory_order_relaxed);
+            } while(!_free_head.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | position, std::memory_order_release,
+                                                      std::memory_order_relaxed));
+            return true;
         }
 
-        void UIDPool::free(size_t id) {
-            _free_ids.insert(id);
+        bool UIDPool::valid(size_t id) const {
+            uint32_t position = (uint32_t)index(id);
+            if(position >= _next.load(std::memory_order_relaxed) || (id >> 32) == 0) return false;
+            Slot* live = slot(position);
+            return live != nullptr && live->generation.load(std::memory_order_acquire) == (uint32_t)(id >> 32);
         }
 
         void UIDPool::freeAll() {
-            _next = 0;
-            _free_ids.clear();
+
+            // Every slot becomes free, first to last, and every ID handed out so far stale
+            size_t count = _next;
+            for(size_t i = count; i-- > 0;) {
+                Slot* freed = slot((uint32_t)i);
+                freed->generation = nextGeneration(freed->generation);
+                freed->next_free = i + 1 < count ? (uint32_t)(i + 1) : NO_SLOT;
+            }
+            _free_head = ((_free_head >> 32) + 1) << 32 | (count > 0 ? 0 : NO_SLOT);
         }
     }
 }
\ No newline at end of file
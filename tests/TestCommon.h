@@ -0,0 +1,48 @@
+#pragma once
+
+// Helpers shared by the test programs; each test includes this after its engine headers. Model helpers need the
+// render library, so only tests that define SWARM_TEST_INCLUDE_MODELS first get them.
+
+#include <chrono>
+#include <vector>
+
+#if defined(SWARM_TEST_INCLUDE_MODELS)
+#include "api/Render.h"
+#endif
+
+
+
+// Milliseconds since 'start'
+inline double elapsed(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+#if defined(SWARM_TEST_INCLUDE_MODELS)
+
+// Builds a flat, UV-mapped grid of (size x size) quads, with upward normals if 'normals' is set
+inline Swarm::Model::RawModelDataIndexed createGrid(unsigned int size, bool normals = false) {
+    std::vector<float> vertices, uvs, normal_data;
+    std::vector<unsigned int> indices;
+    for(unsigned int y = 0; y <= size; y++) {
+        for(unsigned int x = 0; x <= size; x++) {
+            vertices.push_back((float)x); vertices.push_back(0.0f); vertices.push_back((float)y);
+            uvs.push_back((float)x / size); uvs.push_back((float)y / size);
+            if(normals) { normal_data.push_back(0.0f); normal_data.push_back(1.0f); normal_data.push_back(0.0f); }
+        }
+    }
+    for(unsigned int y = 0; y < size; y++) {
+        for(unsigned int x = 0; x < size; x++) {
+            unsigned int i = y * (size+1) + x;
+            unsigned int quad[]{ i, i+size+1, i+size+2, i, i+size+2, i+1 };
+            indices.insert(indices.end(), quad, quad+6);
+        }
+    }
+    Swarm::Model::RawModelDataIndexed grid;
+    grid.put(Swarm::Model::Type::VERTEX, vertices.data(), vertices.size() / 3);
+    grid.put(Swarm::Model::Type::UV,     uvs.data(),      uvs.size() / 2);
+    if(normals) grid.put(Swarm::Model::Type::NORMAL, normal_data.data(), normal_data.size() / 3);
+    grid.putIndices(indices.data(), indices.size());
+    return grid;
+}
+
+#endif
@@ -0,0 +1,208 @@
+#include "api/Asset.h"
+#include "api/Core.h"
+#include "api/Logging.h"
+
+#include "../TestCommon.h"
+
+#include <lodepng.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Swarm;
+
+using namespace Swarm::Logging;
+
+// Asset files are generated rather than shipped, so every one is distinct and the test needs no GL context
+
+std::vector<std::string> createTextures(size_t count, unsigned int size) {
+    std::vector<std::string> paths;
+    std::mt19937 random(1);
+    for(size_t i = 0; i < count; i++) {
+        std::vector<unsigned char> pixels(size * size * 4);
+        for(size_t p = 0; p < pixels.size(); p++) pixels[p] = (unsigned char)(random() & 0xFF);
+        std::string path = "asset_test_texture_" + std::to_string(i) + ".png";
+        lodepng::encode(path, pixels, size, size);
+        paths.push_back(path);
+    }
+    return paths;
+}
+
+std::vector<std::string> createModels(size_t count, unsigned int size) {
+    std::vector<std::string> paths;
+    for(size_t i = 0; i < count; i++) {
+        std::string path = "asset_test_model_" + std::to_string(i) + ".obj";
+        std::ofstream file(path);
+        file.setf(std::ios::fixed);
+        for(unsigned int y = 0; y <= size; y++)
+            for(unsigned int x = 0; x <= size; x++)
+                file << "v " << (float)x << " " << (float)((x * 7 + y * 13) % 5) * 0.1f + (float)i << " " << (float)y << "\n";
+        for(unsigned int y = 0; y <= size; y++)
+            for(unsigned int x = 0; x <= size; x++)
+                file << "vt " << (float)x / size << " " << (float)y / size << "\n";
+        file << "vn 0.0 1.0 0.0\n";
+        for(unsigned int y = 0; y < size; y++) {
+            for(unsigned int x = 0; x < size; x++) {
+                unsigned int a = y * (size+1) + x + 1, b = a + 1, c = a + size + 1, d = c + 1;
+                file << "f " << a << "/" << a << "/1 " << c << "/" << c << "/1 " << d << "/" << d << "/1 " << b << "/" << b << "/1\n";
+            }
+        }
+        paths.push_back(path);
+    }
+    return paths;
+}
+
+int main() {
+
+    if(!Core::init(SWM_INIT_MINIMAL)) {
+        return -1;
+    }
+
+    const size_t count = 16;
+    std::vector<std::string> texture_paths = createTextures(count, 512);
+    std::vector<std::string> model_paths = createModels(count, 96);
+    bool success = true;
+
+    // Serial; the same CPU stages, run one after another on this thread
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<Texture::RawTextureData> serial_textures;
+    std::vector<Model::RawModelDataIndexed> serial_models;
+    for(const std::string &path : texture_paths) serial_textures.push_back(Texture::decodeTexFromFile(path, Texture::PNG));
+    for(const std::string &path : model_paths) {
+        serial_models.push_back(Model::loadFromOBJ(path.c_str()).index());
+        Model::optimize(serial_models.back());
+    }
+    double serial_ms = elapsed(start);
+
+    // Worker Pool
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<Asset::TextureHandle> textures;
+    std::vector<Asset::ModelHandle> models;
+    for(const std::string &path : texture_paths) textures.push_back(Asset::loadTexture(path));
+    for(const std::string &path : model_paths) models.push_back(Asset::loadModel(path));
+    Asset::waitAll();
+    double async_ms = elapsed(start);
+
+    // Without a GL thread, everything should be decoded and waiting for upload
+    for(size_t i = 0; i < count; i++) {
+        std::shared_ptr<const Texture::RawTextureData> pixels = textures[i].data();
+        std::shared_ptr<const Model::RawModelDataIndexed> mesh = models[i].data();
+        if(textures[i].state() != Asset::UPLOADING || !pixels || pixels->pixels != serial_textures[i].pixels) {
+            Log::log_asset(ERR) << "Texture mismatch: " << textures[i].path() << " " << textures[i].error();
+            success = false;
+        }
+        if(models[i].state() != Asset::UPLOADING || !mesh || mesh->indexSize() != serial_models[i].indexSize()
+           || mesh->size() != serial_models[i].size()) {
+            Log::log_asset(ERR) << "Model mismatch: " << models[i].path() << " " << models[i].error();
+            success = false;
+        }
+    }
+    if(Asset::pendingUploads() != count * 2) success = false;
+
+    // Failures are reported through the handle rather than thrown
+    Asset::TextureHandle missing = Asset::loadTexture("asset_test_missing.png");
+    missing.wait();
+    if(!missing.failed() || missing.error().empty()) success = false;
+
+    // Cache; loading a cached path again hands out the same asset
+    Asset::resetCacheStats();
+    for(size_t i = 0; i < count; i++) {
+        if(Asset::loadTexture(texture_paths[i]) != textures[i]) success = false;
+        if(Asset::loadModel(model_paths[i]) != models[i]) success = false;
+    }
+    if(Asset::cacheStats().hits != count * 2 || Asset::cacheStats().misses != 0) success = false;
+
+    // A copy of a file under another path is recognized by its content, and shares the original's data
+    std::string copy_path = "asset_test_texture_copy.png";
+    {
+        std::ifstream source(texture_paths[0], std::ios::binary);
+        std::ofstream copy(copy_path, std::ios::binary);
+        copy << source.rdbuf();
+    }
+    Asset::TextureHandle copy = Asset::loadTexture(copy_path);
+    copy.wait();
+    std::shared_ptr<const Texture::RawTextureData> copy_pixels = copy.data();
+    if(copy.state() != Asset::UPLOADING || !copy_pixels || copy_pixels->pixels != serial_textures[0].pixels
+       || Asset::cacheStats().content_hits != 1 || textures[0].references() != 2) {
+        Log::log_asset(ERR) << "Copied texture was not shared: " << copy.error();
+        success = false;
+    }
+    if(Asset::pendingUploads() != count * 2) success = false;
+
+    // Data handed out by a Handle outlives the upload that releases it; uploads go to a RecordingDevice, so no GL
+    // context is needed
+    Render::RecordingDevice* recorder = Render::RecordingDevice::create();
+    Render::setDevice(recorder);
+    std::shared_ptr<const Texture::RawTextureData> uploaded_pixels = textures[0].data();
+    std::shared_ptr<const Model::RawModelDataIndexed> uploaded_mesh = models[0].data();
+    Asset::processUploads((size_t)-1);
+    if(textures[0].state() != Asset::READY || textures[0].data() || models[0].state() != Asset::READY || models[0].data()
+       || uploaded_pixels->pixels != serial_textures[0].pixels || uploaded_mesh->indexSize() != serial_models[0].indexSize()) {
+        Log::log_asset(ERR) << "Uploaded data was not released, or its snapshot did not survive the upload";
+        success = false;
+    }
+    if(Asset::pendingUploads() != 0) success = false;
+
+    // The batch is fenced once, after its last upload, so other contexts only see it once it has finished
+    std::vector<Render::DeviceCommand> upload_commands = recorder->commands();
+    size_t fences = 0;
+    for(const Render::DeviceCommand &command : upload_commands) if(command.type == Render::CMD_FENCE_SYNC) fences++;
+    if(fences != 1 || upload_commands.empty() || upload_commands.back().type != Render::CMD_FENCE_SYNC) {
+        Log::log_asset(ERR) << "Uploads were fenced " << (unsigned long)fences << " times, not once after the batch";
+        success = false;
+    }
+
+    // Failed loads are not cached, so they are retried
+    Asset::TextureHandle retry = Asset::loadTexture("asset_test_missing.png");
+    if(retry == missing) success = false;
+    Asset::waitAll();
+
+    // Eviction; nothing is evicted while referenced, by a Handle or by a Texture or Model taken from one, and
+    // everything decoded is once those are gone
+    Asset::CacheStats before = Asset::cacheStats();
+    Asset::setCacheBudget(0);
+    if(Asset::cacheStats().evictions != 0) success = false;
+    Texture::Texture kept_texture;
+    kept_texture.put(0, textures[0].texture());
+    Model::Model kept_model = models[0].model();
+    textures.clear();
+    models.clear();
+    copy = Asset::TextureHandle();
+    missing = Asset::TextureHandle();
+    retry = Asset::TextureHandle();
+    Asset::setCacheBudget(0);
+    Asset::processUploads(0);
+    Asset::CacheStats after = Asset::cacheStats();
+    if(after.entries != 2 || after.evictions < count * 2 - 2) {
+        Log::log_asset(ERR) << "Eviction left " << (unsigned long)after.entries << " assets, not the 2 still drawn";
+        success = false;
+    }
+    kept_texture = Texture::Texture();
+    kept_model = Model::Model();
+    Asset::setCacheBudget(0);
+    if(Asset::cacheStats().bytes != 0) success = false;
+    Asset::trimCache();
+    if(Asset::cacheStats().entries != 0) success = false;
+    Asset::setCacheBudget(256 * 1024 * 1024);
+
+    Log::log_asset(INFO) << "Cache held " << (unsigned long)before.entries << " assets in " << before.bytes / 1024
+                         << "KiB; " << (unsigned long)before.hits << " hits, " << (unsigned long)before.content_hits
+                         << " content hits, " << (unsigned long)before.misses << " misses; "
+                         << (unsigned long)Asset::cacheStats().evictions << " evicted";
+
+    Log::log_asset(INFO) << "Loaded " << (unsigned long)count << " textures and " << (unsigned long)count
+                         << " models: serial " << serial_ms << "ms, worker pool " << async_ms << "ms ("
+                         << serial_ms / async_ms << "x)" << (success ? "" : " (FAILED)");
+
+    for(const std::string &path : texture_paths) std::remove(path.c_str());
+    for(const std::string &path : model_paths) std::remove(path.c_str());
+    std::remove(copy_path.c_str());
+
+    Core::cleanup();
+    return success ? 0 : 1;
+}
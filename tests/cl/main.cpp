@@ -1,6 +1,11 @@
 #include "api/Core.h"
 #include "api/Logging.h"
 #include "api/CLEngine.h"
+#include "api/Exception.h"
+
+#include <chrono>
+#include <cmath>
+#include <vector>
 
 using namespace Swarm;
 using namespace Swarm::Logging;
@@ -75,7 +80,138 @@ __kernel void SAXPY (__global float* x, __global float* y, float a)
     for(int i = 0; i < testDataSize; i++)
         Log::log_core << "\t" << b[i] << "\n";
 
+    bool success = true;
+    for(int i = 0; i < testDataSize; i++) {
+        if(b[i] != static_cast<float>(42 ^ i) + 2.0f * static_cast<float>(23 ^ i)) {
+            Log::log_cl(ERR) << "SAXPY result " << i << " is " << b[i];
+            success = false;
+            break;
+        }
+    }
+
+    // Commands wait only for the events they are given; on an out-of-order queue, both writes may run at once
+    CL::CommandQueue async_queue(context, device, CL::QUEUE_OUT_OF_ORDER | CL::QUEUE_PROFILING);
+    Log::log_cl(INFO) << "Queue is " << (async_queue.properties() & CL::QUEUE_OUT_OF_ORDER ? "out of order" : "in order");
+    {
+        std::vector<float> x(testDataSize), y(testDataSize), result(testDataSize);
+        for(int i = 0; i < testDataSize; i++) { x[i] = (float)i; y[i] = 1.0f; }
+        CL::Buffer<float> buff_x(context, true, false, testDataSize);
+        CL::Buffer<float> buff_y(context, true, true, testDataSize);
+        CL::Event wrote_x = async_queue.enqueueWrite(buff_x, 0, testDataSize, x.data(), false);
+        CL::Event wrote_y = async_queue.enqueueWrite(buff_y, 0, testDataSize, y.data(), false);
+        kernel.argument(0, buff_x);
+        kernel.argument(1, buff_y);
+        kernel.argument(2, 1, &two);
+        CL::Event ran = async_queue.enqueueKernel(kernel, CL::NDRange(testDataSize), CL::NDRange(64), { wrote_x, wrote_y });
+        CL::Event read = async_queue.enqueueRead(buff_y, 0, testDataSize, result.data(), false, { ran });
+        read.wait();
+        if(!ran.complete() || !wrote_x.complete() || !wrote_y.complete()) {
+            Log::log_cl(ERR) << "Commands a finished read waited for are not complete";
+            success = false;
+        }
+        for(int i = 0; i < testDataSize; i++) {
+            if(result[i] != 1.0f + 2.0f * i) {
+                Log::log_cl(ERR) << "Event ordered SAXPY result " << i << " is " << result[i];
+                success = false;
+                break;
+            }
+        }
+        Log::log_cl(INFO) << "SAXPY kernel ran for " << (unsigned long)ran.duration() << "ns";
+
+        // A barrier holds every later command until the ones before it finish, whatever they wait for
+        for(int i = 0; i < testDataSize; i++) y[i] = 0.0f;
+        async_queue.enqueueWrite(buff_y, 0, testDataSize, y.data(), false);
+        async_queue.enqueueBarrier();
+        async_queue.enqueueKernel(kernel, CL::NDRange(testDataSize));
+        async_queue.enqueueBarrier();
+        async_queue.enqueueRead(buff_y, 0, testDataSize, result.data(), true);
+        if(result[testDataSize - 1] != 2.0f * (testDataSize - 1)) {
+            Log::log_cl(ERR) << "Barriers did not order the commands between them";
+            success = false;
+        }
+    }
+
+    // Mapped buffers are written in place by the host, then handed back to the device for a kernel
+    {
+        CL::MappedBuffer<float> mapped_x(context, true, true, testDataSize);
+        CL::MappedBuffer<float> mapped_y(context, true, true, testDataSize);
+        CL::Event map_x, map_y;
+        float* x = async_queue.enqueueMap(mapped_x, false, true, false, {}, &map_x);
+        float* y = async_queue.enqueueMap(mapped_y, false, true, false, {}, &map_y);
+        CL::Event::waitAll({ map_x, map_y });
+        for(int i = 0; i < testDataSize; i++) { x[i] = 1.0f; y[i] = (float)i; }
+        CL::Event unmap_x = async_queue.enqueueUnmap(mapped_x, x);
+        CL::Event unmap_y = async_queue.enqueueUnmap(mapped_y, y);
+        kernel.argument(0, mapped_x);
+        kernel.argument(1, mapped_y);
+        CL::Event ran = async_queue.enqueueKernel(kernel, CL::NDRange(testDataSize), CL::NDRange(), { unmap_x, unmap_y });
+        y = async_queue.enqueueMap(mapped_y, true, false, true, { ran });
+        if(y[10] != 12.0f) {
+            Log::log_cl(ERR) << "Mapped SAXPY result is " << y[10] << ", expected 12";
+            success = false;
+        }
+        async_queue.enqueueUnmap(mapped_y, y);
+        async_queue.finish();
+    }
+
+    // A work group size that does not divide the work size is refused when enqueued
+    try {
+        async_queue.enqueueKernel(kernel, CL::NDRange(testDataSize), CL::NDRange(testDataSize - 1));
+        Log::log_cl(ERR) << "Uneven work groups were enqueued";
+        success = false;
+    } catch(Exception::CLCommandException &e) {
+        Log::log_cl(DEBUG) << "Refused as expected: " << e.what();
+    }
+
+    // Streamed in double-buffered chunks, the result matches a single write, run and read; and takes less time when
+    // transfers overlap the kernels
+    {
+        const char *square_src = R"(
+__kernel void Square (__global const float* in, __global float* out, const uint count)
+{
+    const uint i = get_global_id(0);
+
+    if(i < count) out[i] = in[i] * in[i];
+}
+)";
+        CL::Program square_program(std::string(square_src), context);
+        CL::Kernel square = square_program.kernel("Square");
+
+        const size_t stream_size = (1 << 20) + 123, chunk = 1 << 16;
+        std::vector<float> input(stream_size), serial(stream_size), streamed(stream_size);
+        for(size_t i = 0; i < stream_size; i++) input[i] = (float)(i % 1000) * 0.5f;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        CL::Buffer<float> whole_in(context, true, false, stream_size);
+        CL::Buffer<float> whole_out(context, false, true, stream_size);
+        unsigned int count = (unsigned int)stream_size;
+        square.argument(0, whole_in);
+        square.argument(1, whole_out);
+        square.argument(2, 1, &count);
+        async_queue.enqueueWrite(whole_in, 0, stream_size, input.data(), true);
+        async_queue.enqueueKernel(square, CL::NDRange(stream_size)).wait();
+        async_queue.enqueueRead(whole_out, 0, stream_size, serial.data(), true);
+        double serial_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        CL::StreamPipeline<float, float> pipeline(context, async_queue, square, chunk);
+        pipeline.run(input.data(), streamed.data(), stream_size).wait();
+        double streamed_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        for(size_t i = 0; i < stream_size; i++) {
+            if(streamed[i] != input[i] * input[i] || serial[i] != streamed[i]) {
+                Log::log_cl(ERR) << "Streamed result " << (unsigned long)i << " is " << streamed[i] << ", expected " << input[i] * input[i];
+                success = false;
+                break;
+            }
+        }
+        Log::log_cl(INFO) << "Squared " << (unsigned long)stream_size << " floats in " << serial_ms << "ms at once, "
+                          << streamed_ms << "ms streamed in chunks of " << (unsigned long)chunk;
+    }
+
+    Log::log_cl(INFO) << "CL test " << (success ? "passed" : "FAILED");
+
     // Cleanup Everything Up When Done
     Core::cleanup();
-
-}
\ No newline at end of file
+    return success ? 0 : 1;
+}
@@ -3,16 +3,239 @@
 #include "api/Logging.h"
 #include "api/Render.h"
 
+#define SWARM_TEST_INCLUDE_MODELS
+#include "../TestCommon.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <random>
+#include <vector>
 
 using namespace Swarm;
 
 using namespace Swarm::Logging;
 
+// Times tangent generation on grids of increasing size; the grid's UVs follow x and z, so every data point should get
+// a tangent of (1,0,0) and a bitangent of (0,0,1)
+bool benchmarkTangents() {
+    bool success = true;
+    unsigned int sizes[]{ 64, 256, 1024 };
+    for(unsigned int size : sizes) {
+        Model::RawModelDataIndexed grid = createGrid(size, true);
+        size_t triangles = grid.indexSize() / 3;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        bool size_success = Model::computeTangents(grid);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        if(size_success) {
+            Model::VecArray &tangents = grid[Model::Type::TANGENT];
+            Model::VecArray &bitangents = grid[Model::Type::BITANGENT];
+            for(size_t i = 0; i < grid.size() && size_success; i++) {
+                glm::vec3 tangent = tangents[i].val.v3.vec();
+                glm::vec3 bitangent = bitangents[i].val.v3.vec();
+                if(glm::length(tangent - glm::vec3(1.0f, 0.0f, 0.0f)) > 1e-4f
+                   || glm::length(bitangent - glm::vec3(0.0f, 0.0f, 1.0f)) > 1e-4f) {
+                    Log::log_core(ERR) << "Tangents [" << (unsigned long)triangles << " triangles]: data point "
+                                       << (unsigned long)i << " has tangent" << tangent << ", bitangent" << bitangent;
+                    size_success = false;
+                }
+            }
+        }
+
+        Log::log_core(INFO) << "Tangents [" << (unsigned long)triangles << " triangles]: " << ms << "ms, "
+                            << (triangles / ms / 1000.0) << "M triangles/s" << (size_success ? "" : " (FAILED)");
+        success = success && size_success;
+    }
+    return success;
+}
+
+// Lists each triangle by the positions of its corners, starting from its smallest corner so winding is kept, sorted;
+// equal lists mean the same triangles are drawn, however they and their data points are ordered
+std::vector<std::array<float, 9>> triangleCorners(Model::RawModelDataIndexed &data) {
+    Model::VecArray &vertices = data[Model::Type::VERTEX];
+    std::vector<std::array<float, 9>> corners(data.indexSize() / 3);
+    for(size_t i = 0; i < corners.size(); i++) {
+        std::array<std::array<float, 3>, 3> triangle;
+        for(int c = 0; c < 3; c++) {
+            glm::vec3 position = vertices[data.indices()[i*3+c]].val.v3.vec();
+            triangle[c] = {{ position.x, position.y, position.z }};
+        }
+        int first = (int)(std::min_element(triangle.begin(), triangle.end()) - triangle.begin());
+        for(int c = 0; c < 3; c++)
+            for(int d = 0; d < 3; d++) corners[i][c*3+d] = triangle[(first+c)%3][d];
+    }
+    std::sort(corners.begin(), corners.end());
+    return corners;
+}
+
+// Optimizes shuffled grids; checks that cache use improves, the same triangles are drawn, data points are in first
+// use order, and each data point kept its own attributes
+bool benchmarkOptimize() {
+    bool success = true;
+    unsigned int sizes[]{ 64, 256 };
+    for(unsigned int size : sizes) {
+        Model::RawModelDataIndexed grid = createGrid(size, true);
+        size_t triangles = grid.indexSize() / 3;
+
+        // Shuffle triangles, so the optimizer starts from a cache-hostile order like many exporters produce
+        std::vector<unsigned int> shuffled(grid.indices(), grid.indices() + grid.indexSize());
+        std::vector<size_t> order(triangles);
+        for(size_t i = 0; i < triangles; i++) order[i] = i;
+        std::shuffle(order.begin(), order.end(), std::mt19937(size));
+        for(size_t i = 0; i < triangles; i++)
+            for(int c = 0; c < 3; c++) shuffled[i*3+c] = grid.indices()[order[i]*3+c];
+        grid.putIndices(shuffled.data(), shuffled.size());
+        std::vector<std::array<float, 9>> corners = triangleCorners(grid);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        Model::OptimizeResult result = Model::optimize(grid);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        bool size_success = grid.indexSize() == triangles * 3 && grid.size() == (size_t)(size+1) * (size+1);
+        if(!(result.after.acmr < 0.75f && result.after.acmr < result.before.acmr
+             && result.after.atvr < 1.5f && result.after.atvr < result.before.atvr)) {
+            Log::log_core(ERR) << "Optimize [" << (unsigned long)triangles << " triangles]: vertex cache use did not improve enough";
+            size_success = false;
+        }
+        Model::VertexCacheStats measured = Model::analyzeVertexCache(grid);
+        if(measured.acmr != result.after.acmr || measured.atvr != result.after.atvr) {
+            Log::log_core(ERR) << "Optimize [" << (unsigned long)triangles << " triangles]: reported stats do not match the result";
+            size_success = false;
+        }
+        if(size_success && triangleCorners(grid) != corners) {
+            Log::log_core(ERR) << "Optimize [" << (unsigned long)triangles << " triangles]: triangles drawn changed";
+            size_success = false;
+        }
+        unsigned int next_unused = 0;
+        for(size_t i = 0; i < grid.indexSize() && size_success; i++) {
+            if(grid.indices()[i] > next_unused) {
+                Log::log_core(ERR) << "Optimize [" << (unsigned long)triangles << " triangles]: data point "
+                                   << grid.indices()[i] << " is used before " << next_unused;
+                size_success = false;
+            } else if(grid.indices()[i] == next_unused) next_unused++;
+        }
+        Model::VecArray &vertices = grid[Model::Type::VERTEX];
+        Model::VecArray &uvs = grid[Model::Type::UV];
+        for(size_t i = 0; i < grid.size() && size_success; i++) {
+            glm::vec3 position = vertices[i].val.v3.vec();
+            if(uvs[i].val.v2.vec() != glm::vec2(position.x / size, position.z / size)) {
+                Log::log_core(ERR) << "Optimize [" << (unsigned long)triangles << " triangles]: data point "
+                                   << (unsigned long)i << " was moved without its UV";
+                size_success = false;
+            }
+        }
+
+        Log::log_core(INFO) << "Optimize [" << (unsigned long)triangles << " triangles]: " << ms << "ms, ACMR "
+                            << result.before.acmr << " -> " << result.after.acmr << ", ATVR "
+                            << result.before.atvr << " -> " << result.after.atvr
+                            << (size_success ? "" : " (FAILED)");
+        success = success && size_success;
+    }
+    return success;
+}
+
+// Generates an LOD chain for a bumpy grid; checks each level against its triangle target and the error limit
+bool testLODs() {
+    const float max_error = 0.05f;
+    std::vector<float> ratios{ 0.5f, 0.25f, 0.125f, 0.0625f };
+
+    Model::RawModelDataIndexed grid = createGrid(256, true);
+    Model::VecArray &vertices = grid[Model::Type::VERTEX];
+    for(size_t i = 0; i < grid.size(); i++)
+        vertices[i].val.v3.y = 4.0f * std::sin(vertices[i].val.v3.x * 0.05f) * std::cos(vertices[i].val.v3.z * 0.05f);
+    size_t triangles = grid.indexSize() / 3;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<Model::LODLevel> lods = Model::generateLODs(grid, ratios, max_error);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    Log::log_core(INFO) << "Simplify [" << (unsigned long)triangles << " triangles, " << (unsigned long)lods.size()
+                        << " levels]: " << ms << "ms, " << (triangles / ms / 1000.0) << "M triangles/s";
+
+    bool success = lods.size() == ratios.size();
+    float previous_error = 0.0f;
+    for(size_t i = 0; i < lods.size(); i++) {
+        size_t level_triangles = lods[i].indices.size() / 3;
+        bool level_success = level_triangles <= (size_t)(triangles * ratios[i]) + 1
+                             && lods[i].error <= max_error && lods[i].error >= previous_error;
+        for(unsigned int index : lods[i].indices) if(index >= grid.size()) level_success = false;
+        Log::log_core(INFO) << "LOD " << (unsigned long)(i+1) << ": " << (unsigned long)level_triangles
+                            << " triangles, error " << lods[i].error << (level_success ? "" : " (FAILED)");
+        previous_error = lods[i].error;
+        success = success && level_success;
+    }
+    return success;
+}
+
+// Simplifies a flat grid with a UV seam down its middle; seam data points must all be kept, and the border must stay
+// where it was, so the corners are kept and the simplified triangles still cover the whole grid
+bool testSeamsAndBorders() {
+    const unsigned int size = 64, seam = size / 2;
+    Model::RawModelDataIndexed grid = createGrid(size, true);
+
+    // Give the right half its own copies of the data points on the seam, with different UVs
+    std::vector<float> vertices, uvs, normals;
+    for(size_t i = 0; i < grid.size(); i++) {
+        glm::vec3 position = grid[Model::Type::VERTEX][i].val.v3.vec();
+        glm::vec2 uv = grid[Model::Type::UV][i].val.v2.vec();
+        vertices.insert(vertices.end(), { position.x, position.y, position.z });
+        uvs.insert(uvs.end(), { uv.x, uv.y });
+        normals.insert(normals.end(), { 0.0f, 1.0f, 0.0f });
+    }
+    std::vector<unsigned int> seam_points, copies(grid.size(), 0);
+    for(unsigned int y = 0; y <= size; y++) {
+        unsigned int i = y * (size+1) + seam;
+        copies[i] = (unsigned int)vertices.size() / 3;
+        vertices.insert(vertices.end(), { (float)seam, 0.0f, (float)y });
+        uvs.insert(uvs.end(), { 0.0f, (float)y / size });
+        normals.insert(normals.end(), { 0.0f, 1.0f, 0.0f });
+        seam_points.push_back(i);
+        seam_points.push_back(copies[i]);
+    }
+    std::vector<unsigned int> indices(grid.indices(), grid.indices() + grid.indexSize());
+    for(size_t t = 0; t < indices.size(); t += 3) {
+        bool right = false;
+        for(int c = 0; c < 3; c++) right = right || vertices[indices[t+c]*3] > seam;
+        for(int c = 0; c < 3 && right; c++) if(copies[indices[t+c]] != 0) indices[t+c] = copies[indices[t+c]];
+    }
+    Model::RawModelDataIndexed seamed;
+    seamed.put(Model::Type::VERTEX, vertices.data(), vertices.size() / 3);
+    seamed.put(Model::Type::UV,     uvs.data(),      uvs.size() / 2);
+    seamed.put(Model::Type::NORMAL, normals.data(),  normals.size() / 3);
+    seamed.putIndices(indices.data(), indices.size());
+
+    float error = 0.0f;
+    std::vector<unsigned int> simplified = Model::simplify(seamed, indices.size() / 10, 0.01f, &error);
+
+    bool success = simplified.size() < indices.size() / 2;
+    std::vector<bool> used(seamed.size(), false);
+    for(unsigned int index : simplified) used[index] = true;
+    for(unsigned int point : seam_points) if(!used[point]) success = false;
+    unsigned int corners[]{ 0, size, size * (size+1), (size+1) * (size+1) - 1 };
+    for(unsigned int corner : corners) if(!used[corner]) success = false;
+    float area = 0.0f;
+    for(size_t t = 0; t < simplified.size(); t += 3) {
+        glm::vec3 a = seamed[Model::Type::VERTEX][simplified[t]].val.v3.vec();
+        glm::vec3 b = seamed[Model::Type::VERTEX][simplified[t+1]].val.v3.vec();
+        glm::vec3 c = seamed[Model::Type::VERTEX][simplified[t+2]].val.v3.vec();
+        area += glm::cross(b - a, c - a).y;
+    }
+    if(std::abs(std::abs(area) / 2.0f - (float)(size * size)) > 1e-3f * size * size) success = false;
+
+    Log::log_core(INFO) << "Simplify seams and borders: " << (unsigned long)(indices.size() / 3) << " -> "
+                        << (unsigned long)(simplified.size() / 3) << " triangles, area " << std::abs(area) / 2.0f
+                        << " of " << (unsigned long)(size * size) << (success ? "" : " (FAILED)");
+    return success;
+}
+
 int main() {
 
+    bool success = true;
     try {
-        if (!Core::init(SWM_INIT_MODEL)) {
+        if (!Core::init(SWM_INIT_MINIMAL)) {
             return -1;
         }
         
@@ -45,11 +268,29 @@ int main() {
                                 << ", uv" << vec_index_uv[i].val.v2.vec()
                                 << ", normal" << vec_index_normal[i].val.v3.vec();
         }
+        Log::log_core.newline();
+
+        Model::computeTangents(data_index);
+        Model::VecArray vec_index_tangent   = data_index[Model::Type::TANGENT];
+        Model::VecArray vec_index_bitangent = data_index[Model::Type::BITANGENT];
+        Log::log_core(INFO) << "Indexed Tangents:";
+        for(int i = 0; i < data_index.size(); i++) {
+            Log::log_core(INFO) << "[" << i << "] tangent" << vec_index_tangent[i].val.v3.vec()
+                                << ", bitangent" << vec_index_bitangent[i].val.v3.vec();
+        }
+        Log::log_core.newline();
+
+        success = benchmarkTangents() && success;
+        success = benchmarkOptimize() && success;
+        success = testLODs() && success;
+        success = testSeamsAndBorders() && success;
 
+        Log::log_core(INFO) << "Model test " << (success ? "passed" : "FAILED");
         Core::cleanup();
-        
+
     } catch(std::exception &e) {
         std::cerr << e.what() << std::endl;
+        success = false;
     }
-    return 0;
+    return success ? 0 : 1;
 }
\ No newline at end of file
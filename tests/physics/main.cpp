@@ -0,0 +1,409 @@
+#include "api/Core.h"
+#include "api/Logging.h"
+#include "api/Physics.h"
+#include "api/Util.h"
+
+#include "../TestCommon.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace Swarm;
+
+using namespace Swarm::Logging;
+
+struct Body {
+    float inverse_mass, inverse_inertia[3];
+    float position[3], orientation[4], velocity[3], spin[3], force[3], torque[3];
+};
+
+void cross(const float* a, const float* b, float* out) {
+    float x = a[1] * b[2] - a[2] * b[1], y = a[2] * b[0] - a[0] * b[2], z = a[0] * b[1] - a[1] * b[0];
+    out[0] = x; out[1] = y; out[2] = z;
+}
+
+void rotate(const float* u, float s, const float* v, float* out) {
+    float t[3], ut[3];
+    cross(u, v, t);
+    for(int c = 0; c < 3; c++) t[c] *= 2.0f;
+    cross(u, t, ut);
+    for(int c = 0; c < 3; c++) out[c] = v[c] + s * t[c] + ut[c];
+}
+
+// Plain one-body-at-a-time integrator; the engine's integrators must match it on every body
+void integrate(Body &body, float dt) {
+    for(int c = 0; c < 3; c++) {
+        body.velocity[c] += dt * body.inverse_mass * body.force[c];
+        body.position[c] += dt * body.velocity[c];
+    }
+    float inverse[3] = { -body.orientation[0], -body.orientation[1], -body.orientation[2] };
+    float local[3], world[3];
+    rotate(inverse, body.orientation[3], body.torque, local);
+    for(int c = 0; c < 3; c++) local[c] *= body.inverse_inertia[c];
+    rotate(body.orientation, body.orientation[3], local, world);
+    for(int c = 0; c < 3; c++) body.spin[c] += dt * world[c];
+
+    float spin_cross[3], q[4];
+    cross(body.spin, body.orientation, spin_cross);
+    for(int c = 0; c < 3; c++) q[c] = body.orientation[c] + 0.5f * dt * (body.orientation[3] * body.spin[c] + spin_cross[c]);
+    q[3] = body.orientation[3] - 0.5f * dt * (body.spin[0] * body.orientation[0] + body.spin[1] * body.orientation[1] + body.spin[2] * body.orientation[2]);
+    float length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for(int c = 0; c < 4; c++) body.orientation[c] = q[c] / length;
+    for(int c = 0; c < 3; c++) body.force[c] = body.torque[c] = 0.0f;
+}
+
+bool near(float a, float b, float tolerance) {
+    return std::fabs(a - b) <= tolerance * std::max(1.0f, std::fabs(b));
+}
+
+int main() {
+
+    // Physics alone, with no CL, as on a headless server
+    if(!Core::init(SWM_INIT_PHYSICS)) {
+        return -1;
+    }
+
+    bool success = true;
+    if(Physics::backend() != Physics::BACKEND_CPU) {
+        Log::log_physics(ERR) << "Physics without CL is not on the CPU backend";
+        success = false;
+    }
+
+    // Falling under a constant force; semi-implicit Euler lands at g*dt^2*n(n+1)/2
+    const float dt = 0.01f, gravity = -9.8f;
+    const int steps = 100;
+    {
+        Physics::PhysicsObject falling(2.0f);
+        Physics::PhysicsObject drifting(1.0f);
+        Physics::PhysicsObject fixed(0.0f);
+        drifting.setVelocity(Physics::Vec3(1.0f, 0.0f, -2.0f));
+        for(int i = 0; i < steps; i++) {
+            falling.applyForce(Physics::Vec3(0.0f, 2.0f * gravity, 0.0f));
+            fixed.applyForce(Physics::Vec3(100.0f, 100.0f, 100.0f));
+            Physics::step(dt);
+        }
+        float expected = gravity * dt * dt * steps * (steps + 1) / 2.0f;
+        if(!near(falling.position().y, expected, 1e-4f) || !near(falling.velocity().y, gravity * dt * steps, 1e-4f)) {
+            Log::log_physics(ERR) << "Falling body reached " << falling.position().y << ", expected " << expected;
+            success = false;
+        }
+        if(!near(drifting.position().x, dt * steps, 1e-4f) || !near(drifting.position().z, -2.0f * dt * steps, 1e-4f)) {
+            Log::log_physics(ERR) << "Drifting body did not keep its velocity";
+            success = false;
+        }
+        if(fixed.position().x != 0.0f || fixed.velocity().x != 0.0f) {
+            Log::log_physics(ERR) << "Body without mass was moved by force";
+            success = false;
+        }
+    }
+
+    // Torque acts through the inertia about the body's own axes; turned a quarter about x, the body's y axis is the
+    // world's z axis
+    {
+        const float quarter = std::sqrt(0.5f);
+        Physics::PhysicsObject upright(1.0f, Physics::Vec3(1.0f, 2.0f, 4.0f));
+        Physics::PhysicsObject turned(1.0f, Physics::Vec3(1.0f, 2.0f, 4.0f));
+        turned.setOrientation(Physics::Quat(quarter, 0.0f, 0.0f, quarter));
+        upright.applyTorque(Physics::Vec3(0.0f, 0.0f, 8.0f));
+        turned.applyTorque(Physics::Vec3(0.0f, 0.0f, 8.0f));
+        Physics::step(dt);
+        if(!near(upright.angularVelocity().z, 8.0f / 4.0f * dt, 1e-4f) || !near(turned.angularVelocity().z, 8.0f / 2.0f * dt, 1e-4f)) {
+            Log::log_physics(ERR) << "Torque was not scaled by the inertia about the body's axes: "
+                                  << upright.angularVelocity().z << ", " << turned.angularVelocity().z;
+            success = false;
+        }
+
+        // Spinning freely; the angle turned follows the spin, and the orientation stays a unit quaternion
+        upright.setOrientation(Physics::Quat());
+        upright.setAngularVelocity(Physics::Vec3(0.0f, 0.0f, 1.0f));
+        for(int i = 0; i < steps; i++) Physics::step(dt);
+        Physics::Quat q = upright.orientation();
+        float angle = 2.0f * std::atan2(q.z, q.w);
+        float length = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+        if(!near(angle, dt * steps, 1e-3f) || !near(length, 1.0f, 1e-5f)) {
+            Log::log_physics(ERR) << "Spinning body turned " << angle << " radians, expected " << dt * steps;
+            success = false;
+        }
+    }
+
+    // Removing a body leaves the others' state where it was
+    {
+        std::vector<std::unique_ptr<Physics::PhysicsObject>> objects;
+        for(int i = 0; i < 20; i++) {
+            objects.emplace_back(new Physics::PhysicsObject());
+            objects.back()->setPosition(Physics::Vec3((float)i, 0.0f, 0.0f));
+        }
+        for(int i = 0; i < 20; i += 3) objects[i].reset();
+        for(int i = 0; i < 20; i++) if(objects[i] && objects[i]->position().x != (float)i) success = false;
+        objects.clear();
+        if(Physics::bodyCount() != 0) success = false;
+        if(!success) Log::log_physics(ERR) << "Removing bodies moved the others";
+    }
+
+    // The model matrix turns and then moves; a quarter turn about z takes x to y
+    {
+        const float quarter = std::sqrt(0.5f);
+        Physics::PhysicsObject object;
+        object.setPosition(Physics::Vec3(1.0f, 2.0f, 3.0f));
+        object.setOrientation(Physics::Quat(0.0f, 0.0f, quarter, quarter));
+        float matrix[16];
+        object.modelMatrix(matrix);
+        const float expected[16] = { 0.0f, 1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 2.0f, 3.0f, 1.0f };
+        for(int i = 0; i < 16; i++) {
+            if(std::fabs(matrix[i] - expected[i]) > 1e-6f) {
+                Log::log_physics(ERR) << "Model matrix element " << i << " is " << matrix[i] << ", expected " << expected[i];
+                success = false;
+            }
+        }
+    }
+
+    // Bodies outlive restarting physics, onto the CL device when there is one, and move the same afterwards
+    {
+        std::vector<std::unique_ptr<Physics::PhysicsObject>> objects;
+        for(int i = 0; i < 100; i++) {
+            objects.emplace_back(new Physics::PhysicsObject());
+            objects.back()->setPosition(Physics::Vec3((float)i, 0.0f, 0.0f));
+            objects.back()->setVelocity(Physics::Vec3(0.0f, (float)i, 0.0f));
+        }
+        for(Physics::Backend backend : { Physics::BACKEND_AUTO, Physics::BACKEND_CPU }) {
+            Physics::cleanup();
+            Physics::init(backend);
+            Physics::step(dt);
+        }
+        for(int i = 0; i < 100; i++) {
+            Physics::Vec3 position = objects[i]->position();
+            if(position.x != (float)i || !near(position.y, 2.0f * dt * i, 1e-5f)) {
+                Log::log_physics(ERR) << "Body " << i << " is at (" << position.x << ", " << position.y << ") after restarting physics";
+                success = false;
+                break;
+            }
+        }
+    }
+
+    // Random bodies match the reference integrator, over an uneven count so padding is covered
+    const size_t random_count = 10003;
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    {
+        std::vector<Body> reference(random_count);
+        std::vector<std::unique_ptr<Physics::PhysicsObject>> objects;
+        for(Body &body : reference) {
+            float mass = 1.0f + uniform(random) * 0.5f;
+            float inertia[3] = { 1.0f + uniform(random) * 0.5f, 1.0f + uniform(random) * 0.5f, 1.0f + uniform(random) * 0.5f };
+            body.inverse_mass = 1.0f / mass;
+            for(int c = 0; c < 3; c++) body.inverse_inertia[c] = 1.0f / inertia[c];
+            for(int c = 0; c < 3; c++) body.position[c] = uniform(random) * 10.0f;
+            for(int c = 0; c < 4; c++) body.orientation[c] = uniform(random);
+            float length = std::sqrt(body.orientation[0] * body.orientation[0] + body.orientation[1] * body.orientation[1] +
+                                     body.orientation[2] * body.orientation[2] + body.orientation[3] * body.orientation[3]);
+            for(int c = 0; c < 4; c++) body.orientation[c] /= length;
+            for(int c = 0; c < 3; c++) body.velocity[c] = uniform(random);
+            for(int c = 0; c < 3; c++) body.spin[c] = uniform(random);
+
+            objects.emplace_back(new Physics::PhysicsObject(mass, Physics::Vec3(inertia[0], inertia[1], inertia[2])));
+            objects.back()->setPosition(Physics::Vec3(body.position[0], body.position[1], body.position[2]));
+            objects.back()->setOrientation(Physics::Quat(body.orientation[0], body.orientation[1], body.orientation[2], body.orientation[3]));
+            objects.back()->setVelocity(Physics::Vec3(body.velocity[0], body.velocity[1], body.velocity[2]));
+            objects.back()->setAngularVelocity(Physics::Vec3(body.spin[0], body.spin[1], body.spin[2]));
+        }
+        for(int s = 0; s < 10; s++) {
+            for(size_t i = 0; i < random_count; i++) {
+                Body &body = reference[i];
+                for(int c = 0; c < 3; c++) body.force[c] = uniform(random) * 5.0f;
+                for(int c = 0; c < 3; c++) body.torque[c] = uniform(random) * 5.0f;
+                objects[i]->applyForce(Physics::Vec3(body.force[0], body.force[1], body.force[2]));
+                objects[i]->applyTorque(Physics::Vec3(body.torque[0], body.torque[1], body.torque[2]));
+                integrate(body, dt);
+            }
+            Physics::step(dt);
+        }
+        size_t mismatched = 0;
+        for(size_t i = 0; i < random_count; i++) {
+            const Body &body = reference[i];
+            Physics::Vec3 position = objects[i]->position(), spin = objects[i]->angularVelocity();
+            Physics::Quat q = objects[i]->orientation();
+            if(!near(position.x, body.position[0], 1e-4f) || !near(position.y, body.position[1], 1e-4f) ||
+               !near(position.z, body.position[2], 1e-4f) || !near(spin.x, body.spin[0], 1e-4f) ||
+               !near(spin.y, body.spin[1], 1e-4f) || !near(spin.z, body.spin[2], 1e-4f) ||
+               !near(q.x, body.orientation[0], 1e-4f) || !near(q.y, body.orientation[1], 1e-4f) ||
+               !near(q.z, body.orientation[2], 1e-4f) || !near(q.w, body.orientation[3], 1e-4f)) mismatched++;
+        }
+        if(mismatched > 0) {
+            Log::log_physics(ERR) << (unsigned long)mismatched << " of " << (unsigned long)random_count << " bodies differ from the reference";
+            success = false;
+        }
+    }
+
+    // Both broad phases find exactly the pairs testing every pair would, in the same order, however many threads
+    // find them; and again after the bodies move, which only re-sorts the sweep. A few bodies are far larger than a
+    // grid cell, so the grid also tests them apart from its cells.
+    {
+        const size_t crowd = 3000;
+        std::vector<std::unique_ptr<Physics::PhysicsObject>> objects;
+        std::unordered_map<Physics::PhysicsObject*, size_t> index;
+        std::uniform_real_distribution<float> spread(0.0f, 40.0f), size(0.25f, 1.5f);
+        for(size_t i = 0; i < crowd; i++) {
+            objects.emplace_back(new Physics::PhysicsObject());
+            objects.back()->setPosition(Physics::Vec3(spread(random), spread(random), spread(random)));
+            objects.back()->setVelocity(Physics::Vec3(uniform(random), uniform(random), uniform(random)));
+            if(i % 500 == 1) objects.back()->setRadius(12.0f);
+            else if(i % 10 != 0) objects.back()->setRadius(size(random));
+            index[objects.back().get()] = i;
+        }
+
+        auto expected = [&]() {
+            std::vector<std::pair<size_t, size_t>> pairs;
+            std::vector<Physics::Vec3> positions;
+            std::vector<float> radii;
+            for(auto &object : objects) { positions.push_back(object->position()); radii.push_back(object->radius()); }
+            for(size_t a = 0; a < crowd; a++) {
+                for(size_t b = a + 1; b < crowd; b++) {
+                    if(radii[a] <= 0.0f || radii[b] <= 0.0f) continue;
+                    const Physics::Vec3 &pa = positions[a], &pb = positions[b];
+                    if(pa.x - radii[a] <= pb.x + radii[b] && pb.x - radii[b] <= pa.x + radii[a] &&
+                       pa.y - radii[a] <= pb.y + radii[b] && pb.y - radii[b] <= pa.y + radii[a] &&
+                       pa.z - radii[a] <= pb.z + radii[b] && pb.z - radii[b] <= pa.z + radii[a]) pairs.emplace_back(a, b);
+                }
+            }
+            return pairs;
+        };
+        auto found = [&]() {
+            std::vector<std::pair<size_t, size_t>> pairs;
+            for(auto &pair : Physics::overlaps()) pairs.emplace_back(index[pair.first], index[pair.second]);
+            return pairs;
+        };
+
+        unsigned int hardware = std::max(std::thread::hardware_concurrency(), 1u);
+        for(int moved = 0; moved < 3; moved++) {
+            std::vector<std::pair<size_t, size_t>> reference = expected();
+            for(Physics::BroadPhase broad_phase : { Physics::BROAD_PHASE_SWEEP, Physics::BROAD_PHASE_GRID }) {
+                Physics::setBroadPhase(broad_phase);
+                for(unsigned int threads : { 1u, std::max(hardware, 4u) }) {
+                    Util::stopJobs();
+                    if(threads > 1) Util::startJobs(threads - 1);
+                    Physics::step(0.0f);
+                    if(found() != reference) {
+                        Log::log_physics(ERR) << (broad_phase == Physics::BROAD_PHASE_SWEEP ? "Sweep and prune" : "Uniform grid")
+                                              << " on " << threads << " threads found " << (unsigned long)found().size()
+                                              << " pairs, expected " << (unsigned long)reference.size();
+                        success = false;
+                    }
+                }
+            }
+            Physics::setBroadPhase(Physics::BROAD_PHASE_SWEEP);
+            Physics::step(0.5f);
+        }
+        Util::stopJobs();
+        Util::startJobs();
+    }
+
+    // Broad phase time over crowds of bodies spread evenly, each with a few neighbours, and one body a quarter the size
+    // of the crowd in its middle; sweep and prune is left out of the largest, as every body would sweep past thousands
+    // of others along any axis
+    for(size_t crowd : { (size_t)10000, (size_t)100000, (size_t)1000000 }) {
+        std::vector<std::unique_ptr<Physics::PhysicsObject>> objects;
+        float side = std::cbrt((float)crowd) * 2.0f;
+        std::uniform_real_distribution<float> spread(0.0f, side);
+        for(size_t i = 0; i < crowd; i++) {
+            objects.emplace_back(new Physics::PhysicsObject());
+            objects.back()->setPosition(Physics::Vec3(spread(random), spread(random), spread(random)));
+            objects.back()->setRadius(0.5f);
+        }
+        objects.back()->setPosition(Physics::Vec3(side / 2.0f, side / 2.0f, side / 2.0f));
+        objects.back()->setRadius(side / 8.0f);
+        double broad_phase_ms[2] = { 0.0, 0.0 };
+        size_t pairs[2] = { 0, 0 };
+        for(int b = crowd > 100000 ? 1 : 0; b < 2; b++) {
+            Physics::setBroadPhase(b == 0 ? Physics::BROAD_PHASE_SWEEP : Physics::BROAD_PHASE_GRID);
+            Physics::step(0.0f);
+            for(int s = 0; s < 3; s++) {
+                Physics::step(0.0f);
+                broad_phase_ms[b] += Physics::stepStats().broad_phase_ms / 3.0;
+            }
+            pairs[b] = Physics::stepStats().pairs;
+        }
+        // Reading a body waits while the step moves bodies, but not while the broad phase runs
+        if(crowd == 1000000) {
+            std::atomic<bool> stepping(true);
+            double longest_read_ms = 0.0;
+            std::thread reader([&]() {
+                while(stepping) {
+                    auto read_start = std::chrono::high_resolution_clock::now();
+                    objects.front()->position();
+                    longest_read_ms = std::max(longest_read_ms, elapsed(read_start));
+                }
+            });
+            Physics::step(0.0f);
+            stepping = false;
+            reader.join();
+            Physics::StepStats stats = Physics::stepStats();
+            Log::log_physics(INFO) << "Longest body read during a step of " << (unsigned long)crowd << " bodies: "
+                                   << longest_read_ms << "ms, of " << stats.integrate_ms + stats.broad_phase_ms << "ms";
+            if(longest_read_ms > stats.integrate_ms + stats.broad_phase_ms / 2.0) {
+                Log::log_physics(ERR) << "Reading a body waited for the broad phase";
+                success = false;
+            }
+        }
+        if(crowd <= 100000 && pairs[0] != pairs[1]) {
+            Log::log_physics(ERR) << "Sweep and prune found " << (unsigned long)pairs[0] << " pairs over " << (unsigned long)crowd
+                                  << " bodies, the uniform grid " << (unsigned long)pairs[1];
+            success = false;
+        }
+        Log::log_physics(INFO) << "Broad phase over " << (unsigned long)crowd << " bodies, " << (unsigned long)pairs[1]
+                               << " pairs, on " << Util::jobWorkers() + 1 << " threads: sweep and prune "
+                               << (crowd > 100000 ? std::string("skipped") : std::to_string(broad_phase_ms[0]) + "ms")
+                               << ", uniform grid " << broad_phase_ms[1] << "ms";
+    }
+    Physics::setBroadPhase(Physics::BROAD_PHASE_SWEEP);
+
+    // Bodies per millisecond, against the reference integrator on one thread
+    const size_t bench_count = 1 << 20;
+    const int bench_steps = 20;
+    {
+        std::vector<Body> reference(bench_count);
+        for(Body &body : reference) {
+            body.inverse_mass = 1.0f;
+            for(int c = 0; c < 3; c++) body.inverse_inertia[c] = 1.0f;
+            for(int c = 0; c < 3; c++) body.position[c] = body.velocity[c] = body.force[c] = body.torque[c] = 0.0f;
+            for(int c = 0; c < 3; c++) body.spin[c] = uniform(random);
+            for(int c = 0; c < 4; c++) body.orientation[c] = c == 3 ? 1.0f : 0.0f;
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        for(int s = 0; s < bench_steps; s++) for(Body &body : reference) integrate(body, dt);
+        double reference_rate = (double)(bench_count * bench_steps) / elapsed(start);
+
+        std::vector<std::unique_ptr<Physics::PhysicsObject>> objects;
+        for(size_t i = 0; i < bench_count; i++) {
+            objects.emplace_back(new Physics::PhysicsObject());
+            objects.back()->setAngularVelocity(Physics::Vec3(uniform(random), uniform(random), uniform(random)));
+        }
+        unsigned int hardware = std::max(std::thread::hardware_concurrency(), 1u);
+        for(unsigned int threads : std::set<unsigned int>{ 1u, 2u, 4u, hardware }) {
+            if(threads > hardware) continue;
+            Util::stopJobs();
+            if(threads > 1) Util::startJobs(threads - 1);
+            start = std::chrono::high_resolution_clock::now();
+            for(int s = 0; s < bench_steps; s++) Physics::step(dt);
+            double rate = (double)(bench_count * bench_steps) / elapsed(start);
+            Log::log_physics(INFO) << "Integrated " << (unsigned long)bench_count << " bodies on " << threads << " threads: "
+                                   << rate << " bodies per ms; reference " << reference_rate << " bodies per ms ("
+                                   << rate / reference_rate << "x)";
+        }
+        Util::stopJobs();
+        Util::startJobs();
+    }
+
+    Log::log_physics(INFO) << "Physics test " << (success ? "passed" : "FAILED");
+
+    Core::cleanup();
+    return success ? 0 : 1;
+}
@@ -0,0 +1,732 @@
+#define SWARM_INCLUDE_GLM
+#include "api/Core.h"
+#include "api/Logging.h"
+#include "api/Render.h"
+
+#define SWARM_TEST_INCLUDE_MODELS
+#include "../TestCommon.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace Swarm;
+
+using namespace Swarm::Logging;
+
+// Everything renders through a RecordingDevice, so the test needs no window or GPU
+
+// Same work as the default START and END render cycle phases, without needing a Window
+void renderFrame(Render::Renderer &renderer, Render::RenderObjectCollection &collection) {
+    Render::device().useProgram(renderer.program()->ID());
+    renderer.bindUniformsTexture();
+    renderer.bindUniformsCustom();
+    collection.render(renderer);
+}
+
+// Program, vertex array and textures each draw in a command stream sees, along with what it draws
+std::vector<std::vector<size_t>> drawStates(const std::vector<Render::DeviceCommand> &commands) {
+    std::vector<std::vector<size_t>> states;
+    size_t program = 0;
+    std::map<SWMuint, SWMuint> textures;
+    for(const Render::DeviceCommand &command : commands) {
+        if(command.type == Render::CMD_USE_PROGRAM) program = command.object;
+        if(command.type == Render::CMD_BIND_TEXTURE) textures[command.target] = command.object;
+        if(command.type != Render::CMD_DRAW_ELEMENTS && command.type != Render::CMD_DRAW_INSTANCED) continue;
+        std::vector<size_t> state{ program, command.object, command.count, command.bytes, command.instances };
+        for(auto && iter : textures) { state.push_back(iter.first); state.push_back(iter.second); }
+        states.push_back(state);
+    }
+    return states;
+}
+
+// Scatter objects over every Model and Texture; returns the indices one frame draws
+size_t scatter(Render::RenderObjectCollection &collection, size_t count, std::vector<Model::Model> &models,
+               std::vector<Texture::Texture> &textures) {
+    size_t indices = 0;
+    for(size_t i = 0; i < count; i++) {
+        Model::Model &model = models[i % models.size()];
+        collection.insert(Render::RenderObject::createStaticRenderObject(model, textures[i % textures.size()],
+                                                                         (float)(i % 100), 0.0f, (float)(i / 100),
+                                                                         1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f));
+        indices += model.elementCount();
+    }
+    collection.flush();
+    return indices;
+}
+
+// Renders nothing, so timing a collection of them measures only the collection's own overhead
+class QueueObject : public Render::RenderObject {
+public:
+    QueueObject(Model::Model &model, Texture::Texture &texture, float depth) : _model(model), _texture(texture), _depth(depth) {}
+    virtual Model::Model &model() const { return _model; }
+    virtual Texture::Texture &texture() const { return _texture; }
+    virtual void render(const Render::Renderer &renderer) const { rendered++; }
+    virtual float depth(const Render::Renderer &renderer) const { return _depth; }
+
+    static size_t rendered;
+
+protected:
+    Model::Model &_model;
+    Texture::Texture &_texture;
+    float _depth;
+};
+size_t QueueObject::rendered = 0;
+
+// The layout RenderObjectCollection used before its flat render queue; kept to compare against
+typedef std::map<Texture::Texture, std::set<Render::RenderObject*>> MappedCollection;
+
+void renderMapped(Render::Renderer &renderer, MappedCollection &mapped) {
+    Render::device().useProgram(renderer.program()->ID());
+    renderer.bindUniformsTexture();
+    renderer.bindUniformsCustom();
+    for(auto && iter : mapped) {
+        iter.first.bind();
+        for(Render::RenderObject* object : iter.second) object->render(renderer);
+    }
+    Render::device().useProgram(0);
+}
+
+int main() {
+
+    if(!Core::init(SWM_INIT_MINIMAL)) {
+        return -1;
+    }
+
+    Render::RecordingDevice* recorder = Render::RecordingDevice::create();
+    Render::setDevice(recorder);
+    bool success = true;
+
+    Render::Shader* shaders[]{
+            Render::Shader::compileFromSource("uniform mat4 _m;\nuniform mat4 _v, _p;\nvoid main() {}", Render::ShaderType::VERTEX),
+            Render::Shader::compileFromSource("uniform sampler2D _tex;\nuniform vec4 _tint[2];\nvoid main() {}", Render::ShaderType::FRAGMENT)
+    };
+    Render::Program* program = Render::Program::compile(shaders, 2);
+    Render::Renderer* renderer = Render::Renderer::create(program);
+    renderer->setTextureName(0, "_tex");
+
+    // Uniforms are reflected when the Program links, and the Renderer keeps the locations it binds
+    std::set<SWMint> locations;
+    for(const char* name : { "_m", "_v", "_p", "_tex", "_tint" }) locations.insert(program->uniform(name));
+    if(program->uniformCount() != 5 || locations.size() != 5 || locations.count(-1) || program->uniform("_missing") != -1
+       || renderer->uniformLocation(Render::Renderer::MODEL) != program->uniform("_m")
+       || renderer->textureLocation(0) != program->uniform("_tex") || renderer->textureLocation(1) != -1) {
+        Log::log_render(ERR) << "Unexpected uniforms: " << (unsigned long)program->uniformCount() << " reflected";
+        success = false;
+    }
+
+    // Uniform blocks; laid out with std140, and every Renderer's block packed into one upload per frame
+    {
+        Render::Shader* block_shaders[]{
+                Render::Shader::compileFromSource("uniform SwarmFrame {\n  mat4 _v;\n  mat4 _p;\n  vec3 _light;\n  float _time[2];\n};\n"
+                                                  "uniform mat4 _m;\nvoid main() {}", Render::ShaderType::VERTEX),
+                Render::Shader::compileFromSource("uniform vec4 _tint;\nvoid main() {}", Render::ShaderType::FRAGMENT)
+        };
+        Render::Program* block_program = Render::Program::compile(block_shaders, 2);
+        const Render::UniformBlock* block = block_program->uniformBlock("SwarmFrame");
+        auto offset = [block](const char* name) { return block->offsets.count(name) ? block->offsets.at(name) : (size_t)-1; };
+        if(block == nullptr || block->size != 176 || offset("_v") != 0 || offset("_p") != 64 || offset("_light") != 128
+           || offset("_time") != 144 || block_program->uniform("_light") != -1 || block_program->uniformCount() != 2) {
+            Log::log_render(ERR) << "Unexpected uniform block layout: " << (block ? (unsigned long)block->size : 0UL) << " bytes, "
+                                 << (unsigned long)block_program->uniformCount() << " uniforms";
+            success = false;
+        }
+
+        Render::Renderer* first = Render::Renderer::create(block_program);
+        Render::Renderer* second = Render::Renderer::create(block_program);
+        Render::Uniform light("_light"), time("_time"), tint("_tint");
+        first->insertUniform(light);
+        first->insertUniform(tint);
+        second->insertUniform(time);
+        SWMfloat light_value[]{ 1.0f, 2.0f, 3.0f }, time_value[]{ 0.5f, 0.25f }, tint_value[]{ 1.0f, 0.0f, 0.0f, 1.0f };
+        light.setf(1, 3, light_value);
+        time.setf(2, 1, time_value);
+        tint.setf(1, 4, tint_value);
+
+        // The values only apply once flushed; the block is what the GPU would see
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 5.0f, -10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 projection = glm::perspective(1.0f, 1.5f, 0.1f, 100.0f);
+        std::vector<const Render::Renderer*> block_renderers{ first, second };
+        Render::flushUniforms();
+        recorder->reset();
+        Render::uploadUniformBlocks(block_renderers, view, projection);
+        std::vector<Render::DeviceCommand> upload = recorder->commands();
+
+        std::vector<uint8_t> expected(256 + 176, 0);
+        for(size_t base : { (size_t)0, (size_t)256 }) {
+            std::memcpy(&expected[base], &view[0][0], 64);
+            std::memcpy(&expected[base + 64], &projection[0][0], 64);
+        }
+        std::memcpy(&expected[128], light_value, sizeof(light_value));
+        std::memcpy(&expected[256 + 144], &time_value[0], 4);
+        std::memcpy(&expected[256 + 160], &time_value[1], 4);
+        recorder->reset();
+        recorder->bufferStream(0, expected.size(), expected.data());
+        unsigned long long expected_hash = recorder->commands().back().hash;
+
+        if(upload.size() != 2 || upload[1].type != Render::CMD_BUFFER_STREAM || upload[1].bytes != expected.size()
+           || upload[1].hash != expected_hash) {
+            Log::log_render(ERR) << "Unexpected uniform block upload: " << (unsigned long)upload.size() << " commands";
+            success = false;
+        }
+
+        // Each Renderer binds its own range; only the Uniform outside the block is set on its own
+        recorder->reset();
+        Render::device().useProgram(block_program->ID());
+        for(const Render::Renderer* block_renderer : block_renderers) {
+            block_renderer->bindUniformsBlock();
+            block_renderer->bindUniformsCustom();
+        }
+        std::vector<Render::DeviceCommand> bound = recorder->commands();
+        std::vector<size_t> ranges;
+        size_t uniform_commands = 0;
+        for(const Render::DeviceCommand &command : bound) {
+            if(command.type == Render::CMD_BIND_BUFFER_RANGE && command.target == block->binding && command.bytes == 176)
+                ranges.push_back(command.count);
+            if(command.type == Render::CMD_UNIFORM && command.target == (SWMuint)block_program->uniform("_tint"))
+                uniform_commands++;
+        }
+        if(ranges != std::vector<size_t>{ 0, 256 } || uniform_commands != 1 || recorder->stats().uniform_uploads != 1) {
+            Log::log_render(ERR) << "Unexpected uniform block binds: " << (unsigned long)ranges.size() << " ranges, "
+                                 << (unsigned long)recorder->stats().uniform_uploads << " uniforms";
+            success = false;
+        }
+
+        // Setters on many threads while frames are flushed; the last value each thread set is what lands in the block
+        const size_t writer_count = 4, writes = 20000;
+        std::vector<Render::Renderer*> writer_renderers;
+        std::vector<std::unique_ptr<Render::Uniform>> writer_uniforms;
+        for(size_t i = 0; i < writer_count; i++) {
+            writer_renderers.push_back(Render::Renderer::create(block_program));
+            writer_uniforms.emplace_back(new Render::Uniform("_light"));
+            writer_renderers.back()->insertUniform(*writer_uniforms.back());
+        }
+        std::atomic<size_t> writers_done(0);
+        std::vector<std::thread> writers;
+        for(size_t i = 0; i < writer_count; i++) {
+            writers.emplace_back([i, &writer_uniforms, &writers_done]() {
+                for(size_t w = 0; w < writes; w++) {
+                    SWMfloat value[]{ (float)i, (float)w, (float)(i * w) };
+                    writer_uniforms[i]->setf(1, 3, value);
+                }
+                writers_done++;
+            });
+        }
+        size_t flushes = 0;
+        while(writers_done < writer_count) {
+            Render::flushUniforms();
+            flushes++;
+        }
+        for(std::thread &writer : writers) writer.join();
+        Render::flushUniforms();
+        std::vector<const Render::Renderer*> writer_blocks(writer_renderers.begin(), writer_renderers.end());
+        recorder->reset();
+        Render::uploadUniformBlocks(writer_blocks, view, projection);
+        unsigned long long threaded_hash = recorder->commands().back().hash;
+
+        for(size_t i = 0; i < writer_count; i++) {
+            SWMfloat value[]{ (float)i, (float)(writes - 1), (float)(i * (writes - 1)) };
+            writer_uniforms[i]->setf(1, 3, value);
+        }
+        Render::flushUniforms();
+        recorder->reset();
+        Render::uploadUniformBlocks(writer_blocks, view, projection);
+        if(recorder->commands().back().hash != threaded_hash) {
+            Log::log_render(ERR) << "Uniforms set across threads did not match serially set ones";
+            success = false;
+        }
+
+        // A Uniform destroyed before the flush has its values dropped, even if a new Uniform takes its place in memory
+        {
+            // The replacement stays in the Renderer for good, so its storage outlives the test
+            alignas(Render::Uniform) static uint8_t storage[sizeof(Render::Uniform)];
+            Render::Uniform* doomed = new(storage) Render::Uniform("_light");
+            doomed->setf(1, 3, light_value);
+            doomed->~Uniform();
+            Render::Uniform* reborn = new(storage) Render::Uniform("_light");
+            Render::Renderer* reborn_renderer = Render::Renderer::create(block_program);
+            reborn_renderer->insertUniform(*reborn);
+            Render::flushUniforms();
+            std::vector<uint8_t> reborn_block(176);
+            recorder->reset();
+            Render::uploadUniformBlocks({ reborn_renderer }, view, projection);
+            std::vector<Render::DeviceCommand> reborn_upload = recorder->commands();
+            std::memcpy(&reborn_block[0], &view[0][0], 64);
+            std::memcpy(&reborn_block[64], &projection[0][0], 64);
+            recorder->reset();
+            recorder->bufferStream(0, reborn_block.size(), reborn_block.data());
+            if(reborn_upload.empty() || reborn_upload.back().hash != recorder->commands().back().hash) {
+                Log::log_render(ERR) << "A destroyed Uniform's staged value reached the Uniform that replaced it";
+                success = false;
+            }
+        }
+
+        // Without anything flushing, staging keeps only each Uniform's latest value, and still applies it
+        for(size_t i = 0; i < 200000; i++) {
+            for(size_t w = 0; w < writer_count; w++) {
+                SWMfloat value[]{ (float)w, (float)i, (float)(w * i) };
+                writer_uniforms[w]->setf(1, 3, value);
+            }
+        }
+        for(size_t i = 0; i < writer_count; i++) {
+            SWMfloat value[]{ (float)i, (float)(writes - 1), (float)(i * (writes - 1)) };
+            writer_uniforms[i]->setf(1, 3, value);
+        }
+        Render::flushUniforms();
+        recorder->reset();
+        Render::uploadUniformBlocks(writer_blocks, view, projection);
+        if(recorder->commands().back().hash != threaded_hash) {
+            Log::log_render(ERR) << "Uniforms set many times between flushes did not keep their last value";
+            success = false;
+        }
+
+        // Throughput of setting a Uniform, flushed every 1000 sets as a frame would be
+        const size_t sets = 1000000;
+        auto start = std::chrono::high_resolution_clock::now();
+        for(size_t i = 0; i < sets; i++) {
+            light_value[0] = (float)i;
+            light.setf(1, 3, light_value);
+            if(i % 1000 == 999) Render::flushUniforms();
+        }
+        double set_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        Render::flushUniforms();
+        Log::log_render(INFO) << "Set " << (unsigned long)sets << " Uniforms in " << set_ms << "ms ("
+                              << set_ms * 1000000.0 / sets << "ns each); " << (unsigned long)(writer_count * writes)
+                              << " sets on " << (unsigned long)writer_count << " threads over " << (unsigned long)flushes
+                              << " flushes; " << (unsigned long)expected.size() << " block bytes in one upload";
+        recorder->reset();
+    }
+
+    // Upload a few Models and Textures; the uploads are captured too
+    const size_t model_count = 4, texture_count = 8;
+    std::vector<Model::Model> models;
+    size_t expected_buffer_bytes = 0;
+    for(size_t i = 0; i < model_count; i++) {
+        Model::RawModelDataIndexed grid = createGrid(8 + (unsigned int)i * 8);
+        expected_buffer_bytes += grid.size() * (3 + 2) * sizeof(float) + grid.indexSize() * sizeof(unsigned short);
+        models.push_back(Model::Model(grid));
+    }
+    std::vector<Texture::Texture> textures(texture_count);
+    for(size_t i = 0; i < texture_count; i++) {
+        Texture::RawTextureData data;
+        data.width = data.height = 16;
+        data.pixels.assign(16 * 16 * 4, (unsigned char)i);
+        textures[i].put(0, Texture::loadTexFromData(data));
+    }
+    Render::DeviceStats uploads = recorder->stats();
+    if(uploads.buffer_uploads != model_count * 2 || uploads.buffer_bytes != expected_buffer_bytes
+       || uploads.texture_uploads != texture_count || uploads.texture_bytes != texture_count * 16 * 16 * 4) {
+        Log::log_render(ERR) << "Unexpected uploads: " << (unsigned long)uploads.buffer_uploads << " buffers ("
+                             << (unsigned long)uploads.buffer_bytes << " bytes), " << (unsigned long)uploads.texture_uploads
+                             << " textures (" << (unsigned long)uploads.texture_bytes << " bytes)";
+        success = false;
+    }
+
+    // Vertex formats; every attribute shares one buffer, interleaved or planar, and compression packs UVs into
+    // unorm16 and normals into 10:10:10:2
+    {
+        Model::RawModelDataIndexed grid = createGrid(16);
+        std::vector<float> normals;
+        for(size_t i = 0; i < grid.size(); i++) { normals.push_back(0.0f); normals.push_back(1.0f); normals.push_back(0.0f); }
+        grid.put(Model::Type::NORMAL, normals.data(), grid.size());
+
+        // Position, UV and normal attributes: components, offset, and the vertex buffer's size
+        struct Layout { bool interleaved, compressed; size_t components[3], offsets[3], bytes; };
+        size_t count = grid.size();
+        Layout layouts[]{
+                { true,  false, { 3, 2, 3 }, { 0, 12, 20 }, count * 32 },
+                { false, false, { 3, 2, 3 }, { 0, 12 * count, 20 * count }, count * 32 },
+                { true,  true,  { 3, 2, 4 }, { 0, 12, 16 }, count * 20 }
+        };
+        for(const Layout &layout : layouts) {
+            Model::VertexFormat format;
+            format.interleaved = layout.interleaved;
+            format.compressed = layout.compressed;
+            recorder->reset();
+            Model::Model model(grid, std::vector<Model::LODLevel>(), format);
+            std::vector<size_t> components, offsets;
+            std::set<SWMuint> sources;
+            for(const Render::DeviceCommand &command : recorder->commands()) {
+                if(command.type != Render::CMD_VERTEX_ATTRIBUTE) continue;
+                components.push_back(command.count);
+                offsets.push_back(command.bytes);
+                sources.insert(command.object);
+            }
+            if(model.vertexBytes() != layout.bytes || recorder->stats().buffer_uploads != 2
+               || components != std::vector<size_t>(layout.components, layout.components + 3)
+               || offsets != std::vector<size_t>(layout.offsets, layout.offsets + 3) || sources.size() != 1) {
+                Log::log_render(ERR) << "Unexpected vertex format: " << (unsigned long)model.vertexBytes() << " bytes in "
+                                     << (unsigned long)sources.size() << " buffers";
+                success = false;
+            }
+            model.release();
+        }
+
+        // Larger than the stack the upload used to be packed on
+        Model::RawModelDataIndexed large = createGrid(1000);
+        recorder->reset();
+        Model::Model large_model(large);
+        if(large_model.vertexBytes() != large.size() * 20 || recorder->stats().buffer_uploads != 2) {
+            Log::log_render(ERR) << "Unexpected large Model: " << (unsigned long)large_model.vertexBytes() << " bytes";
+            success = false;
+        }
+        large_model.release();
+        Log::log_render(INFO) << "Vertex buffer of " << (unsigned long)count << " vertices: " << (unsigned long)layouts[0].bytes
+                              << " bytes, " << (unsigned long)layouts[2].bytes << " compressed";
+    }
+
+    const size_t object_count = 10000;
+    Render::RenderObjectCollection collection;
+    size_t expected_indices = scatter(collection, object_count, models, textures);
+
+    // One recorded frame; checks the shape of the command stream. Objects sharing a Model share its VAO bind
+    const size_t pair_count = 8; // i % 4 and i % 8 pair each Texture with one Model
+    recorder->reset();
+    renderFrame(*renderer, collection);
+    Render::DeviceStats frame = recorder->stats();
+    std::vector<Render::DeviceCommand> commands = recorder->commands();
+    size_t draw_commands = 0;
+    for(const Render::DeviceCommand &command : commands) {
+        if(command.type == Render::CMD_DRAW_ELEMENTS) draw_commands++;
+        if(command.type == Render::CMD_UNIFORM && command.target != (SWMuint)program->uniform("_m")
+           && command.target != (SWMuint)program->uniform("_tex")) success = false;
+    }
+    if(frame.draw_calls != object_count || draw_commands != object_count || frame.indices != expected_indices
+       || frame.texture_binds != texture_count || frame.uniform_uploads != object_count + 1
+       || frame.vertex_array_binds != pair_count + 1 || commands.size() != frame.commands) {
+        Log::log_render(ERR) << "Unexpected frame: " << (unsigned long)frame.draw_calls << " draws, "
+                             << (unsigned long)frame.texture_binds << " texture binds, "
+                             << (unsigned long)frame.uniform_uploads << " uniforms";
+        success = false;
+    }
+
+    // State cache; without it every object rebinds its VAO, with it only changes reach the Device, and every draw
+    // still sees the same state. Both measured frames start with no Program in use
+    Render::setStateCaching(false);
+    Render::device().useProgram(0);
+    recorder->reset();
+    renderFrame(*renderer, collection);
+    Render::DeviceStats uncached = recorder->stats();
+    std::vector<Render::DeviceCommand> uncached_commands = recorder->commands();
+    Render::setStateCaching(true);
+    renderFrame(*renderer, collection);
+    Render::device().useProgram(0);
+    recorder->reset();
+    Render::resetStateStats();
+    renderFrame(*renderer, collection);
+    Render::StateStats state = Render::stateStats();
+    if(drawStates(uncached_commands) != drawStates(commands) || drawStates(recorder->commands()) != drawStates(commands)
+       || uncached.vertex_array_binds != object_count + 1 || recorder->stats().redundant_binds != 0
+       || state.dropped != uncached.redundant_binds || state.dropped < object_count - pair_count) {
+        Log::log_render(ERR) << "Unexpected state cache frame: " << (unsigned long)state.changes << " changes, "
+                             << (unsigned long)state.dropped << " dropped, against "
+                             << (unsigned long)uncached.redundant_binds << " redundant binds uncached";
+        success = false;
+    }
+
+    // VAOs; the collection binds what Model::vao() returns, but resolves them once per batch rather than per draw.
+    // Model::vao() may be called from several threads at once
+    double lookup_ns = 0.0, batched_ns = 0.0;
+    {
+        std::set<SWMuint> model_vaos, bound_vaos;
+        for(Model::Model &model : models) model_vaos.insert(model.vao());
+        for(const Render::DeviceCommand &command : commands)
+            if(command.type == Render::CMD_BIND_VERTEX_ARRAY && command.object != 0) bound_vaos.insert(command.object);
+        if(bound_vaos != model_vaos || model_vaos.count(0) > 0) {
+            Log::log_render(ERR) << "Collection bound " << (unsigned long)bound_vaos.size() << " VAOs, Models have "
+                                 << (unsigned long)model_vaos.size();
+            success = false;
+        }
+
+        const size_t lookup_threads = 4, lookups = 100000;
+        std::atomic<size_t> mismatches(0);
+        std::vector<std::thread> lookers;
+        for(size_t i = 0; i < lookup_threads; i++) {
+            lookers.emplace_back([i, &models, &model_vaos, &mismatches]() {
+                for(size_t l = 0; l < lookups; l++)
+                    if(model_vaos.count(models[(i + l) % models.size()].vao()) < 1) mismatches++;
+            });
+        }
+        for(std::thread &looker : lookers) looker.join();
+        if(mismatches > 0) {
+            Log::log_render(ERR) << (unsigned long)mismatches << " concurrent VAO lookups were wrong";
+            success = false;
+        }
+
+        // What a per draw Model::vao() cost the old submit loop, against the whole batch resolved submit per draw
+        SWMuint sum = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for(size_t l = 0; l < object_count * 10; l++) sum += models[l % models.size()].vao();
+        lookup_ns = elapsed(start) * 1e6 / (object_count * 10);
+        if(sum == 0) success = false;
+        double submit_ms = 0.0;
+        for(int i = 0; i < 10; i++) {
+            renderFrame(*renderer, collection);
+            submit_ms += collection.stats().submit_ms;
+        }
+        batched_ns = submit_ms * 1e6 / (object_count * 10);
+    }
+
+    // Instanced; one draw per Model and Texture pair, with every matrix in a single upload
+    renderer->setInstancing(true);
+    recorder->reset();
+    renderFrame(*renderer, collection);
+    Render::DeviceStats instanced = recorder->stats();
+    if(instanced.draw_calls != pair_count || instanced.instances != object_count || instanced.indices != expected_indices
+       || instanced.texture_binds != texture_count || instanced.uniform_uploads != 1
+       || instanced.buffer_uploads != 1 || instanced.buffer_bytes != object_count * 16 * sizeof(float)) {
+        Log::log_render(ERR) << "Unexpected instanced frame: " << (unsigned long)instanced.draw_calls << " draws of "
+                             << (unsigned long)instanced.instances << " instances, "
+                             << (unsigned long)instanced.buffer_bytes << " instance bytes";
+        success = false;
+    }
+
+    // Collections destroyed on another thread while instanced frames draw; the render thread deletes their buffers
+    {
+        const size_t rounds = 64;
+        std::vector<std::unique_ptr<Render::RenderObjectCollection>> drawn(rounds);
+        for(std::unique_ptr<Render::RenderObjectCollection> &drawn_collection : drawn) {
+            drawn_collection.reset(new Render::RenderObjectCollection());
+            scatter(*drawn_collection, 16, models, textures);
+            renderFrame(*renderer, *drawn_collection);
+        }
+        std::thread destroyer([&]() { for(std::unique_ptr<Render::RenderObjectCollection> &drawn_collection : drawn) drawn_collection.reset(); });
+        size_t wrong_frames = 0;
+        for(size_t i = 0; i < rounds; i++) {
+            Render::RenderObjectCollection fresh;
+            scatter(fresh, 16, models, textures);
+            recorder->reset();
+            renderFrame(*renderer, fresh);
+            if(recorder->stats().instances != 16) wrong_frames++;
+        }
+        destroyer.join();
+        if(wrong_frames > 0) {
+            Log::log_render(ERR) << (unsigned long)wrong_frames << " instanced frames were wrong while collections were destroyed";
+            success = false;
+        }
+    }
+    renderer->setInstancing(false);
+
+    // Culling; exactly what a brute force test of every object's box against the frustum keeps is drawn
+    {
+        glm::mat4 view = glm::lookAt(glm::vec3(50.0f, 5.0f, -10.0f), glm::vec3(50.0f, 0.0f, 20.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 projection = glm::perspective(45.0f * 3.14159265f / 180.0f, 1.0f, 0.1f, 40.0f);
+        renderer->bindUniformsMatrix(view, projection, 600);
+        float planes[24];
+        if(!renderer->frustum(planes)) success = false;
+
+        size_t expected_visible = 0;
+        for(size_t i = 0; i < object_count; i++) {
+            glm::vec3 position((float)(i % 100), 0.0f, (float)(i / 100));
+            glm::vec3 lo(models[i % model_count].boundsMin() + position), hi(models[i % model_count].boundsMax() + position);
+            bool inside = true;
+            for(int p = 0; p < 6; p++) {
+                const float* plane = planes + p * 4;
+                float distance = plane[0] * (plane[0] > 0.0f ? hi.x : lo.x) + plane[1] * (plane[1] > 0.0f ? hi.y : lo.y)
+                               + plane[2] * (plane[2] > 0.0f ? hi.z : lo.z) + plane[3];
+                if(distance < 0.0f) inside = false;
+            }
+            if(inside) expected_visible++;
+        }
+
+        recorder->reset();
+        renderFrame(*renderer, collection);
+        Render::RenderStats cull = collection.stats();
+        renderer->setInstancing(true);
+        renderFrame(*renderer, collection);
+        renderer->setInstancing(false);
+        Render::RenderStats cull_instanced = collection.stats();
+        if(expected_visible == 0 || expected_visible == object_count || cull.visible != expected_visible
+           || cull.culled != object_count - expected_visible || recorder->stats().draw_calls != expected_visible + pair_count
+           || recorder->stats().instances != expected_visible * 2 || cull_instanced.visible != expected_visible) {
+            Log::log_render(ERR) << "Unexpected culling: " << (unsigned long)cull.visible << " visible, expected "
+                                 << (unsigned long)expected_visible;
+            success = false;
+        }
+
+        recorder->setRecordCommands(false);
+        double cull_ms = 0.0;
+        const int cull_frames = 20;
+        for(int i = 0; i < cull_frames; i++) {
+            renderFrame(*renderer, collection);
+            cull_ms += collection.stats().cull_ms;
+        }
+        recorder->setRecordCommands(true);
+        renderer->setCulling(false);
+        Log::log_render(INFO) << "Culled " << (unsigned long)cull.culled << " of " << (unsigned long)cull.objects
+                              << " objects; " << cull_ms / cull_frames << "ms per frame, " << (unsigned long)cull.nodes_tested
+                              << " nodes tested, hierarchy built in " << cull.hierarchy_ms << "ms";
+    }
+
+    // Parallel build; whatever the thread count, the Device sees the same commands as a serial build
+    {
+        auto record = [&](unsigned int threads, bool instancing) {
+            Render::setBuildThreads(threads);
+            renderer->setInstancing(instancing);
+            renderer->setCulling(true);
+            recorder->reset();
+            renderFrame(*renderer, collection);
+            renderer->setCulling(false);
+            renderer->setInstancing(false);
+            return recorder->commands();
+        };
+        for(bool instancing : { false, true }) {
+            std::vector<Render::DeviceCommand> serial = record(1, instancing), parallel = record(4, instancing);
+            bool same = serial.size() == parallel.size() && collection.stats().threads == 4;
+            for(size_t i = 0; same && i < serial.size(); i++) {
+                same = serial[i].type == parallel[i].type && serial[i].target == parallel[i].target
+                       && serial[i].object == parallel[i].object && serial[i].count == parallel[i].count
+                       && serial[i].bytes == parallel[i].bytes && serial[i].hash == parallel[i].hash
+                       && serial[i].instances == parallel[i].instances;
+            }
+            if(!same) {
+                Log::log_render(ERR) << "Parallel build differs from serial" << (instancing ? " (instanced)" : "") << ": "
+                                     << (unsigned long)parallel.size() << " commands, expected " << (unsigned long)serial.size();
+                success = false;
+            }
+        }
+        Render::setBuildThreads(0);
+    }
+
+    // Handles; erases are applied on flush, stale Handles are ignored, and an insert cancels a queued erase
+    {
+        Render::RenderObjectCollection handled;
+        Render::RenderObject* objects[3];
+        Render::RenderObjectCollection::Handle handles[3];
+        for(int i = 0; i < 3; i++) {
+            objects[i] = Render::RenderObject::createStaticRenderObject(models[0], textures[i], (float)i, 0.0f, 0.0f,
+                                                                        1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+            handles[i] = handled.insert(objects[i]);
+        }
+        handled.flush();
+        handled.erase(handles[0]);
+        handled.erase(objects[1]);
+        handled.insert(objects[1]);
+        handled.flush();
+        handled.erase(handles[0]);
+        handled.flush();
+        if(handled.size() != 2 || handled.contains(objects[0]) || !handled.contains(objects[1])
+           || handled.insert(objects[2]) != handles[2] || handled.insert(objects[0]) == handles[0]) {
+            Log::log_render(ERR) << "Unexpected collection handling: " << (unsigned long)handled.size() << " objects";
+            success = false;
+        }
+    }
+
+    // Render queue; the flat, sorted collection against the map of sets it replaced, with 1% of objects churned
+    // each frame. Objects are allocated out of order, as they would be over a program's lifetime
+    recorder->setRecordCommands(false);
+    const int frames = 20;
+    {
+        const size_t queue_count = 100000, churn = queue_count / 100;
+        std::vector<std::unique_ptr<QueueObject>> owned(queue_count);
+        std::vector<Render::RenderObject*> objects;
+        for(size_t i = 0; i < queue_count; i++) {
+            size_t scattered = (i * 7919) % queue_count;
+            owned[scattered].reset(new QueueObject(models[i % model_count], textures[(i * 7) % texture_count], (float)(i % 1000)));
+        }
+        for(auto && object : owned) objects.push_back(object.get());
+
+        auto start = std::chrono::high_resolution_clock::now();
+        Render::RenderObjectCollection queue;
+        std::vector<Render::RenderObjectCollection::Handle> handles;
+        for(Render::RenderObject* object : objects) handles.push_back(queue.insert(object));
+        queue.flush();
+        double queue_build = elapsed(start);
+        start = std::chrono::high_resolution_clock::now();
+        for(int i = 0; i < frames; i++) {
+            for(size_t c = 0; c < churn; c++) {
+                size_t index = (i * churn + c * 97) % queue_count;
+                queue.erase(handles[index]);
+                queue.flush();
+                handles[index] = queue.insert(objects[index]);
+            }
+            queue.flush();
+            renderFrame(*renderer, queue);
+        }
+        double queue_ms = elapsed(start) / frames;
+
+        start = std::chrono::high_resolution_clock::now();
+        MappedCollection mapped;
+        for(Render::RenderObject* object : objects) mapped[object->texture()].insert(object);
+        double mapped_build = elapsed(start);
+        start = std::chrono::high_resolution_clock::now();
+        for(int i = 0; i < frames; i++) {
+            for(size_t c = 0; c < churn; c++) {
+                Render::RenderObject* object = objects[(i * churn + c * 97) % queue_count];
+                mapped[object->texture()].erase(object);
+                mapped[object->texture()].insert(object);
+            }
+            renderMapped(*renderer, mapped);
+        }
+        double mapped_ms = elapsed(start) / frames;
+
+        if(queue.size() != queue_count || QueueObject::rendered != queue_count * frames * 2) success = false;
+        Log::log_render(INFO) << "Render queue of " << (unsigned long)queue_count << " objects: built in " << queue_build
+                              << "ms, " << queue_ms << "ms per frame; map of sets built in " << mapped_build << "ms, "
+                              << mapped_ms << "ms per frame (" << mapped_ms / queue_ms << "x)";
+    }
+
+    // Submission cost, counting only, per object versus instanced
+    for(size_t count : { (size_t)1000, (size_t)10000, (size_t)50000 }) {
+        Render::RenderObjectCollection bench;
+        scatter(bench, count, models, textures);
+        double ms[2];
+        size_t draws[2];
+        for(int mode = 0; mode < 2; mode++) {
+            renderer->setInstancing(mode == 1);
+            renderFrame(*renderer, bench);
+            recorder->reset();
+            auto start = std::chrono::high_resolution_clock::now();
+            for(int i = 0; i < frames; i++) renderFrame(*renderer, bench);
+            ms[mode] = elapsed(start) / frames;
+            draws[mode] = recorder->stats().draw_calls / frames;
+        }
+        renderer->setInstancing(false);
+        Log::log_render(INFO) << "Rendered " << (unsigned long)count << " objects: per object " << ms[0] << "ms, "
+                              << (unsigned long)draws[0] << " draws; instanced " << ms[1] << "ms, "
+                              << (unsigned long)draws[1] << " draws (" << ms[0] / ms[1] << "x)";
+    }
+
+    // Build and submit time of a large collection over thread counts
+    {
+        const size_t build_count = 100000;
+        Render::RenderObjectCollection bench;
+        scatter(bench, build_count, models, textures);
+        unsigned int hardware = std::max(std::thread::hardware_concurrency(), 1u);
+        for(unsigned int threads : { 1u, 2u, 4u, hardware }) {
+            Render::setBuildThreads(threads);
+            renderFrame(*renderer, bench);
+            double build_ms = 0.0, submit_ms = 0.0;
+            for(int i = 0; i < frames; i++) {
+                renderFrame(*renderer, bench);
+                build_ms += bench.stats().build_ms;
+                submit_ms += bench.stats().submit_ms;
+            }
+            Log::log_render(INFO) << "Built " << (unsigned long)build_count << " objects on " << threads << " threads: build "
+                                  << build_ms / frames << "ms, submit " << submit_ms / frames << "ms per frame";
+        }
+        Render::setBuildThreads(0);
+    }
+
+    Log::log_render(INFO) << "Per object frame: " << (unsigned long)frame.commands << " commands, "
+                          << (unsigned long)frame.draw_calls << " draws, "
+                          << (unsigned long)(frame.program_binds + frame.vertex_array_binds + frame.texture_binds)
+                          << " binds (" << (unsigned long)frame.redundant_binds << " redundant), "
+                          << (unsigned long)frame.uniform_uploads << " uniforms (" << (unsigned long)frame.uniform_bytes
+                          << " bytes); instanced frame: " << (unsigned long)instanced.commands << " commands; state cache "
+                          << "dropped " << (unsigned long)state.dropped << " of "
+                          << (unsigned long)(state.changes + state.dropped) << " state changes per frame; Model::vao() "
+                          << lookup_ns << "ns per lookup, whole submit " << batched_ns << "ns per draw"
+                          << (success ? "" : " (FAILED)");
+
+    Core::cleanup();
+    return success ? 0 : 1;
+}
@@ -0,0 +1,691 @@
+#include "api/Core.h"
+#include "api/Logging.h"
+#include "api/Util.h"
+
+#include "../TestCommon.h"
+
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace Swarm;
+
+using namespace Swarm::Logging;
+
+// Every field holds the same value, so a torn read shows as a mismatch
+struct Sample {
+    uint64_t a, b, c, d;
+
+    Sample(uint64_t value = 0) : a(value), b(value), c(value), d(value) {}
+    bool whole() const { return a == b && b == c && c == d; }
+};
+
+// The ReadWriteBuffer this replaced; every read takes a shared lock, and every flush and creation reallocates and
+// copies the whole read buffer. Kept to compare against
+template<typename T> class LockedBuffer {
+public:
+    ~LockedBuffer() { delete [] _read; }
+
+    size_t create(const T &val) {
+        boost::lock_guard<boost::mutex> write_lock(_write_mutex);
+        boost::lock_guard<boost::shared_mutex> read_lock(_read_mutex);
+        size_t index = _write.size();
+        _write.resize(index + 1);
+        _write[index] = val;
+        delete [] _read;
+        _read = new T[_write.size()];
+        std::memcpy(_read, _write.data(), sizeof(T) * _write.size());
+        return index;
+    }
+
+    // Many at once, copying the read buffer only once
+    void create(size_t count, const T &val) {
+        boost::lock_guard<boost::mutex> write_lock(_write_mutex);
+        boost::lock_guard<boost::shared_mutex> read_lock(_read_mutex);
+        _write.resize(_write.size() + count, val);
+        delete [] _read;
+        _read = new T[_write.size()];
+        std::memcpy(_read, _write.data(), sizeof(T) * _write.size());
+    }
+
+    void set(size_t index, const T &val) {
+        boost::lock_guard<boost::mutex> lock(_write_mutex);
+        _write[index] = val;
+    }
+
+    T get(size_t index) {
+        boost::shared_lock<boost::shared_mutex> lock(_read_mutex);
+        return _read[index];
+    }
+
+    void flush() {
+        boost::lock_guard<boost::mutex> write_lock(_write_mutex);
+        boost::lock_guard<boost::shared_mutex> read_lock(_read_mutex);
+        delete [] _read;
+        _read = new T[_write.size()];
+        std::memcpy(_read, _write.data(), sizeof(T) * _write.size());
+    }
+
+protected:
+    boost::mutex _write_mutex;
+    boost::shared_mutex _read_mutex;
+    std::vector<T> _write;
+    T* _read = nullptr;
+};
+
+// The lock registry this replaced, made safe to share: every lock() looks the buffer's lock up in one map, under one
+// lock of its own. Kept to compare against
+class LockRegistry {
+public:
+    boost::mutex &find(size_t uid) {
+        boost::lock_guard<boost::mutex> lock(_mutex);
+        return _locks[uid];
+    }
+
+protected:
+    boost::mutex _mutex;
+    std::unordered_map<size_t, boost::mutex> _locks;
+};
+
+// The UIDPool this replaced; a tree node allocated on every free, and no lock of its own, so it is compared with the
+// lock it needed around it
+class SetPool {
+public:
+    size_t next() {
+        if(_free_ids.empty()) return _next++;
+        size_t id = *_free_ids.begin();
+        _free_ids.erase(_free_ids.begin());
+        return id;
+    }
+
+    void free(size_t id) { _free_ids.insert(id); }
+
+protected:
+    size_t _next = 0;
+    std::set<size_t> _free_ids;
+};
+
+// Readers read random objects while one writer sets them and another thread flushes, until every reader is done.
+// Returns milliseconds per million reads
+template<typename Set, typename Get, typename Flush>
+double contend(size_t objects, size_t readers, size_t reads, Set set, Get get, Flush flush) {
+    std::atomic<size_t> done(0);
+    std::thread writer([&]() {
+        for(uint64_t value = 1; done < readers; value++) set((size_t)(value % objects), Sample(value));
+    });
+    std::thread flusher([&]() {
+        while(done < readers) {
+            flush();
+            std::this_thread::yield();
+        }
+    });
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for(size_t r = 0; r < readers; r++) {
+        threads.emplace_back([&, r]() {
+            uint64_t seed = r * 7919 + 1, sum = 0;
+            for(size_t i = 0; i < reads; i++) {
+                seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+                sum += get((size_t)(seed >> 33) % objects).a;
+            }
+            if(sum == 1) Log::log_core(DEBUG) << "Unlikely sum";
+            done++;
+        });
+    }
+    for(std::thread &thread : threads) thread.join();
+    double ms = elapsed(start);
+    writer.join();
+    flusher.join();
+    return ms * 1000000.0 / (double)(readers * reads);
+}
+
+int main() {
+
+    if(!Core::init(SWM_INIT_MINIMAL)) {
+        return -1;
+    }
+
+    bool success = true;
+
+    // Values are read as of the last flush; a new object reads its initial value until the next one
+    {
+        Util::ReadWriteBuffer<Sample> buffer;
+        std::unique_ptr<Util::BufferData<Sample>> first(new Util::BufferData<Sample>(buffer, Sample(1)));
+        Util::BufferData<Sample> second(buffer, Sample(2));
+        if(first->get().a != 1 || second.get().a != 2) success = false;
+        second.set(3);
+        if(second.get().a != 2) success = false;
+        buffer.flush();
+        if(second.get().a != 3 || first->get().a != 1) success = false;
+
+        // A freed index is reused, without its old value showing through
+        size_t index = first->index();
+        first.reset();
+        first.reset(new Util::BufferData<Sample>(buffer, Sample(4)));
+        if(first->index() != index || first->get().a != 4 || buffer.size() != 2) success = false;
+        first->set(5);
+        buffer.flush();
+        if(first->get().a != 5) success = false;
+        if(!success) Log::log_core(ERR) << "Unexpected ReadWriteBuffer values";
+
+        Util::ReadWriteBuffer<Sample> fixed(1);
+        Util::BufferData<Sample> only(fixed);
+        bool thrown = false;
+        try {
+            Util::BufferData<Sample> extra(fixed);
+        } catch(std::out_of_range &e) {
+            thrown = true;
+        }
+        if(!thrown) {
+            Log::log_core(ERR) << "ReadWriteBuffer went past its capacity";
+            success = false;
+        }
+    }
+
+    // IDs are never handed out twice while live, and stale IDs stay dead
+    {
+        Util::UIDPool pool;
+        size_t first = pool.next(), second = pool.next();
+        if(first == 0 || first == second || !pool.valid(first) || !pool.free(first) || pool.free(first)
+           || pool.valid(first)) success = false;
+        size_t reused = pool.next();
+        if(Util::UIDPool::index(reused) != Util::UIDPool::index(first) || reused == first || pool.free(first)
+           || !pool.valid(reused)) success = false;
+        pool.freeAll();
+        if(pool.valid(second) || pool.valid(reused) || pool.free(second) || Util::UIDPool::index(pool.next()) != 0)
+            success = false;
+        if(!success) Log::log_core(ERR) << "Unexpected UIDPool IDs";
+    }
+
+    // Threads taking and freeing IDs at once; each slot is owned by one thread at a time
+    {
+        const size_t thread_count = 4, held = 64, rounds = 20000;
+        Util::UIDPool pool;
+        std::vector<std::atomic<uint32_t>> owners(thread_count * held);
+        for(std::atomic<uint32_t> &owner : owners) owner = 0;
+        std::atomic<size_t> shared(0), stale(0), overflow(0);
+        std::vector<std::thread> threads;
+        for(size_t t = 0; t < thread_count; t++) {
+            threads.emplace_back([&, t]() {
+                std::vector<size_t> ids;
+                uint64_t seed = t * 7919 + 1;
+                for(size_t i = 0; i < rounds; i++) {
+                    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+                    if(ids.size() < held && (ids.empty() || (seed >> 40) % 2 == 0)) {
+                        size_t id = pool.next();
+                        size_t index = Util::UIDPool::index(id);
+                        if(index >= owners.size()) {
+                            overflow++;
+                            continue;
+                        }
+                        uint32_t expected = 0;
+                        if(!owners[index].compare_exchange_strong(expected, (uint32_t)t + 1)) shared++;
+                        ids.push_back(id);
+                    } else {
+                        size_t pick = (size_t)(seed >> 33) % ids.size();
+                        size_t id = ids[pick];
+                        ids[pick] = ids.back();
+                        ids.pop_back();
+                        owners[Util::UIDPool::index(id)] = 0;
+                        if(!pool.free(id) || pool.free(id) || pool.valid(id)) stale++;
+                    }
+                }
+                for(size_t id : ids) {
+                    owners[Util::UIDPool::index(id)] = 0;
+                    pool.free(id);
+                }
+            });
+        }
+        for(std::thread &thread : threads) thread.join();
+        if(shared > 0 || stale > 0 || overflow > 0) {
+            Log::log_core(ERR) << "Concurrent UIDPool use shared " << (unsigned long)shared << " IDs, mishandled "
+                               << (unsigned long)stale << " stale ones, and went past "
+                               << (unsigned long)overflow << " times";
+            success = false;
+        }
+    }
+
+    // Taking and freeing IDs, against the old pool behind a lock; on one thread, and then on several
+    const size_t id_count = 1000000;
+    double id_ms[4];
+    {
+        auto churn = [](size_t count, std::function<size_t()> next, std::function<void(size_t)> free) {
+            std::vector<size_t> ids(256);
+            for(size_t &id : ids) id = next();
+            for(size_t i = 0; i < count; i++) {
+                size_t &id = ids[(i * 97) % ids.size()];
+                free(id);
+                id = next();
+            }
+            for(size_t id : ids) free(id);
+        };
+
+        SetPool set_pool;
+        boost::mutex set_mutex;
+        auto start = std::chrono::high_resolution_clock::now();
+        churn(id_count,
+              [&]() { boost::lock_guard<boost::mutex> lock(set_mutex); return set_pool.next(); },
+              [&](size_t id) { boost::lock_guard<boost::mutex> lock(set_mutex); set_pool.free(id); });
+        id_ms[0] = elapsed(start);
+
+        Util::UIDPool pool;
+        start = std::chrono::high_resolution_clock::now();
+        churn(id_count, [&]() { return pool.next(); }, [&](size_t id) { pool.free(id); });
+        id_ms[1] = elapsed(start);
+
+        const size_t thread_count = 4;
+        std::vector<std::thread> threads;
+        start = std::chrono::high_resolution_clock::now();
+        for(size_t t = 0; t < thread_count; t++) {
+            threads.emplace_back([&]() {
+                churn(id_count / thread_count,
+                      [&]() { boost::lock_guard<boost::mutex> lock(set_mutex); return set_pool.next(); },
+                      [&](size_t id) { boost::lock_guard<boost::mutex> lock(set_mutex); set_pool.free(id); });
+            });
+        }
+        for(std::thread &thread : threads) thread.join();
+        id_ms[2] = elapsed(start);
+
+        threads.clear();
+        start = std::chrono::high_resolution_clock::now();
+        for(size_t t = 0; t < thread_count; t++) {
+            threads.emplace_back([&]() {
+                churn(id_count / thread_count, [&]() { return pool.next(); }, [&](size_t id) { pool.free(id); });
+            });
+        }
+        for(std::thread &thread : threads) thread.join();
+        id_ms[3] = elapsed(start);
+    }
+    Log::log_core(INFO) << "Freeing and taking " << (unsigned long)id_count << " UIDPool IDs: " << id_ms[1]
+                        << "ms; old pool with a lock " << id_ms[0] << "ms (" << id_ms[0] / id_ms[1] << "x). On 4 threads: "
+                        << id_ms[3] << "ms; old pool with a lock " << id_ms[2] << "ms (" << id_ms[2] / id_ms[3] << "x)";
+
+    // Concurrent writers, flushes and readers; readers never see a torn value, or a value older than one they saw
+    {
+        const size_t objects = 64, writer_count = 2, reader_count = 2, reads = 200000;
+        Util::ReadWriteBuffer<Sample> buffer;
+        std::vector<std::unique_ptr<Util::BufferData<Sample>>> data;
+        for(size_t i = 0; i < objects; i++) data.emplace_back(new Util::BufferData<Sample>(buffer));
+        buffer.flush();
+
+        std::atomic<size_t> readers_done(0), torn(0), stale(0);
+        std::vector<std::thread> threads;
+        for(size_t w = 0; w < writer_count; w++) {
+            threads.emplace_back([&, w]() {
+                for(uint64_t value = 1; readers_done < reader_count; value++)
+                    for(size_t i = w; i < objects; i += writer_count) data[i]->set(Sample(value));
+            });
+        }
+        threads.emplace_back([&]() {
+            while(readers_done < reader_count) buffer.flush();
+        });
+        for(size_t r = 0; r < reader_count; r++) {
+            threads.emplace_back([&]() {
+                std::vector<uint64_t> seen(objects, 0);
+                for(size_t i = 0; i < reads; i++) {
+                    Sample sample = data[i % objects]->get();
+                    if(!sample.whole()) torn++;
+                    if(sample.a < seen[i % objects]) stale++;
+                    seen[i % objects] = sample.a;
+                }
+                readers_done++;
+            });
+        }
+        for(std::thread &thread : threads) thread.join();
+        if(torn > 0 || stale > 0) {
+            Log::log_core(ERR) << "Concurrent reads saw " << (unsigned long)torn << " torn and " << (unsigned long)stale
+                               << " stale values";
+            success = false;
+        }
+    }
+
+    // Flushes copy only what changed, and every snapshot catches up on what it missed while another was published
+    const size_t flush_objects = 100000;
+    double flush_ms[2];
+    size_t flush_bytes[2];
+    {
+        Util::ReadWriteBuffer<Sample> buffer;
+        std::vector<std::unique_ptr<Util::BufferData<Sample>>> data;
+        for(size_t i = 0; i < flush_objects; i++) data.emplace_back(new Util::BufferData<Sample>(buffer, Sample(i)));
+        buffer.flush();
+        if(buffer.flushedBytes() != flush_objects * sizeof(Sample)) success = false;
+        buffer.flush();
+        if(buffer.flushedBytes() != flush_objects * sizeof(Sample)) success = false;
+        buffer.flush();
+        if(buffer.flushedBytes() != flush_objects * sizeof(Sample)) success = false;
+        buffer.flush();
+        if(buffer.flushedBytes() != 0) success = false;
+
+        for(size_t round = 1; round <= 5; round++) {
+            for(size_t i = round; i < flush_objects; i += 997) data[i]->set(Sample(i + round * flush_objects));
+            for(size_t i = 62; i < 67; i++) data[i]->set(Sample(i + round * flush_objects));
+            buffer.flush();
+        }
+        for(size_t i = 0; i < flush_objects; i++) {
+            uint64_t expected = i;
+            for(size_t round = 1; round <= 5; round++)
+                if((i >= round && (i - round) % 997 == 0) || (i >= 62 && i < 67)) expected = i + round * flush_objects;
+            if(data[i]->get().a != expected || !data[i]->get().whole()) {
+                success = false;
+                break;
+            }
+        }
+        if(!success) Log::log_core(ERR) << "Unexpected values after partial flushes";
+
+        LockedBuffer<Sample> locked;
+        locked.create(flush_objects, Sample());
+        const size_t flush_rounds = 100;
+        auto start = std::chrono::high_resolution_clock::now();
+        for(size_t round = 0; round < flush_rounds; round++) {
+            locked.set(round, Sample(round));
+            locked.flush();
+        }
+        flush_ms[0] = elapsed(start) / flush_rounds;
+        flush_bytes[0] = flush_objects * sizeof(Sample);
+
+        start = std::chrono::high_resolution_clock::now();
+        for(size_t round = 0; round < flush_rounds; round++) {
+            data[round]->set(Sample(round));
+            buffer.flush();
+        }
+        flush_ms[1] = elapsed(start) / flush_rounds;
+        flush_bytes[1] = buffer.flushedBytes();
+
+        // Besides its own change, each flush catches its snapshot up on the two published while it was not
+        if(flush_bytes[1] != 3 * sizeof(Sample)) {
+            Log::log_core(ERR) << "Flushing one changed object copied " << (unsigned long)flush_bytes[1] << " bytes";
+            success = false;
+        }
+    }
+    Log::log_core(INFO) << "Flushing one change among " << (unsigned long)flush_objects << " objects: "
+                        << (unsigned long)flush_bytes[1] << " bytes in " << flush_ms[1] << "ms; locked buffer "
+                        << (unsigned long)flush_bytes[0] << " bytes in " << flush_ms[0] << "ms ("
+                        << flush_ms[0] / flush_ms[1] << "x)";
+
+    // Pacing a loop holds its rate, and waits without spinning the CPU
+    double paced_ms, paced_jitter_ms, paced_cpu;
+    {
+        const double rate = 200.0;
+        const size_t frames = 200;
+        Util::FramePacer pacer(rate);
+        pacer.pace();
+        std::clock_t cpu_start = std::clock();
+        auto start = std::chrono::high_resolution_clock::now();
+        for(size_t i = 0; i < frames; i++) pacer.pace();
+        double total_ms = elapsed(start);
+        paced_cpu = (double)(std::clock() - cpu_start) / CLOCKS_PER_SEC * 1000.0 / total_ms;
+        paced_ms = total_ms / frames;
+        paced_jitter_ms = pacer.jitter();
+        if(paced_ms < 1000.0 / rate * 0.95 || paced_ms > 1000.0 / rate * 1.25 || pacer.utilization() > 0.5) {
+            Log::log_core(ERR) << "Paced at " << paced_ms << "ms per frame, " << pacer.utilization()
+                               << " utilization, for a " << 1000.0 / rate << "ms target";
+            success = false;
+        }
+
+        Util::FramePacer unpaced;
+        start = std::chrono::high_resolution_clock::now();
+        for(size_t i = 0; i < frames; i++) unpaced.pace();
+        if(elapsed(start) > 50.0) {
+            Log::log_core(ERR) << "Unpaced loop waited";
+            success = false;
+        }
+    }
+    Log::log_core(INFO) << "Paced at 200Hz: " << paced_ms << "ms per frame, " << paced_jitter_ms << "ms jitter, "
+                        << paced_cpu * 100.0 << "% of a core used waiting";
+
+    // Jobs; parallelFor covers every index once, even nested inside another parallelFor
+    {
+        const size_t outer = 64, inner = 1000;
+        std::vector<std::atomic<int>> hits(outer * inner);
+        for(std::atomic<int> &hit : hits) hit = 0;
+        Util::parallelFor(outer, 1, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; i++) {
+                Util::parallelFor(inner, 0, [&](size_t inner_begin, size_t inner_end) {
+                    for(size_t j = inner_begin; j < inner_end; j++) hits[i * inner + j]++;
+                });
+            }
+        });
+        for(std::atomic<int> &hit : hits) if(hit != 1) success = false;
+        if(!success) Log::log_core(ERR) << "parallelFor missed or repeated an index";
+    }
+
+    // A range that throws still lets every other range run, and the exception reaches the caller
+    {
+        const size_t ranges = 64;
+        std::vector<std::atomic<int>> hits(ranges);
+        for(std::atomic<int> &hit : hits) hit = 0;
+        bool thrown = false;
+        try {
+            Util::parallelFor(ranges, 1, [&](size_t begin, size_t end) {
+                for(size_t i = begin; i < end; i++) {
+                    hits[i]++;
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    if(i == 37) throw std::runtime_error("range 37");
+                }
+            });
+        } catch(std::runtime_error &e) {
+            thrown = std::string(e.what()) == "range 37";
+        }
+        bool all_ran = true;
+        for(std::atomic<int> &hit : hits) if(hit != 1) all_ran = false;
+        if(!thrown || !all_ran) {
+            Log::log_core(ERR) << "parallelFor " << (thrown ? "" : "did not rethrow a range's exception, ")
+                               << (all_ran ? "" : "skipped ranges after one threw");
+            success = false;
+        }
+    }
+
+    // Jobs run after the ones they depend on, and the counter only finishes once all have
+    {
+        std::atomic<int> first_done(0), order_errors(0);
+        Util::JobCounter first, second;
+        for(int i = 0; i < 16; i++) Util::runJob([&]() { std::this_thread::sleep_for(std::chrono::milliseconds(1)); first_done++; }, &first);
+        for(int i = 0; i < 16; i++) Util::runJobAfter(first, [&]() { if(first_done != 16) order_errors++; }, &second);
+        second.wait();
+        if(!first.done() || order_errors != 0) {
+            Log::log_core(ERR) << "Jobs ran before the jobs they depend on";
+            success = false;
+        }
+    }
+
+    // Main thread jobs only run on the main thread
+    {
+        std::thread::id main_id = std::this_thread::get_id();
+        std::atomic<int> ran(0), wrong_thread(0);
+        Util::JobCounter counter;
+        Util::runJob([&]() {
+            for(int i = 0; i < 8; i++) Util::runMainThreadJob([&]() {
+                if(std::this_thread::get_id() != main_id) wrong_thread++;
+                ran++;
+            }, &counter);
+        }, &counter);
+        counter.wait();
+        if(ran != 8 || wrong_thread != 0) {
+            Log::log_core(ERR) << "Main thread jobs ran " << ran << " times, " << wrong_thread << " off the main thread";
+            success = false;
+        }
+    }
+
+    // Waiting never runs jobs it does not count, as the waiter may hold locks they need
+    {
+        std::thread::id main_id = std::this_thread::get_id();
+        std::atomic<int> stray(0);
+        Util::JobCounter unrelated, counter;
+        for(int i = 0; i < 32; i++) Util::runJob([&]() {
+            if(std::this_thread::get_id() == main_id) stray++;
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }, &unrelated);
+        for(int i = 0; i < 8; i++) Util::runJob([&]() { std::this_thread::sleep_for(std::chrono::microseconds(200)); }, &counter);
+        counter.wait();
+        Util::parallelFor(16, 1, [&](size_t, size_t) { std::this_thread::sleep_for(std::chrono::microseconds(200)); });
+        unrelated.wait();
+        if(stray != 0) {
+            Log::log_core(ERR) << "Waiting ran " << stray << " unrelated jobs on the waiting thread";
+            success = false;
+        }
+    }
+
+    // Jobs queueing jobs, far past what one deque first holds
+    {
+        const size_t spawners = 64, spawned = 2000;
+        std::atomic<size_t> ran(0);
+        Util::JobCounter counter;
+        for(size_t s = 0; s < spawners; s++) {
+            Util::runJob([&]() {
+                for(size_t i = 0; i < spawned; i++) Util::runJob([&]() { ran++; }, &counter);
+            }, &counter);
+        }
+        counter.wait();
+        if(ran != spawners * spawned) {
+            Log::log_core(ERR) << "Ran " << (unsigned long)ran << " of " << (unsigned long)(spawners * spawned) << " spawned jobs";
+            success = false;
+        }
+    }
+
+    // Creating objects; the old buffer copied everything on each one
+    const size_t create_count = 5000;
+    double create_ms[2];
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        LockedBuffer<Sample> locked;
+        for(size_t i = 0; i < create_count; i++) locked.create(Sample(i));
+        create_ms[0] = elapsed(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        Util::ReadWriteBuffer<Sample> buffer;
+        std::vector<std::unique_ptr<Util::BufferData<Sample>>> data;
+        for(size_t i = 0; i < create_count; i++) data.emplace_back(new Util::BufferData<Sample>(buffer, Sample(i)));
+        create_ms[1] = elapsed(start);
+    }
+
+    // Reads with a writer and flushes going on
+    const size_t bench_objects = 1024, bench_reads = 500000;
+    unsigned int hardware = std::max(std::thread::hardware_concurrency(), 1u);
+    for(size_t readers : { (size_t)1, (size_t)4, (size_t)hardware }) {
+        LockedBuffer<Sample> locked;
+        for(size_t i = 0; i < bench_objects; i++) locked.create(Sample(i));
+        double locked_ms = contend(bench_objects, readers, bench_reads,
+                                   [&](size_t i, const Sample &value) { locked.set(i, value); },
+                                   [&](size_t i) { return locked.get(i); },
+                                   [&]() { locked.flush(); });
+
+        Util::ReadWriteBuffer<Sample> buffer;
+        std::vector<std::unique_ptr<Util::BufferData<Sample>>> data;
+        for(size_t i = 0; i < bench_objects; i++) data.emplace_back(new Util::BufferData<Sample>(buffer, Sample(i)));
+        double buffered_ms = contend(bench_objects, readers, bench_reads,
+                                     [&](size_t i, const Sample &value) { data[i]->set(value); },
+                                     [&](size_t i) { return data[i]->get(); },
+                                     [&]() { buffer.flush(); });
+
+        Log::log_core(INFO) << "ReadWriteBuffer reads on " << (unsigned long)readers << " threads, with a writer and flushes: "
+                            << buffered_ms << "ms per million; locked buffer " << locked_ms << "ms per million ("
+                            << locked_ms / buffered_ms << "x)";
+    }
+
+    // Threads writing their own buffers; with a lock per buffer, they have nothing to contend on
+    const size_t write_count = 200000;
+    for(size_t writers : { (size_t)1, (size_t)4, (size_t)hardware }) {
+        LockRegistry registry;
+        std::vector<std::vector<Sample>> values(writers, std::vector<Sample>(1));
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for(size_t w = 0; w < writers; w++) {
+            threads.emplace_back([&, w]() {
+                for(size_t i = 0; i < write_count; i++) {
+                    boost::lock_guard<boost::mutex> lock(registry.find(w));
+                    values[w][0] = Sample(i);
+                }
+            });
+        }
+        for(std::thread &thread : threads) thread.join();
+        double registry_ms = elapsed(start);
+
+        std::vector<std::unique_ptr<Util::ReadWriteBuffer<Sample>>> buffers;
+        std::vector<std::unique_ptr<Util::BufferData<Sample>>> data;
+        for(size_t w = 0; w < writers; w++) {
+            buffers.emplace_back(new Util::ReadWriteBuffer<Sample>());
+            data.emplace_back(new Util::BufferData<Sample>(*buffers[w]));
+        }
+        start = std::chrono::high_resolution_clock::now();
+        threads.clear();
+        for(size_t w = 0; w < writers; w++) {
+            threads.emplace_back([&, w]() {
+                for(size_t i = 0; i < write_count; i++) data[w]->set(Sample(i));
+            });
+        }
+        for(std::thread &thread : threads) thread.join();
+        double embedded_ms = elapsed(start);
+
+        for(size_t w = 0; w < writers; w++) {
+            buffers[w]->flush();
+            if(data[w]->get().a != write_count - 1) success = false;
+        }
+        data.clear();
+
+        Log::log_core(INFO) << "ReadWriteBuffer writes on " << (unsigned long)writers << " threads, each to its own buffer: "
+                            << embedded_ms * 1000000.0 / (double)(writers * write_count) << "ms per million; lock registry "
+                            << registry_ms * 1000000.0 / (double)(writers * write_count) << "ms per million ("
+                            << registry_ms / embedded_ms << "x)";
+    }
+
+    // Job overhead; the old tangent pass started a thread per range instead
+    const size_t job_count = 200000;
+    {
+        std::atomic<size_t> ran(0);
+        auto start = std::chrono::high_resolution_clock::now();
+        Util::JobCounter counter;
+        for(size_t i = 0; i < job_count; i++) Util::runJob([&]() { ran++; }, &counter);
+        counter.wait();
+        double job_ms = elapsed(start);
+
+        const size_t thread_count = 2000;
+        start = std::chrono::high_resolution_clock::now();
+        for(size_t i = 0; i < thread_count; i++) std::thread([&]() { ran++; }).join();
+        double thread_ms = elapsed(start);
+
+        Log::log_core(INFO) << "Ran " << (unsigned long)job_count << " empty jobs on " << Util::jobWorkers() << " workers: "
+                            << job_ms * 1000.0 / (double)job_count << "us per job; a thread each "
+                            << thread_ms * 1000.0 / (double)thread_count << "us per thread";
+    }
+
+    // parallelFor scaling over worker counts
+    const size_t scale_count = 1 << 22;
+    std::vector<float> scale_values(scale_count, 1.0f);
+    double scale_base_ms = 0.0;
+    for(unsigned int threads : std::set<unsigned int>{ 1u, 2u, 4u, hardware }) {
+        if(threads > hardware) continue;
+        Util::stopJobs();
+        if(threads > 1) Util::startJobs(threads - 1);
+        auto start = std::chrono::high_resolution_clock::now();
+        for(int pass = 0; pass < 8; pass++) {
+            Util::parallelFor(scale_count, 0, [&](size_t begin, size_t end) {
+                for(size_t i = begin; i < end; i++) scale_values[i] = std::sqrt(scale_values[i] * 1.0001f + 0.5f);
+            });
+        }
+        double scale_ms = elapsed(start);
+        if(threads == 1) scale_base_ms = scale_ms;
+        Log::log_core(INFO) << "parallelFor over " << (unsigned long)scale_count << " values on " << Util::jobWorkers() + 1
+                            << " threads: " << scale_ms / 8.0 << "ms per pass (" << scale_base_ms / scale_ms << "x)";
+    }
+    Util::stopJobs();
+    Util::startJobs();
+
+    Log::log_core(INFO) << "Created " << (unsigned long)create_count << " BufferData in " << create_ms[1]
+                        << "ms; locked buffer " << create_ms[0] << "ms (" << create_ms[0] / create_ms[1] << "x)"
+                        << (success ? "" : " (FAILED)");
+
+    Core::cleanup();
+    return success ? 0 : 1;
+}